@@ -167,6 +167,7 @@ BuildRequires: libacl-devel
 BuildRequires: pkgconfig
 BuildRequires: lzo-devel
 BuildRequires: libfastlz-devel
+BuildRequires: libzstd-devel
 BuildRequires: logrotate
 %if 0%{?build_sqlite3}
 %if 0%{?suse_version}
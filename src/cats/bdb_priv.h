@@ -74,5 +74,6 @@ public:
       queries = NULL;
    };
    virtual ~B_DB_PRIV() {};
+   bool in_transaction(void) { return m_transaction; };
 };
 #endif /* __BDB_PRIV_H_ */
@@ -36,58 +36,29 @@
 #define dbglevel_sql 15
 
 /*
- * Working Object to store PathId already seen (avoid database queries),
- * equivalent to %cache_ppathid in perl
+ * Paths whose parent link is computed by build_path_hierarchy().
  */
-#define NITEMS 50000
-class pathid_cache {
-private:
-   hlink *nodes;
-   int nb_node;
-   int max_node;
-   alist *table_node;
-   htable *cache_ppathid;
-
-public:
-   pathid_cache() {
-      hlink link;
-      cache_ppathid = (htable *)malloc(sizeof(htable));
-      cache_ppathid->init(&link, &link, NITEMS);
-      max_node = NITEMS;
-      nodes = (hlink *) malloc(max_node * sizeof (hlink));
-      nb_node = 0;
-      table_node = New(alist(5, owned_by_alist));
-      table_node->append(nodes);
-   }
-
-   hlink *get_hlink() {
-      if (++nb_node >= max_node) {
-         nb_node = 0;
-         nodes = (hlink *)malloc(max_node * sizeof(hlink));
-         table_node->append(nodes);
-      }
-      return nodes + nb_node;
-   }
-
-   bool lookup(char *pathid) {
-      return (cache_ppathid->lookup(pathid) != NULL);
-   }
+struct bvfs_path_item {
+   hlink link;                        /* Link in the parent table of a level */
+   uint32_t PathId;
+   bvfs_path_item *parent;
+   char path[1];
+};
 
-   void insert(char *pathid) {
-      hlink *h = get_hlink();
-      cache_ppathid->insert(pathid, h);
-   }
+struct bvfs_done_item {
+   hlink link;
+};
 
-   ~pathid_cache() {
-      cache_ppathid->destroy();
-      free(cache_ppathid);
-      delete table_node;
-   }
+/*
+ * Number of paths or rows handled by one bulk statement.
+ */
+#define BVFS_BULK_SIZE 500
 
-private:
-   pathid_cache(const pathid_cache &); /* prohibit pass by value */
-   pathid_cache &operator= (const pathid_cache &);/* prohibit class assignment*/
-};
+/*
+ * Serializes filling PathHierarchy so concurrent updates for different
+ * jobs don't insert the same parent links.
+ */
+static pthread_mutex_t hierarchy_mutex = PTHREAD_MUTEX_INITIALIZER;
 
 /*
  * Generic path handlers used for database queries.
@@ -108,87 +79,319 @@ static int path_handler(void *ctx, int fields, char **row)
    return fs->_handle_path(ctx, fields, row);
 }
 
+static bvfs_path_item *new_path_item(alist *items, const char *path, uint32_t PathId)
+{
+   int len = strlen(path);
+   bvfs_path_item *item;
+
+   item = (bvfs_path_item *)malloc(sizeof(bvfs_path_item) + len);
+   memset(item, 0, sizeof(bvfs_path_item));
+   memcpy(item->path, path, len + 1);
+   item->PathId = PathId;
+   items->append(item);
+
+   return item;
+}
+
+struct bvfs_hierarchy_ctx {
+   alist *items;                      /* Owns all path items */
+   alist *level;                      /* Paths of the current level */
+   htable *parents;                   /* Parents of the current level by path */
+   htable *done;                      /* PathIds with a PathHierarchy record */
+};
+
+static int new_path_handler(void *ctx, int fields, char **row)
+{
+   bvfs_hierarchy_ctx *hc = (bvfs_hierarchy_ctx *)ctx;
+
+   hc->level->append(new_path_item(hc->items, row[1], str_to_uint64(row[0])));
+
+   return 0;
+}
+
+static int parent_pathid_handler(void *ctx, int fields, char **row)
+{
+   bvfs_hierarchy_ctx *hc = (bvfs_hierarchy_ctx *)ctx;
+   bvfs_path_item *item;
+
+   item = (bvfs_path_item *)hc->parents->lookup(row[1]);
+   if (item && !item->PathId) {
+      item->PathId = str_to_uint64(row[0]);
+   }
+
+   return 0;
+}
+
+static inline void mark_done(htable *done, uint32_t PathId)
+{
+   bvfs_done_item *item;
+
+   if (!done->lookup(PathId)) {
+      item = (bvfs_done_item *)done->hash_malloc(sizeof(bvfs_done_item));
+      done->insert(PathId, item);
+   }
+}
+
+static int hierarchy_done_handler(void *ctx, int fields, char **row)
+{
+   bvfs_hierarchy_ctx *hc = (bvfs_hierarchy_ctx *)ctx;
+
+   mark_done(hc->done, str_to_uint64(row[0]));
+
+   return 0;
+}
+
 /*
  * BVFS specific methods part of the B_DB database abstraction.
  */
-void B_DB::build_path_hierarchy(JCR *jcr, pathid_cache &ppathid_cache,
-                                char *org_pathid, char *new_path)
+
+/**
+ * Resolve the PathIds of the parents collected for a level with bulk
+ * lookups in the Path table and as a last resort by creating the
+ * missing Path records.
+ *
+ * The shared path cache is bypassed, a level is resolved with a few
+ * set based queries anyway. The cache build runs without an open
+ * transaction so Path records created here are committed right away
+ * and no job ever waits on us while we hold hierarchy_mutex.
+ */
+bool B_DB::resolve_parent_pathids(JCR *jcr, void *ctx, alist *parents)
 {
-   char pathid[50];
-   ATTR_DBR parent;
+   int cnt, len;
+   bool retval = false;
+   bvfs_path_item *item;
    char *bkp = path;
+   ATTR_DBR parent;
+   POOL_MEM query(PM_MESSAGE);
+   POOLMEM *esc = get_pool_memory(PM_FNAME);
+
+   cnt = 0;
+   foreach_alist(item, parents) {
+      len = strlen(item->path);
+      esc = check_pool_memory_size(esc, len * 2 + 1);
+      escape_string(jcr, esc, item->path, len);
+      if (cnt == 0) {
+         pm_strcpy(query, "SELECT PathId, Path FROM Path WHERE Path IN (");
+      } else {
+         pm_strcat(query, ",");
+      }
+      pm_strcat(query, "'");
+      pm_strcat(query, esc);
+      pm_strcat(query, "'");
 
-   Dmsg1(dbglevel, "build_path_hierarchy(%s)\n", new_path);
-   bstrncpy(pathid, org_pathid, sizeof(pathid));
+      if (++cnt == BVFS_BULK_SIZE) {
+         pm_strcat(query, ")");
+         if (!sql_query(query.c_str(), parent_pathid_handler, ctx)) {
+            goto bail_out;
+         }
+         cnt = 0;
+      }
+   }
+
+   if (cnt > 0) {
+      pm_strcat(query, ")");
+      if (!sql_query(query.c_str(), parent_pathid_handler, ctx)) {
+         goto bail_out;
+      }
+   }
 
    /*
-    * Does the ppathid exist for this ? we use a memory cache...  In order to
-    * avoid the full loop, we consider that if a dir is already in the
-    * PathHierarchy table, then there is no need to calculate all the hierarchy
+    * Parent directories without any files of their own may not have a
+    * Path record yet.
     */
-   while (path && *path) {
-      if (!ppathid_cache.lookup(pathid)) {
-         Mmsg(cmd, "SELECT PPathId FROM PathHierarchy WHERE PathId = %s", pathid);
+   foreach_alist(item, parents) {
+      if (item->PathId) {
+         continue;
+      }
+
+      path = item->path;
+      pnl = strlen(path);
+      if (!create_path_record(jcr, &parent)) {
+         goto bail_out;
+      }
+      item->PathId = parent.PathId;
+   }
+   retval = true;
+
+bail_out:
+   path = bkp;
+   free_pool_memory(esc);
+
+   return retval;
+}
+
+/**
+ * Fill the PathHierarchy table for all paths used by the given jobs
+ * that don't have a parent link yet. Works a level of the directory
+ * tree at a time with bulk statements instead of walking up the tree
+ * for every single path.
+ */
+bool B_DB::build_path_hierarchy(JCR *jcr, char *jobids)
+{
+   int cnt;
+   char ed1[50], ed2[50];
+   bool retval = false;
+   alist *next_level;
+   bvfs_path_item *item, *parent;
+   bvfs_done_item *done_item = NULL;
+   bvfs_hierarchy_ctx hc;
+   POOL_MEM query(PM_MESSAGE),
+            parent_path(PM_FNAME);
+
+   hc.items = New(alist(1000, owned_by_alist));
+   hc.level = New(alist(1000, not_owned_by_alist));
+   hc.parents = NULL;
+   hc.done = New(htable(done_item, &done_item->link, 1000));
+
+   Mmsg(query, "SELECT DISTINCT PathVisibility.PathId, Path "
+               "FROM PathVisibility "
+               "JOIN Path ON (PathVisibility.PathId = Path.PathId) "
+               "LEFT JOIN PathHierarchy "
+               "ON (PathVisibility.PathId = PathHierarchy.PathId) "
+               "WHERE PathVisibility.JobId IN (%s) "
+               "AND PathHierarchy.PathId IS NULL",
+        jobids);
+
+   if (!sql_query(query.c_str(), new_path_handler, &hc)) {
+      Dmsg1(dbglevel, "Can't get new Path %s\n", jobids);
+      goto bail_out;
+   }
+
+   while (hc.level->size() > 0) {
+      Dmsg1(dbglevel, "build_path_hierarchy: %d paths on this level\n", hc.level->size());
 
-         if (!QUERY_DB(jcr, cmd)) {
-            goto bail_out;      /* Query failed, just leave */
+      /*
+       * Collect the distinct parent directories of this level.
+       */
+      alist parents(hc.level->size(), not_owned_by_alist);
+      item = NULL;
+      hc.parents = New(htable(item, &item->link, hc.level->size()));
+      foreach_alist(item, hc.level) {
+         if (!item->path[0]) {
+            continue;
+         }
+         pm_strcpy(parent_path, item->path);
+         bvfs_parent_dir(parent_path.c_str());
+
+         parent = (bvfs_path_item *)hc.parents->lookup(parent_path.c_str());
+         if (!parent) {
+            parent = new_path_item(hc.items, parent_path.c_str(), 0);
+            hc.parents->insert(parent->path, parent);
+            parents.append(parent);
          }
+         item->parent = parent;
+      }
 
-         /*
-          * Do we have a result ?
-          */
-         if (sql_num_rows() > 0) {
-            ppathid_cache.insert(pathid);
-            /* This dir was in the db ...
-             * It means we can leave, the tree has allready been built for
-             * this dir
-             */
-            goto bail_out;
+      if (!resolve_parent_pathids(jcr, &hc, &parents)) {
+         goto bail_out;
+      }
+
+      /*
+       * Insert the parent links of this level.
+       */
+      cnt = 0;
+      foreach_alist(item, hc.level) {
+         if (!item->parent) {
+            continue;
+         }
+
+         if (cnt == 0) {
+            pm_strcpy(query, "INSERT INTO PathHierarchy (PathId, PPathId) VALUES ");
          } else {
-            /*
-             * Search or create parent PathId in Path table
-             */
-            path = bvfs_parent_dir(new_path);
-            pnl = strlen(path);
+            pm_strcat(query, ",");
+         }
+         Mmsg(parent_path, "(%s,%s)", edit_uint64(item->PathId, ed1), edit_uint64(item->parent->PathId, ed2));
+         pm_strcat(query, parent_path.c_str());
+         mark_done(hc.done, item->PathId);
 
-            if (!create_path_record(jcr, &parent)) {
+         if (++cnt == BVFS_BULK_SIZE) {
+            if (!QUERY_DB(jcr, query.c_str())) {
+               Dmsg1(dbglevel, "Can't fill PathHierarchy %s\n", jobids);
                goto bail_out;
             }
-            ppathid_cache.insert(pathid);
+            cnt = 0;
+         }
+      }
+
+      if (cnt > 0 && !QUERY_DB(jcr, query.c_str())) {
+         Dmsg1(dbglevel, "Can't fill PathHierarchy %s\n", jobids);
+         goto bail_out;
+      }
+
+      /*
+       * See which parents already have a link of their own.
+       */
+      cnt = 0;
+      foreach_alist(parent, &parents) {
+         if (!parent->path[0] || hc.done->lookup(parent->PathId)) {
+            continue;
+         }
+
+         if (cnt == 0) {
+            pm_strcpy(query, "SELECT PathId FROM PathHierarchy WHERE PathId IN (");
+         } else {
+            pm_strcat(query, ",");
+         }
+         pm_strcat(query, edit_uint64(parent->PathId, ed1));
 
-            Mmsg(cmd, "INSERT INTO PathHierarchy (PathId, PPathId) VALUES (%s,%lld)", pathid, (uint64_t) parent.PathId);
-            if (!INSERT_DB(jcr, cmd)) {
-               goto bail_out;   /* Can't insert the record, just leave */
+         if (++cnt == BVFS_BULK_SIZE) {
+            pm_strcat(query, ")");
+            if (!sql_query(query.c_str(), hierarchy_done_handler, &hc)) {
+               goto bail_out;
             }
+            cnt = 0;
+         }
+      }
 
-            edit_uint64(parent.PathId, pathid);
-            new_path = path;   /* already done */
+      if (cnt > 0) {
+         pm_strcat(query, ")");
+         if (!sql_query(query.c_str(), hierarchy_done_handler, &hc)) {
+            goto bail_out;
          }
-      } else {
-         /*
-          * It's already in the cache.  We can leave, no time to waste here,
-          * all the parent dirs have already been done
-          */
-         goto bail_out;
       }
+
+      /*
+       * The parents still without a link form the next level.
+       */
+      next_level = New(alist(1000, not_owned_by_alist));
+      foreach_alist(parent, &parents) {
+         if (!parent->path[0] || hc.done->lookup(parent->PathId)) {
+            continue;
+         }
+         mark_done(hc.done, parent->PathId);
+         parent->parent = NULL;
+         next_level->append(parent);
+      }
+
+      delete hc.parents;
+      hc.parents = NULL;
+      delete hc.level;
+      hc.level = next_level;
    }
+   retval = true;
 
 bail_out:
-   path = bkp;
-   fnl = 0;
+   if (hc.parents) {
+      delete hc.parents;
+   }
+   delete hc.level;
+   delete hc.done;
+   delete hc.items;
+
+   return retval;
 }
 
 /**
- * Internal function to update path_hierarchy cache with a shared pathid cache
- * return Error 0
- *        OK    1
+ * Claim a job for a cache update and record the paths it uses.
+ * Returns: -1 on error or when another update is in progress
+ *           0 when the cache was already computed
+ *           1 when the job was claimed
  */
-bool B_DB::update_path_hierarchy_cache(JCR *jcr, pathid_cache &ppathid_cache, JobId_t JobId)
+int B_DB::start_path_visibility(JCR *jcr, JobId_t JobId)
 {
-   Dmsg0(dbglevel, "update_path_hierarchy_cache()\n");
-   bool retval = false;
-   uint32_t num;
+   int retval = -1;
    char jobid[50];
+
    edit_uint64(JobId, jobid);
 
    db_lock(this);
@@ -198,7 +401,7 @@ bool B_DB::update_path_hierarchy_cache(JCR *jcr, pathid_cache &ppathid_cache, Jo
 
    if (!QUERY_DB(jcr, cmd) || sql_num_rows() > 0) {
       Dmsg1(dbglevel, "Already computed %d\n", (uint32_t)JobId );
-      retval = true;
+      retval = 0;
       goto bail_out;
    }
 
@@ -207,7 +410,6 @@ bool B_DB::update_path_hierarchy_cache(JCR *jcr, pathid_cache &ppathid_cache, Jo
 
    if (!QUERY_DB(jcr, cmd) || sql_num_rows() > 0) {
       Dmsg1(dbglevel, "already in progress %d\n", (uint32_t)JobId );
-      retval = false;
       goto bail_out;
    }
 
@@ -236,52 +438,27 @@ bool B_DB::update_path_hierarchy_cache(JCR *jcr, pathid_cache &ppathid_cache, Jo
       Dmsg1(dbglevel, "Can't fill PathVisibility %d\n", (uint32_t)JobId );
       goto bail_out;
    }
+   retval = 1;
 
-   /*
-    * Now we have to do the directory recursion stuff to determine missing
-    * visibility We try to avoid recursion, to be as fast as possible We also
-    * only work on not allready hierarchised directories...
-    */
-   Mmsg(cmd, "SELECT PathVisibility.PathId, Path "
-             "FROM PathVisibility "
-             "JOIN Path ON( PathVisibility.PathId = Path.PathId) "
-             "LEFT JOIN PathHierarchy "
-             "ON (PathVisibility.PathId = PathHierarchy.PathId) "
-             "WHERE PathVisibility.JobId = %s "
-             "AND PathHierarchy.PathId IS NULL "
-             "ORDER BY Path",
-        jobid);
+bail_out:
+   end_transaction(jcr);
+   db_unlock(this);
 
-   if (!QUERY_DB(jcr, cmd)) {
-      Dmsg1(dbglevel, "Can't get new Path %d\n", (uint32_t)JobId );
-      goto bail_out;
-   }
+   return retval;
+}
 
-   /* TODO: I need to reuse the DB connection without emptying the result
-    * So, now i'm copying the result in memory to be able to query the
-    * catalog descriptor again.
-    */
-   num = sql_num_rows();
-   if (num > 0) {
-      char **result = (char **)malloc (num * 2 * sizeof(char *));
-
-      SQL_ROW row;
-      int i=0;
-      while((row = sql_fetch_row())) {
-         result[i++] = bstrdup(row[0]);
-         result[i++] = bstrdup(row[1]);
-      }
+/**
+ * Make the parent directories of all paths of a job visible and
+ * mark its cache as computed.
+ */
+bool B_DB::finish_path_visibility(JCR *jcr, JobId_t JobId)
+{
+   bool retval;
+   char jobid[50];
 
-      i = 0;
-      while (num > 0) {
-         build_path_hierarchy(jcr, ppathid_cache, result[i], result[i + 1]);
-         free(result[i++]);
-         free(result[i++]);
-         num--;
-      }
-      free(result);
-   }
+   edit_uint64(JobId, jobid);
 
+   db_lock(this);
    start_transaction(jcr);
 
    fill_query(cmd, SQL_QUERY_bvfs_update_path_visibility_3, jobid, jobid, jobid);
@@ -293,7 +470,6 @@ bool B_DB::update_path_hierarchy_cache(JCR *jcr, pathid_cache &ppathid_cache, Jo
    Mmsg(cmd, "UPDATE Job SET HasCache=1 WHERE JobId=%s", jobid);
    UPDATE_DB(jcr, cmd);
 
-bail_out:
    end_transaction(jcr);
    db_unlock(this);
 
@@ -329,36 +505,61 @@ void B_DB::bvfs_update_cache(JCR *jcr)
 
 /*
  * Update the bvfs cache for given jobids (1,2,3,4)
+ *
+ * The paths of all jobs are recorded first so the parent links
+ * missing for any of them can be built in one go.
  */
 bool B_DB::bvfs_update_path_hierarchy_cache(JCR *jcr, char *jobids)
 {
    char *p;
    int status;
    JobId_t JobId;
+   char ed1[50];
    bool retval = true;
-   pathid_cache ppathid_cache;
+   db_list_ctx claimed;
 
    p = jobids;
    while (1) {
       status = get_next_jobid_from_list(&p, &JobId);
-      if (status < 0) {
-         goto bail_out;
-      }
-
-      if (status == 0) {
+      if (status <= 0) {
          /*
-          * We reached the end of the list.
+          * We reached the end of the list or it is malformed.
           */
-         goto bail_out;
+         break;
       }
 
       Dmsg1(dbglevel, "Updating cache for %lld\n", (uint64_t)JobId);
-      if (!update_path_hierarchy_cache(jcr, ppathid_cache, JobId)) {
+      switch (start_path_visibility(jcr, JobId)) {
+      case 1:
+         claimed.add(edit_uint64(JobId, ed1));
+         break;
+      case 0:
+         break;
+      default:
+         retval = false;
+         break;
+      }
+   }
+
+   if (claimed.count == 0) {
+      return retval;
+   }
+
+   db_lock(this);
+   P(hierarchy_mutex);
+   if (!build_path_hierarchy(jcr, claimed.list)) {
+      retval = false;
+   }
+   V(hierarchy_mutex);
+   db_unlock(this);
+
+   p = claimed.list;
+   while (get_next_jobid_from_list(&p, &JobId) > 0) {
+      if (!finish_path_visibility(jcr, JobId)) {
          retval = false;
       }
    }
 
-bail_out:
    return retval;
 }
 
@@ -899,7 +1100,7 @@ bool Bvfs::compute_restore_list(char *fileid, char *dirid, char *hardlink, char
             tmp.strcat(") UNION ");
             query.strcat(tmp.c_str());
          }
-         Mmsg(tmp,   "SELECT Job.JobId, JobTDate, FileIndex, Name, "
+         Mmsg(tmp,   "SELECT Job.JobId, JobTDate, FileIndex, File.Name, "
                             "PathId, FileId "
                        "FROM File JOIN Job USING (JobId) WHERE JobId = %lld "
                         "AND FileIndex IN (%lld", jobid, id);
@@ -524,8 +524,6 @@ typedef int (DB_RESULT_HANDLER)(void *, int, char **);
 #define db_lock(mdb)   mdb->_lock_db(__FILE__, __LINE__)
 #define db_unlock(mdb) mdb->_unlock_db(__FILE__, __LINE__)
 
-class pathid_cache;
-
 /*
  * Initial size of query hash table and hint for number of pages.
  */
@@ -562,6 +560,8 @@ struct BDB_QUERY {
    hlink link;                            /* List management */
 };
 
+struct path_cache;
+
 class CATS_IMP_EXP B_DB: public SMARTALLOC, public B_DB_QUERY_ENUM_CLASS {
 protected:
    /*
@@ -574,6 +574,7 @@ protected:
    uint32_t m_ref_count;                  /**< Reference count */
    bool m_connected;                      /**< Connection made to db */
    bool m_have_batch_insert;              /**< Have batch insert support ? */
+   bool m_direct_batch_insert;            /**< Batch insert copies straight into File with resolved PathIds ? */
    bool m_try_reconnect;                  /**< Try reconnecting DB connection ? */
    bool m_exit_on_fatal;                  /**< Exit on FATAL DB errors ? */
    char *m_db_driver;                     /**< Database driver */
@@ -601,6 +602,8 @@ protected:
    POOLMEM *esc_obj;                      /**< Escaped restore object */
    POOLMEM *cmd;                          /**< SQL command string */
    POOLMEM *errmsg;                       /**< Nicely edited error message */
+   struct path_cache *m_path_cache;       /**< Shared path cache of this catalog */
+   alist *m_pending_path_ids;             /**< PathIds waiting for the commit of the transaction */
    const char **queries;                  /**< table of query texts */
    static const char *query_names[];      /**< table of query names */
 
@@ -611,11 +614,15 @@ private:
    int get_filename_record(JCR *jcr);
    bool get_file_record(JCR *jcr, JOB_DBR *jr, FILE_DBR *fdbr);
    bool create_batch_file_attributes_record(JCR *jcr, ATTR_DBR *ar);
+   bool create_batch_path_record(JCR *jcr, B_DB *batch, ATTR_DBR *ar);
+   void warm_path_cache(JCR *jcr);
    bool create_filename_record(JCR *jcr, ATTR_DBR *ar);
    bool create_file_record(JCR *jcr, ATTR_DBR *ar);
    void cleanup_base_file(JCR *jcr);
-   void build_path_hierarchy(JCR *jcr, pathid_cache &ppathid_cache, char *org_pathid, char *path);
-   bool update_path_hierarchy_cache(JCR *jcr, pathid_cache &ppathid_cache, JobId_t JobId);
+   bool resolve_parent_pathids(JCR *jcr, void *ctx, alist *parents);
+   bool build_path_hierarchy(JCR *jcr, char *jobids);
+   int start_path_visibility(JCR *jcr, JobId_t JobId);
+   bool finish_path_visibility(JCR *jcr, JobId_t JobId);
    void fill_query_va_list(POOLMEM *&query, B_DB::SQL_QUERY_ENUM predefined_query, va_list arg_ptr);
    void fill_query_va_list(POOL_MEM &query, B_DB::SQL_QUERY_ENUM predefined_query, va_list arg_ptr);
 
@@ -623,8 +630,14 @@ public:
    /*
     * Methods
     */
-   B_DB() {};
-   virtual ~B_DB() {};
+   B_DB() {
+      m_direct_batch_insert = false;
+      m_path_cache = NULL;
+      m_pending_path_ids = NULL;
+   };
+   virtual ~B_DB() {
+      publish_cached_path_ids(false);
+   };
    const char *get_db_name(void) { return m_db_name; };
    const char *get_db_user(void) { return m_db_user; };
    bool is_connected(void) { return m_connected; };
@@ -639,6 +652,14 @@ public:
    int bvfs_ls_dirs(POOL_MEM &query, void *ctx);
    int bvfs_build_ls_file_query(POOL_MEM &query, DB_RESULT_HANDLER *result_handler, void *ctx);
 
+   /* path_cache.c */
+   struct path_cache *get_path_cache(bool create = true);
+   bool lookup_cached_path_id(const char *path, uint32_t *PathId);
+   void cache_path_id(const char *path, uint32_t PathId);
+   void publish_cached_path_ids(bool committed);
+   bool claim_path_cache_warmup(void);
+   void flush_path_cache(void);
+
    /* sql.c */
    char *strerror();
    bool check_max_connections(JCR *jcr, uint32_t max_concurrent_jobs);
@@ -656,7 +677,7 @@ public:
    void db_debug_print(FILE *fp);
 
    /* sql_create.c */
-   bool create_path_record(JCR *jcr, ATTR_DBR *ar);
+   bool create_path_record(JCR *jcr, ATTR_DBR *ar, bool autocommit = false);
    bool create_file_attributes_record(JCR *jcr, ATTR_DBR *ar);
    bool create_job_record(JCR *jcr, JOB_DBR *jr);
    bool create_media_record(JCR *jcr, MEDIA_DBR *media_dbr);
@@ -677,9 +698,9 @@ public:
    bool create_quota_record(JCR *jcr, CLIENT_DBR *cr);
    bool create_ndmp_level_mapping(JCR *jcr, JOB_DBR *jr, char *filesystem);
    bool create_ndmp_environment_string(JCR *jcr, JOB_DBR *jr, char *name, char *value);
-   bool create_job_statistics(JCR *jcr, JOB_STATS_DBR *jsr);
-   bool create_device_statistics(JCR *jcr, DEVICE_STATS_DBR *dsr);
-   bool create_tapealert_statistics(JCR *jcr, TAPEALERT_STATS_DBR *tsr);
+   bool create_job_statistics(JCR *jcr, JOB_STATS_DBR *jsr, int num = 1);
+   bool create_device_statistics(JCR *jcr, DEVICE_STATS_DBR *dsr, int num = 1);
+   bool create_tapealert_statistics(JCR *jcr, TAPEALERT_STATS_DBR *tsr, int num = 1);
 
    /* sql_delete.c */
    bool delete_pool_record(JCR *jcr, POOL_DBR *pool_dbr);
@@ -809,6 +830,7 @@ public:
    virtual bool validate_connection(void) = 0;
    virtual void start_transaction(JCR *jcr) = 0;
    virtual void end_transaction(JCR *jcr) = 0;
+   virtual bool in_transaction(void) { return false; };
 
    /* By default, we use db_sql_query */
    virtual bool big_sql_query(const char *query,
@@ -851,6 +873,9 @@ private:
 /* flush the batch insert connection every x changes */
 #define BATCH_FLUSH 800000
 
+/* number of recent paths loaded into the path cache of a catalog before its first direct batch insert */
+#define PATH_CACHE_WARM_ENTRIES 50000
+
 /* Use for better error location printing */
 #define UPDATE_DB(jcr, cmd) UpdateDB(__FILE__, __LINE__, jcr, cmd, 1)
 #define UPDATE_DB_NO_AFR(jcr, cmd) UpdateDB(__FILE__, __LINE__, jcr, cmd, 0)
@@ -885,6 +910,17 @@ struct SQL_POOL_DESCRIPTOR {
    dlink link;                            /**< list management */
 };
 
+/**
+ * Size and hit counters of the shared path caches.
+ */
+struct PATH_CACHE_STATS {
+   uint32_t entries;                      /**< Number of cached paths */
+   uint32_t max_entries;                  /**< Maximum number of cached paths */
+   uint64_t hits;                         /**< Lookups answered from the cache */
+   uint64_t misses;                       /**< Lookups that needed the catalog */
+   uint64_t evictions;                    /**< Least recently used paths dropped */
+};
+
 #include "protos.h"
 #include "jcr.h"
 
@@ -384,6 +384,8 @@ void B_DB_INGRES::start_transaction(JCR *jcr)
 
 void B_DB_INGRES::end_transaction(JCR *jcr)
 {
+   bool committed;
+
    if (jcr && jcr->cached_attribute) {
       Dmsg0(400, "Flush last cached attribute.\n");
       if (!create_attributes_record(jcr, jcr->ar)) {
@@ -398,8 +400,9 @@ void B_DB_INGRES::end_transaction(JCR *jcr)
 
    db_lock(this);
    if (m_transaction) {
-      sql_query_without_handler("COMMIT"); /* end transaction */
+      committed = sql_query_without_handler("COMMIT"); /* end transaction */
       m_transaction = false;
+      publish_cached_path_ids(committed);
       Dmsg1(400, "End Ingres transaction changes=%d\n", changes);
    }
    changes = 0;
@@ -0,0 +1,379 @@
+/*
+   BAREOS® - Backup Archiving REcovery Open Sourced
+
+   Copyright (C) 2016-2016 Bareos GmbH & Co. KG
+
+   This program is Free Software; you can redistribute it and/or
+   modify it under the terms of version three of the GNU Affero General Public
+   License as published by the Free Software Foundation and included
+   in the file LICENSE.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+   Affero General Public License for more details.
+
+   You should have received a copy of the GNU Affero General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+   02110-1301, USA.
+*/
+/**
+ * @file
+ * BAREOS Catalog Path cache
+ *
+ * Mapping of Path to PathId shared by all jobs using the same catalog,
+ * so attribute inserts, bvfs updates and restore queries can resolve
+ * the PathId of a path without a query to the catalog for paths
+ * seen before.
+ *
+ * Each catalog, identified by its database type, name, address, port
+ * and socket, has its own cache. A cache is split into shards by a
+ * hash of the path, each with its own lock, hash table and least
+ * recently used list so concurrent jobs seldom wait for each other.
+ * When a shard is full its least recently used path is dropped.
+ *
+ * PathIds found or created by a connection inside a transaction are
+ * only shared once that transaction has committed, as other jobs
+ * can't see the Path record before.
+ */
+
+#include "bareos.h"
+
+#if HAVE_SQLITE3 || HAVE_MYSQL || HAVE_POSTGRESQL || HAVE_INGRES || HAVE_DBI
+
+#include "cats.h"
+#include "lib/htable.h"
+
+#define PATH_CACHE_SHARDS 16
+#define PATH_CACHE_MAX_ENTRIES 262144
+
+struct path_cache_entry {
+   hlink link;
+   dlink lru;
+   uint32_t PathId;
+   char path[1];
+};
+
+struct path_cache_shard {
+   pthread_mutex_t mutex;
+   htable *table;
+   dlist *lru;                        /* Most recently used first */
+   uint64_t hits;
+   uint64_t misses;
+   uint64_t evictions;
+};
+
+struct path_cache {
+   dlink link;
+   char *catalog;                     /* Identifies the catalog */
+   bool warmed;                       /* Recent paths loaded */
+   path_cache_shard shards[PATH_CACHE_SHARDS];
+};
+
+/*
+ * A PathId waiting for the commit of the transaction that found it.
+ */
+struct pending_path_id {
+   uint32_t PathId;
+   char path[1];
+};
+
+static dlist *path_caches = NULL;
+static pthread_mutex_t path_caches_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static inline path_cache_shard *get_shard(path_cache *cache, const char *path)
+{
+   uint32_t hash = 0;
+
+   for (const char *p = path; *p; p++) {
+      hash = (hash * 31) + (uint8_t)*p;
+   }
+
+   return &cache->shards[hash % PATH_CACHE_SHARDS];
+}
+
+static void free_shard(path_cache_shard *shard)
+{
+   path_cache_entry *entry;
+
+   if (shard->table) {
+      while ((entry = (path_cache_entry *)shard->lru->first())) {
+         shard->lru->remove(entry);
+         free(entry);
+      }
+      delete shard->lru;
+      delete shard->table;
+      shard->lru = NULL;
+      shard->table = NULL;
+   }
+}
+
+static void flush_cache(path_cache *cache)
+{
+   path_cache_shard *shard;
+
+   for (int i = 0; i < PATH_CACHE_SHARDS; i++) {
+      shard = &cache->shards[i];
+      P(shard->mutex);
+      free_shard(shard);
+      V(shard->mutex);
+   }
+}
+
+static void insert_path(path_cache *cache, const char *path, uint32_t PathId)
+{
+   int len;
+   path_cache_entry *entry;
+   path_cache_shard *shard = get_shard(cache, path);
+
+   P(shard->mutex);
+   if (!shard->table) {
+      entry = NULL;
+      shard->table = New(htable(entry, &entry->link, PATH_CACHE_MAX_ENTRIES / PATH_CACHE_SHARDS));
+      shard->lru = New(dlist(entry, &entry->lru));
+   }
+
+   entry = (path_cache_entry *)shard->table->lookup((char *)path);
+   if (entry) {
+      entry->PathId = PathId;
+      shard->lru->remove(entry);
+      shard->lru->prepend(entry);
+   } else {
+      if (shard->table->size() >= PATH_CACHE_MAX_ENTRIES / PATH_CACHE_SHARDS) {
+         entry = (path_cache_entry *)shard->lru->last();
+         shard->table->remove(entry->path);
+         shard->lru->remove(entry);
+         free(entry);
+         shard->evictions++;
+      }
+
+      len = strlen(path);
+      entry = (path_cache_entry *)malloc(sizeof(path_cache_entry) + len);
+      memcpy(entry->path, path, len + 1);
+      entry->PathId = PathId;
+      shard->table->insert(entry->path, entry);
+      shard->lru->prepend(entry);
+   }
+   V(shard->mutex);
+}
+
+/**
+ * Get the cache of the catalog this connection uses,
+ * creating it on first use unless create is false.
+ */
+path_cache *B_DB::get_path_cache(bool create)
+{
+   path_cache *cache;
+   POOL_MEM catalog(PM_NAME);
+
+   if (m_path_cache) {
+      return m_path_cache;
+   }
+
+   Mmsg(catalog, "%s:%s@%s:%d:%s", get_type(), NPRTB(m_db_name),
+        NPRTB(m_db_address), m_db_port, NPRTB(m_db_socket));
+
+   P(path_caches_mutex);
+   if (!path_caches) {
+      cache = NULL;
+      path_caches = New(dlist(cache, &cache->link));
+   }
+
+   foreach_dlist(cache, path_caches) {
+      if (bstrcmp(cache->catalog, catalog.c_str())) {
+         break;
+      }
+   }
+
+   if (!cache && create) {
+      cache = (path_cache *)malloc(sizeof(path_cache));
+      memset(cache, 0, sizeof(path_cache));
+      cache->catalog = bstrdup(catalog.c_str());
+      for (int i = 0; i < PATH_CACHE_SHARDS; i++) {
+         pthread_mutex_init(&cache->shards[i].mutex, NULL);
+      }
+      path_caches->append(cache);
+   }
+   V(path_caches_mutex);
+
+   m_path_cache = cache;
+
+   return cache;
+}
+
+/**
+ * Lookup the PathId of a path in the cache of this catalog.
+ * Returns: false when the path is not cached
+ *          true with the PathId filled in
+ */
+bool B_DB::lookup_cached_path_id(const char *path, uint32_t *PathId)
+{
+   path_cache_entry *entry = NULL;
+   path_cache_shard *shard = get_shard(get_path_cache(), path);
+
+   P(shard->mutex);
+   if (shard->table) {
+      entry = (path_cache_entry *)shard->table->lookup((char *)path);
+   }
+   if (entry) {
+      *PathId = entry->PathId;
+      if (entry != shard->lru->first()) {
+         shard->lru->remove(entry);
+         shard->lru->prepend(entry);
+      }
+      shard->hits++;
+   } else {
+      shard->misses++;
+   }
+   V(shard->mutex);
+
+   return entry != NULL;
+}
+
+/**
+ * Remember the PathId of a path found or created on this connection.
+ * Inside a transaction it is kept back until the transaction commits.
+ */
+void B_DB::cache_path_id(const char *path, uint32_t PathId)
+{
+   int len;
+   pending_path_id *pending;
+
+   if (!in_transaction()) {
+      insert_path(get_path_cache(), path, PathId);
+      return;
+   }
+
+   if (!m_pending_path_ids) {
+      m_pending_path_ids = New(alist(100, owned_by_alist));
+   }
+
+   len = strlen(path);
+   pending = (pending_path_id *)malloc(sizeof(pending_path_id) + len);
+   memcpy(pending->path, path, len + 1);
+   pending->PathId = PathId;
+   m_pending_path_ids->append(pending);
+}
+
+/**
+ * Called when the transaction of this connection ended. Share the
+ * PathIds kept back when it committed, forget them otherwise.
+ */
+void B_DB::publish_cached_path_ids(bool committed)
+{
+   pending_path_id *pending;
+
+   if (!m_pending_path_ids) {
+      return;
+   }
+
+   if (committed) {
+      foreach_alist(pending, m_pending_path_ids) {
+         insert_path(get_path_cache(), pending->path, pending->PathId);
+      }
+   }
+
+   delete m_pending_path_ids;
+   m_pending_path_ids = NULL;
+}
+
+/**
+ * Returns true for exactly one caller per catalog, which should then
+ * load the most recently created paths into the cache.
+ */
+bool B_DB::claim_path_cache_warmup(void)
+{
+   bool retval;
+   path_cache *cache = get_path_cache();
+
+   P(path_caches_mutex);
+   retval = !cache->warmed;
+   cache->warmed = true;
+   V(path_caches_mutex);
+
+   return retval;
+}
+
+/**
+ * Forget all cached paths of this catalog, e.g. after Path records were deleted.
+ */
+void B_DB::flush_path_cache(void)
+{
+   path_cache *cache = get_path_cache(false);
+
+   if (cache) {
+      flush_cache(cache);
+   }
+}
+
+/**
+ * Get the size and hit counters of the caches of all catalogs.
+ */
+void db_path_cache_get_stats(PATH_CACHE_STATS *stats)
+{
+   path_cache *cache;
+   path_cache_shard *shard;
+
+   memset(stats, 0, sizeof(PATH_CACHE_STATS));
+
+   P(path_caches_mutex);
+   if (path_caches) {
+      foreach_dlist(cache, path_caches) {
+         stats->max_entries += PATH_CACHE_MAX_ENTRIES;
+         for (int i = 0; i < PATH_CACHE_SHARDS; i++) {
+            shard = &cache->shards[i];
+            P(shard->mutex);
+            if (shard->table) {
+               stats->entries += shard->table->size();
+            }
+            stats->hits += shard->hits;
+            stats->misses += shard->misses;
+            stats->evictions += shard->evictions;
+            V(shard->mutex);
+         }
+      }
+   }
+   V(path_caches_mutex);
+}
+
+/**
+ * Forget the cached paths of all catalogs. The caches get warmed again
+ * on their next use.
+ */
+void db_path_cache_flush(void)
+{
+   path_cache *cache;
+
+   P(path_caches_mutex);
+   if (path_caches) {
+      foreach_dlist(cache, path_caches) {
+         flush_cache(cache);
+         cache->warmed = false;
+      }
+   }
+   V(path_caches_mutex);
+}
+
+/**
+ * Free the caches of all catalogs, all connections must be closed.
+ */
+void db_path_cache_destroy(void)
+{
+   path_cache *cache;
+
+   P(path_caches_mutex);
+   if (path_caches) {
+      foreach_dlist(cache, path_caches) {
+         for (int i = 0; i < PATH_CACHE_SHARDS; i++) {
+            free_shard(&cache->shards[i]);
+            pthread_mutex_destroy(&cache->shards[i].mutex);
+         }
+         free(cache->catalog);
+      }
+      delete path_caches;
+      path_caches = NULL;
+   }
+   V(path_caches_mutex);
+}
+#endif /* HAVE_SQLITE3 || HAVE_MYSQL || HAVE_POSTGRESQL || HAVE_INGRES || HAVE_DBI */
@@ -110,6 +110,13 @@ B_DB_POSTGRESQL::B_DB_POSTGRESQL(JCR *jcr,
       m_have_batch_insert = false;
 #endif /* USE_BATCH_FILE_INSERT */
    }
+
+   /*
+    * Copy attributes straight into the File table, the PathIds are
+    * resolved by the director using the shared path cache so we don't
+    * need to lock the Path table and join against it.
+    */
+   m_direct_batch_insert = m_have_batch_insert;
    errmsg = get_pool_memory(PM_EMSG); /* get error message buffer */
    *errmsg = 0;
    cmd = get_pool_memory(PM_EMSG); /* get command buffer */
@@ -486,6 +493,8 @@ void B_DB_POSTGRESQL::start_transaction(JCR *jcr)
 
 void B_DB_POSTGRESQL::end_transaction(JCR *jcr)
 {
+   bool committed;
+
    if (jcr && jcr->cached_attribute) {
       Dmsg0(400, "Flush last cached attribute.\n");
       if (!create_attributes_record(jcr, jcr->ar)) {
@@ -500,8 +509,13 @@ void B_DB_POSTGRESQL::end_transaction(JCR *jcr)
 
    db_lock(this);
    if (m_transaction) {
-      sql_query_without_handler("COMMIT"); /* end transaction */
+      /*
+       * A transaction aborted by an error is rolled back by the COMMIT.
+       */
+      committed = sql_query_without_handler("COMMIT") && /* end transaction */
+                  bstrcmp(PQcmdStatus(m_result), "COMMIT");
       m_transaction = false;
+      publish_cached_path_ids(committed);
       Dmsg1(400, "End PostgreSQL transaction changes=%d\n", changes);
    }
    changes = 0;
@@ -1026,16 +1040,18 @@ bool B_DB_POSTGRESQL::sql_batch_start(JCR *jcr)
 
    Dmsg0(500, "sql_batch_start started\n");
 
-   if (!sql_query_without_handler("CREATE TEMPORARY TABLE batch ("
-                                  "FileIndex int,"
-                                  "JobId int,"
-                                  "Path varchar,"
-                                  "Name varchar,"
-                                  "LStat varchar,"
-                                  "Md5 varchar,"
-                                  "DeltaSeq smallint,"
-                                  "Fhinfo NUMERIC(20),"
-                                  "Fhnode NUMERIC(20))")) {
+   if (m_direct_batch_insert) {
+      query = "COPY File (FileIndex, JobId, PathId, Name, LStat, MD5, DeltaSeq, Fhinfo, Fhnode) FROM STDIN";
+   } else if (!sql_query_without_handler("CREATE TEMPORARY TABLE batch ("
+                                         "FileIndex int,"
+                                         "JobId int,"
+                                         "Path varchar,"
+                                         "Name varchar,"
+                                         "LStat varchar,"
+                                         "Md5 varchar,"
+                                         "DeltaSeq smallint,"
+                                         "Fhinfo NUMERIC(20),"
+                                         "Fhnode NUMERIC(20))")) {
       Dmsg0(500, "sql_batch_start failed\n");
       return false;
    }
@@ -1126,6 +1142,13 @@ bool B_DB_POSTGRESQL::sql_batch_end(JCR *jcr, const char *error)
 
    Dmsg0(500, "sql_batch_end finishing\n");
 
+   /*
+    * With direct batch insert there is no batch table to continue with.
+    */
+   if (m_direct_batch_insert) {
+      return (m_status == 1);
+   }
+
    return true;
 }
 
@@ -1140,20 +1163,28 @@ bool B_DB_POSTGRESQL::sql_batch_insert(JCR *jcr, ATTR_DBR *ar)
    esc_name = check_pool_memory_size(esc_name, fnl*2+1);
    pgsql_copy_escape(esc_name, fname, fnl);
 
-   esc_path = check_pool_memory_size(esc_path, pnl*2+1);
-   pgsql_copy_escape(esc_path, path, pnl);
-
    if (ar->Digest == NULL || ar->Digest[0] == 0) {
       digest = "0";
    } else {
       digest = ar->Digest;
    }
 
-   len = Mmsg(cmd, "%u\t%s\t%s\t%s\t%s\t%s\t%u\t%s\t%s\n",
-              ar->FileIndex, edit_int64(ar->JobId, ed1), esc_path,
-              esc_name, ar->attr, digest, ar->DeltaSeq,
-              edit_uint64(ar->Fhinfo,ed2),
-              edit_uint64(ar->Fhnode,ed3));
+   if (m_direct_batch_insert) {
+      len = Mmsg(cmd, "%u\t%s\t%u\t%s\t%s\t%s\t%u\t%s\t%s\n",
+                 ar->FileIndex, edit_int64(ar->JobId, ed1), ar->PathId,
+                 esc_name, ar->attr, digest, ar->DeltaSeq,
+                 edit_uint64(ar->Fhinfo,ed2),
+                 edit_uint64(ar->Fhnode,ed3));
+   } else {
+      esc_path = check_pool_memory_size(esc_path, pnl*2+1);
+      pgsql_copy_escape(esc_path, path, pnl);
+
+      len = Mmsg(cmd, "%u\t%s\t%s\t%s\t%s\t%s\t%u\t%s\t%s\n",
+                 ar->FileIndex, edit_int64(ar->JobId, ed1), esc_path,
+                 esc_name, ar->attr, digest, ar->DeltaSeq,
+                 edit_uint64(ar->Fhinfo,ed2),
+                 edit_uint64(ar->Fhnode,ed3));
+   }
 
    do {
       res = PQputCopyData(m_db_handle, cmd, len);
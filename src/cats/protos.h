@@ -58,6 +58,11 @@ int db_list_handler(void *ctx, int num_fields, char **row);
 void db_debug_print(JCR *jcr, FILE *fp);
 int db_int_handler(void *ctx, int num_fields, char **row);
 
+/* path_cache.c */
+void db_path_cache_get_stats(PATH_CACHE_STATS *stats);
+void db_path_cache_flush(void);
+void db_path_cache_destroy(void);
+
 /* sql_pooling.c */
 bool db_sql_pool_initialize(const char *db_drivername,
                             const char *db_name,
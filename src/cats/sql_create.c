@@ -36,6 +36,8 @@ static const int dbglevel = 100;
 
 #include "cats.h"
 
+#define STATS_BULK_SIZE 100
+
 /* -----------------------------------------------------------------------
  *
  *   Generic Routines (or almost generic)
@@ -589,19 +591,24 @@ bail_out:
 
 /**
  * Create a Unique record for the Path -- no duplicates
+ *
+ * With autocommit an open transaction is committed before a missing
+ * Path record is created, so the record is shared with other jobs right
+ * away and they never wait on the lock of our uncommitted Path row until
+ * the end of the transaction.
+ *
  * Returns: false on failure
  *          true on success with id in cr->ClientId
  */
-bool B_DB::create_path_record(JCR *jcr, ATTR_DBR *ar)
+bool B_DB::create_path_record(JCR *jcr, ATTR_DBR *ar, bool autocommit)
 {
    bool retval = false;
    SQL_ROW row;
    int num_rows;
+   bool use_savepoint;
+   bool retried = false;
 
    errmsg[0] = 0;
-   esc_name = check_pool_memory_size(esc_name, 2 * pnl + 2);
-   escape_string(jcr, esc_name, path, pnl);
-
    if (cached_path_id != 0 &&
        cached_path_len == pnl &&
        bstrcmp(cached_path, path)) {
@@ -609,6 +616,24 @@ bool B_DB::create_path_record(JCR *jcr, ATTR_DBR *ar)
       return true;
    }
 
+   /*
+    * See if another job already used this path.
+    */
+   if (lookup_cached_path_id(path, &ar->PathId)) {
+      cached_path_id = ar->PathId;
+      cached_path_len = pnl;
+      pm_strcpy(cached_path, path);
+      return true;
+   }
+
+   if (autocommit && in_transaction()) {
+      end_transaction(NULL);
+   }
+
+   esc_name = check_pool_memory_size(esc_name, 2 * pnl + 2);
+   escape_string(jcr, esc_name, path, pnl);
+
+retry_select:
    Mmsg(cmd, "SELECT PathId FROM Path WHERE Path='%s'", esc_name);
 
    if (QUERY_DB(jcr, cmd)) {
@@ -640,6 +665,7 @@ bool B_DB::create_path_record(JCR *jcr, ATTR_DBR *ar)
             cached_path_len = pnl;
             pm_strcpy(cached_path, path);
          }
+         cache_path_id(path, ar->PathId);
          ASSERT(ar->PathId);
          retval = true;
          goto bail_out;
@@ -647,16 +673,39 @@ bool B_DB::create_path_record(JCR *jcr, ATTR_DBR *ar)
       sql_free_result();
    }
 
+   /*
+    * Another job may insert the same path concurrently. Where the catalog
+    * has a unique index on Path one of the inserts fails and that job
+    * looks the path up again. A failing statement aborts a PostgreSQL
+    * transaction, so there the insert is guarded by a savepoint.
+    */
+   use_savepoint = in_transaction() && m_db_type == SQL_TYPE_POSTGRESQL;
+   if (use_savepoint) {
+      sql_query("SAVEPOINT create_path");
+   }
+
    Mmsg(cmd, "INSERT INTO Path (Path) VALUES ('%s')", esc_name);
 
    ar->PathId = sql_insert_autokey_record(cmd, NT_("Path"));
    if (ar->PathId == 0) {
       Mmsg2(errmsg, _("Create db Path record %s failed. ERR=%s\n"), cmd, sql_strerror());
+      if (use_savepoint) {
+         sql_query("ROLLBACK TO SAVEPOINT create_path");
+      }
+      if (!retried) {
+         Dmsg1(dbglevel, "Path %s possibly created concurrently, looking it up again\n", path);
+         retried = true;
+         goto retry_select;
+      }
       Jmsg(jcr, M_FATAL, 0, "%s", errmsg);
       ar->PathId = 0;
       goto bail_out;
    }
 
+   if (use_savepoint) {
+      sql_query("RELEASE SAVEPOINT create_path");
+   }
+
    /*
     * Cache path
     */
@@ -665,6 +714,7 @@ bool B_DB::create_path_record(JCR *jcr, ATTR_DBR *ar)
       cached_path_len = pnl;
       pm_strcpy(cached_path, path);
    }
+   cache_path_id(path, ar->PathId);
    retval = true;
 
 bail_out:
@@ -835,6 +885,19 @@ bool B_DB::write_batch_file_records(JCR *jcr)
       Jmsg1(jcr, M_FATAL, 0, "Batch end %s\n", errmsg);
       goto bail_out;
    }
+
+   /*
+    * With direct batch insert the rows were copied into File
+    * with their PathId already resolved so we are done.
+    */
+   if (m_direct_batch_insert) {
+      jcr->batch_started = false;
+      changes = 0;
+      jcr->JobStatus = JobStatus;
+      Jmsg0(jcr, M_INFO, 0, "Insert of attributes batch done\n");
+      return true;
+   }
+
    if (job_canceled(jcr)) {
       goto bail_out;
    }
@@ -925,9 +988,86 @@ bool B_DB::create_batch_file_attributes_record(JCR *jcr, ATTR_DBR *ar)
 
    jcr->db_batch->split_path_and_file(jcr, ar->fname);
 
+   /*
+    * The batch connection is busy copying into File so resolve
+    * the PathId on our own connection.
+    */
+   if (jcr->db_batch->m_direct_batch_insert) {
+      if (!create_batch_path_record(jcr, jcr->db_batch, ar)) {
+         return false;
+      }
+   }
+
    return jcr->db_batch->sql_batch_insert(jcr, ar);
 }
 
+/**
+ * Load the most recently created paths into the shared path cache
+ * so the first jobs after a start don't query every path.
+ */
+struct warm_path_cache_ctx {
+   B_DB *db;
+   int count;
+};
+
+static int warm_path_cache_handler(void *ctx, int num_fields, char **row)
+{
+   warm_path_cache_ctx *wc = (warm_path_cache_ctx *)ctx;
+
+   if (row[0] && row[1]) {
+      wc->db->cache_path_id(row[1], str_to_uint64(row[0]));
+      wc->count++;
+   }
+
+   return 0;
+}
+
+void B_DB::warm_path_cache(JCR *jcr)
+{
+   warm_path_cache_ctx wc;
+   POOL_MEM query(PM_MESSAGE);
+
+   wc.db = this;
+   wc.count = 0;
+
+   Mmsg(query, "SELECT PathId, Path FROM Path ORDER BY PathId DESC LIMIT %d", PATH_CACHE_WARM_ENTRIES);
+   if (!sql_query(query.c_str(), warm_path_cache_handler, &wc)) {
+      Dmsg1(50, "Warming path cache failed: %s\n", sql_strerror());
+      return;
+   }
+   Dmsg1(50, "Path cache warmed with %d paths\n", wc.count);
+}
+
+/**
+ * Resolve the PathId of the path split into the batch connection,
+ * through the shared path cache or by creating the Path record.
+ * Returns: false on failure
+ *          true on success with ar->PathId filled in
+ */
+bool B_DB::create_batch_path_record(JCR *jcr, B_DB *batch, ATTR_DBR *ar)
+{
+   bool retval;
+
+   db_lock(this);
+   if (claim_path_cache_warmup()) {
+      warm_path_cache(jcr);
+   }
+
+   pnl = batch->pnl;
+   path = check_pool_memory_size(path, pnl + 1);
+   memcpy(path, batch->path, pnl + 1);
+
+   /*
+    * Our connection only resolves paths as the File rows go through the
+    * batch connection, so missing Path records can be created outside of
+    * the job's transaction.
+    */
+   retval = create_path_record(jcr, ar, true);
+   db_unlock(this);
+
+   return retval;
+}
+
 /**
  * Create File record in B_DB
  *
@@ -1334,144 +1474,158 @@ bool B_DB::create_ndmp_environment_string(JCR *jcr, JOB_DBR *jr, char *name, cha
 }
 
 /**
- * Create a Job Statistics record.
+ * Create Job Statistics records.
+ * Up to STATS_BULK_SIZE samples are written with a single INSERT.
  * Returns: false on failure
  *          true on success
  */
-bool B_DB::create_job_statistics(JCR *jcr, JOB_STATS_DBR *jsr)
+bool B_DB::create_job_statistics(JCR *jcr, JOB_STATS_DBR *jsr, int num)
 {
-   time_t stime;
-   bool retval = false;
+   int cnt = 0;
+   bool retval = true;
    char dt[MAX_TIME_LENGTH];
    char ed1[50], ed2[50], ed3[50], ed4[50];
+   POOL_MEM values(PM_MESSAGE);
 
    db_lock(this);
 
-   stime = jsr->SampleTime;
-   ASSERT(stime != 0);
-
-   bstrutime(dt, sizeof(dt), stime);
+   for (int i = 0; i < num; i++) {
+      ASSERT(jsr[i].SampleTime != 0);
+      bstrutime(dt, sizeof(dt), jsr[i].SampleTime);
 
-   /*
-    * Create job statistics record
-    */
-   Mmsg(cmd, "INSERT INTO JobStats (SampleTime, JobId, JobFiles, JobBytes, DeviceId)"
-                  " VALUES ('%s', %s, %s, %s, %s)",
-                  dt,
-                  edit_int64(jsr->JobId, ed1),
-                  edit_uint64(jsr->JobFiles, ed2),
-                  edit_uint64(jsr->JobBytes, ed3),
-                  edit_int64(jsr->DeviceId, ed4));
-   Dmsg1(200, "Create job stats: %s\n", cmd);
+      if (cnt == 0) {
+         pm_strcpy(cmd, "INSERT INTO JobStats (SampleTime, JobId, JobFiles, JobBytes, DeviceId) VALUES ");
+      } else {
+         pm_strcat(cmd, ",");
+      }
 
-   if (!INSERT_DB(jcr, cmd)) {
-      Mmsg2(errmsg, _("Create DB JobStats record %s failed. ERR=%s\n"), cmd, sql_strerror());
-      Jmsg(jcr, M_ERROR, 0, "%s", errmsg);
-      goto bail_out;
-   } else {
-      retval = true;
+      Mmsg(values, "('%s', %s, %s, %s, %s)",
+           dt,
+           edit_int64(jsr[i].JobId, ed1),
+           edit_uint64(jsr[i].JobFiles, ed2),
+           edit_uint64(jsr[i].JobBytes, ed3),
+           edit_int64(jsr[i].DeviceId, ed4));
+      pm_strcat(cmd, values.c_str());
+
+      if (++cnt == STATS_BULK_SIZE || i == num - 1) {
+         Dmsg1(200, "Create job stats: %s\n", cmd);
+         if (!QUERY_DB(jcr, cmd)) {
+            Mmsg2(errmsg, _("Create DB JobStats record %s failed. ERR=%s\n"), cmd, sql_strerror());
+            Jmsg(jcr, M_ERROR, 0, "%s", errmsg);
+            retval = false;
+         }
+         cnt = 0;
+      }
    }
 
-bail_out:
    db_unlock(this);
    return retval;
 }
 
 /**
- * Create a Device Statistics record.
+ * Create Device Statistics records.
+ * Up to STATS_BULK_SIZE samples are written with a single INSERT.
  * Returns: false on failure
  *          true on success
  */
-bool B_DB::create_device_statistics(JCR *jcr, DEVICE_STATS_DBR *dsr)
+bool B_DB::create_device_statistics(JCR *jcr, DEVICE_STATS_DBR *dsr, int num)
 {
-   time_t stime;
-   bool retval = false;
+   int cnt = 0;
+   bool retval = true;
    char dt[MAX_TIME_LENGTH];
    char ed1[50], ed2[50], ed3[50], ed4[50], ed5[50], ed6[50];
    char ed7[50], ed8[50], ed9[50], ed10[50], ed11[50], ed12[50];
+   POOL_MEM values(PM_MESSAGE);
 
    db_lock(this);
 
-   stime = dsr->SampleTime;
-   ASSERT(stime != 0);
-
-   bstrutime(dt, sizeof(dt), stime);
+   for (int i = 0; i < num; i++) {
+      ASSERT(dsr[i].SampleTime != 0);
+      bstrutime(dt, sizeof(dt), dsr[i].SampleTime);
 
-   /*
-    * Create device statistics record
-    */
-   Mmsg(cmd,
-        "INSERT INTO DeviceStats (DeviceId, SampleTime, ReadTime, WriteTime,"
-        " ReadBytes, WriteBytes, SpoolSize, NumWaiting, NumWriters, MediaId,"
-        " VolCatBytes, VolCatFiles, VolCatBlocks)"
-        " VALUES (%s, '%s', %s, %s, %s, %s, %s, %s, %s, %s, %s, %s, %s)",
-        edit_int64(dsr->DeviceId, ed1),
-        dt,
-        edit_uint64(dsr->ReadTime, ed2),
-        edit_uint64(dsr->WriteTime, ed3),
-        edit_uint64(dsr->ReadBytes, ed4),
-        edit_uint64(dsr->WriteBytes, ed5),
-        edit_uint64(dsr->SpoolSize, ed6),
-        edit_uint64(dsr->NumWaiting, ed7),
-        edit_uint64(dsr->NumWriters, ed8),
-        edit_int64(dsr->MediaId, ed9),
-        edit_uint64(dsr->VolCatBytes, ed10),
-        edit_uint64(dsr->VolCatFiles, ed11),
-        edit_uint64(dsr->VolCatBlocks, ed12));
-   Dmsg1(200, "Create device stats: %s\n", cmd);
+      if (cnt == 0) {
+         pm_strcpy(cmd,
+                   "INSERT INTO DeviceStats (DeviceId, SampleTime, ReadTime, WriteTime,"
+                   " ReadBytes, WriteBytes, SpoolSize, NumWaiting, NumWriters, MediaId,"
+                   " VolCatBytes, VolCatFiles, VolCatBlocks) VALUES ");
+      } else {
+         pm_strcat(cmd, ",");
+      }
 
-   if (!INSERT_DB(jcr, cmd)) {
-      Mmsg2(errmsg, _("Create DB DeviceStats record %s failed. ERR=%s\n"), cmd, sql_strerror());
-      Jmsg(jcr, M_ERROR, 0, "%s", errmsg);
-      goto bail_out;
-   } else {
-      retval = true;
+      Mmsg(values, "(%s, '%s', %s, %s, %s, %s, %s, %s, %s, %s, %s, %s, %s)",
+           edit_int64(dsr[i].DeviceId, ed1),
+           dt,
+           edit_uint64(dsr[i].ReadTime, ed2),
+           edit_uint64(dsr[i].WriteTime, ed3),
+           edit_uint64(dsr[i].ReadBytes, ed4),
+           edit_uint64(dsr[i].WriteBytes, ed5),
+           edit_uint64(dsr[i].SpoolSize, ed6),
+           edit_uint64(dsr[i].NumWaiting, ed7),
+           edit_uint64(dsr[i].NumWriters, ed8),
+           edit_int64(dsr[i].MediaId, ed9),
+           edit_uint64(dsr[i].VolCatBytes, ed10),
+           edit_uint64(dsr[i].VolCatFiles, ed11),
+           edit_uint64(dsr[i].VolCatBlocks, ed12));
+      pm_strcat(cmd, values.c_str());
+
+      if (++cnt == STATS_BULK_SIZE || i == num - 1) {
+         Dmsg1(200, "Create device stats: %s\n", cmd);
+         if (!QUERY_DB(jcr, cmd)) {
+            Mmsg2(errmsg, _("Create DB DeviceStats record %s failed. ERR=%s\n"), cmd, sql_strerror());
+            Jmsg(jcr, M_ERROR, 0, "%s", errmsg);
+            retval = false;
+         }
+         cnt = 0;
+      }
    }
 
-bail_out:
    db_unlock(this);
    return retval;
 }
 
 /**
- * Create a tapealert record.
+ * Create tapealert records.
+ * Up to STATS_BULK_SIZE samples are written with a single INSERT.
  * Returns: false on failure
  *          true on success
  */
-bool B_DB::create_tapealert_statistics(JCR *jcr, TAPEALERT_STATS_DBR *tsr)
+bool B_DB::create_tapealert_statistics(JCR *jcr, TAPEALERT_STATS_DBR *tsr, int num)
 {
-   time_t stime;
-   bool retval = false;
+   int cnt = 0;
+   bool retval = true;
    char dt[MAX_TIME_LENGTH];
    char ed1[50], ed2[50];
+   POOL_MEM values(PM_MESSAGE);
 
    db_lock(this);
 
-   stime = tsr->SampleTime;
-   ASSERT(stime != 0);
+   for (int i = 0; i < num; i++) {
+      ASSERT(tsr[i].SampleTime != 0);
+      bstrutime(dt, sizeof(dt), tsr[i].SampleTime);
 
-   bstrutime(dt, sizeof(dt), stime);
+      if (cnt == 0) {
+         pm_strcpy(cmd, "INSERT INTO TapeAlerts (DeviceId, SampleTime, AlertFlags) VALUES ");
+      } else {
+         pm_strcat(cmd, ",");
+      }
 
-   /*
-    * Create device statistics record
-    */
-   Mmsg(cmd,
-        "INSERT INTO TapeAlerts (DeviceId, SampleTime, AlertFlags)"
-        " VALUES (%s, '%s', %s)",
-        edit_int64(tsr->DeviceId, ed1),
-        dt,
-        edit_uint64(tsr->AlertFlags, ed2));
-   Dmsg1(200, "Create tapealert: %s\n", cmd);
+      Mmsg(values, "(%s, '%s', %s)",
+           edit_int64(tsr[i].DeviceId, ed1),
+           dt,
+           edit_uint64(tsr[i].AlertFlags, ed2));
+      pm_strcat(cmd, values.c_str());
 
-   if (!INSERT_DB(jcr, cmd)) {
-      Mmsg2(errmsg, _("Create DB TapeAlerts record %s failed. ERR=%s\n"), cmd, sql_strerror());
-      Jmsg(jcr, M_ERROR, 0, "%s", errmsg);
-      goto bail_out;
-   } else {
-      retval = true;
+      if (++cnt == STATS_BULK_SIZE || i == num - 1) {
+         Dmsg1(200, "Create tapealert: %s\n", cmd);
+         if (!QUERY_DB(jcr, cmd)) {
+            Mmsg2(errmsg, _("Create DB TapeAlerts record %s failed. ERR=%s\n"), cmd, sql_strerror());
+            Jmsg(jcr, M_ERROR, 0, "%s", errmsg);
+            retval = false;
+         }
+         cnt = 0;
+      }
    }
 
-bail_out:
    db_unlock(this);
    return retval;
 }
@@ -185,6 +185,10 @@ int B_DB::get_path_record(JCR *jcr)
       return cached_path_id;
    }
 
+   if (lookup_cached_path_id(path, &PathId)) {
+      return PathId;
+   }
+
    Mmsg(cmd, "SELECT PathId FROM Path WHERE Path='%s'", esc_name);
    if (QUERY_DB(jcr, cmd)) {
       char ed1[30];
@@ -211,6 +215,7 @@ int B_DB::get_path_record(JCR *jcr)
                   cached_path_len = pnl;
                   pm_strcpy(cached_path, path);
                }
+               cache_path_id(path, PathId);
             }
          }
       } else {
@@ -759,6 +759,11 @@ int wait_for_job_termination(JCR *jcr, int timeout)
     */
    wait_for_storage_daemon_termination(jcr);
 
+   /*
+    * Spooled attributes may still be going into the catalog.
+    */
+   wait_for_attribute_despool(jcr);
+
    /*
     * Return values from FD
     */
@@ -0,0 +1,129 @@
+/*
+   BAREOS® - Backup Archiving REcovery Open Sourced
+
+   Copyright (C) 2016-2016 Bareos GmbH & Co. KG
+
+   This program is Free Software; you can redistribute it and/or
+   modify it under the terms of version three of the GNU Affero General Public
+   License as published by the Free Software Foundation and included
+   in the file LICENSE.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+   Affero General Public License for more details.
+
+   You should have received a copy of the GNU Affero General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+   02110-1301, USA.
+*/
+/**
+ * @file
+ * Background update of the bvfs cache at job end.
+ *
+ * Jobs with "Update Bvfs Cache" enabled queue their JobId here when
+ * they terminate. A small pool of worker threads updates the cache,
+ * each on its own private catalog connection, so the update of
+ * several jobs can run concurrently and doesn't delay the job itself.
+ */
+
+#include "bareos.h"
+#include "dird.h"
+
+#define BVFS_UPDATE_WORKERS 4
+
+struct bvfs_update_item {
+   JobId_t JobId;
+   B_DB *db;                          /* Private connection used for the update */
+};
+
+/* Static globals */
+static bool workq_running = false;
+static workq_t bvfs_workq;
+static pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static void *bvfs_update_engine(void *arg)
+{
+   JCR *jcr;
+   char ed1[50];
+   bvfs_update_item *item = (bvfs_update_item *)arg;
+
+   jcr = new_control_jcr("*BvfsUpdate*", JT_SYSTEM);
+   jcr->db = item->db;
+
+   Dmsg1(100, "Updating bvfs cache for JobId=%d\n", item->JobId);
+   if (!jcr->db->bvfs_update_path_hierarchy_cache(jcr, edit_uint64(item->JobId, ed1))) {
+      Dmsg1(100, "Bvfs cache update for JobId=%d not done\n", item->JobId);
+   }
+
+   /*
+    * free_jcr() returns the connection to the pool.
+    */
+   free_jcr(jcr);
+   free(item);
+
+   return NULL;
+}
+
+/**
+ * Queue an update of the bvfs cache for a terminated job.
+ */
+void queue_bvfs_update(JCR *jcr)
+{
+   int status;
+   bvfs_update_item *item;
+   B_DB *db;
+
+   if (!jcr->res.job->UpdateBvfsCache || !jcr->db) {
+      return;
+   }
+
+   db = jcr->db->clone_database_connection(jcr, true, true, true);
+   if (!db) {
+      Jmsg(jcr, M_WARNING, 0, _("Could not open database connection to update the bvfs cache.\n"));
+      return;
+   }
+
+   item = (bvfs_update_item *)malloc(sizeof(bvfs_update_item));
+   item->JobId = jcr->JobId;
+   item->db = db;
+
+   P(mutex);
+   if (!workq_running) {
+      if ((status = workq_init(&bvfs_workq, BVFS_UPDATE_WORKERS, bvfs_update_engine)) != 0) {
+         berrno be;
+         V(mutex);
+         Jmsg1(jcr, M_WARNING, 0, _("Could not init bvfs update work queue: ERR=%s\n"), be.bstrerror(status));
+         goto bail_out;
+      }
+      workq_running = true;
+   }
+
+   if ((status = workq_add(&bvfs_workq, item, NULL, 0)) != 0) {
+      berrno be;
+      V(mutex);
+      Jmsg1(jcr, M_WARNING, 0, _("Could not queue bvfs update: ERR=%s\n"), be.bstrerror(status));
+      goto bail_out;
+   }
+   V(mutex);
+
+   return;
+
+bail_out:
+   db_sql_close_pooled_connection(jcr, db);
+   free(item);
+}
+
+/**
+ * Wait for the queued bvfs updates to finish and stop the workers.
+ */
+void term_bvfs_update(void)
+{
+   P(mutex);
+   if (workq_running) {
+      workq_destroy(&bvfs_workq);
+      workq_running = false;
+   }
+   V(mutex);
+}
@@ -377,7 +377,19 @@ bail_out:
  * packet, VolSessionId, VolSessionTime, FileIndex, file type, and file name to
  * store in the catalog.
  */
-static void update_attribute(JCR *jcr, char *msg, int32_t msglen)
+/**
+ * JobId the attributes of a job are stored under.
+ */
+static inline JobId_t attribute_jobid(JCR *jcr)
+{
+   if (jcr->mig_jcr) {
+      return jcr->mig_jcr->JobId;
+   }
+
+   return jcr->JobId;
+}
+
+static void update_attribute(JCR *jcr, JobId_t JobId, char *msg, int32_t msglen)
 {
    unser_declare;
    uint32_t VolSessionId, VolSessionTime;
@@ -506,11 +518,7 @@ static void update_attribute(JCR *jcr, char *msg, int32_t msglen)
       }
       ar->Stream = Stream;
       ar->link = NULL;
-      if (jcr->mig_jcr) {
-         ar->JobId = jcr->mig_jcr->JobId;
-      } else {
-         ar->JobId = jcr->JobId;
-      }
+      ar->JobId = JobId;
       ar->Digest = NULL;
       ar->DigestType = CRYPTO_DIGEST_NONE;
       jcr->cached_attribute = true;
@@ -534,11 +542,7 @@ static void update_attribute(JCR *jcr, char *msg, int32_t msglen)
       memset(&ro, 0, sizeof(ro));
       ro.Stream = Stream;
       ro.FileIndex = FileIndex;
-      if (jcr->mig_jcr) {
-         ro.JobId = jcr->mig_jcr->JobId;
-      } else {
-         ro.JobId = jcr->JobId;
-      }
+      ro.JobId = JobId;
 
       Dmsg1(100, "Robj=%s\n", p);
 
@@ -668,7 +672,7 @@ void catalog_update(JCR *jcr, BSOCK *bs)
       goto bail_out;
    }
 
-   update_attribute(jcr, bs->msg, bs->msglen);
+   update_attribute(jcr, attribute_jobid(jcr), bs->msg, bs->msglen);
 
 bail_out:
    if (jcr->is_job_canceled()) {
@@ -677,33 +681,18 @@ bail_out:
 }
 
 /**
- * Update File Attributes in the catalog with data read from
- * the storage daemon spool file. We receive the filename and
- * we try to read it.
+ * Replay the attributes in a spool file into the catalog.
+ * The job_jcr is checked for cancellation, the jcr is used for the inserts.
  */
-bool despool_attributes_from_file(JCR *jcr, const char *file)
+static bool replay_attribute_spool(JCR *jcr, JCR *job_jcr, int spool_fd)
 {
    bool retval = false;
    int32_t pktsiz;
    size_t nbytes;
    ssize_t size = 0;
    int32_t msglen;                    /* message length */
-   int spool_fd = -1;
    POOLMEM *msg = get_pool_memory(PM_MESSAGE);
 
-   Dmsg0(100, "Begin despool_attributes_from_file\n");
-
-   if (jcr->is_job_canceled() || !jcr->res.pool->catalog_files || !jcr->db) {
-      goto bail_out;                  /* user disabled cataloging */
-   }
-
-   spool_fd = open(file, O_RDONLY | O_BINARY);
-   if (spool_fd == -1) {
-      Dmsg0(100, "cancel despool_attributes_from_file\n");
-      /* send an error message */
-      goto bail_out;
-   }
-
 #if defined(HAVE_POSIX_FADVISE) && defined(POSIX_FADV_WILLNEED)
    posix_fadvise(spool_fd, 0, 0, POSIX_FADV_WILLNEED);
 #endif
@@ -730,9 +719,9 @@ bool despool_attributes_from_file(JCR *jcr, const char *file)
          size += nbytes;
       }
 
-      if (!jcr->is_job_canceled()) {
-         update_attribute(jcr, msg, msglen);
-         if (jcr->is_job_canceled()) {
+      if (!jcr->is_job_canceled() && !job_jcr->is_job_canceled()) {
+         update_attribute(jcr, attribute_jobid(job_jcr), msg, msglen);
+         if (jcr->is_job_canceled() || job_jcr->is_job_canceled()) {
             goto bail_out;
          }
       }
@@ -740,6 +729,252 @@ bool despool_attributes_from_file(JCR *jcr, const char *file)
 
    retval = true;
 
+bail_out:
+   free_pool_memory(msg);
+
+   return retval;
+}
+
+/**
+ * Attribute spool files handed to the background catalog writers.
+ */
+struct attr_despool_item {
+   dlink link;
+   JCR *jcr;                          /* Job the attributes belong to, it waits for us before it is freed */
+   B_DB *db;                          /* Private connection for the inserts */
+   int spool_fd;
+   bool done;
+   bool ok;
+   uint64_t SDJobBytes;
+};
+
+#define ATTR_DESPOOL_WORKERS 4
+
+static bool despool_workq_running = false;
+static workq_t despool_workq;
+static dlist *despool_items = NULL;
+static pthread_mutex_t despool_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t despool_done = PTHREAD_COND_INITIALIZER;
+
+static void *attr_despool_engine(void *arg)
+{
+   JCR *jcr;
+   attr_despool_item *item = (attr_despool_item *)arg;
+
+   Dmsg1(100, "Begin background despool JobId=%d\n", item->jcr->JobId);
+
+   /*
+    * Insert the attributes using a JCR of our own so the batch
+    * connection and cached attribute of the job are not touched.
+    * It keeps JobId 0 so it is never taken for the job itself,
+    * the JobId of the attributes is taken from the job.
+    */
+   jcr = new_control_jcr("*AttrDespool*", JT_SYSTEM);
+   jcr->db = item->db;
+
+   if (replay_attribute_spool(jcr, item->jcr, item->spool_fd)) {
+      jcr->db->end_transaction(jcr);  /* flush the cached attribute */
+      if (jcr->batch_started) {
+         item->ok = jcr->db_batch->write_batch_file_records(jcr);
+      } else {
+         item->ok = true;
+      }
+      item->ok = item->ok && !jcr->is_job_canceled();
+   }
+   close(item->spool_fd);
+   item->SDJobBytes = jcr->SDJobBytes;
+
+   /*
+    * free_jcr() returns both connections to the pool.
+    */
+   free_jcr(jcr);
+
+   Dmsg2(100, "End background despool JobId=%d ok=%d\n", item->jcr->JobId, item->ok);
+
+   P(despool_mutex);
+   item->done = true;
+   pthread_cond_broadcast(&despool_done);
+   V(despool_mutex);
+
+   return NULL;
+}
+
+/**
+ * Hand a spool file to the background catalog writers.
+ * The file is opened here so it stays readable after the
+ * Storage daemon removes it once we acknowledged it.
+ */
+static bool queue_attribute_spool(JCR *jcr, int spool_fd)
+{
+   int status;
+   B_DB *db;
+   attr_despool_item *item;
+
+   db = jcr->db->clone_database_connection(jcr, true, true, true);
+   if (!db) {
+      return false;
+   }
+
+   item = (attr_despool_item *)malloc(sizeof(attr_despool_item));
+   memset(item, 0, sizeof(attr_despool_item));
+   item->jcr = jcr;
+   item->db = db;
+   item->spool_fd = spool_fd;
+
+   P(despool_mutex);
+   if (!despool_workq_running) {
+      if ((status = workq_init(&despool_workq, ATTR_DESPOOL_WORKERS, attr_despool_engine)) != 0) {
+         berrno be;
+         Jmsg1(jcr, M_WARNING, 0, _("Could not init attribute despool work queue: ERR=%s\n"), be.bstrerror(status));
+         goto bail_out;
+      }
+      despool_items = New(dlist(item, &item->link));
+      despool_workq_running = true;
+   }
+
+   if ((status = workq_add(&despool_workq, item, NULL, 0)) != 0) {
+      berrno be;
+      Jmsg1(jcr, M_WARNING, 0, _("Could not queue attribute despool: ERR=%s\n"), be.bstrerror(status));
+      goto bail_out;
+   }
+   despool_items->append(item);
+   V(despool_mutex);
+
+   return true;
+
+bail_out:
+   V(despool_mutex);
+   db_sql_close_pooled_connection(jcr, db);
+   free(item);
+
+   return false;
+}
+
+/**
+ * Wait for the spool files queued for a job and remove them from the queue.
+ *
+ * Returns: false if inserting any of them failed.
+ */
+static bool drain_attribute_despool(JCR *jcr)
+{
+   bool ok = true;
+   attr_despool_item *item, *next;
+
+   P(despool_mutex);
+   if (!despool_items) {
+      V(despool_mutex);
+      return true;
+   }
+
+   item = (attr_despool_item *)despool_items->first();
+   while (item) {
+      if (item->jcr != jcr) {
+         item = (attr_despool_item *)despool_items->next(item);
+         continue;
+      }
+
+      if (!item->done) {
+         Dmsg1(100, "Waiting for background despool JobId=%d\n", jcr->JobId);
+         pthread_cond_wait(&despool_done, &despool_mutex);
+         item = (attr_despool_item *)despool_items->first();
+         continue;
+      }
+
+      next = (attr_despool_item *)despool_items->next(item);
+      despool_items->remove(item);
+      jcr->SDJobBytes += item->SDJobBytes;
+      if (!item->ok) {
+         ok = false;
+      }
+      free(item);
+      item = next;
+   }
+   V(despool_mutex);
+
+   return ok;
+}
+
+/**
+ * Wait until the spool files queued for a job are in the catalog.
+ */
+void wait_for_attribute_despool(JCR *jcr)
+{
+   if (!drain_attribute_despool(jcr) && !jcr->is_job_canceled()) {
+      Jmsg(jcr, M_FATAL, 0, _("Inserting the spooled attributes into the catalog failed.\n"));
+   }
+}
+
+/**
+ * Called when the JCR is freed. A job that ended without waiting
+ * for its spool files, e.g. because it failed or was canceled,
+ * still has to wait for the writers using it to finish.
+ */
+void release_attribute_despool(JCR *jcr)
+{
+   drain_attribute_despool(jcr);
+}
+
+/**
+ * Stop the background catalog writers.
+ */
+void term_attribute_despool(void)
+{
+   P(despool_mutex);
+   if (despool_workq_running) {
+      workq_destroy(&despool_workq);
+      delete despool_items;
+      despool_items = NULL;
+      despool_workq_running = false;
+   }
+   V(despool_mutex);
+}
+
+/**
+ * Update File Attributes in the catalog with data read from
+ * the storage daemon spool file. We receive the filename and
+ * we try to read it.
+ *
+ * Plain backups leave the inserts to the background catalog writers
+ * and return right away, so the Storage daemon can release the
+ * device while the attributes are inserted. The job waits for them
+ * in wait_for_job_termination().
+ */
+bool despool_attributes_from_file(JCR *jcr, const char *file)
+{
+   bool retval = false;
+   int spool_fd = -1;
+
+   Dmsg0(100, "Begin despool_attributes_from_file\n");
+
+   if (jcr->is_job_canceled() || !jcr->res.pool->catalog_files || !jcr->db) {
+      goto bail_out;                  /* user disabled cataloging */
+   }
+
+   spool_fd = open(file, O_RDONLY | O_BINARY);
+   if (spool_fd == -1) {
+      Dmsg0(100, "cancel despool_attributes_from_file\n");
+      /* send an error message */
+      goto bail_out;
+   }
+
+#if !defined(HAVE_WIN32)
+   /*
+    * An open file can't be removed on Windows, so we can only
+    * read it in the background on other platforms.
+    */
+   if (jcr->is_JobType(JT_BACKUP) &&
+       jcr->getJobProtocol() == PT_NATIVE &&
+       !jcr->HasBase) {
+      if (queue_attribute_spool(jcr, spool_fd)) {
+         spool_fd = -1;
+         retval = true;
+         goto bail_out;
+      }
+   }
+#endif
+
+   retval = replay_attribute_spool(jcr, jcr, spool_fd);
+
 bail_out:
    if (spool_fd != -1) {
       close(spool_fd);
@@ -749,7 +984,6 @@ bail_out:
       cancel_storage_daemon_job(jcr);
    }
 
-   free_pool_memory(msg);
    Dmsg1(100, "End despool_attributes_from_file retval=%i\n", retval);
    return retval;
 }
@@ -484,6 +484,21 @@ static int delete_id_list(const char *query, ID_LIST *id_list)
    return 1;
 }
 
+/*
+ * Path records were deleted so any cached PathIds of this catalog
+ * may point to records that are gone.
+ */
+static void path_records_deleted()
+{
+   static bool reported = false;
+
+   db->flush_path_cache();
+   if (!reported) {
+      printf(_("Path records were deleted, reload running Directors to drop their cached PathIds.\n"));
+      reported = true;
+   }
+}
+
 /*
  * Called here with each name to be added to the list
  */
@@ -605,6 +620,9 @@ static void eliminate_duplicate_paths()
             }
             db->sql_query(buf, NULL, NULL);
          }
+         if (id_list.num_ids > 1) {
+            path_records_deleted();
+         }
       }
       fflush(stdout);
    }
@@ -766,6 +784,7 @@ static void eliminate_orphaned_path_records()
          printf(_("Deleting %d orphaned Path records.\n"), id_list.num_ids);
          fflush(stdout);
          delete_id_list("DELETE FROM Path WHERE PathId=%s", &id_list);
+         path_records_deleted();
       } else {
          break;                       /* get out if not updating db */
       }
@@ -468,7 +468,10 @@ void terminate_dird(int sig)
    destroy_configure_usage_string();
    stop_statistics_thread();
    stop_watchdog();
+   term_bvfs_update();
+   term_attribute_despool();
    db_sql_pool_destroy();
+   db_path_cache_destroy();
    db_flush_backends();
    unload_dir_plugins();
    if (!test_config) {                /* we don't need to do this block in test mode */
@@ -594,6 +597,12 @@ bool do_reload_config()
     */
    db_sql_pool_flush();
 
+   /*
+    * Forget the cached PathIds, Path records may have been removed
+    * by dbcheck or the catalogs may have changed.
+    */
+   db_path_cache_flush();
+
    /*
     * Save the previous config so we can restore it.
     */
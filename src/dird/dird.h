@@ -29,6 +29,7 @@
  */
 
 #include "lib/connection_pool.h"
+#include "lib/bnet_reactor.h"
 #include "lib/runscript.h"
 #include "lib/breg.h"
 #include "lib/bsr.h"
@@ -128,6 +128,9 @@ static RES_ITEM dir_items[] = {
    { "HeartbeatInterval", CFG_TYPE_TIME, ITEM(res_dir.heartbeat_interval), 0, CFG_ITEM_DEFAULT, "0", NULL, NULL },
    { "StatisticsRetention", CFG_TYPE_TIME, ITEM(res_dir.stats_retention), 0, CFG_ITEM_DEFAULT, "160704000" /* 5 years */, NULL, NULL },
    { "StatisticsCollectInterval", CFG_TYPE_PINT32, ITEM(res_dir.stats_collect_interval), 0, CFG_ITEM_DEFAULT, "150", "14.2.0-", NULL },
+   { "StatisticsFlushInterval", CFG_TYPE_PINT32, ITEM(res_dir.stats_flush_interval), 0, CFG_ITEM_DEFAULT, "0", "17.4.2-",
+      "Keep collected statistics in memory for this many seconds and write them to the catalog in bulk. "
+      "0 writes them after every collection run." },
    { "VerId", CFG_TYPE_STR, ITEM(res_dir.verid), 0, 0, NULL, NULL, NULL },
    { "OptimizeForSize", CFG_TYPE_BOOL, ITEM(res_dir.optimize_for_size), 0, CFG_ITEM_DEFAULT, "false", NULL, NULL },
    { "OptimizeForSpeed", CFG_TYPE_BOOL, ITEM(res_dir.optimize_for_speed), 0, CFG_ITEM_DEFAULT, "false", NULL, NULL },
@@ -448,6 +451,8 @@ RES_ITEM job_items[] = {
      "If \"AlwaysIncrementalMaxFullAge\" is set, during consolidations only incremental backups will be considered while the Full Backup remains to reduce the amount of data being consolidated. Only if the Full Backup is older than \"AlwaysIncrementalMaxFullAge\", the Full Backup will be part of the consolidation to avoid the Full Backup becoming too old ." },
    { "MaxFullConsolidations", CFG_TYPE_PINT32, ITEM(res_job.MaxFullConsolidations), 0, CFG_ITEM_DEFAULT, "0", "16.2.4-",
      "If \"AlwaysIncrementalMaxFullAge\" is configured, do not run more than \"MaxFullConsolidations\" consolidation jobs that include the Full backup."},
+   { "UpdateBvfsCache", CFG_TYPE_BOOL, ITEM(res_job.UpdateBvfsCache), 0, CFG_ITEM_DEFAULT, "false", "17.4.2-",
+     "Update the bvfs cache in the background when a backup job terminates successfully, so it is ready for browsing and restores." },
    { NULL, 0, { 0 }, 0, 0, NULL, NULL, NULL }
 };
 
@@ -2031,6 +2036,24 @@ bool FILESETRES::print_config(POOL_MEM &buff, bool hide_sensitive_data, bool ver
                      }
                      pm_strcat(cfg_str, "\n");
                      break;
+                  case 'T':                 /* compression threads */
+                     indent_config_item(cfg_str, 3, "CompressionThreads = ");
+                     p++;                   /* skip T */
+                     for (; *p && *p != ':'; p++) {
+                        Mmsg(temp, "%c", *p);
+                        pm_strcat(cfg_str, temp.c_str());
+                     }
+                     pm_strcat(cfg_str, "\n");
+                     break;
+                  case 'L':                 /* walker threads */
+                     indent_config_item(cfg_str, 3, "WalkerThreads = ");
+                     p++;                   /* skip L */
+                     for (; *p && *p != ':'; p++) {
+                        Mmsg(temp, "%c", *p);
+                        pm_strcat(cfg_str, temp.c_str());
+                     }
+                     pm_strcat(cfg_str, "\n");
+                     break;
                   case 'R':                 /* Resource forks and Finder Info */
                      indent_config_item(cfg_str, 3, "HFSPlusSupport = Yes\n");
                      break;
@@ -2134,6 +2157,12 @@ bool FILESETRES::print_config(POOL_MEM &buff, bool hide_sensitive_data, bool ver
                            break;
                         }
                         break;
+                     case 's':
+                        p++;                /* skip s */
+                        Mmsg(temp, "ZSTD%d\n", (p[0] - '0') * 10 + (p[1] - '0'));
+                        pm_strcat(cfg_str, temp.c_str());
+                        p++;                /* skip first level digit */
+                        break;
                      default:
                         Emsg1(M_ERROR, 0, _("Unknown compression include/exclude option: %c\n"), *p);
                         break;
@@ -136,6 +136,7 @@ public:
    uint32_t subscriptions_used;       /* Number of subscribtions used */
    uint32_t jcr_watchdog_time;        /* Absolute time after which a Job gets terminated regardless of its progress */
    uint32_t stats_collect_interval;   /* Statistics collect interval in seconds */
+   uint32_t stats_flush_interval;     /* Statistics flush interval in seconds */
    char *verid;                       /* Custom Id to print in version command */
    char *secure_erase_cmdline;        /* Cmdline to execute to perform secure erase of file */
    char *log_timestamp_format;        /* Timestamp format to use in generic logging messages */
@@ -443,6 +444,7 @@ public:
    bool IgnoreDuplicateJobChecking;   /**< Ignore Duplicate Job Checking */
    bool SaveFileHist;                 /**< Ability to disable File history saving for certain protocols */
    bool AlwaysIncremental;            /**< Always incremental with regular consolidation */
+   bool UpdateBvfsCache;              /**< Update the bvfs cache at job end */
 
    runtime_job_status_t *rjs;         /**< Runtime Job Status */
 
@@ -103,6 +103,8 @@ RES_ITEM options_items[] = {
    { "Shadowing", CFG_TYPE_OPTION, { 0 }, 0, 0, NULL, NULL, NULL },
    { "AutoExclude", CFG_TYPE_OPTION, { 0 }, 0, 0, NULL, NULL, NULL },
    { "ForceEncryption", CFG_TYPE_OPTION, { 0 }, 0, 0, NULL, NULL, NULL },
+   { "CompressionThreads", CFG_TYPE_OPTION, { 0 }, 0, 0, NULL, NULL, NULL },
+   { "WalkerThreads", CFG_TYPE_OPTION, { 0 }, 0, 0, NULL, NULL, NULL },
    { "Meta", CFG_TYPE_META, { 0 }, 0, 0, 0, NULL, NULL },
    { NULL, 0, { 0 }, 0, 0, NULL, NULL, NULL }
 };
@@ -231,6 +233,22 @@ static void scan_include_options(LEX *lc, int keyword, char *opts, int optlen)
       bstrncat(opts, lc->str, optlen);
       bstrncat(opts, ":", optlen);         /* terminate it */
       Dmsg3(900, "Catopts=%s option=%s optlen=%d\n", opts, option,optlen);
+   } else if (keyword == INC_KW_COMPRESSION_THREADS) { /* special case */
+      if (!is_an_integer(lc->str)) {
+         scan_err1(lc, _("Expected a compression threads positive integer, got: %s:"), lc->str);
+      }
+      bstrncat(opts, "T", optlen);         /* indicate compression threads */
+      bstrncat(opts, lc->str, optlen);
+      bstrncat(opts, ":", optlen);         /* terminate it */
+      Dmsg3(900, "Catopts=%s option=%s optlen=%d\n", opts, option,optlen);
+   } else if (keyword == INC_KW_WALKER_THREADS) { /* special case */
+      if (!is_an_integer(lc->str)) {
+         scan_err1(lc, _("Expected a walker threads positive integer, got: %s:"), lc->str);
+      }
+      bstrncat(opts, "L", optlen);         /* indicate walker threads */
+      bstrncat(opts, lc->str, optlen);
+      bstrncat(opts, ":", optlen);         /* terminate it */
+      Dmsg3(900, "Catopts=%s option=%s optlen=%d\n", opts, option,optlen);
    } else if (keyword == INC_KW_SIZE) { /* special case */
       if (!parse_size_match(lc->str, &size_matching)) {
          scan_err1(lc, _("Expected a parseable size, got: %s:"), lc->str);
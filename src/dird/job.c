@@ -196,6 +196,7 @@ bool setup_job(JCR *jcr, bool suppress_output)
    }
 
    jcr->JobId = jcr->jr.JobId;
+   register_jcr_jobid(jcr);
    Dmsg4(100, "Created job record JobId=%d Name=%s Type=%c Level=%c\n",
          jcr->JobId, jcr->Job, jcr->jr.JobType, jcr->jr.JobLevel);
 
@@ -625,6 +626,14 @@ static void *job_thread(void *arg)
       break;
    }
 
+   /*
+    * Fill the bvfs cache of successful backups in the background.
+    */
+   if (jcr->is_JobType(JT_BACKUP) &&
+       (jcr->is_JobStatus(JS_Terminated) || jcr->is_JobStatus(JS_Warnings))) {
+      queue_bvfs_update(jcr);
+   }
+
    /*
     * Check for subscriptions and issue a warning when exceeded.
     */
@@ -1524,6 +1533,8 @@ void dird_free_jcr(JCR *jcr)
 {
    Dmsg0(200, "Start dird free_jcr\n");
 
+   release_attribute_despool(jcr);
+
    if (jcr->mig_jcr) {
       free_jcr(jcr->mig_jcr);
       jcr->mig_jcr = NULL;
@@ -77,7 +77,7 @@ static inline char *lookup_fileindex(JCR *jcr, int32_t FileIndex)
          }
       }
 
-      node = next_tree_node(node);
+      node = next_tree_node(jcr->restore_tree_root, node);
    }
 
    return NULL;
@@ -202,7 +202,7 @@ static inline int set_files_to_restore(JCR *jcr, struct ndm_job_param *job, int3
          }
       }
 
-      node = next_tree_node(node);
+      node = next_tree_node(jcr->restore_tree_root, node);
    }
 
    return cnt;
@@ -83,10 +83,17 @@ bool open_bootstrap_file(JCR *jcr, bootstrap_info &info);
 bool send_bootstrap_file(JCR *jcr, BSOCK *sock, bootstrap_info &info);
 void close_bootstrap_file(bootstrap_info &info);
 
+/* bvfs_update.c */
+void queue_bvfs_update(JCR *jcr);
+void term_bvfs_update(void);
+
 /* catreq.c */
 void catalog_request(JCR *jcr, BSOCK *bs);
 void catalog_update(JCR *jcr, BSOCK *bs);
 bool despool_attributes_from_file(JCR *jcr, const char *file);
+void wait_for_attribute_despool(JCR *jcr);
+void release_attribute_despool(JCR *jcr);
+void term_attribute_despool(void);
 
 /* consolidate.c */
 bool do_consolidate_init(JCR *jcr);
@@ -316,6 +323,7 @@ void term_scheduler();
 /* socket_server.c */
 void start_socket_server(dlist *addrs);
 void stop_socket_server();
+BNET_REACTOR *get_console_reactor();
 
 /* stats.c */
 int start_statistics_thread(void);
@@ -463,6 +471,7 @@ void list_dir_status_header(UAContext *ua);
 /* ua_tree.c */
 bool user_select_files_from_tree(TREE_CTX *tree);
 int insert_tree_handler(void *ctx, int num_fields, char **row);
+void lazy_tree_load_handler(TREE_ROOT *root, TREE_NODE *node, void *ctx);
 
 /* ua_prune.c */
 bool prune_files(UAContext *ua, CLIENTRES *client, POOLRES *pool);
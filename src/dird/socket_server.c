@@ -42,6 +42,7 @@ static workq_t socket_workq;
 static alist *sock_fds = NULL;
 static pthread_t tcp_server_tid;
 static CONNECTION_POOL *client_connections = NULL;
+static BNET_REACTOR *console_reactor = NULL;
 
 struct s_addr_port {
    char *addr;
@@ -59,6 +60,11 @@ CONNECTION_POOL *get_client_connections()
    return client_connections;
 }
 
+BNET_REACTOR *get_console_reactor()
+{
+   return console_reactor;
+}
+
 static void *handle_connection_request(void *arg)
 {
    BSOCK *bs = (BSOCK *)arg;
@@ -130,6 +136,18 @@ void start_socket_server(dlist *addrs)
    if (client_connections == NULL) {
       client_connections = New(CONNECTION_POOL());
    }
+
+   /*
+    * Idle console sessions are parked in the reactor between commands,
+    * the workers executing the commands share the MaxConnections limit.
+    */
+   if (console_reactor == NULL) {
+      console_reactor = New(BNET_REACTOR());
+      if (!console_reactor->start(me->MaxConnections)) {
+         delete console_reactor;
+         console_reactor = NULL;
+      }
+   }
    if ((status = pthread_create(&tcp_server_tid, NULL, connect_thread, (void *)myaddrs)) != 0) {
       berrno be;
       Emsg1(M_ABORT, 0, _("Cannot create UA thread: %s\n"), be.bstrerror(status));
@@ -146,6 +164,11 @@ void stop_socket_server()
       delete sock_fds;
       sock_fds = NULL;
    }
+   /*
+    * The console reactor is not stopped here: by now the catalog pool and
+    * the resources are gone, so parked consoles can no longer be shut down
+    * cleanly. Like consoles busy in a command they end with the process.
+    */
    if (client_connections) {
       delete(client_connections);
    }
@@ -41,13 +41,60 @@ static char TapeAlerts[] =
 static char JobStats[] =
    "Jobstats [%lld]: JobId=%ld, JobFiles=%lu, JobBytes=%llu, DevName=%s";
 
+/*
+ * Storage daemons that know about binary statistics records answer this
+ * with one message per device or job holding all its samples, see
+ * stored/sd_stats.c. Older ones ignore the argument and send text lines.
+ * A binary record starts with its type in network byte order and so with
+ * a NUL byte.
+ */
+static char statsbinarycmd[] = "stats binary";
+
+#define STATS_RECORD_DEVICE 1
+#define STATS_RECORD_TAPEALERT 2
+#define STATS_RECORD_JOB 3
+
+#define DEVICE_SAMPLE_SIZE 84
+#define TAPEALERT_SAMPLE_SIZE 16
+#define JOB_SAMPLE_SIZE 21             /* without the device name */
+
+#define STATS_POLL_WORKERS 8
+#define STATS_MAX_PENDING 100000       /* flush early when this many samples are pending */
+
+/*
+ * A sample received from a storage daemon waiting to be written to the catalog.
+ */
+struct stats_sample {
+   int type;                          /* STATS_RECORD_* */
+   DBId_t StorageId;
+   char DevName[MAX_NAME_LENGTH];
+   union {
+      DEVICE_STATS_DBR dsr;
+      TAPEALERT_STATS_DBR tsr;
+      JOB_STATS_DBR jsr;
+   };
+};
+
+/*
+ * A storage daemon to poll. A reload may free the Storage resource while
+ * it is polled, so what is needed to connect is copied into the item.
+ */
+struct stats_poll_item {
+   STORERES store;                    /* Copy of the Storage resource to poll */
+};
+
 /* Static globals */
 static bool quit = false;
 static bool statistics_initialized = false;
 static bool need_flush = true;
+static bool workq_running = false;
+static int polls_running = 0;
+static workq_t poll_workq;
+static alist *pending_samples = NULL;
 static pthread_t statistics_tid;
 static pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
 static pthread_cond_t wait_for_next_run_cond = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t polls_done_cond = PTHREAD_COND_INITIALIZER;
 
 /*
  * Cache the last lookup of a DeviceId.
@@ -99,6 +146,255 @@ bail_out:
    return false;
 }
 
+/*
+ * Remember a sample until the next flush. The DeviceId is looked up
+ * when the samples are written as that needs the catalog.
+ */
+static void queue_sample(int type, DBId_t StorageId, const char *DevName, void *dbr, size_t size)
+{
+   stats_sample *sample;
+
+   sample = (stats_sample *)malloc(sizeof(stats_sample));
+   memset(sample, 0, sizeof(stats_sample));
+   sample->type = type;
+   sample->StorageId = StorageId;
+   bstrncpy(sample->DevName, DevName, sizeof(sample->DevName));
+   memcpy(&sample->dsr, dbr, size);
+
+   P(mutex);
+   if (!pending_samples) {
+      pending_samples = New(alist(1000, owned_by_alist));
+   }
+   pending_samples->append(sample);
+   V(mutex);
+}
+
+static inline void queue_device_statistics(DBId_t StorageId, const char *DevName, DEVICE_STATS_DBR *dsr)
+{
+   queue_sample(STATS_RECORD_DEVICE, StorageId, DevName, dsr, sizeof(DEVICE_STATS_DBR));
+}
+
+static inline void queue_tapealert_statistics(DBId_t StorageId, const char *DevName, TAPEALERT_STATS_DBR *tsr)
+{
+   queue_sample(STATS_RECORD_TAPEALERT, StorageId, DevName, tsr, sizeof(TAPEALERT_STATS_DBR));
+}
+
+static inline void queue_job_statistics(DBId_t StorageId, const char *DevName, JOB_STATS_DBR *jsr)
+{
+   queue_sample(STATS_RECORD_JOB, StorageId, DevName, jsr, sizeof(JOB_STATS_DBR));
+}
+
+static inline int pending_size()
+{
+   int size;
+
+   P(mutex);
+   size = pending_samples ? pending_samples->size() : 0;
+   V(mutex);
+
+   return size;
+}
+
+/*
+ * Write all pending samples to the catalog, each kind with as few
+ * INSERTs as possible.
+ */
+static void flush_statistics(JCR *jcr)
+{
+   alist *samples;
+   stats_sample *sample;
+   int num_dsr = 0, num_tsr = 0, num_jsr = 0;
+   DEVICE_STATS_DBR *dsr;
+   TAPEALERT_STATS_DBR *tsr;
+   JOB_STATS_DBR *jsr;
+
+   P(mutex);
+   samples = pending_samples;
+   pending_samples = NULL;
+   V(mutex);
+
+   if (!samples) {
+      return;
+   }
+
+   Dmsg1(200, "statistics_thread_runner: flushing %d samples\n", samples->size());
+
+   dsr = (DEVICE_STATS_DBR *)malloc(samples->size() * sizeof(DEVICE_STATS_DBR));
+   tsr = (TAPEALERT_STATS_DBR *)malloc(samples->size() * sizeof(TAPEALERT_STATS_DBR));
+   jsr = (JOB_STATS_DBR *)malloc(samples->size() * sizeof(JOB_STATS_DBR));
+
+   foreach_alist(sample, samples) {
+      switch (sample->type) {
+      case STATS_RECORD_DEVICE:
+         if (lookup_device(jcr, sample->DevName, sample->StorageId, &sample->dsr.DeviceId)) {
+            dsr[num_dsr++] = sample->dsr;
+         }
+         break;
+      case STATS_RECORD_TAPEALERT:
+         if (lookup_device(jcr, sample->DevName, sample->StorageId, &sample->tsr.DeviceId)) {
+            tsr[num_tsr++] = sample->tsr;
+         }
+         break;
+      case STATS_RECORD_JOB:
+         if (lookup_device(jcr, sample->DevName, sample->StorageId, &sample->jsr.DeviceId)) {
+            jsr[num_jsr++] = sample->jsr;
+         }
+         break;
+      default:
+         break;
+      }
+   }
+
+   if (num_dsr > 0) {
+      jcr->db->create_device_statistics(jcr, dsr, num_dsr);
+   }
+   if (num_tsr > 0) {
+      jcr->db->create_tapealert_statistics(jcr, tsr, num_tsr);
+   }
+   if (num_jsr > 0) {
+      jcr->db->create_job_statistics(jcr, jsr, num_jsr);
+   }
+
+   free(dsr);
+   free(tsr);
+   free(jsr);
+   delete samples;
+}
+
+/*
+ * Unserialize a string of a binary statistics record checking it fits
+ * into both the message and the destination.
+ */
+static inline bool unser_stats_string(uint8_t **ptr, uint8_t *end, char *dest, int max)
+{
+   int len;
+
+   for (len = 0; *ptr + len < end && (*ptr)[len]; len++) {
+      if (len >= max - 1) {
+         return false;
+      }
+   }
+   if (*ptr + len >= end) {
+      return false;
+   }
+   memcpy(dest, *ptr, len + 1);
+   *ptr += len + 1;
+
+   return true;
+}
+
+/*
+ * Queue the samples of a binary statistics record.
+ * Returns: false when the record is malformed.
+ */
+static bool queue_binary_statistics(DBId_t StorageId, BSOCK *sd)
+{
+   uint32_t type, cnt, JobId;
+   uint64_t value;
+   uint8_t *end;
+   char DevName[MAX_NAME_LENGTH];
+   unser_declare;
+
+   if (sd->msglen < 12) {
+      return false;
+   }
+
+   unser_begin(sd->msg, sd->msglen);
+   end = (uint8_t *)sd->msg + sd->msglen;
+   unser_uint32(type);
+
+   switch (type) {
+   case STATS_RECORD_DEVICE: {
+      DEVICE_STATS_DBR dsr;
+
+      if (!unser_stats_string(&ser_ptr, end, DevName, sizeof(DevName)) || end - ser_ptr < 4) {
+         return false;
+      }
+      unser_uint32(cnt);
+      if (cnt > (uint32_t)(end - ser_ptr) / DEVICE_SAMPLE_SIZE) {
+         return false;
+      }
+
+      for (uint32_t i = 0; i < cnt; i++) {
+         memset(&dsr, 0, sizeof(dsr));
+         unser_uint64(value);
+         dsr.SampleTime = (time_t)value;
+         unser_uint64(dsr.ReadBytes);
+         unser_uint64(dsr.WriteBytes);
+         unser_uint64(dsr.SpoolSize);
+         unser_uint32(dsr.NumWaiting);
+         unser_uint32(dsr.NumWriters);
+         unser_uint64(dsr.ReadTime);
+         unser_uint64(dsr.WriteTime);
+         unser_uint32(dsr.MediaId);
+         unser_uint64(dsr.VolCatBytes);
+         unser_uint64(dsr.VolCatFiles);
+         unser_uint64(dsr.VolCatBlocks);
+
+         Dmsg5(200, "New Devstats [%lld]: Device=%s Read=%llu, Write=%llu, SpoolSize=%llu\n",
+               (int64_t)dsr.SampleTime, DevName, dsr.ReadBytes, dsr.WriteBytes, dsr.SpoolSize);
+
+         queue_device_statistics(StorageId, DevName, &dsr);
+      }
+      break;
+   }
+   case STATS_RECORD_TAPEALERT: {
+      TAPEALERT_STATS_DBR tsr;
+
+      if (!unser_stats_string(&ser_ptr, end, DevName, sizeof(DevName)) || end - ser_ptr < 4) {
+         return false;
+      }
+      unser_uint32(cnt);
+      if (cnt > (uint32_t)(end - ser_ptr) / TAPEALERT_SAMPLE_SIZE) {
+         return false;
+      }
+
+      for (uint32_t i = 0; i < cnt; i++) {
+         memset(&tsr, 0, sizeof(tsr));
+         unser_uint64(value);
+         tsr.SampleTime = (time_t)value;
+         unser_uint64(tsr.AlertFlags);
+
+         Dmsg3(200, "New stats [%lld]: Device %s TapeAlert %llu\n",
+               (int64_t)tsr.SampleTime, DevName, tsr.AlertFlags);
+
+         queue_tapealert_statistics(StorageId, DevName, &tsr);
+      }
+      break;
+   }
+   case STATS_RECORD_JOB: {
+      JOB_STATS_DBR jsr;
+
+      unser_uint32(JobId);
+      unser_uint32(cnt);
+      for (uint32_t i = 0; i < cnt; i++) {
+         if (end - ser_ptr < JOB_SAMPLE_SIZE) {
+            return false;
+         }
+         memset(&jsr, 0, sizeof(jsr));
+         jsr.JobId = JobId;
+         unser_uint64(value);
+         jsr.SampleTime = (time_t)value;
+         unser_uint32(jsr.JobFiles);
+         unser_uint64(jsr.JobBytes);
+         if (!unser_stats_string(&ser_ptr, end, DevName, sizeof(DevName))) {
+            return false;
+         }
+
+         Dmsg5(200, "New Jobstats [%lld]: JobId %ld, JobFiles %lu, JobBytes %llu, DevName %s\n",
+               (int64_t)jsr.SampleTime, (long)jsr.JobId, (unsigned long)jsr.JobFiles, jsr.JobBytes, DevName);
+
+         queue_job_statistics(StorageId, DevName, &jsr);
+      }
+      break;
+   }
+   default:
+      return false;
+   }
+
+   return true;
+}
+
 /**
  * Wait for the next run.
  */
@@ -121,6 +417,292 @@ static inline void wait_for_next_run()
    V(mutex);
 }
 
+/*
+ * Retrieve the statistics from a connected storage daemon.
+ */
+static void receive_statistics(JCR *jcr, DBId_t StorageId, BSOCK *sd)
+{
+   if (!sd->fsend(statsbinarycmd)) {
+      return;
+   }
+
+   while (bnet_recv(sd) >= 0) {
+      if (sd->msglen > 0 && sd->msg[0] == '\0') {
+         if (!queue_binary_statistics(StorageId, sd)) {
+            Jmsg1(jcr, M_ERROR, 0, _("Malformed binary statistics message of %d bytes\n"), sd->msglen);
+         }
+         continue;
+      }
+
+      Dmsg1(200, "<stored: %s", sd->msg);
+      if (bstrncmp(sd->msg, "Devicestats", 10)) {
+         POOL_MEM DevName(PM_NAME);
+         DEVICE_STATS_DBR dsr;
+
+         memset(&dsr, 0, sizeof(dsr));
+         if (sscanf(sd->msg, DevStats, &dsr.SampleTime, DevName.c_str(), &dsr.ReadBytes,
+                    &dsr.WriteBytes, &dsr.SpoolSize, &dsr.NumWaiting, &dsr.NumWriters,
+                    &dsr.ReadTime, &dsr.WriteTime, &dsr.MediaId,
+                    &dsr.VolCatBytes, &dsr.VolCatFiles, &dsr.VolCatBlocks) == 13) {
+
+            Dmsg5(200, "New Devstats [%lld]: Device=%s Read=%llu, Write=%llu, SpoolSize=%llu,\n",
+                  dsr.SampleTime, DevName.c_str(), dsr.ReadBytes, dsr.WriteBytes, dsr.SpoolSize);
+            Dmsg4(200, "NumWaiting=%lu, NumWriters=%lu, ReadTime=%lld, WriteTime=%lld,\n",
+                  dsr.NumWaiting, dsr.NumWriters, dsr.ReadTime, dsr.WriteTime);
+            Dmsg4(200, "MediaId=%ld, VolBytes=%llu, VolFiles=%llu, VolBlocks=%llu\n",
+                  dsr.MediaId, dsr.VolCatBytes, dsr.VolCatFiles, dsr.VolCatBlocks);
+
+            queue_device_statistics(StorageId, DevName.c_str(), &dsr);
+         } else {
+            Jmsg1(jcr, M_ERROR, 0, _("Malformed message: %s\n"), sd->msg);
+         }
+      } else if (bstrncmp(sd->msg, "Tapealerts", 10)) {
+         POOL_MEM DevName(PM_NAME);
+         TAPEALERT_STATS_DBR tsr;
+
+         memset(&tsr, 0, sizeof(tsr));
+         if (sscanf(sd->msg, TapeAlerts, &tsr.SampleTime, DevName.c_str(), &tsr.AlertFlags) == 3) {
+            unbash_spaces(DevName);
+
+            Dmsg3(200, "New stats [%lld]: Device %s TapeAlert %llu\n",
+                  tsr.SampleTime, DevName.c_str(), tsr.AlertFlags);
+
+            queue_tapealert_statistics(StorageId, DevName.c_str(), &tsr);
+         } else {
+            Jmsg1(jcr, M_ERROR, 0, _("Malformed message: %s\n"), sd->msg);
+         }
+      } else if (bstrncmp(sd->msg, "Jobstats", 8)) {
+         POOL_MEM DevName(PM_NAME);
+         JOB_STATS_DBR jsr;
+
+         memset(&jsr, 0, sizeof(jsr));
+         if (sscanf(sd->msg, JobStats, &jsr.SampleTime, &jsr.JobId, &jsr.JobFiles, &jsr.JobBytes, DevName.c_str()) == 5) {
+            unbash_spaces(DevName);
+
+            Dmsg5(200, "New Jobstats [%lld]: JobId %ld, JobFiles %lu, JobBytes %llu, DevName %s\n",
+                  jsr.SampleTime, jsr.JobId, jsr.JobFiles, jsr.JobBytes, DevName.c_str());
+
+            queue_job_statistics(StorageId, DevName.c_str(), &jsr);
+         } else {
+            Jmsg1(jcr, M_ERROR, 0, _("Malformed message: %s\n"), sd->msg);
+         }
+      }
+   }
+}
+
+static inline char *copy_string(const char *str)
+{
+   return (str) ? bstrdup(str) : NULL;
+}
+
+/*
+ * Copy the connection settings of a Storage resource, called with the resources locked.
+ */
+static stats_poll_item *new_poll_item(STORERES *store)
+{
+   char *cn;
+   stats_poll_item *item;
+
+   item = (stats_poll_item *)malloc(sizeof(stats_poll_item));
+   memset(item, 0, sizeof(stats_poll_item));
+
+   item->store.hdr.name = bstrdup(store->name());
+   item->store.address = copy_string(store->address);
+   item->store.SDport = store->SDport;
+   item->store.heartbeat_interval = store->heartbeat_interval;
+   item->store.StorageId = store->StorageId;
+   item->store.password.encoding = store->password.encoding;
+   item->store.password.value = copy_string(store->password.value);
+
+   item->store.tls.authenticate = store->tls.authenticate;
+   item->store.tls.enable = store->tls.enable;
+   item->store.tls.require = store->tls.require;
+   item->store.tls.verify_peer = store->tls.verify_peer;
+   item->store.tls.ca_certfile = copy_string(store->tls.ca_certfile);
+   item->store.tls.ca_certdir = copy_string(store->tls.ca_certdir);
+   item->store.tls.crlfile = copy_string(store->tls.crlfile);
+   item->store.tls.certfile = copy_string(store->tls.certfile);
+   item->store.tls.keyfile = copy_string(store->tls.keyfile);
+   item->store.tls.cipherlist = copy_string(store->tls.cipherlist);
+   if (store->tls.allowed_cns) {
+      item->store.tls.allowed_cns = New(alist(5, owned_by_alist));
+      foreach_alist(cn, store->tls.allowed_cns) {
+         item->store.tls.allowed_cns->append(bstrdup(cn));
+      }
+   }
+
+   return item;
+}
+
+/*
+ * The TLS context of the Storage resource goes away with it,
+ * so the copy gets a context of its own.
+ */
+static bool init_poll_item_tls(JCR *jcr, stats_poll_item *item)
+{
+   tls_t *tls = &item->store.tls;
+   bool need_tls = tls->enable || tls->authenticate;
+
+   if (!need_tls && !tls->require) {
+      return true;
+   }
+
+   tls->ctx = new_tls_context(tls->ca_certfile,
+                              tls->ca_certdir,
+                              tls->crlfile,
+                              tls->certfile,
+                              tls->keyfile,
+                              NULL,
+                              NULL,
+                              NULL,
+                              tls->cipherlist,
+                              tls->verify_peer);
+   if (!tls->ctx) {
+      Jmsg(jcr, M_ERROR, 0, _("Failed to initialize TLS context for Storage \"%s\".\n"),
+           item->store.name());
+      return false;
+   }
+   set_tls_enable(tls->ctx, need_tls);
+   set_tls_require(tls->ctx, tls->require);
+
+   return true;
+}
+
+static void free_poll_item(stats_poll_item *item)
+{
+   tls_t *tls = &item->store.tls;
+
+   if (tls->ctx) {
+      free_tls_context(tls->ctx);
+   }
+   if (tls->allowed_cns) {
+      delete tls->allowed_cns;
+   }
+   bfree_and_null(tls->ca_certfile);
+   bfree_and_null(tls->ca_certdir);
+   bfree_and_null(tls->crlfile);
+   bfree_and_null(tls->certfile);
+   bfree_and_null(tls->keyfile);
+   bfree_and_null(tls->cipherlist);
+   if (item->store.password.value) {
+      memset(item->store.password.value, 0, strlen(item->store.password.value));
+      free(item->store.password.value);
+   }
+   bfree_and_null(item->store.address);
+   bfree_and_null(item->store.hdr.name);
+   free(item);
+}
+
+/*
+ * Work queue engine polling one storage daemon. Each poll uses its own
+ * JCR so slow storage daemons don't hold up the others.
+ */
+static void *poll_storage_engine(void *arg)
+{
+   JCR *jcr;
+   BSOCK *sd;
+   stats_poll_item *item = (stats_poll_item *)arg;
+
+   jcr = new_control_jcr("*StatisticsCollector*", JT_SYSTEM);
+
+   /*
+    * Connect using the copy of the resource, so we don't hold the
+    * resource lock while waiting for the storage daemon.
+    *
+    * Try connecting 2 times with a max time to wait of 1 seconds.
+    * As the stored will cache the stats anyway we can always try
+    * collecting things in the next run.
+    */
+   if (!init_poll_item_tls(jcr, item)) {
+      goto bail_out;
+   }
+
+   jcr->res.rstore = &item->store;
+   if (!connect_to_storage_daemon(jcr, 2, 1, false)) {
+      goto bail_out;
+   }
+
+   sd = jcr->store_bsock;
+   receive_statistics(jcr, item->store.StorageId, sd);
+
+   /*
+    * Disconnect.
+    */
+   sd->close();
+   delete sd;
+   jcr->store_bsock = NULL;
+
+bail_out:
+   jcr->res.rstore = NULL;
+   free_jcr(jcr);
+   free_poll_item(item);
+
+   P(mutex);
+   if (--polls_running == 0) {
+      pthread_cond_broadcast(&polls_done_cond);
+   }
+   V(mutex);
+
+   return NULL;
+}
+
+/*
+ * Poll all storage daemons we collect statistics from concurrently
+ * and wait for all of them to answer.
+ */
+static void poll_storages(JCR *jcr)
+{
+   int status;
+   STORERES *store;
+   stats_poll_item *item;
+
+   if (!workq_running) {
+      if ((status = workq_init(&poll_workq, STATS_POLL_WORKERS, poll_storage_engine)) != 0) {
+         berrno be;
+         Jmsg1(jcr, M_ERROR, 0, _("Could not init statistics work queue: ERR=%s\n"), be.bstrerror(status));
+         return;
+      }
+      workq_running = true;
+   }
+
+   LockRes();
+   foreach_res(store, R_STORAGE) {
+      if (!store->collectstats) {
+         continue;
+      }
+
+      switch (store->Protocol) {
+      case APT_NATIVE:
+         break;
+      default:
+         continue;
+      }
+
+      item = new_poll_item(store);
+
+      P(mutex);
+      polls_running++;
+      V(mutex);
+
+      if ((status = workq_add(&poll_workq, item, NULL, 0)) != 0) {
+         berrno be;
+
+         P(mutex);
+         polls_running--;
+         V(mutex);
+         free_poll_item(item);
+         Jmsg1(jcr, M_ERROR, 0, _("Could not queue statistics poll: ERR=%s\n"), be.bstrerror(status));
+      }
+   }
+   UnlockRes();
+
+   P(mutex);
+   while (polls_running > 0) {
+      pthread_cond_wait(&polls_done_cond, &mutex);
+   }
+   V(mutex);
+}
+
 /**
  * Entry point for a separate statistics thread.
  */
@@ -128,11 +710,11 @@ extern "C"
 void *statistics_thread_runner(void *arg)
 {
    JCR *jcr;
+   bool flush;
    utime_t now;
-   POOL_MEM current_store(PM_NAME);
+   utime_t last_flush = 0;
 
    memset(&cached_device, 0, sizeof(struct cached_device));
-   pm_strcpy(current_store, "");
 
    /*
     * Create a dummy JCR for the statistics thread.
@@ -165,6 +747,7 @@ void *statistics_thread_runner(void *arg)
     */
    while (!quit) {
       now = (utime_t)time(NULL);
+      flush = false;
 
       Dmsg1(200, "statistics_thread_runner: Doing work at %ld\n", now);
 
@@ -182,6 +765,7 @@ void *statistics_thread_runner(void *arg)
              */
             Dmsg0(200, "statistics_thread_runner: flushing pending statistics\n");
             need_flush = false;
+            flush = true;
          }
       } else {
          /*
@@ -190,146 +774,32 @@ void *statistics_thread_runner(void *arg)
          need_flush = true;
       }
 
-      while (1) {
-         BSOCK *sd;
-         STORERES *store;
-         int64_t StorageId;
-
-         LockRes();
-         if ((current_store.c_str())[0]) {
-            store = (STORERES *)GetResWithName(R_STORAGE, current_store.c_str());
-         } else {
-            store = NULL;
-         }
-
-         store = (STORERES *)GetNextRes(R_STORAGE, (RES *)store);
-         if (!store) {
-            pm_strcpy(current_store, "");
-            UnlockRes();
-            break;
-         }
-
-         pm_strcpy(current_store, store->name());
-         if (!store->collectstats) {
-            UnlockRes();
-            continue;
-         }
-
-         switch (store->Protocol) {
-         case APT_NATIVE:
-            break;
-         default:
-            UnlockRes();
-            continue;
-         }
-
-         /*
-          * Try connecting 2 times with a max time to wait of 1 seconds.
-          * We don't want to lock the resources to long. And as the stored
-          * will cache the stats anyway we can always try collecting things
-          * in the next run.
-          */
-         jcr->res.rstore = store;
-         if (!connect_to_storage_daemon(jcr, 2, 1, false)) {
-            UnlockRes();
-            continue;
-         }
-
-         StorageId = store->StorageId;
-         sd = jcr->store_bsock;
-
-         UnlockRes();
-
-         /*
-          * Do our work retrieving the statistics from the remote SD.
-          */
-         if (sd->fsend("stats")) {
-            while (bnet_recv(sd) >= 0) {
-               Dmsg1(200, "<stored: %s", sd->msg);
-               if (bstrncmp(sd->msg, "Devicestats", 10)) {
-                  POOL_MEM DevName(PM_NAME);
-                  DEVICE_STATS_DBR dsr;
-
-                  memset(&dsr, 0, sizeof(dsr));
-                  if (sscanf(sd->msg, DevStats, &dsr.SampleTime, DevName.c_str(), &dsr.ReadBytes,
-                             &dsr.WriteBytes, &dsr.SpoolSize, &dsr.NumWaiting, &dsr.NumWriters,
-                             &dsr.ReadTime, &dsr.WriteTime, &dsr.MediaId,
-                             &dsr.VolCatBytes, &dsr.VolCatFiles, &dsr.VolCatBlocks) == 13) {
-
-                     Dmsg5(200, "New Devstats [%lld]: Device=%s Read=%llu, Write=%llu, SpoolSize=%llu,\n",
-                           dsr.SampleTime, DevName.c_str(), dsr.ReadBytes, dsr.WriteBytes, dsr.SpoolSize);
-                     Dmsg4(200, "NumWaiting=%lu, NumWriters=%lu, ReadTime=%lld, WriteTime=%lld,\n",
-                           dsr.NumWaiting, dsr.NumWriters, dsr.ReadTime, dsr.WriteTime);
-                     Dmsg4(200, "MediaId=%ld, VolBytes=%llu, VolFiles=%llu, VolBlocks=%llu\n",
-                           dsr.MediaId, dsr.VolCatBytes, dsr.VolCatFiles, dsr.VolCatBlocks);
-
-                     if (!lookup_device(jcr, DevName.c_str(), StorageId, &dsr.DeviceId)) {
-                        continue;
-                     }
-
-                     if (!jcr->db->create_device_statistics(jcr, &dsr)) {
-                        continue;
-                     }
-                  } else {
-                     Jmsg1(jcr, M_ERROR, 0, _("Malformed message: %s\n"), sd->msg);
-                  }
-               } else if (bstrncmp(sd->msg, "Tapealerts", 10)) {
-                  POOL_MEM DevName(PM_NAME);
-                  TAPEALERT_STATS_DBR tsr;
-
-                  memset(&tsr, 0, sizeof(tsr));
-                  if (sscanf(sd->msg, TapeAlerts, &tsr.SampleTime, DevName.c_str(), &tsr.AlertFlags) == 3) {
-                     unbash_spaces(DevName);
-
-                     Dmsg3(200, "New stats [%lld]: Device %s TapeAlert %llu\n",
-                           tsr.SampleTime, DevName.c_str(), tsr.AlertFlags);
-
-                     if (!lookup_device(jcr, DevName.c_str(), StorageId, &tsr.DeviceId)) {
-                        continue;
-                     }
-
-                     if (!jcr->db->create_tapealert_statistics(jcr, &tsr)) {
-                        continue;
-                     }
-                  } else {
-                     Jmsg1(jcr, M_ERROR, 0, _("Malformed message: %s\n"), sd->msg);
-                  }
-               } else if (bstrncmp(sd->msg, "Jobstats", 8)) {
-                  POOL_MEM DevName(PM_NAME);
-                  JOB_STATS_DBR jsr;
-
-                  memset(&jsr, 0, sizeof(jsr));
-                  if (sscanf(sd->msg, JobStats, &jsr.SampleTime, &jsr.JobId, &jsr.JobFiles, &jsr.JobBytes, DevName.c_str()) == 5) {
-                     unbash_spaces(DevName);
-
-                     Dmsg5(200, "New Jobstats [%lld]: JobId %ld, JobFiles %lu, JobBytes %llu, DevName %s\n",
-                           jsr.SampleTime, jsr.JobId, jsr.JobFiles, jsr.JobBytes, DevName.c_str());
-
-                     if (!lookup_device(jcr, DevName.c_str(), StorageId, &jsr.DeviceId)) {
-                        continue;
-                     }
-
-                     if (!jcr->db->create_job_statistics(jcr, &jsr)) {
-                        continue;
-                     }
-                  } else {
-                     Jmsg1(jcr, M_ERROR, 0, _("Malformed message: %s\n"), sd->msg);
-                  }
-               }
-            }
-         }
+      /*
+       * Do our work retrieving the statistics from the remote SDs.
+       */
+      poll_storages(jcr);
 
-         /*
-          * Disconnect.
-          */
-         jcr->store_bsock->close();
-         delete jcr->store_bsock;
-         jcr->store_bsock = NULL;
+      /*
+       * Write the collected samples to the catalog every Statistics Flush Interval
+       * seconds or when too many of them pile up.
+       */
+      if (flush ||
+          now - last_flush >= me->stats_flush_interval ||
+          pending_size() >= STATS_MAX_PENDING) {
+         flush_statistics(jcr);
+         last_flush = now;
       }
 
       wait_for_next_run();
    }
 
+   if (workq_running) {
+      workq_destroy(&poll_workq);
+      workq_running = false;
+   }
+
+   flush_statistics(jcr);
+
    db_sql_close_pooled_connection(jcr, jcr->db);
 
 bail_out:
@@ -141,6 +141,8 @@ public:
 /*
  * Context for insert_tree_handler()
  */
+class Bvfs;
+
 struct TREE_CTX {
    TREE_ROOT *root;                   /**< Root */
    TREE_NODE *node;                   /**< Current node */
@@ -152,6 +154,7 @@ struct TREE_CTX {
    uint32_t FileCount;                /**< Current count of files */
    uint32_t LastCount;                /**< Last count of files */
    uint32_t DeltaCount;               /**< Trigger for printing */
+   Bvfs *bvfs;                        /**< Bvfs used to load a lazy tree */
 };
 
 struct NAME_LIST {
@@ -193,6 +196,7 @@ struct RESTORE_CTX {
    int pnl;                           /**< Path length */
    bool found;
    bool all;                          /**< Mark all as default */
+   bool lazy;                         /**< Load the tree on demand using bvfs */
    NAME_LIST name_list;
 };
 
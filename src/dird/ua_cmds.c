@@ -344,7 +344,7 @@ static struct ua_cmdstruct commands[] = {
          "\tregexwhere=<regex> restoreclient=<client-name> backupformat=<format>\n"
          "\tpool=<pool-name> file=<filename> directory=<directory> before=<date>\n"
          "\tstrip_prefix=<prefix> add_prefix=<prefix> add_suffix=<suffix>\n"
-         "\tselect=<date> select before current copies done all"), false, true },
+         "\tselect=<date> select before current copies done all lazy"), false, true },
    { NT_("relabel"), relabel_cmd, _("Relabel a tape"),
      NT_("storage=<storage-name> oldvolume=<old-volume-name>\n"
          "\tvolume=<new-volume-name> pool=<pool-name> [ encrypt ]"), false, true },
@@ -35,6 +35,7 @@
 
 #include "bareos.h"
 #include "dird.h"
+#include "cats/bvfs.h"
 
 /* Imported functions */
 extern void print_bsr(UAContext *ua, RBSR *bsr);
@@ -211,6 +212,14 @@ bool restore_cmd(UAContext *ua, const char *cmd)
       goto bail_out;
    }
 
+   /*
+    * NDMP restores need the complete tree with the NDMP file history.
+    */
+   if (rx.lazy && job->Protocol != PT_NATIVE) {
+      ua->error_msg(_("A lazy directory tree cannot be used for NDMP restores.\n"));
+      goto bail_out;
+   }
+
    /*
     * When doing NDMP_NATIVE restores, we don't create any bootstrap file
     * as we only send a namelist for restore. The storage handling is
@@ -542,6 +551,7 @@ static int user_select_jobids_or_files(UAContext *ua, RESTORE_CTX *rx)
       "restorejob",    /* 22 */
       "replace",       /* 23 */
       "pluginoptions", /* 24 */
+      "lazy",          /* 25 */
       NULL
    };
 
@@ -627,6 +637,9 @@ static int user_select_jobids_or_files(UAContext *ua, RESTORE_CTX *rx)
       case 7:                         /* all specified */
          rx->all = true;
          break;
+      case 25:                        /* lazy specified */
+         rx->lazy = true;
+         break;
       default:
          /*
           * All keywords 7 or greater are ignored or handled by a select prompt
@@ -1171,6 +1184,75 @@ static void add_delta_list_findex(RESTORE_CTX *rx, struct delta_list *lst)
    add_findex(rx->bsr, lst->JobId, lst->FileIndex);
 }
 
+static void add_id_to_list(POOL_MEM &list, const char *id)
+{
+   if (*list.c_str()) {
+      list.strcat(",");
+   }
+   list.strcat(id);
+}
+
+/*
+ * Get the JobId and FileIndexes of all files marked in a lazy tree.
+ * Everything that got marked in a loaded directory is looked up by its
+ * FileId, directories marked before they were loaded are pending ranges
+ * that are expanded here by bvfs.
+ */
+static bool insert_lazy_tree_into_findex_list(UAContext *ua, RESTORE_CTX *rx, TREE_CTX *tree)
+{
+   static pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+   static uint32_t table_seq = 0;
+   TREE_NODE *node;
+   char ed1[50], ed2[50];
+   char table[50];
+   POOL_MEM fileids(PM_MESSAGE),
+            dirids(PM_MESSAGE),
+            hardlinks(PM_MESSAGE);
+
+   for (node = first_tree_node(tree->root); node; node = next_tree_node(tree->root, node)) {
+      if (!node->extract && !node->extract_dir) {
+         continue;
+      }
+
+      if (node->extract && !node->loaded) {
+         add_id_to_list(dirids, edit_uint64(tree_get_pathid(tree->root, node), ed1));
+         continue;
+      }
+
+      if (tree_get_fileid(tree->root, node)) {
+         add_id_to_list(fileids, edit_uint64(tree_get_fileid(tree->root, node), ed1));
+      }
+
+      /*
+       * For hard linked files the tree keeps the FileIndex of the
+       * file linked to, restore that file too.
+       */
+      if (node->extract && node->hard_link && node->FileIndex > 0) {
+         add_id_to_list(hardlinks, edit_uint64(node->JobId, ed1));
+         add_id_to_list(hardlinks, edit_int64(node->FileIndex, ed2));
+      }
+   }
+
+   if (!*fileids.c_str() && !*dirids.c_str() && !*hardlinks.c_str()) {
+      return true;
+   }
+
+   P(mutex);
+   bsnprintf(table, sizeof(table), "b2%d%u", (int)getpid(), ++table_seq);
+   V(mutex);
+
+   if (!tree->bvfs->compute_restore_list(fileids.c_str(), dirids.c_str(),
+                                         hardlinks.c_str(), table)) {
+      ua->error_msg(_("Unable to compute the files to restore from the directory tree.\n"));
+      return false;
+   }
+
+   insert_table_into_findex_list(ua, rx, table);
+   tree->bvfs->drop_restore_list(table);
+
+   return true;
+}
+
 static bool build_directory_tree(UAContext *ua, RESTORE_CTX *rx)
 {
    TREE_CTX tree;
@@ -1184,7 +1266,7 @@ static bool build_directory_tree(UAContext *ua, RESTORE_CTX *rx)
    /*
     * Build the directory tree containing JobIds user selected
     */
-   tree.root = new_tree(rx->TotalFiles);
+   tree.root = new_tree(rx->lazy ? 0 : rx->TotalFiles);
    tree.ua = ua;
    tree.all = rx->all;
    last_JobId = 0;
@@ -1196,7 +1278,7 @@ static bool build_directory_tree(UAContext *ua, RESTORE_CTX *rx)
    p = rx->JobIds;
    tree.FileEstimate = 0;
 
-   if (get_next_jobid_from_list(&p, &JobId) > 0) {
+   if (!rx->lazy && get_next_jobid_from_list(&p, &JobId) > 0) {
       /*
        * Use first JobId as estimate of the number of files to restore
        */
@@ -1213,11 +1295,15 @@ static bool build_directory_tree(UAContext *ua, RESTORE_CTX *rx)
       }
    }
 
-   ua->info_msg(_("\nBuilding directory tree for JobId(s) %s ...  "), rx->JobIds);
+   if (rx->lazy) {
+      ua->info_msg(_("\nLoading directory tree for JobId(s) %s on demand ...  "), rx->JobIds);
+   } else {
+      ua->info_msg(_("\nBuilding directory tree for JobId(s) %s ...  "), rx->JobIds);
 
-   if (!ua->db->get_file_list(ua->jcr, rx->JobIds, false /* do not use md5 */,
-                              true /* get delta */, insert_tree_handler, (void *)&tree)) {
-      ua->error_msg("%s", ua->db->strerror());
+      if (!ua->db->get_file_list(ua->jcr, rx->JobIds, false /* do not use md5 */,
+                                 true /* get delta */, insert_tree_handler, (void *)&tree)) {
+         ua->error_msg("%s", ua->db->strerror());
+      }
    }
 
    if (*rx->BaseJobIds) {
@@ -1225,6 +1311,23 @@ static bool build_directory_tree(UAContext *ua, RESTORE_CTX *rx)
       pm_strcat(rx->JobIds, rx->BaseJobIds);
    }
 
+   if (rx->lazy) {
+      /*
+       * Only the top level of the tree gets loaded now, the other
+       * directories are loaded from the bvfs cache when they are used.
+       */
+      if (!ua->db->bvfs_update_path_hierarchy_cache(ua->jcr, rx->JobIds)) {
+         ua->error_msg(_("BVFS reported a problem for %s\n"), rx->JobIds);
+      }
+      tree.bvfs = new Bvfs(ua->jcr, ua->db);
+      tree.bvfs->set_jobids(rx->JobIds);
+      tree.root->load_children = lazy_tree_load_handler;
+      tree.root->load_ctx = (void *)&tree;
+      tree.root->loaded = false;
+      tree.root->extract = tree.all;
+      tree_first_child(tree.root, (TREE_NODE *)tree.root);
+   }
+
    /*
     * At this point, the tree is built, so we can garbage collect
     * any memory released by the SQL engine that RedHat has
@@ -1266,7 +1369,10 @@ static bool build_directory_tree(UAContext *ua, RESTORE_CTX *rx)
       }
    } else {
       char ec1[50];
-      if (tree.all) {
+      if (rx->lazy) {
+         ua->info_msg(_("\n%s entries loaded into the top of the tree, the rest is loaded on demand.\n"),
+                      edit_uint64_with_commas(tree.FileCount, ec1));
+      } else if (tree.all) {
          ua->info_msg(_("\n%s files inserted into the tree and marked for extraction.\n"),
                       edit_uint64_with_commas(tree.FileCount, ec1));
       } else {
@@ -1285,8 +1391,10 @@ static bool build_directory_tree(UAContext *ua, RESTORE_CTX *rx)
        * Walk down through the tree finding all files marked to be
        *  extracted making a bootstrap file.
        */
-      if (OK) {
-         for (TREE_NODE *node=first_tree_node(tree.root); node; node=next_tree_node(node)) {
+      if (OK && rx->lazy) {
+         OK = insert_lazy_tree_into_findex_list(ua, rx, &tree);
+      } else if (OK) {
+         for (TREE_NODE *node=first_tree_node(tree.root); node; node=next_tree_node(tree.root, node)) {
             Dmsg2(400, "FI=%d node=0x%x\n", node->FileIndex, node);
             if (node->extract || node->extract_dir) {
                Dmsg3(400, "JobId=%lld type=%d FI=%d\n", (uint64_t)node->JobId, node->type, node->FileIndex);
@@ -1301,6 +1409,12 @@ static bool build_directory_tree(UAContext *ua, RESTORE_CTX *rx)
       }
    }
 
+   if (tree.bvfs) {
+      tree.root->load_children = NULL;
+      tree.root->load_ctx = NULL;
+      delete tree.bvfs;
+   }
+
    /*
     * We keep the tree with selected restore files.
     * For NDMP restores its used in the DMA to know what to restore.
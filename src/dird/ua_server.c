@@ -64,12 +64,112 @@ JCR *new_control_jcr(const char *base_name, int job_type)
    return jcr;
 }
 
+/**
+ * Read and execute one command of a console.
+ */
+static void ua_session_command(UAContext *ua)
+{
+   int status;
+   BSOCK *user = ua->UA_sock;
+
+   status = user->recv();
+   if (status >= 0) {
+      pm_strcpy(ua->cmd, ua->UA_sock->msg);
+      parse_ua_args(ua);
+      do_a_command(ua);
+
+      dequeue_messages(ua->jcr);
+
+      if (!ua->quit) {
+         if (console_msg_pending && ua->acl_access_ok(Command_ACL, "messages")) {
+            if (ua->auto_display_messages) {
+               pm_strcpy(ua->cmd, "messages");
+               dot_messages_cmd(ua, ua->cmd);
+               ua->user_notified_msg_pending = false;
+            } else if (!ua->gui && !ua->user_notified_msg_pending && console_msg_pending) {
+               if (ua->api) {
+                  user->signal(BNET_MSGS_PENDING);
+               } else {
+                  bsendmsg(ua, _("You have messages.\n"));
+               }
+               ua->user_notified_msg_pending = true;
+            }
+         }
+         if (!ua->api) {
+            user->signal(BNET_EOD); /* send end of command */
+         }
+      }
+   } else if (is_bnet_stop(user)) {
+      ua->quit = true;
+   } else { /* signal */
+      user->signal(BNET_POLL);
+   }
+}
+
+static void ua_session_end(UAContext *ua)
+{
+   JCR *jcr = ua->jcr;
+   BSOCK *user = ua->UA_sock;
+
+   close_db(ua);
+   free_ua_context(ua);
+   free_jcr(jcr);
+   user->close();
+   delete user;
+}
+
+static void ua_session_resume(BSOCK *user, void *ctx, bool readable);
+
+/**
+ * Process console commands until the console quits. While waiting for
+ * the next command the connection is handed to the console reactor,
+ * so idle consoles don't occupy a thread. Without a reactor we wait
+ * for the command in this thread.
+ */
+static void ua_session_run(UAContext *ua)
+{
+   BNET_REACTOR *reactor = get_console_reactor();
+
+   while (!ua->quit) {
+      if (ua->api) {
+         ua->UA_sock->signal(BNET_MAIN_PROMPT);
+      }
+
+      if (reactor) {
+         if (reactor->watch(ua->UA_sock, ua_session_resume, ua)) {
+            return;
+         }
+         break;                       /* reactor is stopping or failed */
+      }
+
+      ua_session_command(ua);
+   }
+
+   ua_session_end(ua);
+}
+
+/**
+ * Called by the console reactor when the next command arrives
+ * or when the director shuts down.
+ */
+static void ua_session_resume(BSOCK *user, void *ctx, bool readable)
+{
+   UAContext *ua = (UAContext *)ctx;
+
+   if (readable) {
+      ua_session_command(ua);
+   } else {
+      ua->quit = true;
+   }
+
+   ua_session_run(ua);
+}
+
 /**
  * Handle Director User Agent commands
  */
 void *handle_UA_client_request(BSOCK *user)
 {
-   int status;
    UAContext *ua;
    JCR *jcr;
 
@@ -82,54 +182,11 @@ void *handle_UA_client_request(BSOCK *user)
    set_jcr_in_tsd(INVALID_JCR);
 
    if (!authenticate_user_agent(ua)) {
-      goto getout;
+      ua_session_end(ua);
+      return NULL;
    }
 
-   while (!ua->quit) {
-      if (ua->api) {
-         user->signal(BNET_MAIN_PROMPT);
-      }
-
-      status = user->recv();
-      if (status >= 0) {
-         pm_strcpy(ua->cmd, ua->UA_sock->msg);
-         parse_ua_args(ua);
-         do_a_command(ua);
-
-         dequeue_messages(ua->jcr);
-
-         if (!ua->quit) {
-            if (console_msg_pending && ua->acl_access_ok(Command_ACL, "messages")) {
-               if (ua->auto_display_messages) {
-                  pm_strcpy(ua->cmd, "messages");
-                  dot_messages_cmd(ua, ua->cmd);
-                  ua->user_notified_msg_pending = false;
-               } else if (!ua->gui && !ua->user_notified_msg_pending && console_msg_pending) {
-                  if (ua->api) {
-                     user->signal(BNET_MSGS_PENDING);
-                  } else {
-                     bsendmsg(ua, _("You have messages.\n"));
-                  }
-                  ua->user_notified_msg_pending = true;
-               }
-            }
-            if (!ua->api) {
-               user->signal(BNET_EOD); /* send end of command */
-            }
-         }
-      } else if (is_bnet_stop(user)) {
-         ua->quit = true;
-      } else { /* signal */
-         user->signal(BNET_POLL);
-      }
-   }
-
-getout:
-   close_db(ua);
-   free_ua_context(ua);
-   free_jcr(jcr);
-   user->close();
-   delete user;
+   ua_session_run(ua);
 
    return NULL;
 }
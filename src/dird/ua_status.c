@@ -337,6 +337,7 @@ void list_dir_status_header(UAContext *ua)
 {
    int len, cnt;
    CATRES *catalog;
+   PATH_CACHE_STATS pcs;
    char dt[MAX_TIME_LENGTH];
    char b1[35], b2[35], b3[35], b4[35], b5[35];
    POOL_MEM msg(PM_FNAME),
@@ -362,6 +363,17 @@ void list_dir_status_header(UAContext *ua)
                 edit_uint64_with_commas(sm_buffers, b4),
                 edit_uint64_with_commas(sm_max_buffers, b5));
 
+   db_path_cache_get_stats(&pcs);
+   if (pcs.hits + pcs.misses > 0) {
+      ua->send_msg(_(" Path cache: entries=%s max_entries=%s hits=%s misses=%s evictions=%s hit_rate=%d%%\n"),
+                   edit_uint64_with_commas(pcs.entries, b1),
+                   edit_uint64_with_commas(pcs.max_entries, b2),
+                   edit_uint64_with_commas(pcs.hits, b3),
+                   edit_uint64_with_commas(pcs.misses, b4),
+                   edit_uint64_with_commas(pcs.evictions, b5),
+                   (int)((pcs.hits * 100) / (pcs.hits + pcs.misses)));
+   }
+
    if (me->secure_erase_cmdline) {
       ua->send_msg(_(" secure erase command='%s'\n"), me->secure_erase_cmdline);
    }
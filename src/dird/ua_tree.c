@@ -39,6 +39,7 @@
 #include "lib/fnmatch.h"
 #endif
 #include "findlib/find.h"
+#include "cats/bvfs.h"
 
 /* Forward referenced commands */
 static int markcmd(UAContext *ua, TREE_CTX *tree);
@@ -236,10 +237,9 @@ int insert_tree_handler(void *ctx, int num_fields, char **row)
    JobId = str_to_int64(row[3]);
    FileIndex = str_to_int64(row[2]);
    delta_seq = str_to_int64(row[5]);
-   node->fhinfo = str_to_int64(row[6]);
-   node->fhnode = str_to_int64(row[7]);
-   Dmsg8(150, "node=0x%p JobId=%s FileIndex=%s Delta=%s node.delta=%d LinkFI=%d, fhinfo=%d, fhnode=%d\n",
-         node, row[3], row[2], row[5], node->delta_seq, LinkFI, node->fhinfo, node->fhnode);
+   tree_set_fh(tree->root, node, str_to_int64(row[6]), str_to_int64(row[7]));
+   Dmsg8(150, "node=0x%p JobId=%s FileIndex=%s Delta=%s node.delta=%d LinkFI=%d, fhinfo=%s, fhnode=%s\n",
+         node, row[3], row[2], row[5], node->delta_seq, LinkFI, row[6], row[7]);
 
    /*
     * TODO: check with hardlinks
@@ -346,6 +346,165 @@ int insert_tree_handler(void *ctx, int num_fields, char **row)
    return 0;
 }
 
+/*
+ * Context used while loading a directory of a lazy tree.
+ */
+struct lazy_load_ctx {
+   TREE_CTX *tree;                    /* Tree being loaded */
+   TREE_NODE *parent;                 /* Directory being loaded */
+   DBId_t unix_root;                  /* PathId of "/" when loading the root */
+   POOLMEM *buf;                      /* Scratch buffer for names */
+};
+
+/**
+ * This callback routine is responsible for inserting the directories and
+ * files of one directory of a lazy tree. It is called by bvfs for each
+ * entry of the directory.
+ *
+ * row[0]=Type row[1]=PathId row[2]=Name row[3]=JobId row[4]=LStat row[5]=FileId
+ *
+ * For directories Name is the full path, for files only the filename.
+ */
+static int lazy_tree_handler(void *ctx, int num_fields, char **row)
+{
+   struct lazy_load_ctx *lctx = (struct lazy_load_ctx *)ctx;
+   TREE_CTX *tree = lctx->tree;
+   TREE_NODE *parent = lctx->parent;
+   TREE_NODE *node;
+   struct stat statp;
+   int32_t LinkFI = 0;
+   char *fname, *p;
+   int type, len;
+
+   Dmsg3(150, "Type=%s PathId=%s Name=%s\n", row[BVFS_Type], row[BVFS_PathId], row[BVFS_Name]);
+
+   pm_strcpy(lctx->buf, row[BVFS_Name]);
+   fname = lctx->buf;
+   if (bvfs_is_dir(row)) {
+      /*
+       * Strip the trailing slash and use the last component of the path.
+       */
+      len = strlen(fname);
+      if (len > 0 && IsPathSeparator(fname[len - 1])) {
+         fname[--len] = '\0';
+      }
+
+      if (len == 0) {
+         /*
+          * This is the "/" directory below the bvfs root, its
+          * entries are at the top of our tree.
+          */
+         lctx->unix_root = str_to_int64(row[BVFS_PathId]);
+         return 0;
+      }
+
+      p = (char *)last_path_separator(fname);
+      if (p) {
+         fname = p + 1;
+      }
+
+      if (!IsPathSeparator(*row[BVFS_Name])) {
+         type = TN_DIR_NLS;
+      } else {
+         type = TN_DIR;
+      }
+   } else if (bvfs_is_file(row)) {
+      type = TN_FILE;
+   } else {
+      return 0;
+   }
+
+   if (*fname == '\0') {
+      return 0;
+   }
+
+   memset(&statp, 0, sizeof(statp));
+   if (*row[BVFS_LStat]) {
+      decode_stat(row[BVFS_LStat], &statp, sizeof(statp), &LinkFI);
+   }
+
+   node = insert_tree_node((char *)"", fname, type, tree->root, parent);
+   node->type = type;
+   node->JobId = str_to_int64(row[BVFS_JobId]);
+   node->hard_link = (LinkFI != 0);
+   node->soft_link = S_ISLNK(statp.st_mode) != 0;
+
+   /*
+    * Bvfs does not return the FileIndex, for hard linked files we keep
+    * the FileIndex of the file linked to so that it can be restored too.
+    */
+   node->FileIndex = LinkFI;
+
+   if (type == TN_FILE) {
+      node->loaded = true;
+   }
+   tree_set_dbids(tree->root, node, str_to_int64(row[BVFS_PathId]),
+                  (*row[BVFS_FileId]) ? str_to_int64(row[BVFS_FileId]) : 0);
+
+   /*
+    * A directory marked before it was loaded marks all its children.
+    */
+   if (parent->extract) {
+      node->extract = true;
+      if (type == TN_DIR || type == TN_DIR_NLS) {
+         node->extract_dir = true;
+      }
+   }
+
+   if (node->inserted) {
+      tree->FileCount++;
+   }
+
+   tree->cnt++;
+   return 0;
+}
+
+static void lazy_load_directory(Bvfs *bvfs, DBId_t PathId)
+{
+   bvfs->ch_dir(PathId);
+   while (bvfs->ls_dirs()) {
+      bvfs->next_offset();
+   }
+
+   bvfs->ch_dir(PathId);
+   while (bvfs->ls_files()) {
+      bvfs->next_offset();
+   }
+}
+
+/**
+ * Insert the children of a directory of a lazy tree using the bvfs cache.
+ */
+void lazy_tree_load_handler(TREE_ROOT *root, TREE_NODE *node, void *ctx)
+{
+   TREE_CTX *tree = (TREE_CTX *)ctx;
+   struct lazy_load_ctx lctx;
+   DBId_t PathId;
+
+   if (node == (TREE_NODE *)root) {
+      PathId = tree->bvfs->get_root();
+   } else {
+      PathId = tree_get_pathid(root, node);
+   }
+
+   if (!PathId) {
+      return;
+   }
+
+   lctx.tree = tree;
+   lctx.parent = node;
+   lctx.unix_root = 0;
+   lctx.buf = get_pool_memory(PM_FNAME);
+   tree->bvfs->set_handler(lazy_tree_handler, &lctx);
+
+   lazy_load_directory(tree->bvfs, PathId);
+   if (lctx.unix_root) {
+      lazy_load_directory(tree->bvfs, lctx.unix_root);
+   }
+
+   free_pool_memory(lctx.buf);
+}
+
 /**
  * Set extract to value passed. We recursively walk down the tree setting all children
  * if the node is a directory.
@@ -369,10 +528,14 @@ static int set_extract(UAContext *ua, TREE_NODE *node, TREE_CTX *tree, bool extr
     */
    if (node->type != TN_FILE || (node->soft_link && tree_node_has_child(node))) {
       /*
-       * Recursive set children within directory
+       * Recursive set children within directory. The children of a
+       * directory of a lazy tree that is not loaded yet inherit the
+       * setting when they get loaded or are expanded at done.
        */
-      foreach_child(n, node) {
-         count += set_extract(ua, n, tree, extract);
+      if (node->loaded) {
+         foreach_child(n, tree->root, node) {
+            count += set_extract(ua, n, tree, extract);
+         }
       }
 
       /*
@@ -506,7 +669,7 @@ static int markcmd(UAContext *ua, TREE_CTX *tree)
          tree->node = node;
          restore_cwd = true;
 
-         foreach_child(node, tree->node) {
+         foreach_child(node, tree->root, tree->node) {
             if (fnmatch(file, node->fname, 0) == 0) {
                count += set_extract(ua, node, tree, true);
             }
@@ -518,7 +681,7 @@ static int markcmd(UAContext *ua, TREE_CTX *tree)
          /*
           * Only a pattern without a / so do things relative to CWD.
           */
-         foreach_child(node, tree->node) {
+         foreach_child(node, tree->root, tree->node) {
             if (fnmatch(ua->argk[i], node->fname, 0) == 0) {
                count += set_extract(ua, node, tree, true);
             }
@@ -566,7 +729,7 @@ static int markdircmd(UAContext *ua, TREE_CTX *tree)
    }
    for (int i = 1; i < ua->argc; i++) {
       strip_trailing_slash(ua->argk[i]);
-      foreach_child(node, tree->node) {
+      foreach_child(node, tree->root, tree->node) {
          if (fnmatch(ua->argk[i], node->fname, 0) == 0) {
             if (node->type == TN_DIR || node->type == TN_DIR_NLS) {
                node->extract_dir = true;
@@ -595,7 +758,7 @@ static int countcmd(UAContext *ua, TREE_CTX *tree)
    total = num_extract = 0;
    for (node = first_tree_node(tree->root);
         node;
-        node = next_tree_node(node)) {
+        node = next_tree_node(tree->root, node)) {
       if (node->type != TN_NEWDIR) {
          total++;
          if (node->extract || node->extract_dir) {
@@ -622,7 +785,7 @@ static int findcmd(UAContext *ua, TREE_CTX *tree)
    for (int i = 1; i < ua->argc; i++) {
       for (node = first_tree_node(tree->root);
            node;
-           node = next_tree_node(node)) {
+           node = next_tree_node(tree->root, node)) {
          if (fnmatch(ua->argk[i], node->fname, 0) == 0) {
             const char *tag;
 
@@ -650,7 +813,7 @@ static int dot_lsdircmd(UAContext *ua, TREE_CTX *tree)
       return 1;
    }
 
-   foreach_child(node, tree->node) {
+   foreach_child(node, tree->root, tree->node) {
       if (ua->argc == 1 || fnmatch(ua->argk[1], node->fname, 0) == 0) {
          if (tree_node_has_child(node)) {
             ua->send_msg("%s/\n", node->fname);
@@ -680,7 +843,7 @@ static int dot_lscmd(UAContext *ua, TREE_CTX *tree)
       return 1;
    }
 
-   foreach_child(node, tree->node) {
+   foreach_child(node, tree->root, tree->node) {
       if (ua->argc == 1 || fnmatch(ua->argk[1], node->fname, 0) == 0) {
          ua->send_msg("%s%s\n", node->fname, tree_node_has_child(node)?"/":"");
       }
@@ -696,7 +859,7 @@ static int lscmd(UAContext *ua, TREE_CTX *tree)
    if (!tree_node_has_child(tree->node)) {
       return 1;
    }
-   foreach_child(node, tree->node) {
+   foreach_child(node, tree->root, tree->node) {
       if (ua->argc == 1 || fnmatch(ua->argk[1], node->fname, 0) == 0) {
          const char *tag;
          if (node->extract) {
@@ -721,7 +884,7 @@ static int dot_lsmarkcmd(UAContext *ua, TREE_CTX *tree)
    if (!tree_node_has_child(tree->node)) {
       return 1;
    }
-   foreach_child(node, tree->node) {
+   foreach_child(node, tree->root, tree->node) {
       if ((ua->argc == 1 || fnmatch(ua->argk[1], node->fname, 0) == 0) &&
           (node->extract || node->extract_dir)) {
          ua->send_msg("%s%s\n", node->fname, tree_node_has_child(node)?"/":"");
@@ -733,7 +896,7 @@ static int dot_lsmarkcmd(UAContext *ua, TREE_CTX *tree)
 /**
  * This recursive ls command that lists only the marked files
  */
-static void rlsmark(UAContext *ua, TREE_NODE *tnode, int level)
+static void rlsmark(UAContext *ua, TREE_CTX *tree, TREE_NODE *tnode, int level)
 {
    TREE_NODE *node;
    const int max_level = 100;
@@ -752,7 +915,7 @@ static void rlsmark(UAContext *ua, TREE_NODE *tnode, int level)
    }
    indent[j] = 0;
 
-   foreach_child(node, tnode) {
+   foreach_child(node, tree->root, tnode) {
       if ((ua->argc == 1 || fnmatch(ua->argk[1], node->fname, 0) == 0) &&
           (node->extract || node->extract_dir)) {
          const char *tag;
@@ -764,8 +927,12 @@ static void rlsmark(UAContext *ua, TREE_NODE *tnode, int level)
             tag = "";
          }
          ua->send_msg("%s%s%s%s\n", indent, tag, node->fname, tree_node_has_child(node)?"/":"");
-         if (tree_node_has_child(node)) {
-            rlsmark(ua, node, level+1);
+
+         /*
+          * Don't load the directories of a lazy tree just for listing them.
+          */
+         if (tree_node_has_child(node) && node->loaded) {
+            rlsmark(ua, tree, node, level+1);
          }
       }
    }
@@ -773,7 +940,7 @@ static void rlsmark(UAContext *ua, TREE_NODE *tnode, int level)
 
 static int lsmarkcmd(UAContext *ua, TREE_CTX *tree)
 {
-   rlsmark(ua, tree->node, 0);
+   rlsmark(ua, tree, tree->node, 0);
    return 1;
 }
 
@@ -850,7 +1017,7 @@ static int do_dircmd(UAContext *ua, TREE_CTX *tree, bool dot_cmd)
    ua->guid = new_guid_list();
    buf = get_pool_memory(PM_FNAME);
 
-   foreach_child(node, tree->node) {
+   foreach_child(node, tree->root, tree->node) {
       const char *tag;
       if (ua->argc == 1 || fnmatch(ua->argk[1], node->fname, 0) == 0) {
          if (node->extract) {
@@ -928,7 +1095,7 @@ static int estimatecmd(UAContext *ua, TREE_CTX *tree)
    total = num_extract = 0;
    for (node = first_tree_node(tree->root);
         node;
-        node = next_tree_node(node)) {
+        node = next_tree_node(tree->root, node)) {
       if (node->type != TN_NEWDIR) {
          total++;
          if (node->extract && node->type == TN_FILE) {
@@ -1096,7 +1263,7 @@ static int unmarkcmd(UAContext *ua, TREE_CTX *tree)
          tree->node = node;
          restore_cwd = true;
 
-         foreach_child(node, tree->node) {
+         foreach_child(node, tree->root, tree->node) {
             if (fnmatch(file, node->fname, 0) == 0) {
                count += set_extract(ua, node, tree, false);
             }
@@ -1108,7 +1275,7 @@ static int unmarkcmd(UAContext *ua, TREE_CTX *tree)
          /*
           * Only a pattern without a / so do things relative to CWD.
           */
-         foreach_child(node, tree->node) {
+         foreach_child(node, tree->root, tree->node) {
             if (fnmatch(ua->argk[i], node->fname, 0) == 0) {
                count += set_extract(ua, node, tree, false);
             }
@@ -1156,7 +1323,7 @@ static int unmarkdircmd(UAContext *ua, TREE_CTX *tree)
 
    for (int i = 1; i < ua->argc; i++) {
       strip_trailing_slash(ua->argk[i]);
-      foreach_child(node, tree->node) {
+      foreach_child(node, tree->root, tree->node) {
          if (fnmatch(ua->argk[i], node->fname, 0) == 0) {
             if (node->type == TN_DIR || node->type == TN_DIR_NLS) {
                node->extract_dir = false;
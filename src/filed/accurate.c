@@ -354,19 +354,28 @@ bool accurate_cmd(JCR *jcr)
       return false;
    }
 
+#ifdef HAVE_MMAP
+   if (me->always_use_accurate_mmap ||
+       (me->accurate_mmap_threshold > 0 && nb >= me->accurate_mmap_threshold)) {
+      jcr->file_list = New(B_ACCURATE_MMAP);
+   }
+#endif
+
+   if (!jcr->file_list) {
 #ifdef HAVE_LMDB
-   if (me->always_use_lmdb) {
-      jcr->file_list = New(B_ACCURATE_LMDB);
-   } else {
-      if (me->lmdb_threshold > 0 && nb >= me->lmdb_threshold) {
+      if (me->always_use_lmdb) {
          jcr->file_list = New(B_ACCURATE_LMDB);
       } else {
-         jcr->file_list = New(B_ACCURATE_HTABLE);
+         if (me->lmdb_threshold > 0 && nb >= me->lmdb_threshold) {
+            jcr->file_list = New(B_ACCURATE_LMDB);
+         } else {
+            jcr->file_list = New(B_ACCURATE_HTABLE);
+         }
       }
-   }
 #else
-   jcr->file_list = New(B_ACCURATE_HTABLE);
+      jcr->file_list = New(B_ACCURATE_HTABLE);
 #endif
+   }
 
    jcr->file_list->init(jcr, nb);
    jcr->accurate = true;
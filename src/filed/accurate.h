@@ -81,7 +81,7 @@ public:
 };
 
 /*
- * Hash table specific storage abstraction class using the internal htable datastructure.
+ * Hash table specific storage abstraction class using the internal ohtable datastructure.
  */
 struct CurFile {
    hlink link;
@@ -91,7 +91,7 @@ struct CurFile {
 
 class B_ACCURATE_HTABLE: public B_ACCURATE {
 protected:
-   htable *m_file_list;
+   ohtable *m_file_list;
 
 public:
    /* methods */
@@ -114,6 +114,83 @@ public:
    void destroy(JCR *jcr);
 };
 
+#ifdef HAVE_MMAP
+/*
+ * Sorted memory mapped file specific storage abstraction class.
+ *
+ * The incoming file list is sorted in memory limited runs which are spilled
+ * to disk and merged into a file with path prefix compressed entries grouped
+ * in blocks. The file is memory mapped and searched using the block index.
+ */
+struct accurate_mmap_header {
+   char magic[8];                 /* ACCURATE_MMAP_MAGIC */
+   uint64_t nr_entries;           /* Number of entries in the file */
+   uint64_t nr_blocks;            /* Number of blocks in the file */
+   uint64_t index_offset;         /* Offset of the block index */
+};
+
+struct accurate_mmap_entry {
+   uint32_t prefix_length;        /* Bytes shared with the name of the previous entry */
+   uint32_t suffix_length;        /* Bytes following the shared prefix */
+   uint32_t lstat_length;         /* Length of the lstat field */
+   uint32_t chksum_length;        /* Length of the chksum field */
+   int64_t filenr;                /* Index in the seen bitmap */
+   uint8_t *delta_seq;            /* Location of the delta_seq in the mapping */
+   char *suffix;                  /* Name suffix */
+   char *lstat;                   /* lstat field */
+   char *chksum;                  /* chksum field */
+   uint8_t *next;                 /* Start of the next entry */
+};
+
+class B_ACCURATE_MMAP: public B_ACCURATE {
+protected:
+   FILE *m_spill;
+   POOLMEM *m_spill_name;
+   POOLMEM *m_file_name;
+   POOLMEM *m_pay_load;
+   POOLMEM *m_name;
+   char *m_run_buf;
+   uint32_t m_run_size;
+   uint32_t m_run_used;
+   char **m_run_entries;
+   uint32_t m_nr_run_entries;
+   uint32_t m_max_run_entries;
+   uint64_t *m_runs;
+   uint32_t m_nr_runs;
+   uint64_t m_spill_size;
+   char *m_map;
+   size_t m_map_size;
+   accurate_mmap_header *m_header;
+   uint64_t *m_index;
+
+   bool flush_run(JCR *jcr);
+   bool merge_runs(JCR *jcr);
+   void decode_entry(uint8_t *p, accurate_mmap_entry *entry);
+   bool find_entry(char *fname, accurate_mmap_entry *entry);
+   accurate_payload *fill_payload(accurate_mmap_entry *entry);
+
+public:
+   /* methods */
+   B_ACCURATE_MMAP();
+   ~B_ACCURATE_MMAP();
+   bool init(JCR *jcr, uint32_t nbfile);
+   bool add_file(JCR *jcr,
+                 char *fname,
+                 int fname_length,
+                 char *lstat,
+                 int lstat_length,
+                 char *chksum,
+                 int chksum_length,
+                 int32_t delta_seq);
+   bool end_load(JCR *jcr);
+   accurate_payload *lookup_payload(JCR *jcr, char *fname);
+   bool update_payload(JCR *jcr, char *fname, accurate_payload *payload);
+   bool send_base_file_list(JCR *jcr);
+   bool send_deleted_list(JCR *jcr);
+   void destroy(JCR *jcr);
+};
+#endif /* HAVE_MMAP */
+
 #ifdef HAVE_LMDB
 
 #include "lmdb.h"
@@ -50,7 +50,7 @@ bool B_ACCURATE_HTABLE::init(JCR *jcr, uint32_t nbfile)
    CurFile *elt = NULL;
 
    if (!m_file_list) {
-      m_file_list = (htable *)malloc(sizeof(htable));
+      m_file_list = (ohtable *)malloc(sizeof(ohtable));
       m_file_list->init(elt, &elt->link, nbfile);
    }
 
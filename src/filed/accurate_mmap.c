@@ -0,0 +1,907 @@
+/*
+   BAREOS® - Backup Archiving REcovery Open Sourced
+
+   Copyright (C) 2016-2016 Bareos GmbH & Co. KG
+
+   This program is Free Software; you can redistribute it and/or
+   modify it under the terms of version three of the GNU Affero General Public
+   License as published by the Free Software Foundation and included
+   in the file LICENSE.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+   Affero General Public License for more details.
+
+   You should have received a copy of the GNU Affero General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+   02110-1301, USA.
+*/
+/**
+ * @file
+ * This file contains the sorted memory mapped file abstraction of the
+ * accurate payload storage.
+ *
+ * While loading, the entries send by the director are collected in a run
+ * buffer of limited size. When the buffer is full it is sorted on filename
+ * and appended to a spill file. At the end of the load all sorted runs are
+ * merged into the final file which is then memory mapped. This keeps the
+ * memory usage bounded and the I/O sequential.
+ *
+ * The final file looks like this:
+ *
+ * accurate_mmap_header
+ * block 0 .. block n    - ACCURATE_MMAP_BLOCK_ENTRIES entries per block
+ * block index           - offset of each block in the file
+ *
+ * Each entry is encoded as:
+ *
+ * varint prefix length  - bytes shared with the name of the previous entry
+ * varint suffix length
+ * varint lstat length
+ * varint chksum length
+ * varint filenr
+ * 4 bytes delta_seq
+ * suffix lstat chksum   - not \0 terminated
+ *
+ * The first entry of each block has a prefix length of 0 so its name can be
+ * used for a binary search on the block index after which only a single
+ * block needs to be scanned.
+ */
+
+#include "bareos.h"
+#include "filed.h"
+
+#ifdef HAVE_MMAP
+
+#include "accurate.h"
+
+#ifdef HAVE_SYS_MMAN_H
+#include <sys/mman.h>
+#endif
+
+static int dbglvl = 100;
+
+#define ACCURATE_MMAP_MAGIC "BACCMAP1"
+#define ACCURATE_MMAP_BLOCK_ENTRIES 64
+#define ACCURATE_MMAP_RUN_SIZE (64 * 1024 * 1024)
+#define ACCURATE_MMAP_RUN_ENTRIES 65536
+
+/*
+ * Entry as stored in the run buffer and the spill file.
+ */
+struct spill_entry {
+   uint32_t total_length;
+   uint32_t fname_length;
+   uint32_t lstat_length;
+   uint32_t chksum_length;
+   int64_t filenr;
+   int32_t delta_seq;
+};
+
+/*
+ * Cursor on one sorted run in the spill file.
+ */
+struct run_cursor {
+   char *ptr;
+   char *end;
+};
+
+static inline char *spill_entry_fname(char *entry)
+{
+   return entry + sizeof(spill_entry);
+}
+
+/*
+ * Order entries on filename, duplicates in the order they were added.
+ */
+static inline int compare_spill_entry(char *e1, char *e2)
+{
+   int result;
+
+   result = strcmp(spill_entry_fname(e1), spill_entry_fname(e2));
+   if (result == 0) {
+      result = (((spill_entry *)e1)->filenr < ((spill_entry *)e2)->filenr) ? -1 : 1;
+   }
+
+   return result;
+}
+
+static int compare_spill_entries(const void *e1, const void *e2)
+{
+   return compare_spill_entry(*(char **)e1, *(char **)e2);
+}
+
+static inline uint8_t *put_varint(uint8_t *p, uint64_t value)
+{
+   while (value >= 0x80) {
+      *p++ = (value & 0x7F) | 0x80;
+      value >>= 7;
+   }
+   *p++ = value;
+
+   return p;
+}
+
+static inline uint64_t get_varint(uint8_t *&p)
+{
+   int shift = 0;
+   uint64_t value = 0;
+
+   while (*p & 0x80) {
+      value |= (uint64_t)(*p++ & 0x7F) << shift;
+      shift += 7;
+   }
+   value |= (uint64_t)(*p++) << shift;
+
+   return value;
+}
+
+static inline bool write_bytes(FILE *fp, const void *data, size_t length)
+{
+   return length == 0 || fwrite(data, 1, length, fp) == length;
+}
+
+/*
+ * Compare a \0 terminated name with a name of the given length.
+ */
+static inline int compare_name(const char *fname, int fname_length, const char *name, int name_length)
+{
+   int result;
+
+   result = memcmp(fname, name, MIN(fname_length, name_length));
+   if (result == 0) {
+      result = fname_length - name_length;
+   }
+
+   return result;
+}
+
+/*
+ * Restore the heap property of the merge heap starting at the given position.
+ */
+static void sift_down(run_cursor *heap, int nr_cursors, int pos)
+{
+   int child;
+   run_cursor tmp;
+
+   while ((child = 2 * pos + 1) < nr_cursors) {
+      if (child + 1 < nr_cursors &&
+          compare_spill_entry(heap[child + 1].ptr, heap[child].ptr) < 0) {
+         child++;
+      }
+
+      if (compare_spill_entry(heap[pos].ptr, heap[child].ptr) <= 0) {
+         break;
+      }
+
+      tmp = heap[pos];
+      heap[pos] = heap[child];
+      heap[child] = tmp;
+      pos = child;
+   }
+}
+
+B_ACCURATE_MMAP::B_ACCURATE_MMAP()
+{
+   m_filenr = 0;
+   m_seen_bitmap = NULL;
+   m_spill = NULL;
+   m_spill_name = NULL;
+   m_file_name = NULL;
+   m_pay_load = NULL;
+   m_name = NULL;
+   m_run_buf = NULL;
+   m_run_size = 0;
+   m_run_used = 0;
+   m_run_entries = NULL;
+   m_nr_run_entries = 0;
+   m_max_run_entries = 0;
+   m_runs = NULL;
+   m_nr_runs = 0;
+   m_spill_size = 0;
+   m_map = NULL;
+   m_map_size = 0;
+   m_header = NULL;
+   m_index = NULL;
+}
+
+B_ACCURATE_MMAP::~B_ACCURATE_MMAP()
+{
+}
+
+bool B_ACCURATE_MMAP::init(JCR *jcr, uint32_t nbfile)
+{
+   if (!m_spill_name) {
+      m_spill_name = get_pool_memory(PM_FNAME);
+      Mmsg(m_spill_name, "%s/.accurate_spill.%d", me->working_directory, jcr->JobId);
+   }
+
+   if (!m_file_name) {
+      m_file_name = get_pool_memory(PM_FNAME);
+      Mmsg(m_file_name, "%s/.accurate_mmap.%d", me->working_directory, jcr->JobId);
+   }
+
+   if (!m_pay_load) {
+      m_pay_load = get_pool_memory(PM_MESSAGE);
+   }
+
+   if (!m_name) {
+      m_name = get_pool_memory(PM_FNAME);
+   }
+
+   if (!m_spill) {
+      m_spill = fopen(m_spill_name, "w+b");
+      if (!m_spill) {
+         berrno be;
+
+         Jmsg2(jcr, M_FATAL, 0, _("Unable to create accurate spill file %s: ERR=%s\n"),
+               m_spill_name, be.bstrerror());
+         return false;
+      }
+   }
+
+   if (!m_run_buf) {
+      m_run_size = ACCURATE_MMAP_RUN_SIZE;
+      m_run_buf = (char *)malloc(m_run_size);
+      m_max_run_entries = ACCURATE_MMAP_RUN_ENTRIES;
+      m_run_entries = (char **)malloc(m_max_run_entries * sizeof(char *));
+   }
+
+   if (!m_seen_bitmap) {
+      m_seen_bitmap = (char *)malloc(nbytes_for_bits(nbfile));
+      clear_all_bits(nbfile, m_seen_bitmap);
+   }
+
+   return true;
+}
+
+/*
+ * Sort the entries in the run buffer and append them to the spill file.
+ */
+bool B_ACCURATE_MMAP::flush_run(JCR *jcr)
+{
+   spill_entry *entry;
+
+   if (m_nr_run_entries == 0) {
+      return true;
+   }
+
+   qsort(m_run_entries, m_nr_run_entries, sizeof(char *), compare_spill_entries);
+
+   for (uint32_t i = 0; i < m_nr_run_entries; i++) {
+      entry = (spill_entry *)m_run_entries[i];
+      if (fwrite(entry, entry->total_length, 1, m_spill) != 1) {
+         berrno be;
+
+         Jmsg2(jcr, M_FATAL, 0, _("Unable to write accurate spill file %s: ERR=%s\n"),
+               m_spill_name, be.bstrerror());
+         return false;
+      }
+   }
+
+   /*
+    * Remember where this run started.
+    */
+   m_runs = (uint64_t *)realloc(m_runs, (m_nr_runs + 1) * sizeof(uint64_t));
+   m_runs[m_nr_runs++] = m_spill_size;
+   m_spill_size += m_run_used;
+
+   Dmsg3(dbglvl, "Spilled run %d with %d entries (%d bytes)\n", m_nr_runs, m_nr_run_entries, m_run_used);
+
+   m_run_used = 0;
+   m_nr_run_entries = 0;
+
+   return true;
+}
+
+bool B_ACCURATE_MMAP::add_file(JCR *jcr,
+                               char *fname,
+                               int fname_length,
+                               char *lstat,
+                               int lstat_length,
+                               char *chksum,
+                               int chksum_length,
+                               int32_t delta_seq)
+{
+   char *bp;
+   spill_entry *entry;
+   uint32_t total_length;
+
+   if (!m_spill) {
+      return false;
+   }
+
+   /*
+    * Keep the entries aligned as we access the spill_entry structure in place.
+    */
+   total_length = sizeof(spill_entry) + fname_length + lstat_length + chksum_length + 3;
+   total_length = (total_length + sizeof(uint64_t) - 1) & ~(sizeof(uint64_t) - 1);
+
+   /*
+    * See if the entry still fits into the current run.
+    */
+   if (m_run_used + total_length > m_run_size) {
+      if (!flush_run(jcr)) {
+         return false;
+      }
+
+      if (total_length > m_run_size) {
+         m_run_size = total_length;
+         m_run_buf = (char *)realloc(m_run_buf, m_run_size);
+      }
+   }
+
+   if (m_nr_run_entries == m_max_run_entries) {
+      m_max_run_entries *= 2;
+      m_run_entries = (char **)realloc(m_run_entries, m_max_run_entries * sizeof(char *));
+   }
+
+   /*
+    * We store the entry as:
+    *
+    * spill_entry structure fname\0lstat\0chksum\0
+    */
+   bp = m_run_buf + m_run_used;
+   entry = (spill_entry *)bp;
+   entry->total_length = total_length;
+   entry->fname_length = fname_length;
+   entry->lstat_length = lstat_length;
+   entry->chksum_length = chksum_length;
+   entry->filenr = m_filenr++;
+   entry->delta_seq = delta_seq;
+
+   bp += sizeof(spill_entry);
+   memcpy(bp, fname, fname_length);
+   bp[fname_length] = '\0';
+   bp += fname_length + 1;
+   memcpy(bp, lstat, lstat_length);
+   bp[lstat_length] = '\0';
+   bp += lstat_length + 1;
+   if (chksum_length) {
+      memcpy(bp, chksum, chksum_length);
+   }
+   bp[chksum_length] = '\0';
+
+   m_run_entries[m_nr_run_entries++] = (char *)entry;
+   m_run_used += total_length;
+
+   if (chksum) {
+      Dmsg4(dbglvl, "add fname=<%s> lstat=%s delta_seq=%i chksum=%s\n", fname, lstat, delta_seq, chksum);
+   } else {
+      Dmsg2(dbglvl, "add fname=<%s> lstat=%s\n", fname, lstat);
+   }
+
+   return true;
+}
+
+/*
+ * Merge all sorted runs in the spill file into the final file.
+ */
+bool B_ACCURATE_MMAP::merge_runs(JCR *jcr)
+{
+   FILE *fp;
+   char *spill_map = NULL;
+   char *fname, *prev_name;
+   int nr_cursors = 0;
+   uint32_t prefix_length, prev_length = 0;
+   uint64_t nr_blocks = 0, max_blocks = 0;
+   uint64_t *index = NULL;
+   uint64_t offset;
+   uint8_t encoded[64], *p;
+   spill_entry *entry;
+   run_cursor *heap = NULL;
+   accurate_mmap_header header;
+   bool retval = false;
+
+   fp = fopen(m_file_name, "w+b");
+   if (!fp) {
+      berrno be;
+
+      Jmsg2(jcr, M_FATAL, 0, _("Unable to create accurate file %s: ERR=%s\n"),
+            m_file_name, be.bstrerror());
+      return false;
+   }
+
+   memset(&header, 0, sizeof(header));
+   memcpy(header.magic, ACCURATE_MMAP_MAGIC, sizeof(header.magic));
+   if (fwrite(&header, sizeof(header), 1, fp) != 1) {
+      goto bail_out;
+   }
+   offset = sizeof(header);
+
+   if (m_spill_size > 0) {
+      spill_map = (char *)mmap(NULL, m_spill_size, PROT_READ, MAP_SHARED, fileno(m_spill), 0);
+      if (spill_map == MAP_FAILED) {
+         berrno be;
+
+         spill_map = NULL;
+         Jmsg2(jcr, M_FATAL, 0, _("Unable to mmap accurate spill file %s: ERR=%s\n"),
+               m_spill_name, be.bstrerror());
+         goto bail_out;
+      }
+
+      heap = (run_cursor *)malloc(m_nr_runs * sizeof(run_cursor));
+      for (uint32_t i = 0; i < m_nr_runs; i++) {
+         heap[nr_cursors].ptr = spill_map + m_runs[i];
+         heap[nr_cursors].end = spill_map + ((i + 1 < m_nr_runs) ? m_runs[i + 1] : m_spill_size);
+         if (heap[nr_cursors].ptr < heap[nr_cursors].end) {
+            nr_cursors++;
+         }
+      }
+
+      for (int i = nr_cursors / 2 - 1; i >= 0; i--) {
+         sift_down(heap, nr_cursors, i);
+      }
+   }
+
+   prev_name = m_name;
+   prev_name[0] = '\0';
+   while (nr_cursors > 0) {
+      entry = (spill_entry *)heap[0].ptr;
+      fname = spill_entry_fname(heap[0].ptr);
+
+      /*
+       * Advance the cursor of the run we took this entry from.
+       */
+      heap[0].ptr += entry->total_length;
+      if (heap[0].ptr >= heap[0].end) {
+         heap[0] = heap[--nr_cursors];
+      }
+
+      /*
+       * Skip duplicate entries, the first one wins.
+       */
+      if (header.nr_entries > 0 &&
+          compare_name(fname, entry->fname_length, prev_name, prev_length) == 0) {
+         if (nr_cursors > 0) {
+            sift_down(heap, nr_cursors, 0);
+         }
+         continue;
+      }
+
+      /*
+       * Start a new block, the first entry of a block holds the full name.
+       */
+      if ((header.nr_entries % ACCURATE_MMAP_BLOCK_ENTRIES) == 0) {
+         if (nr_blocks == max_blocks) {
+            max_blocks = (max_blocks) ? max_blocks * 2 : 1024;
+            index = (uint64_t *)realloc(index, max_blocks * sizeof(uint64_t));
+         }
+         index[nr_blocks++] = offset;
+         prefix_length = 0;
+      } else {
+         prefix_length = 0;
+         while (prefix_length < prev_length &&
+                prefix_length < entry->fname_length &&
+                prev_name[prefix_length] == fname[prefix_length]) {
+            prefix_length++;
+         }
+      }
+
+      p = put_varint(encoded, prefix_length);
+      p = put_varint(p, entry->fname_length - prefix_length);
+      p = put_varint(p, entry->lstat_length);
+      p = put_varint(p, entry->chksum_length);
+      p = put_varint(p, entry->filenr);
+      memcpy(p, &entry->delta_seq, sizeof(int32_t));
+      p += sizeof(int32_t);
+
+      if (!write_bytes(fp, encoded, p - encoded) ||
+          !write_bytes(fp, fname + prefix_length, entry->fname_length - prefix_length) ||
+          !write_bytes(fp, fname + entry->fname_length + 1, entry->lstat_length) ||
+          !write_bytes(fp, fname + entry->fname_length + entry->lstat_length + 2, entry->chksum_length)) {
+         goto bail_out;
+      }
+      offset += (p - encoded) + entry->fname_length - prefix_length +
+                entry->lstat_length + entry->chksum_length;
+
+      /*
+       * Remember the name for calculating the prefix of the next entry.
+       */
+      m_name = check_pool_memory_size(m_name, entry->fname_length + 1);
+      prev_name = m_name;
+      memcpy(prev_name, fname, entry->fname_length + 1);
+      prev_length = entry->fname_length;
+      header.nr_entries++;
+
+      if (nr_cursors > 0) {
+         sift_down(heap, nr_cursors, 0);
+      }
+   }
+
+   /*
+    * Align the block index and write it after the blocks.
+    */
+   while (offset % sizeof(uint64_t)) {
+      if (fputc(0, fp) == EOF) {
+         goto bail_out;
+      }
+      offset++;
+   }
+
+   header.nr_blocks = nr_blocks;
+   header.index_offset = offset;
+   if (nr_blocks > 0 && fwrite(index, sizeof(uint64_t), nr_blocks, fp) != nr_blocks) {
+      goto bail_out;
+   }
+
+   if (fseek(fp, 0, SEEK_SET) != 0 ||
+       fwrite(&header, sizeof(header), 1, fp) != 1 ||
+       fflush(fp) != 0) {
+      goto bail_out;
+   }
+
+   m_map_size = offset + nr_blocks * sizeof(uint64_t);
+   m_map = (char *)mmap(NULL, m_map_size, PROT_READ | PROT_WRITE, MAP_SHARED, fileno(fp), 0);
+   if (m_map == MAP_FAILED) {
+      berrno be;
+
+      m_map = NULL;
+      Jmsg2(jcr, M_FATAL, 0, _("Unable to mmap accurate file %s: ERR=%s\n"),
+            m_file_name, be.bstrerror());
+      goto bail_out;
+   }
+
+   m_header = (accurate_mmap_header *)m_map;
+   m_index = (uint64_t *)(m_map + m_header->index_offset);
+
+   Dmsg3(dbglvl, "Merged %d runs into %llu entries in %llu blocks\n",
+         m_nr_runs, m_header->nr_entries, m_header->nr_blocks);
+
+   retval = true;
+
+bail_out:
+   if (!retval && !m_map) {
+      berrno be;
+
+      Jmsg2(jcr, M_FATAL, 0, _("Unable to write accurate file %s: ERR=%s\n"),
+            m_file_name, be.bstrerror());
+   }
+
+   if (spill_map) {
+      munmap(spill_map, m_spill_size);
+   }
+
+   if (heap) {
+      free(heap);
+   }
+
+   if (index) {
+      free(index);
+   }
+
+   fclose(fp);
+
+   return retval;
+}
+
+bool B_ACCURATE_MMAP::end_load(JCR *jcr)
+{
+   bool retval;
+
+   if (!m_spill) {
+      return false;
+   }
+
+   if (!flush_run(jcr)) {
+      return false;
+   }
+
+   if (fflush(m_spill) != 0) {
+      berrno be;
+
+      Jmsg2(jcr, M_FATAL, 0, _("Unable to write accurate spill file %s: ERR=%s\n"),
+            m_spill_name, be.bstrerror());
+      return false;
+   }
+
+   /*
+    * The run buffer is no longer needed.
+    */
+   free(m_run_buf);
+   m_run_buf = NULL;
+   free(m_run_entries);
+   m_run_entries = NULL;
+
+   retval = merge_runs(jcr);
+
+   /*
+    * Get rid of the spill file.
+    */
+   fclose(m_spill);
+   m_spill = NULL;
+   secure_erase(jcr, m_spill_name);
+
+   if (m_runs) {
+      free(m_runs);
+      m_runs = NULL;
+   }
+
+   return retval;
+}
+
+void B_ACCURATE_MMAP::decode_entry(uint8_t *p, accurate_mmap_entry *entry)
+{
+   entry->prefix_length = get_varint(p);
+   entry->suffix_length = get_varint(p);
+   entry->lstat_length = get_varint(p);
+   entry->chksum_length = get_varint(p);
+   entry->filenr = get_varint(p);
+   entry->delta_seq = p;
+   p += sizeof(int32_t);
+   entry->suffix = (char *)p;
+   entry->lstat = entry->suffix + entry->suffix_length;
+   entry->chksum = entry->lstat + entry->lstat_length;
+   entry->next = (uint8_t *)entry->chksum + entry->chksum_length;
+}
+
+/*
+ * Find an entry by doing a binary search on the first names of the blocks
+ * and then scanning the block that can contain the name.
+ * On success m_name holds the full name of the entry.
+ */
+bool B_ACCURATE_MMAP::find_entry(char *fname, accurate_mmap_entry *entry)
+{
+   int result;
+   int fname_length;
+   uint64_t lo, hi, mid, block, nr_entries;
+   uint8_t *p;
+
+   if (!m_map || m_header->nr_entries == 0) {
+      return false;
+   }
+
+   fname_length = strlen(fname);
+
+   lo = 0;
+   hi = m_header->nr_blocks;
+   while (lo < hi) {
+      mid = lo + (hi - lo) / 2;
+      decode_entry((uint8_t *)m_map + m_index[mid], entry);
+      if (compare_name(fname, fname_length, entry->suffix, entry->suffix_length) < 0) {
+         hi = mid;
+      } else {
+         lo = mid + 1;
+      }
+   }
+
+   if (lo == 0) {
+      return false;
+   }
+   block = lo - 1;
+
+   nr_entries = MIN(ACCURATE_MMAP_BLOCK_ENTRIES,
+                    m_header->nr_entries - block * ACCURATE_MMAP_BLOCK_ENTRIES);
+   p = (uint8_t *)m_map + m_index[block];
+   for (uint64_t i = 0; i < nr_entries; i++) {
+      decode_entry(p, entry);
+      m_name = check_pool_memory_size(m_name, entry->prefix_length + entry->suffix_length + 1);
+      memcpy(m_name + entry->prefix_length, entry->suffix, entry->suffix_length);
+      m_name[entry->prefix_length + entry->suffix_length] = '\0';
+
+      result = strcmp(fname, m_name);
+      if (result == 0) {
+         return true;
+      } else if (result < 0) {
+         break;
+      }
+      p = entry->next;
+   }
+
+   return false;
+}
+
+/*
+ * Make a private copy of the payload of an entry.
+ */
+accurate_payload *B_ACCURATE_MMAP::fill_payload(accurate_mmap_entry *entry)
+{
+   accurate_payload *payload;
+
+   m_pay_load = check_pool_memory_size(m_pay_load, sizeof(accurate_payload) +
+                                       entry->lstat_length + entry->chksum_length + 2);
+
+   payload = (accurate_payload *)m_pay_load;
+   payload->lstat = (char *)payload + sizeof(accurate_payload);
+   memcpy(payload->lstat, entry->lstat, entry->lstat_length);
+   payload->lstat[entry->lstat_length] = '\0';
+
+   payload->chksum = payload->lstat + entry->lstat_length + 1;
+   memcpy(payload->chksum, entry->chksum, entry->chksum_length);
+   payload->chksum[entry->chksum_length] = '\0';
+
+   memcpy(&payload->delta_seq, entry->delta_seq, sizeof(int32_t));
+   payload->filenr = entry->filenr;
+
+   return payload;
+}
+
+accurate_payload *B_ACCURATE_MMAP::lookup_payload(JCR *jcr, char *fname)
+{
+   accurate_mmap_entry entry;
+
+   if (!find_entry(fname, &entry)) {
+      return NULL;
+   }
+
+   return fill_payload(&entry);
+}
+
+/*
+ * The payload can only be updated in place, so the lstat and chksum
+ * fields must keep their size.
+ */
+bool B_ACCURATE_MMAP::update_payload(JCR *jcr, char *fname, accurate_payload *payload)
+{
+   accurate_mmap_entry entry;
+
+   if (!find_entry(fname, &entry)) {
+      return false;
+   }
+
+   if (strlen(payload->lstat) != entry.lstat_length ||
+       strlen(payload->chksum) != entry.chksum_length) {
+      Dmsg1(dbglvl, "Unable to update payload of <%s> in place\n", fname);
+      return false;
+   }
+
+   memcpy(entry.lstat, payload->lstat, entry.lstat_length);
+   memcpy(entry.chksum, payload->chksum, entry.chksum_length);
+   memcpy(entry.delta_seq, &payload->delta_seq, sizeof(int32_t));
+
+   return true;
+}
+
+bool B_ACCURATE_MMAP::send_base_file_list(JCR *jcr)
+{
+   uint8_t *p;
+   FF_PKT *ff_pkt;
+   int32_t LinkFIc;
+   struct stat statp;
+   accurate_payload *payload;
+   accurate_mmap_entry entry;
+   int stream = STREAM_UNIX_ATTRIBUTES;
+
+   if (!jcr->accurate || jcr->getJobLevel() != L_FULL) {
+      return true;
+   }
+
+   if (!m_map || m_header->nr_entries == 0) {
+      return true;
+   }
+
+   ff_pkt = init_find_files();
+   ff_pkt->type = FT_BASE;
+
+   p = (uint8_t *)m_map + m_index[0];
+   for (uint64_t i = 0; i < m_header->nr_entries; i++) {
+      decode_entry(p, &entry);
+      p = entry.next;
+
+      m_name = check_pool_memory_size(m_name, entry.prefix_length + entry.suffix_length + 1);
+      memcpy(m_name + entry.prefix_length, entry.suffix, entry.suffix_length);
+      m_name[entry.prefix_length + entry.suffix_length] = '\0';
+
+      if (bit_is_set(entry.filenr, m_seen_bitmap)) {
+         Dmsg1(dbglvl, "base file fname=%s\n", m_name);
+         payload = fill_payload(&entry);
+         decode_stat(payload->lstat, &statp, sizeof(statp), &LinkFIc); /* decode catalog stat */
+         ff_pkt->fname = m_name;
+         ff_pkt->statp = statp;
+         encode_and_send_attributes(jcr, ff_pkt, stream);
+      }
+   }
+
+   term_find_files(ff_pkt);
+   return true;
+}
+
+bool B_ACCURATE_MMAP::send_deleted_list(JCR *jcr)
+{
+   uint8_t *p;
+   FF_PKT *ff_pkt;
+   int32_t LinkFIc;
+   struct stat statp;
+   accurate_payload *payload;
+   accurate_mmap_entry entry;
+   int stream = STREAM_UNIX_ATTRIBUTES;
+
+   if (!jcr->accurate) {
+      return true;
+   }
+
+   if (!m_map || m_header->nr_entries == 0) {
+      return true;
+   }
+
+   ff_pkt = init_find_files();
+   ff_pkt->type = FT_DELETED;
+
+   p = (uint8_t *)m_map + m_index[0];
+   for (uint64_t i = 0; i < m_header->nr_entries; i++) {
+      decode_entry(p, &entry);
+      p = entry.next;
+
+      m_name = check_pool_memory_size(m_name, entry.prefix_length + entry.suffix_length + 1);
+      memcpy(m_name + entry.prefix_length, entry.suffix, entry.suffix_length);
+      m_name[entry.prefix_length + entry.suffix_length] = '\0';
+
+      if (bit_is_set(entry.filenr, m_seen_bitmap) ||
+          plugin_check_file(jcr, m_name)) {
+         continue;
+      }
+
+      Dmsg1(dbglvl, "deleted fname=%s\n", m_name);
+      payload = fill_payload(&entry);
+      decode_stat(payload->lstat, &statp, sizeof(statp), &LinkFIc); /* decode catalog stat */
+      ff_pkt->fname = m_name;
+      ff_pkt->statp.st_mtime = statp.st_mtime;
+      ff_pkt->statp.st_ctime = statp.st_ctime;
+      encode_and_send_attributes(jcr, ff_pkt, stream);
+   }
+
+   term_find_files(ff_pkt);
+   return true;
+}
+
+void B_ACCURATE_MMAP::destroy(JCR *jcr)
+{
+   if (m_map) {
+      munmap(m_map, m_map_size);
+      m_map = NULL;
+      m_header = NULL;
+      m_index = NULL;
+   }
+
+   if (m_spill) {
+      fclose(m_spill);
+      m_spill = NULL;
+      secure_erase(jcr, m_spill_name);
+   }
+
+   if (m_spill_name) {
+      free_pool_memory(m_spill_name);
+      m_spill_name = NULL;
+   }
+
+   if (m_file_name) {
+      secure_erase(jcr, m_file_name);
+      free_pool_memory(m_file_name);
+      m_file_name = NULL;
+   }
+
+   if (m_pay_load) {
+      free_pool_memory(m_pay_load);
+      m_pay_load = NULL;
+   }
+
+   if (m_name) {
+      free_pool_memory(m_name);
+      m_name = NULL;
+   }
+
+   if (m_run_buf) {
+      free(m_run_buf);
+      m_run_buf = NULL;
+   }
+
+   if (m_run_entries) {
+      free(m_run_entries);
+      m_run_entries = NULL;
+   }
+
+   if (m_runs) {
+      free(m_runs);
+      m_runs = NULL;
+   }
+
+   if (m_seen_bitmap) {
+      free(m_seen_bitmap);
+      m_seen_bitmap = NULL;
+   }
+
+   m_filenr = 0;
+}
+#endif /* HAVE_MMAP */
@@ -200,3 +200,18 @@ bool authenticate_with_storagedaemon(JCR *jcr)
 
    return result;
 }
+
+/**
+ * Authenticate an additional data connection with the Storage daemon.
+ *
+ * The key is handed out by the Storage daemon when it grants the data streams.
+ */
+bool authenticate_data_stream_with_storagedaemon(JCR *jcr, BSOCK *sd, char *key)
+{
+   s_password password;
+
+   password.encoding = p_encoding_md5;
+   password.value = key;
+
+   return sd->authenticate_outbound_connection(jcr, "Storage daemon", "", password, me->tls);
+}
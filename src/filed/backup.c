@@ -104,7 +104,12 @@ bool blast_data_to_storage_daemon(JCR *jcr, char *addr, crypto_cipher_t cipher)
       return false;
    }
 
+   if (!start_compress_pipeline(jcr)) {
+      return false;
+   }
+
    if (!crypto_session_start(jcr, cipher)) {
+      stop_compress_pipeline(jcr);
       return false;
    }
 
@@ -119,6 +124,16 @@ bool blast_data_to_storage_daemon(JCR *jcr, char *addr, crypto_cipher_t cipher)
 
    start_heartbeat_monitor(jcr);
 
+   /**
+    * Coalesce the many small attribute and data packets into larger writes.
+    */
+   sd->set_coalescing();
+
+   /**
+    * Stripe the packets over the additional data streams to the SD, if any.
+    */
+   sd->set_striping();
+
    if (have_acl) {
       jcr->acl_data = (acl_data_t *)malloc(sizeof(acl_data_t));
       memset(jcr->acl_data, 0, sizeof(acl_data_t));
@@ -159,6 +174,8 @@ bool blast_data_to_storage_daemon(JCR *jcr, char *addr, crypto_cipher_t cipher)
    stop_heartbeat_monitor(jcr);
 
    sd->signal(BNET_EOD);            /* end of sending data */
+   sd->clear_striping();
+   sd->clear_coalescing();
 
    if (have_acl && jcr->acl_data) {
       free_pool_memory(jcr->acl_data->u.build->content);
@@ -179,6 +196,7 @@ bool blast_data_to_storage_daemon(JCR *jcr, char *addr, crypto_cipher_t cipher)
       jcr->big_buf = NULL;
    }
 
+   stop_compress_pipeline(jcr);
    cleanup_compression(jcr);
    crypto_session_end(jcr);
 
@@ -1101,6 +1119,118 @@ bail_out:
 }
 #endif
 
+/**
+ * Send the content of a file using the parallel compression pipeline.
+ *
+ * The data is read and postprocessed the same way as send_data_to_sd() does
+ * but the compression is done by the compression threads of the pipeline.
+ * Encryption is not supported as the cipher needs to process the compressed
+ * data sequentially.
+ */
+static inline bool send_pipelined_data(b_ctx &bctx)
+{
+   bool retval = false;
+   int32_t rlen;
+   uint32_t offset_len = 0;
+   compress_slot *slot;
+   JCR *jcr = bctx.jcr;
+   BSOCK *sd = jcr->store_bsock;
+
+   if (bit_is_set(FO_SPARSE, bctx.ff_pkt->flags) || bit_is_set(FO_OFFSETS, bctx.ff_pkt->flags)) {
+      offset_len = OFFSET_FADDR_SIZE;
+   }
+
+   while (1) {
+      slot = compress_pipeline_get_slot(jcr);
+      if (!slot) {
+         goto bail_out;
+      }
+
+      /*
+       * Read the file data
+       */
+      rlen = (int32_t)bread(&bctx.ff_pkt->bfd, slot->rbuf, bctx.rsize);
+      if (rlen <= 0) {
+         break;
+      }
+
+      /*
+       * Check for sparse blocks
+       */
+      if (bit_is_set(FO_SPARSE, bctx.ff_pkt->flags)) {
+         bool allZeros;
+         ser_declare;
+
+         allZeros = false;
+         if ((rlen == bctx.rsize &&
+             (bctx.fileAddr + rlen < (uint64_t)bctx.ff_pkt->statp.st_size)) ||
+             ((bctx.ff_pkt->type == FT_RAW ||
+               bctx.ff_pkt->type == FT_FIFO) &&
+             ((uint64_t)bctx.ff_pkt->statp.st_size == 0))) {
+            allZeros = is_buf_zero(slot->rbuf, bctx.rsize);
+         }
+
+         if (!allZeros) {
+            /*
+             * Put file address as first data in buffer
+             */
+            ser_begin(slot->wbuf, OFFSET_FADDR_SIZE);
+            ser_uint64(bctx.fileAddr); /* store fileAddr in begin of buffer */
+         }
+
+         bctx.fileAddr += rlen; /* update file address */
+
+         /*
+          * Skip block of all zeros, the slot is reused for the next read.
+          */
+         if (allZeros) {
+            continue;
+         }
+      } else if (bit_is_set(FO_OFFSETS, bctx.ff_pkt->flags)) {
+         ser_declare;
+         ser_begin(slot->wbuf, OFFSET_FADDR_SIZE);
+         ser_uint64(bctx.ff_pkt->bfd.offset); /* store offset in begin of buffer */
+      }
+
+      jcr->ReadBytes += rlen; /* count bytes read */
+
+      /*
+       * Update checksum if requested
+       */
+      if (bctx.digest) {
+         crypto_digest_update(bctx.digest, (uint8_t *)slot->rbuf, rlen);
+      }
+
+      /*
+       * Update signing digest if requested
+       */
+      if (bctx.signing_digest) {
+         crypto_digest_update(bctx.signing_digest, (uint8_t *)slot->rbuf, rlen);
+      }
+
+      slot->algo = bctx.ff_pkt->Compress_algo;
+      slot->level = bctx.ff_pkt->Compress_level;
+      slot->header = (bctx.chead != NULL);
+      slot->ch = bctx.ch;
+      slot->offset_len = offset_len;
+      slot->rlen = rlen;
+
+      if (!compress_pipeline_queue_slot(jcr, slot)) {
+         goto bail_out;
+      }
+   }
+
+   if (!compress_pipeline_flush(jcr)) {
+      goto bail_out;
+   }
+
+   sd->msglen = rlen; /* let caller check for read errors */
+   retval = true;
+
+bail_out:
+   return retval;
+}
+
 /**
  * Send the content of a file on anything but an EFS filesystem.
  */
@@ -1109,6 +1239,17 @@ static inline bool send_plain_data(b_ctx &bctx)
    bool retval = false;
    BSOCK *sd = bctx.jcr->store_bsock;
 
+   /*
+    * Let the compression threads compress the data when the
+    * fileset options ask for it.
+    */
+   if (bctx.jcr->compress_pipeline &&
+       bctx.ff_pkt->compress_threads > 1 &&
+       bit_is_set(FO_COMPRESS, bctx.ff_pkt->flags) &&
+       !bit_is_set(FO_ENCRYPT, bctx.ff_pkt->flags)) {
+      return send_pipelined_data(bctx);
+   }
+
    /*
     * Read the file data
     */
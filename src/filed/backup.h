@@ -60,4 +60,28 @@ struct b_ctx {
    DIGEST *signing_digest;      /* Signing Digest */
    CIPHER_CONTEXT *cipher_ctx;  /* Cipher context */
 };
+
+/*
+ * Slot states of the parallel compression pipeline.
+ */
+enum {
+   CS_FREE = 0,                 /* Slot available for reading data */
+   CS_FILLED,                   /* Data read, waiting for a compression thread */
+   CS_BUSY,                     /* Data being compressed */
+   CS_COMPRESSED,               /* Data compressed, waiting to be sent to the SD */
+   CS_ERROR                     /* Compression failed */
+};
+
+struct compress_slot {
+   int state;                   /* State of this slot */
+   uint32_t algo;               /* Compression algorithm to use */
+   int level;                   /* Compression level to use */
+   bool header;                 /* Generate a comp_stream_header */
+   comp_stream_header ch;       /* Compression Stream Header with info about compression used */
+   uint32_t offset_len;         /* Size of fileAddr stored at begin of wbuf */
+   POOLMEM *rbuf;               /* Uncompressed data */
+   uint32_t rlen;               /* Length of uncompressed data */
+   POOLMEM *wbuf;               /* Compressed data to send to the SD */
+   uint32_t wlen;               /* Length of data to send to the SD */
+};
 #endif
@@ -32,7 +32,7 @@
 #include "bareos.h"
 #include "filed.h"
 
-#if defined(HAVE_LZO) || defined(HAVE_LIBZ) || defined(HAVE_FASTLZ)
+#if defined(HAVE_LZO) || defined(HAVE_LIBZ) || defined(HAVE_FASTLZ) || defined(HAVE_ZSTD)
 
 #if defined(HAVE_LIBZ)
 #include <zlib.h>
@@ -42,6 +42,10 @@
 #include <fastlzlib.h>
 #endif
 
+#if defined(HAVE_ZSTD)
+#include <zstd.h>
+#endif
+
 /**
  * For compression we enable all used compressors in the fileset.
  */
@@ -66,7 +70,7 @@ bool adjust_compression_buffers(JCR *jcr)
       }
 
       if (compress_buf_size > 0) {
-         jcr->compress.deflate_buffer = get_memory(compress_buf_size);
+         jcr->compress.deflate_buffer = get_large_memory(compress_buf_size);
          jcr->compress.deflate_buffer_size = compress_buf_size;
       }
    }
@@ -84,13 +88,98 @@ bool adjust_decompression_buffers(JCR *jcr)
    setup_decompression_buffers(jcr, &decompress_buf_size);
 
    if (decompress_buf_size > 0) {
-      jcr->compress.inflate_buffer = get_memory(decompress_buf_size);
+      jcr->compress.inflate_buffer = get_large_memory(decompress_buf_size);
       jcr->compress.inflate_buffer_size = decompress_buf_size;
    }
 
    return true;
 }
 
+/**
+ * Set the per file compression parameters on a compression workset.
+ */
+static bool set_compression_parameters(JCR *jcr, CMPRS_CTX *ctx, uint32_t compression_algorithm, int level)
+{
+   switch (compression_algorithm) {
+#if defined(HAVE_LIBZ)
+   case COMPRESS_GZIP: {
+      z_stream *pZlibStream;
+
+      /**
+       * Only change zlib parameters if there is no pending operation.
+       * This should never happen as deflateReset is called after each
+       * deflate.
+       */
+      pZlibStream = (z_stream *)ctx->workset.pZLIB;
+      if (pZlibStream->total_in == 0) {
+         int zstat;
+
+         /*
+          * Set gzip compression level - must be done per file
+          */
+         if ((zstat = deflateParams(pZlibStream, level, Z_DEFAULT_STRATEGY)) != Z_OK) {
+            Jmsg(jcr, M_FATAL, 0, _("Compression deflateParams error: %d\n"), zstat);
+            jcr->setJobStatus(JS_ErrorTerminated);
+            return false;
+         }
+      }
+      break;
+   }
+#endif
+#if defined(HAVE_FASTLZ)
+   case COMPRESS_FZFZ:
+   case COMPRESS_FZ4L:
+   case COMPRESS_FZ4H: {
+      int zstat;
+      zfast_stream *pZfastStream;
+      zfast_stream_compressor compressor = COMPRESSOR_FASTLZ;
+
+      /**
+       * Only change fastlz parameters if there is no pending operation.
+       * This should never happen as fastlzlibCompressReset is called after each
+       * fastlzlibCompress.
+       */
+      pZfastStream = (zfast_stream *)ctx->workset.pZFAST;
+      if (pZfastStream->total_in == 0) {
+         switch (compression_algorithm) {
+         case COMPRESS_FZ4L:
+         case COMPRESS_FZ4H:
+            compressor = COMPRESSOR_LZ4;
+            break;
+         }
+
+         if ((zstat = fastlzlibSetCompressor(pZfastStream, compressor)) != Z_OK) {
+            Jmsg(jcr, M_FATAL, 0, _("Compression fastlzlibSetCompressor error: %d\n"), zstat);
+            jcr->setJobStatus(JS_ErrorTerminated);
+            return false;
+         }
+      }
+      break;
+   }
+#endif
+#if defined(HAVE_ZSTD)
+   case COMPRESS_ZSTD: {
+      size_t zstat;
+
+      /*
+       * Set zstd compression level - must be done per file
+       */
+      zstat = ZSTD_CCtx_setParameter((ZSTD_CCtx *)ctx->workset.pZSTD, ZSTD_c_compressionLevel, level);
+      if (ZSTD_isError(zstat)) {
+         Jmsg(jcr, M_FATAL, 0, _("Compression ZSTD_CCtx_setParameter error: %s\n"), ZSTD_getErrorName(zstat));
+         jcr->setJobStatus(JS_ErrorTerminated);
+         return false;
+      }
+      break;
+   }
+#endif
+   default:
+      break;
+   }
+
+   return true;
+}
+
 bool setup_compression_context(b_ctx &bctx)
 {
    bool retval = false;
@@ -138,81 +227,426 @@ bool setup_compression_context(b_ctx &bctx)
       }
 
       /*
-       * Do compression specific actions and set the magic, header version and compression level.
+       * Do compression specific actions and set the compression level.
        */
-      switch (bctx.ff_pkt->Compress_algo) {
-#if defined(HAVE_LIBZ)
-      case COMPRESS_GZIP: {
-         z_stream *pZlibStream;
+      if (!set_compression_parameters(bctx.jcr, &bctx.jcr->compress,
+                                      bctx.ff_pkt->Compress_algo,
+                                      bctx.ff_pkt->Compress_level)) {
+         goto bail_out;
+      }
 
-         /**
-          * Only change zlib parameters if there is no pending operation.
-          * This should never happen as deflateReset is called after each
-          * deflate.
-          */
-         pZlibStream = (z_stream *)bctx.jcr->compress.workset.pZLIB;
-         if (pZlibStream->total_in == 0) {
-            int zstat;
-
-            /*
-             * Set gzip compression level - must be done per file
-             */
-            if ((zstat = deflateParams(pZlibStream, bctx.ff_pkt->Compress_level, Z_DEFAULT_STRATEGY)) != Z_OK) {
-               Jmsg(bctx.jcr, M_FATAL, 0, _("Compression deflateParams error: %d\n"), zstat);
-               bctx.jcr->setJobStatus(JS_ErrorTerminated);
-               goto bail_out;
-            }
-         }
+      /*
+       * LZO has no compression levels.
+       */
+      if (bctx.ff_pkt->Compress_algo != COMPRESS_LZO1X) {
          bctx.ch.level = bctx.ff_pkt->Compress_level;
+      }
+   }
+
+   retval = true;
+
+bail_out:
+   return retval;
+}
+
+/*
+ * Parallel compression pipeline.
+ *
+ * The thread running the backup reads the file data into a ring of slots
+ * which are compressed by a set of compression threads each having its own
+ * compression workset. The compressed slots are sent to the SD by the
+ * backup thread in the same order as they were read so the SD sees exactly
+ * the same data stream as with the sequential code path.
+ */
+#define MAX_COMPRESS_THREADS 64
+
+struct compress_pipeline {
+   JCR *jcr;                    /* Job we compress the data for */
+   pthread_mutex_t lock;        /* Protects the slot states and next_work */
+   pthread_cond_t work;         /* Signalled when a slot is queued or on shutdown */
+   pthread_cond_t done;         /* Signalled when a slot is compressed */
+   bool shutdown;               /* Compression threads should exit */
+   int nr_threads;              /* Number of compression threads */
+   int nr_slots;                /* Number of slots in the ring */
+   uint64_t next_read;          /* Sequence number of the next slot to fill */
+   uint64_t next_work;          /* Sequence number of the next slot to compress */
+   uint64_t next_send;          /* Sequence number of the next slot to send */
+   pthread_t *threads;          /* Compression threads */
+   CMPRS_CTX *contexts;         /* Compression workset per thread */
+   compress_slot *slots;        /* Ring of slots */
+};
+
+struct compress_thread_arg {
+   compress_pipeline *cp;
+   CMPRS_CTX *ctx;
+};
+
+/**
+ * Compress the data of a single slot into its write buffer.
+ */
+static bool compress_slot_data(JCR *jcr, CMPRS_CTX *ctx, compress_slot *slot, uint32_t wbuf_size)
+{
+   uint32_t compress_len, max_compress_len;
+   unsigned char *chead, *cbuf;
+
+   if (!set_compression_parameters(jcr, ctx, slot->algo, slot->level)) {
+      return false;
+   }
+
+   chead = (unsigned char *)slot->wbuf + slot->offset_len;
+   if (slot->header) {
+      cbuf = chead + sizeof(comp_stream_header);
+      max_compress_len = wbuf_size - (slot->offset_len + sizeof(comp_stream_header));
+   } else {
+      cbuf = chead;
+      max_compress_len = wbuf_size - slot->offset_len;
+   }
+
+   if (!compress_data(jcr, ctx, slot->algo, slot->rbuf, slot->rlen,
+                      cbuf, max_compress_len, &compress_len)) {
+      return false;
+   }
+
+   if (slot->header) {
+      ser_declare;
+
+      ser_begin(chead, sizeof(comp_stream_header));
+      ser_uint32(slot->ch.magic);
+      ser_uint32(compress_len);
+      ser_uint16(slot->ch.level);
+      ser_uint16(slot->ch.version);
+      ser_end(chead, sizeof(comp_stream_header));
+
+      compress_len += sizeof(comp_stream_header);
+   }
+
+   slot->wlen = slot->offset_len + compress_len;
+
+   return true;
+}
+
+/**
+ * Compression thread, compresses queued slots in sequence order.
+ */
+extern "C" void *compress_thread(void *arg)
+{
+   compress_thread_arg *cta = (compress_thread_arg *)arg;
+   compress_pipeline *cp = cta->cp;
+   CMPRS_CTX *ctx = cta->ctx;
+   JCR *jcr = cp->jcr;
+   compress_slot *slot;
+   bool ok;
+
+   free(cta);
+   set_jcr_in_tsd(jcr);
+
+   P(cp->lock);
+   while (1) {
+      while (!cp->shutdown && cp->next_work == cp->next_read) {
+         pthread_cond_wait(&cp->work, &cp->lock);
+      }
+
+      if (cp->shutdown) {
          break;
-     }
-#endif
-#if defined(HAVE_LZO)
-      case COMPRESS_LZO1X:
-         break;
-#endif
-#if defined(HAVE_FASTLZ)
-      case COMPRESS_FZFZ:
-      case COMPRESS_FZ4L:
-      case COMPRESS_FZ4H: {
-         int zstat;
-         zfast_stream *pZfastStream;
-         zfast_stream_compressor compressor = COMPRESSOR_FASTLZ;
+      }
 
-         /**
-          * Only change fastlz parameters if there is no pending operation.
-          * This should never happen as fastlzlibCompressReset is called after each
-          * fastlzlibCompress.
-          */
-         pZfastStream = (zfast_stream *)bctx.jcr->compress.workset.pZFAST;
-         if (pZfastStream->total_in == 0) {
-
-            switch (bctx.ff_pkt->Compress_algo) {
-            case COMPRESS_FZ4L:
-            case COMPRESS_FZ4H:
-               compressor = COMPRESSOR_LZ4;
-               break;
-            }
+      slot = &cp->slots[cp->next_work % cp->nr_slots];
+      cp->next_work++;
+      slot->state = CS_BUSY;
+      V(cp->lock);
+
+      ok = compress_slot_data(jcr, ctx, slot, jcr->compress.deflate_buffer_size);
+
+      P(cp->lock);
+      slot->state = (ok) ? CS_COMPRESSED : CS_ERROR;
+      pthread_cond_broadcast(&cp->done);
+   }
+   V(cp->lock);
+
+   return NULL;
+}
+
+/**
+ * Wait for all outstanding slots to finish compressing and throw them away.
+ */
+static void discard_slots(compress_pipeline *cp)
+{
+   compress_slot *slot;
+
+   P(cp->lock);
+   while (cp->next_send < cp->next_read) {
+      slot = &cp->slots[cp->next_send % cp->nr_slots];
+      while (slot->state == CS_FILLED || slot->state == CS_BUSY) {
+         pthread_cond_wait(&cp->done, &cp->lock);
+      }
+      slot->state = CS_FREE;
+      cp->next_send++;
+   }
+   cp->next_work = cp->next_read;
+   V(cp->lock);
+}
+
+/**
+ * Send the oldest outstanding slot to the SD. When wait is false we only
+ * send it when it is already compressed. Sets sent to indicate if a slot
+ * was sent, returns false on error.
+ */
+static bool send_next_slot(compress_pipeline *cp, bool wait, bool *sent)
+{
+   JCR *jcr = cp->jcr;
+   BSOCK *sd = jcr->store_bsock;
+   compress_slot *slot;
+   POOLMEM *msgsave;
+   bool ok;
+
+   *sent = false;
+   if (cp->next_send == cp->next_read) {
+      return true;
+   }
+
+   slot = &cp->slots[cp->next_send % cp->nr_slots];
+
+   P(cp->lock);
+   while (slot->state == CS_FILLED || slot->state == CS_BUSY) {
+      if (!wait) {
+         V(cp->lock);
+         return true;
+      }
+      pthread_cond_wait(&cp->done, &cp->lock);
+   }
+   V(cp->lock);
+
+   if (slot->state == CS_ERROR) {
+      discard_slots(cp);
+      return false;
+   }
+
+   /*
+    * Send the buffer to the Storage daemon
+    */
+   msgsave = sd->msg;
+   sd->msg = slot->wbuf;
+   sd->msglen = slot->wlen;
+   ok = sd->send();
+   if (ok) {
+      Dmsg1(130, "Send data to SD len=%d\n", sd->msglen);
+      jcr->JobBytes += sd->msglen; /* count bytes saved possibly compressed */
+   } else if (!jcr->is_job_canceled()) {
+      Jmsg1(jcr, M_FATAL, 0, _("Network send error to SD. ERR=%s\n"), sd->bstrerror());
+   }
+   sd->msg = msgsave;
+
+   if (!ok) {
+      discard_slots(cp);
+      return false;
+   }
+
+   P(cp->lock);
+   slot->state = CS_FREE;
+   cp->next_send++;
+   V(cp->lock);
 
-            if ((zstat = fastlzlibSetCompressor(pZfastStream, compressor)) != Z_OK) {
-               Jmsg(bctx.jcr, M_FATAL, 0, _("Compression fastlzlibSetCompressor error: %d\n"), zstat);
-               bctx.jcr->setJobStatus(JS_ErrorTerminated);
+   *sent = true;
+   return true;
+}
+
+/**
+ * Start the parallel compression pipeline when any of the options in the
+ * fileset asks for more then one compression thread.
+ */
+bool start_compress_pipeline(JCR *jcr)
+{
+   int i, j;
+   int status;
+   int nr_threads = 0;
+   uint32_t compress_buf_size;
+   compress_pipeline *cp;
+   findFILESET *fileset = jcr->ff->fileset;
+
+   if (!fileset || !jcr->compress.deflate_buffer) {
+      return true;
+   }
+
+   for (i = 0; i < fileset->include_list.size(); i++) {
+      findINCEXE *incexe = (findINCEXE *)fileset->include_list.get(i);
+      for (j = 0; j < incexe->opts_list.size(); j++) {
+         findFOPTS *fo = (findFOPTS *)incexe->opts_list.get(j);
+
+         if (bit_is_set(FO_COMPRESS, fo->flags) && fo->compress_threads > nr_threads) {
+            nr_threads = fo->compress_threads;
+         }
+      }
+   }
+
+   if (nr_threads <= 1) {
+      return true;
+   }
+
+   if (nr_threads > MAX_COMPRESS_THREADS) {
+      nr_threads = MAX_COMPRESS_THREADS;
+   }
+
+   cp = (compress_pipeline *)malloc(sizeof(compress_pipeline));
+   memset(cp, 0, sizeof(compress_pipeline));
+   cp->jcr = jcr;
+   cp->nr_slots = 2 * nr_threads + 2;
+   pthread_mutex_init(&cp->lock, NULL);
+   pthread_cond_init(&cp->work, NULL);
+   pthread_cond_init(&cp->done, NULL);
+
+   cp->slots = (compress_slot *)malloc(cp->nr_slots * sizeof(compress_slot));
+   memset(cp->slots, 0, cp->nr_slots * sizeof(compress_slot));
+   for (i = 0; i < cp->nr_slots; i++) {
+      cp->slots[i].rbuf = get_large_memory(jcr->buf_size);
+      cp->slots[i].wbuf = get_large_memory(jcr->compress.deflate_buffer_size);
+   }
+
+   /*
+    * Each compression thread gets its own compression workset with all
+    * compressors used in the fileset enabled.
+    */
+   cp->contexts = (CMPRS_CTX *)malloc(nr_threads * sizeof(CMPRS_CTX));
+   memset(cp->contexts, 0, nr_threads * sizeof(CMPRS_CTX));
+   cp->threads = (pthread_t *)malloc(nr_threads * sizeof(pthread_t));
+   jcr->compress_pipeline = cp;
+
+   for (i = 0; i < nr_threads; i++) {
+      compress_thread_arg *cta;
+
+      for (j = 0; j < fileset->include_list.size(); j++) {
+         findINCEXE *incexe = (findINCEXE *)fileset->include_list.get(j);
+         for (int k = 0; k < incexe->opts_list.size(); k++) {
+            findFOPTS *fo = (findFOPTS *)incexe->opts_list.get(k);
+
+            compress_buf_size = 0;
+            if (!setup_compression_buffers(jcr, &cp->contexts[i], me->compatible,
+                                           fo->Compress_algo, &compress_buf_size)) {
+               cleanup_compression_workset(&cp->contexts[i]);
                goto bail_out;
             }
          }
-         bctx.ch.level = bctx.ff_pkt->Compress_level;
-         break;
       }
-#endif
-      default:
-         break;
+
+      cta = (compress_thread_arg *)malloc(sizeof(compress_thread_arg));
+      cta->cp = cp;
+      cta->ctx = &cp->contexts[i];
+      if ((status = pthread_create(&cp->threads[i], NULL, compress_thread, (void *)cta)) != 0) {
+         berrno be;
+
+         free(cta);
+         cleanup_compression_workset(&cp->contexts[i]);
+         Jmsg1(jcr, M_FATAL, 0, _("Cannot create compression thread: %s\n"), be.bstrerror(status));
+         goto bail_out;
       }
+      cp->nr_threads++;
    }
 
-   retval = true;
+   Dmsg1(100, "Started compression pipeline with %d threads\n", cp->nr_threads);
+
+   return true;
 
 bail_out:
-   return retval;
+   stop_compress_pipeline(jcr);
+   return false;
+}
+
+/**
+ * Stop the compression threads and free the pipeline.
+ */
+void stop_compress_pipeline(JCR *jcr)
+{
+   int i;
+   compress_pipeline *cp = jcr->compress_pipeline;
+
+   if (!cp) {
+      return;
+   }
+
+   discard_slots(cp);
+
+   P(cp->lock);
+   cp->shutdown = true;
+   pthread_cond_broadcast(&cp->work);
+   V(cp->lock);
+
+   for (i = 0; i < cp->nr_threads; i++) {
+      pthread_join(cp->threads[i], NULL);
+      cleanup_compression_workset(&cp->contexts[i]);
+   }
+
+   for (i = 0; i < cp->nr_slots; i++) {
+      free_pool_memory(cp->slots[i].rbuf);
+      free_pool_memory(cp->slots[i].wbuf);
+   }
+
+   pthread_cond_destroy(&cp->work);
+   pthread_cond_destroy(&cp->done);
+   pthread_mutex_destroy(&cp->lock);
+   free(cp->threads);
+   free(cp->contexts);
+   free(cp->slots);
+   free(cp);
+
+   jcr->compress_pipeline = NULL;
+}
+
+/**
+ * Get a free slot to read data into. When all slots are in use we first
+ * send the oldest one to the SD. Returns NULL on error.
+ */
+compress_slot *compress_pipeline_get_slot(JCR *jcr)
+{
+   bool sent;
+   compress_pipeline *cp = jcr->compress_pipeline;
+
+   while (cp->next_read - cp->next_send >= (uint64_t)cp->nr_slots) {
+      if (!send_next_slot(cp, true, &sent)) {
+         return NULL;
+      }
+   }
+
+   return &cp->slots[cp->next_read % cp->nr_slots];
+}
+
+/**
+ * Hand a filled slot to the compression threads and send any slots
+ * that are already compressed. Returns false on error.
+ */
+bool compress_pipeline_queue_slot(JCR *jcr, compress_slot *slot)
+{
+   bool sent;
+   compress_pipeline *cp = jcr->compress_pipeline;
+
+   P(cp->lock);
+   slot->state = CS_FILLED;
+   cp->next_read++;
+   pthread_cond_signal(&cp->work);
+   V(cp->lock);
+
+   do {
+      if (!send_next_slot(cp, false, &sent)) {
+         return false;
+      }
+   } while (sent);
+
+   return true;
+}
+
+/**
+ * Wait for all queued slots to be compressed and send them to the SD.
+ */
+bool compress_pipeline_flush(JCR *jcr)
+{
+   bool sent;
+   compress_pipeline *cp = jcr->compress_pipeline;
+
+   do {
+      if (!send_next_slot(cp, true, &sent)) {
+         return false;
+      }
+   } while (sent);
+
+   return true;
 }
 
 #else
@@ -226,4 +660,28 @@ bool setup_compression_context(b_ctx &bctx)
 {
    return true;
 }
-#endif /* defined(HAVE_LZO) || defined(HAVE_LIBZ) || defined(HAVE_FASTLZ) */
+
+bool start_compress_pipeline(JCR *jcr)
+{
+   return true;
+}
+
+void stop_compress_pipeline(JCR *jcr)
+{
+}
+
+compress_slot *compress_pipeline_get_slot(JCR *jcr)
+{
+   return NULL;
+}
+
+bool compress_pipeline_queue_slot(JCR *jcr, compress_slot *slot)
+{
+   return false;
+}
+
+bool compress_pipeline_flush(JCR *jcr)
+{
+   return true;
+}
+#endif /* defined(HAVE_LZO) || defined(HAVE_LIBZ) || defined(HAVE_FASTLZ) || defined(HAVE_ZSTD) */
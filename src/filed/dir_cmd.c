@@ -105,6 +105,7 @@ static bool response(JCR *jcr, BSOCK *sd, char *resp, const char *cmd);
 static void filed_free_jcr(JCR *jcr);
 static bool open_sd_read_session(JCR *jcr);
 static void set_storage_auth_key(JCR *jcr, char *key);
+static void open_data_streams(JCR *jcr, BSOCK *sd, int streams, char *key);
 
 /* Exported functions */
 
@@ -294,6 +295,8 @@ static char OK_close[] =
    "3000 OK close Status = %d\n";
 static char OK_open[] =
    "3000 OK open ticket = %d\n";
+static char OK_open_streams[] =
+   "3000 OK open ticket = %d streams=%d key=%127s\n";
 static char OK_data[] =
    "3000 OK data\n";
 static char OK_append[] =
@@ -304,8 +307,12 @@ static char OK_append[] =
  */
 static char append_open[] =
    "append open session\n";
+static char append_open_streams[] =
+   "append open session streams=%d\n";
 static char append_data[] =
    "append data %d\n";
+static char append_data_streams[] =
+   "append data %d streams=%d\n";
 static char append_end[] =
    "append end session %d\n";
 static char append_close[] =
@@ -1007,6 +1014,7 @@ static bool job_cmd(JCR *jcr)
       dir->fsend(BADjob);
       return false;
    }
+   register_jcr_jobid(jcr);
    set_storage_auth_key(jcr, sd_auth_key.c_str());
    Dmsg2(120, "JobId=%d Auth=%s\n", jcr->JobId, jcr->sd_auth_key);
    Mmsg(jcr->errmsg, "JobId=%d Job=%s", jcr->JobId, jcr->Job);
@@ -1736,6 +1744,53 @@ bail_out:
    return false;
 }
 
+/**
+ * Open the additional data connections to the Storage daemon granted
+ * for this backup. The data of the job is striped over them and the
+ * main connection. When not all of them can be opened the job uses
+ * the ones that could.
+ */
+static void open_data_streams(JCR *jcr, BSOCK *sd, int streams, char *key)
+{
+   int i;
+   BSOCK *bs;
+
+   for (i = 1; i < streams; i++) {
+      bs = New(BSOCK_TCP);
+      if (me->nokeepalive) {
+         bs->clear_keepalive();
+      }
+      bs->set_source_address(me->FDsrc_addr);
+
+      if (!bs->connect(jcr, 10, (int)me->SDConnectTimeout, me->heartbeat_interval,
+                       _("Storage daemon"), sd->host(), NULL, sd->port(), 1)) {
+         delete bs;
+         break;
+      }
+
+      bs->fsend("Hello Data Stream %d Job %s\n", i, jcr->Job);
+      if (!authenticate_data_stream_with_storagedaemon(jcr, bs, key)) {
+         bs->close();
+         delete bs;
+         break;
+      }
+
+      sd->add_data_stream(bs);
+   }
+
+   /*
+    * The bandwidth limit of the job is shared by the connections that could be opened.
+    */
+   sd->set_bwlimit(jcr->max_bandwidth);
+
+   if (sd->get_data_streams() < streams) {
+      Jmsg(jcr, M_WARNING, 0, _("Could only open %d of %d data streams to the Storage daemon.\n"),
+           sd->get_data_streams(), streams);
+   } else {
+      Jmsg(jcr, M_INFO, 0, _("Using %d data streams to the Storage daemon.\n"), streams);
+   }
+}
+
 /**
  * Clear a flag in the find options.
  *
@@ -1804,6 +1859,10 @@ static inline void clear_compression_flag_in_fileset(JCR *jcr)
                case COMPRESS_FZ4L:
                case COMPRESS_FZ4H:
                   break;
+#endif
+#if defined(HAVE_ZSTD)
+               case COMPRESS_ZSTD:
+                  break;
 #endif
                default:
                   /*
@@ -1985,21 +2044,37 @@ static bool backup_cmd(JCR *jcr)
    Dmsg1(110, "filed>dird: %s", dir->msg);
 
    /**
-    * Send Append Open Session to Storage daemon
+    * Send Append Open Session to Storage daemon,
+    * asking for additional data streams when configured.
     */
-   sd->fsend(append_open);
+   if (me->data_streams_per_job > 1 && !jcr->passive_client) {
+      sd->fsend(append_open_streams, me->data_streams_per_job);
+   } else {
+      sd->fsend(append_open);
+   }
    Dmsg1(110, ">stored: %s", sd->msg);
 
    /**
     * Expect to receive back the Ticket number
     */
    if (bget_msg(sd) >= 0) {
+      int streams, ticket;
+      char key[MAX_NAME_LENGTH];
+
       Dmsg1(110, "<stored: %s", sd->msg);
       if (sscanf(sd->msg, OK_open, &jcr->Ticket) != 1) {
          Jmsg(jcr, M_FATAL, 0, _("Bad response to append open: %s\n"), sd->msg);
          goto cleanup;
       }
       Dmsg1(110, "Got Ticket=%d\n", jcr->Ticket);
+
+      /**
+       * An older Storage daemon or one that doesn't grant the data streams answers without them.
+       */
+      if (sscanf(sd->msg, OK_open_streams, &ticket, &streams, key) == 3 && streams > 1) {
+         open_data_streams(jcr, sd, streams, key);
+      }
+      memset(key, 0, sizeof(key));
    } else {
       Jmsg(jcr, M_FATAL, 0, _("Bad response from stored to open command\n"));
       goto cleanup;
@@ -2008,7 +2083,11 @@ static bool backup_cmd(JCR *jcr)
    /**
     * Send Append data command to Storage daemon
     */
-   sd->fsend(append_data, jcr->Ticket);
+   if (sd->get_data_streams() > 1) {
+      sd->fsend(append_data_streams, jcr->Ticket, sd->get_data_streams());
+   } else {
+      sd->fsend(append_data, jcr->Ticket);
+   }
    Dmsg1(110, ">stored: %s", sd->msg);
 
    /**
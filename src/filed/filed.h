@@ -37,6 +37,7 @@
 #include "jcr.h"
 #include "lib/breg.h"
 #include "lib/htable.h"
+#include "lib/ohtable.h"
 #include "lib/runscript.h"
 #include "findlib/find.h"
 #include "fd_plugins.h"
@@ -115,11 +115,17 @@ static RES_ITEM cli_items[] = {
    { "Compatible", CFG_TYPE_BOOL, ITEM(res_client.compatible), 0, CFG_ITEM_DEFAULT, "false", NULL, NULL },
    { "MaximumBandwidthPerJob", CFG_TYPE_SPEED, ITEM(res_client.max_bandwidth_per_job), 0, 0, NULL, NULL, NULL },
    { "AllowBandwidthBursting", CFG_TYPE_BOOL, ITEM(res_client.allow_bw_bursting), 0, CFG_ITEM_DEFAULT, "false", NULL, NULL },
+   { "DataStreamsPerJob", CFG_TYPE_PINT32, ITEM(res_client.data_streams_per_job), 0, CFG_ITEM_DEFAULT, "1", "17.4.2-",
+     "Number of network connections to the Storage daemon a backup job stripes its data over." },
    { "AllowedScriptDir", CFG_TYPE_ALIST_DIR, ITEM(res_client.allowed_script_dirs), 0, 0, NULL, NULL, NULL },
    { "AllowedJobCommand", CFG_TYPE_ALIST_STR, ITEM(res_client.allowed_job_cmds), 0, 0, NULL, NULL, NULL },
    { "AbsoluteJobTimeout", CFG_TYPE_PINT32, ITEM(res_client.jcr_watchdog_time), 0, 0, NULL, NULL, NULL },
    { "AlwaysUseLmdb", CFG_TYPE_BOOL, ITEM(res_client.always_use_lmdb), 0, CFG_ITEM_DEFAULT, "false", NULL, NULL },
    { "LmdbThreshold", CFG_TYPE_PINT32, ITEM(res_client.lmdb_threshold), 0, 0, NULL, NULL, NULL },
+   { "AlwaysUseAccurateMmap", CFG_TYPE_BOOL, ITEM(res_client.always_use_accurate_mmap), 0, CFG_ITEM_DEFAULT, "false", "17.4.2-",
+     "Store the accurate file list in a sorted memory mapped file in the working directory." },
+   { "AccurateMmapThreshold", CFG_TYPE_PINT32, ITEM(res_client.accurate_mmap_threshold), 0, 0, NULL, "17.4.2-",
+     "Store the accurate file list in a sorted memory mapped file when it has at least this many entries." },
    { "SecureEraseCommand", CFG_TYPE_STR, ITEM(res_client.secure_erase_cmdline), 0, 0, NULL, "15.2.1-",
      "Specify command that will be called when bareos unlinks files." },
    { "LogTimestampFormat", CFG_TYPE_STR, ITEM(res_client.log_timestamp_format), 0, 0, NULL, "15.2.3-", NULL },
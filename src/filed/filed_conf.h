@@ -93,6 +93,9 @@ public:
    bool nokeepalive;                  /* Don't use SO_KEEPALIVE on sockets */
    bool always_use_lmdb;              /* Use LMDB for accurate data */
    uint32_t lmdb_threshold;           /* Switch to using LDMD when number of accurate entries exceeds treshold. */
+   bool always_use_accurate_mmap;     /* Use a sorted memory mapped file for accurate data */
+   uint32_t accurate_mmap_threshold;  /* Switch to using a sorted memory mapped file when number of accurate entries exceeds treshold. */
+   uint32_t data_streams_per_job;     /* Number of data connections to the SD per backup job */
    X509_KEYPAIR *pki_keypair;         /* Shared PKI Public/Private Keypair */
    alist *pki_signers;                /* Shared PKI Trusted Signers */
    alist *pki_recipients;             /* Shared PKI Recipients */
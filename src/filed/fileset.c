@@ -515,6 +515,7 @@ static int set_options(findFOPTS *fo, const char *opts)
    int j;
    const char *p;
    char strip[21];
+   char threads[21];
    char size[50];
 
    for (p = opts; *p; p++) {
@@ -680,6 +681,36 @@ static int set_options(findFOPTS *fo, const char *opts)
          set_bit(FO_STRIPPATH, fo->flags);
          Dmsg2(100, "strip=%s strip_path=%d\n", strip, fo->strip_path);
          break;
+      case 'T':                         /* Compression threads */
+         /*
+          * Get integer
+          */
+         p++;                           /* skip T */
+         for (j = 0; *p && *p != ':'; p++) {
+            threads[j] = *p;
+            if (j < (int)sizeof(threads) - 1) {
+               j++;
+            }
+         }
+         threads[j] = 0;
+         fo->compress_threads = atoi(threads);
+         Dmsg2(100, "threads=%s compress_threads=%d\n", threads, fo->compress_threads);
+         break;
+      case 'L':                         /* Walker threads */
+         /*
+          * Get integer
+          */
+         p++;                           /* skip L */
+         for (j = 0; *p && *p != ':'; p++) {
+            threads[j] = *p;
+            if (j < (int)sizeof(threads) - 1) {
+               j++;
+            }
+         }
+         threads[j] = 0;
+         fo->walker_threads = atoi(threads);
+         Dmsg2(100, "threads=%s walker_threads=%d\n", threads, fo->walker_threads);
+         break;
       case 'p':                         /* Use portable data format */
          set_bit(FO_PORTABLE, fo->flags);
          break;
@@ -768,6 +799,16 @@ static int set_options(findFOPTS *fo, const char *opts)
                fo->Compress_algo = COMPRESS_FZ4H;
                fo->Compress_level = 1;     /* not used with FZ4H */
             }
+         } else if (*p == 's') {
+            /*
+             * ZSTD level is always encoded as two digits.
+             */
+            if (B_ISDIGIT(p[1]) && B_ISDIGIT(p[2])) {
+               set_bit(FO_COMPRESS, fo->flags);
+               fo->Compress_algo = COMPRESS_ZSTD;
+               fo->Compress_level = (p[1] - '0') * 10 + (p[2] - '0');
+               p += 2;
+            }
          }
          break;
       case 'z':                         /* Min, max or approx size or size range */
@@ -38,6 +38,7 @@ bool authenticate_director(JCR *jcr);
 bool authenticate_with_director(JCR *jcr, DIRRES *director);
 bool authenticate_storagedaemon(JCR *jcr);
 bool authenticate_with_storagedaemon(JCR *jcr);
+bool authenticate_data_stream_with_storagedaemon(JCR *jcr, BSOCK *sd, char *key);
 
 /* backup.c */
 bool blast_data_to_storage_daemon(JCR *jcr, char *addr, crypto_cipher_t cipher);
@@ -49,6 +50,11 @@ void unstrip_path(FF_PKT *ff_pkt);
 bool adjust_compression_buffers(JCR *jcr);
 bool adjust_decompression_buffers(JCR *jcr);
 bool setup_compression_context(b_ctx &bctx);
+bool start_compress_pipeline(JCR *jcr);
+void stop_compress_pipeline(JCR *jcr);
+compress_slot *compress_pipeline_get_slot(JCR *jcr);
+bool compress_pipeline_queue_slot(JCR *jcr, compress_slot *slot);
+bool compress_pipeline_flush(JCR *jcr);
 
 /* crypto.c */
 bool crypto_session_start(JCR *jcr, crypto_cipher_t cipher);
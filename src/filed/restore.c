@@ -87,6 +87,11 @@ const bool have_fastlz = true;
 #else
 const bool have_fastlz = false;
 #endif
+#if defined(HAVE_ZSTD)
+const bool have_zstd = true;
+#else
+const bool have_zstd = false;
+#endif
 
 static void free_signature(r_ctx &rctx);
 static bool close_previous_stream(JCR *jcr, r_ctx &rctx);
@@ -419,7 +424,7 @@ void do_restore(JCR *jcr)
    }
    jcr->buf_size = sd->msglen;
 
-   if (have_libz || have_lzo || have_fastlz) {
+   if (have_libz || have_lzo || have_fastlz || have_zstd) {
       if (!adjust_decompression_buffers(jcr)) {
          goto bail_out;
       }
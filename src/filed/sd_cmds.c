@@ -72,6 +72,7 @@ void *handle_stored_connection(BSOCK *sd)
 
    jcr->store_bsock = sd;
    jcr->store_bsock->set_jcr(jcr);
+   jcr->passive_client = true;
 
    /*
     * Authenticate the Storage Daemon.
@@ -97,6 +97,17 @@ void set_find_changed_function(FF_PKT *ff, bool check_fct(JCR *jcr, FF_PKT *ff))
    ff->check_fct = check_fct;
 }
 
+/**
+ * Stop the parallel directory walker of the current Include{} if any.
+ */
+static inline void stop_dir_walker(FF_PKT *ff)
+{
+   if (ff->walker) {
+      free_dir_walker(ff->walker);
+      ff->walker = NULL;
+   }
+}
+
 /**
  * Call this subroutine with a callback subroutine as the first
  * argument and a packet as the second argument, this packet
@@ -133,6 +144,7 @@ int find_files(JCR *jcr, FF_PKT *ff,
          strcpy(ff->BaseJobOpts, "Jspug5"); /* size+perm+user+group+chk  */
          ff->plugin = NULL;
          ff->opt_plugin = false;
+         ff->walker_threads = 0;
 
          /*
           * By setting all options, we in effect OR the global options which is what we want.
@@ -145,6 +157,8 @@ int find_files(JCR *jcr, FF_PKT *ff,
             ff->Compress_algo = fo->Compress_algo;
             ff->Compress_level = fo->Compress_level;
             ff->strip_path = fo->strip_path;
+            ff->compress_threads = fo->compress_threads;
+            ff->walker_threads = fo->walker_threads;
             ff->size_match = fo->size_match;
             ff->fstypes = fo->fstype;
             ff->drivetypes = fo->drivetype;
@@ -163,19 +177,27 @@ int find_files(JCR *jcr, FF_PKT *ff,
          Dmsg4(50, "Verify=<%s> Accurate=<%s> BaseJob=<%s> flags=<%d>\n",
                ff->VerifyOpts, ff->AccurateOpts, ff->BaseJobOpts, ff->flags);
 
+         if (ff->walker_threads > 0 && incexe->name_list.size() > 0) {
+            ff->walker = new_dir_walker(jcr, ff);
+         }
+
          foreach_dlist(node, &incexe->name_list) {
             char *fname = node->c_str();
 
             Dmsg1(dbglvl, "F %s\n", fname);
             ff->top_fname = fname;
             if (find_one_file(jcr, ff, our_callback, ff->top_fname, (dev_t)-1, true) == 0) {
+               stop_dir_walker(ff);
                return 0;                  /* error return */
             }
             if (job_canceled(jcr)) {
+               stop_dir_walker(ff);
                return 0;
             }
          }
 
+         stop_dir_walker(ff);
+
          foreach_dlist(node, &incexe->plugin_list) {
             char *fname = node->c_str();
 
@@ -235,127 +257,118 @@ bool is_in_fileset(FF_PKT *ff)
    return false;
 }
 
-bool accept_file(FF_PKT *ff)
+/**
+ * Match a file against the patterns of one Options{} of an Include{}.
+ * The flags of the options decide how to match and what a match means.
+ *
+ * Returns: 1 when the file is accepted
+ *          0 when the file is rejected
+ *          -1 when no pattern matched
+ */
+static int match_options(findFOPTS *fo, const char *fname, const char *basename, bool is_dir)
 {
-   int i, j, k;
+   int k;
    int fnm_flags;
-   const char *basename;
-   findFILESET *fileset = ff->fileset;
-   findINCEXE *incexe = fileset->incexe;
    int (*match_func)(const char *pattern, const char *string, int flags);
 
-   Dmsg1(dbglvl, "enter accept_file: fname=%s\n", ff->fname);
-   if (bit_is_set(FO_ENHANCEDWILD, ff->flags)) {
-      match_func = fnmatch;
-      if ((basename = last_path_separator(ff->fname)) != NULL)
-         basename++;
-      else
-         basename = ff->fname;
-   } else {
-      match_func = fnmatch;
-      basename = ff->fname;
-   }
-
-   for (j = 0; j < incexe->opts_list.size(); j++) {
-      findFOPTS *fo;
+   match_func = fnmatch;
+   fnm_flags = bit_is_set(FO_IGNORECASE, fo->flags) ? FNM_CASEFOLD : 0;
+   fnm_flags |= bit_is_set(FO_ENHANCEDWILD, fo->flags) ? FNM_PATHNAME : 0;
 
-      fo = (findFOPTS *)incexe->opts_list.get(j);
-      copy_bits(FO_MAX, fo->flags, ff->flags);
-      ff->Compress_algo = fo->Compress_algo;
-      ff->Compress_level = fo->Compress_level;
-      ff->fstypes = fo->fstype;
-      ff->drivetypes = fo->drivetype;
-
-      fnm_flags = bit_is_set(FO_IGNORECASE, ff->flags) ? FNM_CASEFOLD : 0;
-      fnm_flags |= bit_is_set(FO_ENHANCEDWILD, ff->flags) ? FNM_PATHNAME : 0;
-
-      if (S_ISDIR(ff->statp.st_mode)) {
-         for (k = 0; k < fo->wilddir.size(); k++) {
-            if (match_func((char *)fo->wilddir.get(k), ff->fname, fnmode | fnm_flags) == 0) {
-               if (bit_is_set(FO_EXCLUDE, ff->flags)) {
-                  Dmsg2(dbglvl, "Exclude wilddir: %s file=%s\n", (char *)fo->wilddir.get(k), ff->fname);
-                  return false;       /* reject dir */
-               }
-               return true;           /* accept dir */
+   if (is_dir) {
+      for (k = 0; k < fo->wilddir.size(); k++) {
+         if (match_func((char *)fo->wilddir.get(k), fname, fnmode | fnm_flags) == 0) {
+            if (bit_is_set(FO_EXCLUDE, fo->flags)) {
+               Dmsg2(dbglvl, "Exclude wilddir: %s file=%s\n", (char *)fo->wilddir.get(k), fname);
+               return 0;              /* reject dir */
             }
+            return 1;                 /* accept dir */
          }
-      } else {
-         for (k = 0; k < fo->wildfile.size(); k++) {
-            if (match_func((char *)fo->wildfile.get(k), ff->fname, fnmode | fnm_flags) == 0) {
-               if (bit_is_set(FO_EXCLUDE, ff->flags)) {
-                  Dmsg2(dbglvl, "Exclude wildfile: %s file=%s\n", (char *)fo->wildfile.get(k), ff->fname);
-                  return false;       /* reject file */
-               }
-               return true;           /* accept file */
+      }
+   } else {
+      for (k = 0; k < fo->wildfile.size(); k++) {
+         if (match_func((char *)fo->wildfile.get(k), fname, fnmode | fnm_flags) == 0) {
+            if (bit_is_set(FO_EXCLUDE, fo->flags)) {
+               Dmsg2(dbglvl, "Exclude wildfile: %s file=%s\n", (char *)fo->wildfile.get(k), fname);
+               return 0;              /* reject file */
             }
+            return 1;                 /* accept file */
          }
+      }
 
-         for (k = 0; k < fo->wildbase.size(); k++) {
-            if (match_func((char *)fo->wildbase.get(k), basename, fnmode | fnm_flags) == 0) {
-               if (bit_is_set(FO_EXCLUDE, ff->flags)) {
-                  Dmsg2(dbglvl, "Exclude wildbase: %s file=%s\n", (char *)fo->wildbase.get(k), basename);
-                  return false;       /* reject file */
-               }
-               return true;           /* accept file */
+      for (k = 0; k < fo->wildbase.size(); k++) {
+         if (match_func((char *)fo->wildbase.get(k), basename, fnmode | fnm_flags) == 0) {
+            if (bit_is_set(FO_EXCLUDE, fo->flags)) {
+               Dmsg2(dbglvl, "Exclude wildbase: %s file=%s\n", (char *)fo->wildbase.get(k), basename);
+               return 0;              /* reject file */
             }
+            return 1;                 /* accept file */
          }
       }
+   }
 
-      for (k = 0; k < fo->wild.size(); k++) {
-         if (match_func((char *)fo->wild.get(k), ff->fname, fnmode | fnm_flags) == 0) {
-            if (bit_is_set(FO_EXCLUDE, ff->flags)) {
-               Dmsg2(dbglvl, "Exclude wild: %s file=%s\n", (char *)fo->wild.get(k), ff->fname);
-               return false;          /* reject file */
-            }
-            return true;              /* accept file */
+   for (k = 0; k < fo->wild.size(); k++) {
+      if (match_func((char *)fo->wild.get(k), fname, fnmode | fnm_flags) == 0) {
+         if (bit_is_set(FO_EXCLUDE, fo->flags)) {
+            Dmsg2(dbglvl, "Exclude wild: %s file=%s\n", (char *)fo->wild.get(k), fname);
+            return 0;                 /* reject file */
          }
+         return 1;                    /* accept file */
       }
+   }
 
-      if (S_ISDIR(ff->statp.st_mode)) {
-         for (k = 0; k < fo->regexdir.size(); k++) {
-            if (regexec((regex_t *)fo->regexdir.get(k), ff->fname, 0, NULL,  0) == 0) {
-               if (bit_is_set(FO_EXCLUDE, ff->flags)) {
-                  return false;       /* reject file */
-               }
-               return true;           /* accept file */
-            }
-         }
-      } else {
-         for (k = 0; k < fo->regexfile.size(); k++) {
-            if (regexec((regex_t *)fo->regexfile.get(k), ff->fname, 0, NULL,  0) == 0) {
-               if (bit_is_set(FO_EXCLUDE, ff->flags)) {
-                  return false;       /* reject file */
-               }
-               return true;           /* accept file */
+   if (is_dir) {
+      for (k = 0; k < fo->regexdir.size(); k++) {
+         if (regexec((regex_t *)fo->regexdir.get(k), fname, 0, NULL,  0) == 0) {
+            if (bit_is_set(FO_EXCLUDE, fo->flags)) {
+               return 0;              /* reject file */
             }
+            return 1;                 /* accept file */
          }
       }
-
-      for (k = 0; k < fo->regex.size(); k++) {
-         if (regexec((regex_t *)fo->regex.get(k), ff->fname, 0, NULL,  0) == 0) {
-            if (bit_is_set(FO_EXCLUDE, ff->flags)) {
-               return false;          /* reject file */
+   } else {
+      for (k = 0; k < fo->regexfile.size(); k++) {
+         if (regexec((regex_t *)fo->regexfile.get(k), fname, 0, NULL,  0) == 0) {
+            if (bit_is_set(FO_EXCLUDE, fo->flags)) {
+               return 0;              /* reject file */
             }
-            return true;              /* accept file */
+            return 1;                 /* accept file */
          }
       }
+   }
 
-      /*
-       * If we have an empty Options clause with exclude, then exclude the file
-       */
-      if (bit_is_set(FO_EXCLUDE, ff->flags) &&
-          fo->regex.size() == 0 && fo->wild.size() == 0 &&
-          fo->regexdir.size() == 0 && fo->wilddir.size() == 0 &&
-          fo->regexfile.size() == 0 && fo->wildfile.size() == 0 &&
-          fo->wildbase.size() == 0) {
-         Dmsg1(dbglvl, "Empty options, rejecting: %s\n", ff->fname);
-         return false;              /* reject file */
+   for (k = 0; k < fo->regex.size(); k++) {
+      if (regexec((regex_t *)fo->regex.get(k), fname, 0, NULL,  0) == 0) {
+         if (bit_is_set(FO_EXCLUDE, fo->flags)) {
+            return 0;                 /* reject file */
+         }
+         return 1;                    /* accept file */
       }
    }
 
    /*
-    * Now apply the Exclude { } directive
+    * If we have an empty Options clause with exclude, then exclude the file
     */
+   if (bit_is_set(FO_EXCLUDE, fo->flags) &&
+       fo->regex.size() == 0 && fo->wild.size() == 0 &&
+       fo->regexdir.size() == 0 && fo->wilddir.size() == 0 &&
+       fo->regexfile.size() == 0 && fo->wildfile.size() == 0 &&
+       fo->wildbase.size() == 0) {
+      Dmsg1(dbglvl, "Empty options, rejecting: %s\n", fname);
+      return 0;                       /* reject file */
+   }
+
+   return -1;
+}
+
+/**
+ * Apply the Exclude { } directive
+ */
+static bool file_in_exclude_list(findFILESET *fileset, const char *fname)
+{
+   int i, j, k;
+   int fnm_flags;
+
    for (i = 0; i < fileset->exclude_list.size(); i++) {
       dlistString *node;
       findINCEXE *incexe = (findINCEXE *)fileset->exclude_list.get(i);
@@ -364,25 +377,90 @@ bool accept_file(FF_PKT *ff)
          findFOPTS *fo = (findFOPTS *)incexe->opts_list.get(j);
          fnm_flags = bit_is_set(FO_IGNORECASE, fo->flags) ? FNM_CASEFOLD : 0;
          for (k = 0; k < fo->wild.size(); k++) {
-            if (fnmatch((char *)fo->wild.get(k), ff->fname, fnmode | fnm_flags) == 0) {
-               Dmsg1(dbglvl, "Reject wild1: %s\n", ff->fname);
-               return false;          /* reject file */
+            if (fnmatch((char *)fo->wild.get(k), fname, fnmode | fnm_flags) == 0) {
+               Dmsg1(dbglvl, "Reject wild1: %s\n", fname);
+               return true;           /* reject file */
             }
          }
       }
       fnm_flags = (incexe->current_opts != NULL &&
                    bit_is_set(FO_IGNORECASE, incexe->current_opts->flags)) ? FNM_CASEFOLD : 0;
       foreach_dlist(node, &incexe->name_list) {
-         char *fname = node->c_str();
+         char *name = node->c_str();
 
-         if (fnmatch(fname, ff->fname, fnmode|fnm_flags) == 0) {
-            Dmsg1(dbglvl, "Reject wild2: %s\n", ff->fname);
-            return false;          /* reject file */
+         if (fnmatch(name, fname, fnmode|fnm_flags) == 0) {
+            Dmsg1(dbglvl, "Reject wild2: %s\n", fname);
+            return true;              /* reject file */
          }
       }
    }
 
-   return true;
+   return false;
+}
+
+bool accept_file(FF_PKT *ff)
+{
+   int j;
+   const char *basename;
+   findFILESET *fileset = ff->fileset;
+   findINCEXE *incexe = fileset->incexe;
+
+   Dmsg1(dbglvl, "enter accept_file: fname=%s\n", ff->fname);
+   if (bit_is_set(FO_ENHANCEDWILD, ff->flags)) {
+      if ((basename = last_path_separator(ff->fname)) != NULL)
+         basename++;
+      else
+         basename = ff->fname;
+   } else {
+      basename = ff->fname;
+   }
+
+   for (j = 0; j < incexe->opts_list.size(); j++) {
+      findFOPTS *fo;
+
+      fo = (findFOPTS *)incexe->opts_list.get(j);
+      copy_bits(FO_MAX, fo->flags, ff->flags);
+      ff->Compress_algo = fo->Compress_algo;
+      ff->Compress_level = fo->Compress_level;
+      ff->compress_threads = fo->compress_threads;
+      ff->fstypes = fo->fstype;
+      ff->drivetypes = fo->drivetype;
+
+      switch (match_options(fo, ff->fname, basename, S_ISDIR(ff->statp.st_mode))) {
+      case 0:
+         return false;
+      case 1:
+         return true;
+      default:
+         break;
+      }
+   }
+
+   return !file_in_exclude_list(fileset, ff->fname);
+}
+
+/**
+ * See if accept_file() would accept a directory of the current Include{}.
+ * Unlike accept_file() this leaves the options in the FF_PKT alone, so
+ * the directory walker threads can use it while find_files() runs.
+ */
+bool accept_directory(findFILESET *fileset, const char *dirname)
+{
+   int j;
+   findINCEXE *incexe = fileset->incexe;
+
+   for (j = 0; j < incexe->opts_list.size(); j++) {
+      switch (match_options((findFOPTS *)incexe->opts_list.get(j), dirname, dirname, true)) {
+      case 0:
+         return false;
+      case 1:
+         return true;
+      default:
+         break;
+      }
+   }
+
+   return !file_in_exclude_list(fileset, dirname);
 }
 
 /**
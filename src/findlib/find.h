@@ -132,6 +132,8 @@ struct findFOPTS {
    uint32_t Compress_algo;            /**< Compression algorithm. 4 letters stored as an integer */
    int Compress_level;                /**< Compression level */
    int strip_path;                    /**< Strip path count */
+   int compress_threads;              /**< Number of threads compressing data */
+   int walker_threads;                /**< Number of threads reading directories */
    struct s_sz_matching *size_match;  /**< Perform size matching ? */
    b_fileset_shadow_type shadow_type; /**< Perform fileset shadowing check ? */
    char VerifyOpts[MAX_OPTS];         /**< Verify options */
@@ -232,6 +234,7 @@ struct FF_PKT {
    bool null_output_device;           /**< Using null output device */
    bool incremental;                  /**< Incremental save */
    bool no_read;                      /**< Do not read this file when using Plugin */
+   bool stat_prefetched;              /**< statp and ff_errno already filled by the directory walker */
    char VerifyOpts[MAX_OPTS];
    char AccurateOpts[MAX_OPTS];
    char BaseJobOpts[MAX_OPTS];
@@ -250,6 +253,8 @@ struct FF_PKT {
    uint32_t Compress_algo;            /**< Compression algorithm. 4 letters stored as an integer */
    int Compress_level;                /**< Compression level */
    int strip_path;                    /**< Strip path count */
+   int compress_threads;              /**< Number of threads compressing data */
+   int walker_threads;                /**< Number of threads reading directories */
    struct s_sz_matching *size_match;  /**< Perform size matching ? */
    bool cmd_plugin;                   /**< Set if we have a command plugin */
    bool opt_plugin;                   /**< Set if we have an option plugin */
@@ -269,10 +274,16 @@ struct FF_PKT {
    BFILE rsrc_bfd;                    /**< Fd for resource forks */
    bool volhas_attrlist;              /**< Volume supports getattrlist() */
    struct HFSPLUS_INFO hfsinfo;       /**< Finder Info and resource fork size */
+
+   /*
+    * Parallel directory walker, NULL when directories are read sequentially.
+    */
+   struct dir_walker *walker;
 };
 
 #include "acl.h"
 #include "xattr.h"
+#include "walker.h"
 #include "protos.h"
 
 #endif /* __FILES_H */
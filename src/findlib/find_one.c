@@ -703,6 +703,66 @@ static inline int process_directory(JCR *jcr, FF_PKT *ff_pkt,
 
    ff_pkt->link = ff_pkt->fname;     /* reset "link" */
 
+   /*
+    * When we have a directory walker let it read the directory and lstat()
+    * its entries. We still visit the entries in the order readdir() returned
+    * them, only the lstat() results come from the walker.
+    */
+   if (ff_pkt->walker) {
+      walk_dir *dir;
+      walk_entry *entry;
+
+      dir = dir_walker_get_directory(ff_pkt->walker, link, our_device);
+      if (dir->open_errno) {
+         ff_pkt->type = FT_NOOPEN;
+         ff_pkt->ff_errno = dir->open_errno;
+         dir_walker_release_directory(ff_pkt->walker, dir);
+         rtn_stat = handle_file(jcr, ff_pkt, top_level);
+         if (ff_pkt->linked) {
+            ff_pkt->linked->FileIndex = ff_pkt->FileIndex;
+         }
+         free(link);
+         free_dir_ff_pkt(dir_ff_pkt);
+         return rtn_stat;
+      }
+
+      rtn_stat = 1;
+      for (int i = 0; i < dir->num_entries && !job_canceled(jcr); i++) {
+         entry = dir_walker_get_entry(ff_pkt->walker, dir, i);
+
+         if (entry->too_long) {
+            Jmsg2(jcr, M_ERROR, 0, _("%s: File name too long [%d]\n"),
+                  dir->names + entry->name_offset, entry->name_length);
+            continue;
+         }
+
+         /*
+          * Make sure there is enough room to store the whole name.
+          */
+         if ((int)entry->name_length + len >= link_len) {
+            link_len = len + entry->name_length + 1;
+            link = (char *)brealloc(link, link_len + 1);
+         }
+
+         memcpy(link + len, dir->names + entry->name_offset, entry->name_length);
+         link[len + entry->name_length] = '\0';
+
+         if (!file_is_excluded(ff_pkt, link)) {
+            memcpy(&ff_pkt->statp, &entry->statp, sizeof(ff_pkt->statp));
+            ff_pkt->ff_errno = entry->stat_errno;
+            ff_pkt->stat_prefetched = true;
+            rtn_stat = find_one_file(jcr, ff_pkt, handle_file, link, our_device, false);
+            if (ff_pkt->linked) {
+               ff_pkt->linked->FileIndex = ff_pkt->FileIndex;
+            }
+         }
+      }
+
+      dir_walker_release_directory(ff_pkt->walker, dir);
+      free(link);
+      goto save_directory;
+   }
+
    /*
     * Descend into or "recurse" into the directory to read all the files in it.
     */
@@ -837,6 +897,8 @@ static inline int process_directory(JCR *jcr, FF_PKT *ff_pkt,
    closedir(directory);
    free(link);
 #endif
+
+save_directory:
    /*
     * Now that we have recursed through all the files in the
     * directory, we "save" the directory so that after all
@@ -968,7 +1030,16 @@ int find_one_file(JCR *jcr, FF_PKT *ff_pkt,
 
    ff_pkt->fname = ff_pkt->link = fname;
    ff_pkt->type = FT_UNSET;
-   if (lstat(fname, &ff_pkt->statp) != 0) {
+   if (ff_pkt->stat_prefetched) {
+      /*
+       * The directory walker already did the lstat() for us.
+       */
+      ff_pkt->stat_prefetched = false;
+      if (ff_pkt->ff_errno != 0) {
+         ff_pkt->type = FT_NOSTAT;
+         return handle_file(jcr, ff_pkt, top_level);
+      }
+   } else if (lstat(fname, &ff_pkt->statp) != 0) {
        /*
         * Cannot stat file
         */
@@ -345,6 +345,13 @@ void add_fname_to_include_list(FF_PKT *ff, int prefixed, const char *fname)
                   inc->algo = COMPRESS_FZ4H;
                   inc->level = 1;   /* Not used with libfzlib */
                }
+            } else if (*rp == 's') {
+               if (B_ISDIGIT(rp[1]) && B_ISDIGIT(rp[2])) {
+                  set_bit(FO_COMPRESS, inc->options);
+                  inc->algo = COMPRESS_ZSTD;
+                  inc->level = (rp[1] - '0') * 10 + (rp[2] - '0');
+                  rp += 2;          /* Skip level */
+               }
             }
             Dmsg2(200, "Compression alg=%d level=%d\n", inc->algo, inc->level);
             break;
@@ -49,6 +49,7 @@ bool match_files(JCR *jcr, FF_PKT *ff, int sub(JCR *, FF_PKT *ff_pkt, bool));
 int term_find_files(FF_PKT *ff);
 bool is_in_fileset(FF_PKT *ff);
 bool accept_file(FF_PKT *ff);
+bool accept_directory(findFILESET *fileset, const char *dirname);
 findINCEXE *allocate_new_incexe(void);
 findINCEXE *new_exclude(findFILESET *fileset);
 findINCEXE *new_include(findFILESET *fileset);
@@ -103,6 +104,13 @@ bool drivetype(const char *fname, char *fs, int fslen);
 /* shadowing.c */
 void check_include_list_shadowing(JCR *jcr, findFILESET *fileset);
 
+/* walker.c */
+dir_walker *new_dir_walker(JCR *jcr, FF_PKT *ff);
+void free_dir_walker(dir_walker *w);
+walk_dir *dir_walker_get_directory(dir_walker *w, const char *path, dev_t device);
+walk_entry *dir_walker_get_entry(dir_walker *w, walk_dir *dir, int index);
+void dir_walker_release_directory(dir_walker *w, walk_dir *dir);
+
 #if defined(HAVE_WIN32)
 /* win32.c */
 bool win32_onefs_is_disabled(findFILESET *fileset);
@@ -22,3 +22,5 @@
 
 void test_fstype(void **state);
 void test_drivetype(void **state);
+void test_walker(void **state);
+void test_walker_no_recursion(void **state);
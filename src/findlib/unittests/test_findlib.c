@@ -38,6 +38,13 @@ int main(void) {
    const struct CMUnitTest tests[] = {
       cmocka_unit_test(test_fstype),
       cmocka_unit_test(test_drivetype),
+      cmocka_unit_test(test_walker),
+      cmocka_unit_test(test_walker_no_recursion),
    };
+   /*
+    * The directory walker starts threads.
+    */
+   lmgr_init_thread();
+
    return cmocka_run_group_tests(tests, NULL, NULL);
 }
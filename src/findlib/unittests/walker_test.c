@@ -0,0 +1,302 @@
+/*
+   BAREOS® - Backup Archiving REcovery Open Sourced
+
+   Copyright (C) 2016-2016 Bareos GmbH & Co. KG
+
+   This program is Free Software; you can redistribute it and/or
+   modify it under the terms of version three of the GNU Affero General Public
+   License as published by the Free Software Foundation and included
+   in the file LICENSE.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+   Affero General Public License for more details.
+
+   You should have received a copy of the GNU Affero General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+   02110-1301, USA.
+*/
+/*
+ * Test the parallel directory walker: entries come back in readdir()
+ * order with their lstat() and only the subdirectories find_files()
+ * descends into are read ahead.
+ */
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+
+extern "C" {
+#include <cmocka.h>
+}
+
+#include "bareos.h"
+#include "jcr.h"
+#include "findlib/find.h"
+
+#define NUM_FILES 300                 /* More than one lstat() batch */
+
+static char testdir[64];
+
+static void make_dir(const char *dir, const char *name)
+{
+   POOL_MEM path(PM_FNAME);
+
+   Mmsg(path, "%s/%s", dir, name);
+   assert_int_equal(mkdir(path.c_str(), 0755), 0);
+}
+
+static void make_file(const char *dir, const char *name)
+{
+   int fd;
+   POOL_MEM path(PM_FNAME);
+
+   Mmsg(path, "%s/%s", dir, name);
+   fd = open(path.c_str(), O_CREAT | O_WRONLY, 0644);
+   assert_true(fd >= 0);
+   close(fd);
+}
+
+/*
+ * Build the tree:
+ *
+ *   top/file000 .. file299
+ *   top/keep/sub/           read ahead, also below keep
+ *   top/skip/.nobackup      Exclude Dir Containing
+ *   top/skip/deep/
+ *   top/excluded/           Exclude { File = "* /excluded" }
+ *   top/optexcl/            Options { WildDir = "* /optexcl"; Exclude = yes }
+ */
+static void make_tree(POOL_MEM &top)
+{
+   char name[20];
+   POOL_MEM path(PM_FNAME);
+
+   bstrncpy(testdir, "/tmp/walker_test.XXXXXX", sizeof(testdir));
+   assert_non_null(mkdtemp(testdir));
+   make_dir(testdir, "top");
+   Mmsg(top, "%s/top", testdir);
+
+   for (int i = 0; i < NUM_FILES; i++) {
+      bsnprintf(name, sizeof(name), "file%03d", i);
+      make_file(top.c_str(), name);
+   }
+
+   make_dir(top.c_str(), "keep");
+   make_dir(top.c_str(), "keep/sub");
+   make_dir(top.c_str(), "skip");
+   make_dir(top.c_str(), "skip/deep");
+   Mmsg(path, "%s/skip", top.c_str());
+   make_file(path.c_str(), ".nobackup");
+   make_dir(top.c_str(), "excluded");
+   make_dir(top.c_str(), "optexcl");
+}
+
+static void remove_tree()
+{
+   POOL_MEM cmd(PM_FNAME);
+
+   Mmsg(cmd, "rm -rf %s", testdir);
+   assert_int_equal(system(cmd.c_str()), 0);
+}
+
+/*
+ * Setup a fileset with one Include{} of the top directory, the same
+ * way the File daemon does from the fileset it gets from the Director.
+ */
+static FF_PKT *setup_find_files(const char *top, int threads)
+{
+   FF_PKT *ff;
+   findFILESET *fileset;
+   findINCEXE *incexe;
+   findFOPTS *fo;
+   POOL_MEM pattern(PM_FNAME);
+
+   ff = init_find_files();
+   fileset = (findFILESET *)malloc(sizeof(findFILESET));
+   memset(fileset, 0, sizeof(findFILESET));
+   fileset->include_list.init(1, true);
+   fileset->exclude_list.init(1, true);
+   ff->fileset = fileset;
+
+   new_exclude(fileset);
+   Mmsg(pattern, "%s/excluded", top);
+   fileset->incexe->name_list.append(new_dlistString(pattern.c_str()));
+
+   incexe = new_include(fileset);
+   incexe->name_list.append(new_dlistString(top));
+   incexe->ignoredir.append(bstrdup(".nobackup"));
+   fo = start_options(ff);
+   set_bit(FO_EXCLUDE, fo->flags);
+   fo->wilddir.append(bstrdup("*/optexcl"));
+   fo->walker_threads = threads;
+
+   ff->walker_threads = threads;
+   copy_bits(FO_MAX, fo->flags, ff->flags);
+
+   return ff;
+}
+
+/*
+ * Wait until the walker has nothing left to read ahead.
+ */
+static void wait_for_walker(dir_walker *w)
+{
+   bool busy;
+   walk_dir *dir;
+
+   do {
+      busy = false;
+      P(w->lock);
+      if (!w->stat_tasks->empty() || !w->dir_tasks->empty()) {
+         busy = true;
+      }
+      foreach_dlist(dir, w->dirs) {
+         if (dir->pending > 0) {
+            busy = true;
+         }
+      }
+      V(w->lock);
+      if (busy) {
+         bmicrosleep(0, 10000);
+      }
+   } while (busy);
+}
+
+static bool is_read_ahead(dir_walker *w, const char *top, const char *name)
+{
+   bool found = false;
+   walk_dir *dir;
+   POOL_MEM path(PM_FNAME);
+
+   Mmsg(path, "%s/%s/", top, name);
+   P(w->lock);
+   foreach_dlist(dir, w->dirs) {
+      if (bstrcmp(dir->path, path.c_str())) {
+         found = true;
+      }
+   }
+   V(w->lock);
+
+   return found;
+}
+
+/*
+ * Claim a directory and check its entries against readdir() and lstat().
+ */
+static walk_dir *check_directory(dir_walker *w, const char *dirname)
+{
+   int i = 0;
+   DIR *directory;
+   struct dirent *result;
+   struct stat statp;
+   walk_dir *dir;
+   walk_entry *entry;
+   POOL_MEM path(PM_FNAME);
+
+   assert_int_equal(lstat(dirname, &statp), 0);
+   Mmsg(path, "%s/", dirname);
+   dir = dir_walker_get_directory(w, path.c_str(), statp.st_dev);
+   assert_non_null(dir);
+   assert_int_equal(dir->open_errno, 0);
+
+   directory = opendir(dirname);
+   assert_non_null(directory);
+   while ((result = readdir(directory))) {
+      if (bstrcmp(result->d_name, ".") || bstrcmp(result->d_name, "..")) {
+         continue;
+      }
+      assert_true(i < dir->num_entries);
+      entry = dir_walker_get_entry(w, dir, i++);
+      assert_string_equal(dir->names + entry->name_offset, result->d_name);
+      assert_int_equal(entry->stat_errno, 0);
+
+      Mmsg(path, "%s/%s", dirname, result->d_name);
+      assert_int_equal(lstat(path.c_str(), &statp), 0);
+      assert_true(entry->statp.st_ino == statp.st_ino);
+      assert_true(entry->statp.st_mode == statp.st_mode);
+   }
+   closedir(directory);
+   assert_int_equal(i, dir->num_entries);
+
+   return dir;
+}
+
+static void free_find_files(FF_PKT *ff)
+{
+   ff->fileset->include_list.destroy();
+   ff->fileset->exclude_list.destroy();
+   free(ff->fileset);
+   term_find_files(ff);
+}
+
+void test_walker(void **state)
+{
+   FF_PKT *ff;
+   dir_walker *w;
+   walk_dir *dir, *subdir;
+   POOL_MEM top(PM_FNAME), keep(PM_FNAME);
+
+   make_tree(top);
+   ff = setup_find_files(top.c_str(), 4);
+
+   w = new_dir_walker(NULL, ff);
+   assert_non_null(w);
+   assert_true(w->read_ahead);
+
+   dir = check_directory(w, top.c_str());
+   assert_int_equal(dir->num_entries, NUM_FILES + 4);
+   wait_for_walker(w);
+
+   assert_true(is_read_ahead(w, top.c_str(), "keep"));
+   assert_true(is_read_ahead(w, top.c_str(), "keep/sub"));
+   assert_false(is_read_ahead(w, top.c_str(), "skip"));
+   assert_false(is_read_ahead(w, top.c_str(), "skip/deep"));
+   assert_false(is_read_ahead(w, top.c_str(), "excluded"));
+   assert_false(is_read_ahead(w, top.c_str(), "optexcl"));
+
+   /*
+    * The read ahead directory is handed to find_files() as it was read.
+    */
+   Mmsg(keep, "%s/keep", top.c_str());
+   subdir = check_directory(w, keep.c_str());
+   assert_int_equal(subdir->num_entries, 1);
+   assert_int_equal(w->dirs_read_ahead, 1);
+   dir_walker_release_directory(w, subdir);
+
+   /*
+    * Releasing the top directory drops whatever is left below it.
+    */
+   dir_walker_release_directory(w, dir);
+   assert_int_equal(w->num_dirs, 0);
+
+   free_dir_walker(w);
+   free_find_files(ff);
+   remove_tree();
+}
+
+void test_walker_no_recursion(void **state)
+{
+   FF_PKT *ff;
+   dir_walker *w;
+   walk_dir *dir;
+   POOL_MEM top(PM_FNAME);
+
+   make_tree(top);
+   ff = setup_find_files(top.c_str(), 2);
+   set_bit(FO_NO_RECURSION, ff->flags);
+
+   w = new_dir_walker(NULL, ff);
+   assert_non_null(w);
+   assert_false(w->read_ahead);
+
+   dir = check_directory(w, top.c_str());
+   wait_for_walker(w);
+   assert_int_equal(w->num_dirs, 0);
+   dir_walker_release_directory(w, dir);
+
+   free_dir_walker(w);
+   free_find_files(ff);
+   remove_tree();
+}
@@ -0,0 +1,734 @@
+/*
+   BAREOS® - Backup Archiving REcovery Open Sourced
+
+   Copyright (C) 2016-2016 Bareos GmbH & Co. KG
+
+   This program is Free Software; you can redistribute it and/or
+   modify it under the terms of version three of the GNU Affero General Public
+   License as published by the Free Software Foundation and included
+   in the file LICENSE.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+   Affero General Public License for more details.
+
+   You should have received a copy of the GNU Affero General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+   02110-1301, USA.
+*/
+/**
+ * @file
+ * Parallel directory walker.
+ *
+ * On filesystems with a high latency for metadata operations (e.g. NFS)
+ * most of the time of an incremental backup is spent waiting for readdir()
+ * and lstat(). The walker uses a pool of threads to do these operations
+ * concurrently while the find_files() thread still visits all files in
+ * exactly the same order as the sequential code does, so the callbacks
+ * (e.g. save_file()) see a deterministic order.
+ *
+ * There are two kinds of tasks:
+ *
+ * - Reading a directory. The entry names are read using readdir() and
+ *   the lstat() of the entries is split into batches of WALK_BATCH_SIZE
+ *   entries which are queued as separate tasks. This way all idle
+ *   threads pick up a part of the work of a large directory.
+ * - Doing the lstat() for a batch of entries. When subdirectories are
+ *   found they are queued to be read ahead.
+ *
+ * Batches are always processed before directories. Directories are taken
+ * from the queue in LIFO order which makes the read ahead follow the depth
+ * first order in which find_files() descends. The number of directories
+ * read ahead is limited, when the limit is reached the oldest directory
+ * that has not been read yet is dropped; it will be read on demand when
+ * find_files() gets to it.
+ *
+ * Only subdirectories find_files() will descend into are read ahead, so
+ * the same exclusions apply: the excluded files and paths, the Options{}
+ * and Exclude{} patterns of the Include{}, Exclude Dir Containing, One FS,
+ * FsType and No Recursion. Options that differ per file are taken from the
+ * Include{} as find_files() starts it.
+ */
+
+#include "bareos.h"
+#include "jcr.h"
+#include "find.h"
+
+static const int dbglvl = 150;
+
+extern int32_t name_max;              /* filename max length */
+
+/*
+ * Simple FNV-1a hash of a pathname.
+ */
+static inline uint32_t hash_path(const char *path)
+{
+   uint32_t hash = 2166136261U;
+
+   while (*path) {
+      hash ^= (uint8_t)*path++;
+      hash *= 16777619U;
+   }
+
+   return hash;
+}
+
+static walk_dir *new_walk_dir(const char *path, dev_t device)
+{
+   walk_dir *dir;
+
+   dir = (walk_dir *)malloc(sizeof(walk_dir));
+   memset(dir, 0, sizeof(walk_dir));
+   dir->path = bstrdup(path);
+   dir->hash = hash_path(path);
+   dir->device = device;
+   dir->state = WALK_DIR_QUEUED;
+
+   return dir;
+}
+
+static void free_walk_dir(walk_dir *dir)
+{
+   if (dir->names) {
+      free(dir->names);
+   }
+   if (dir->entries) {
+      free(dir->entries);
+   }
+   if (dir->batch_done) {
+      free(dir->batch_done);
+   }
+   free(dir->path);
+   free(dir);
+}
+
+static inline void queue_task(dlist *queue, walk_dir *dir, int batch, bool prepend)
+{
+   walk_task *task;
+
+   task = (walk_task *)malloc(sizeof(walk_task));
+   memset(task, 0, sizeof(walk_task));
+   task->dir = dir;
+   task->batch = batch;
+   if (prepend) {
+      queue->prepend(task);
+   } else {
+      queue->append(task);
+   }
+   dir->pending++;
+}
+
+/*
+ * Remove all queued tasks of a directory.
+ * Should be called with the walker lock held.
+ */
+static void unqueue_tasks(dlist *queue, walk_dir *dir)
+{
+   walk_task *task, *next;
+
+   task = (walk_task *)queue->first();
+   while (task) {
+      next = (walk_task *)queue->next(task);
+      if (task->dir == dir) {
+         queue->remove(task);
+         free(task);
+         dir->pending--;
+      }
+      task = next;
+   }
+}
+
+/*
+ * Find a directory that is not claimed yet.
+ * Should be called with the walker lock held.
+ */
+static walk_dir *lookup_dir(dir_walker *w, const char *path)
+{
+   walk_dir *dir;
+   uint32_t hash = hash_path(path);
+
+   foreach_dlist(dir, w->dirs) {
+      if (dir->hash == hash && bstrcmp(dir->path, path)) {
+         return dir;
+      }
+   }
+
+   return NULL;
+}
+
+/*
+ * Drop an unclaimed directory.
+ * Should be called with the walker lock held.
+ */
+static void drop_dir(dir_walker *w, walk_dir *dir)
+{
+   unqueue_tasks(w->stat_tasks, dir);
+   unqueue_tasks(w->dir_tasks, dir);
+   w->dirs->remove(dir);
+   w->num_dirs--;
+   w->dirs_dropped++;
+   free_walk_dir(dir);
+}
+
+/*
+ * Make room for one more directory to read ahead by dropping the oldest
+ * directory that was not read yet or if there is none the oldest directory
+ * no thread is working on. Returns false if there is no room.
+ * Should be called with the walker lock held.
+ */
+static bool make_room(dir_walker *w)
+{
+   walk_dir *dir;
+
+   if (w->num_dirs < w->max_dirs) {
+      return true;
+   }
+
+   foreach_dlist(dir, w->dirs) {
+      if (dir->state == WALK_DIR_QUEUED && dir->running == 0) {
+         drop_dir(w, dir);
+         return true;
+      }
+   }
+
+   foreach_dlist(dir, w->dirs) {
+      if (dir->running == 0) {
+         drop_dir(w, dir);
+         return true;
+      }
+   }
+
+   return false;
+}
+
+/*
+ * Queue a directory for reading ahead.
+ * Should be called with the walker lock held.
+ */
+static void read_ahead_dir(dir_walker *w, const char *path, dev_t device)
+{
+   walk_dir *dir;
+
+   if (lookup_dir(w, path) || !make_room(w)) {
+      return;
+   }
+
+   dir = new_walk_dir(path, device);
+   w->dirs->append(dir);
+   w->num_dirs++;
+   queue_task(w->dir_tasks, dir, -1, true);
+   pthread_cond_signal(&w->work);
+}
+
+static inline void add_entry(walk_dir *dir, int *max_entries, uint32_t *names_size,
+                             uint32_t *names_len, const char *name, int name_length)
+{
+   walk_entry *entry;
+
+   if (dir->num_entries >= *max_entries) {
+      *max_entries = (*max_entries) ? *max_entries * 2 : 64;
+      dir->entries = (walk_entry *)realloc(dir->entries, *max_entries * sizeof(walk_entry));
+   }
+
+   if (*names_len + name_length + 1 > *names_size) {
+      while (*names_len + name_length + 1 > *names_size) {
+         *names_size = (*names_size) ? *names_size * 2 : 4096;
+      }
+      dir->names = (char *)realloc(dir->names, *names_size);
+   }
+
+   entry = &dir->entries[dir->num_entries++];
+   memset(entry, 0, sizeof(walk_entry));
+   entry->name_offset = *names_len;
+   entry->name_length = name_length;
+
+   /*
+    * Some filesystems violate against the rules and return filenames
+    * longer than _PC_NAME_MAX. This gets logged by the find_files() thread.
+    */
+   if ((name_max + 1) <= ((int)sizeof(struct dirent) + name_length)) {
+      entry->too_long = true;
+   }
+
+   memcpy(dir->names + *names_len, name, name_length);
+   dir->names[*names_len + name_length] = '\0';
+   *names_len += name_length + 1;
+}
+
+/*
+ * Read all entry names of a directory.
+ */
+static void read_directory(dir_walker *w, walk_dir *dir)
+{
+   DIR *directory;
+   struct dirent *result;
+#ifdef USE_READDIR_R
+   struct dirent *entry;
+#endif
+   int len;
+   int max_entries = 0;
+   uint32_t names_size = 0,
+            names_len = 0;
+   POOL_MEM dirname(PM_FNAME);
+
+   /*
+    * Open the directory by its name without the trailing slash
+    * just as the sequential code does.
+    */
+   pm_strcpy(dirname, dir->path);
+   len = strlen(dirname.c_str());
+   if (len > 1 && IsPathSeparator(dirname.c_str()[len - 1])) {
+      dirname.c_str()[len - 1] = '\0';
+   }
+
+   errno = 0;
+   if ((directory = opendir(dirname.c_str())) == NULL) {
+      dir->open_errno = (errno) ? errno : ENOENT;
+      return;
+   }
+
+#ifdef USE_READDIR_R
+   entry = (struct dirent *)malloc(sizeof(struct dirent) + name_max + 100);
+   while (!w->quit) {
+      if (readdir_r(directory, entry, &result) != 0 || result == NULL) {
+         break;
+      }
+#else
+   while (!w->quit) {
+      if ((result = readdir(directory)) == NULL) {
+         break;
+      }
+#endif
+
+      /*
+       * Skip `.' and `..'.
+       */
+      if (result->d_name[0] == '\0' ||
+         (result->d_name[0] == '.' && (result->d_name[1] == '\0' ||
+         (result->d_name[1] == '.' && result->d_name[2] == '\0')))) {
+         continue;
+      }
+
+      add_entry(dir, &max_entries, &names_size, &names_len, result->d_name, (int)NAMELEN(result));
+   }
+
+   closedir(directory);
+#ifdef USE_READDIR_R
+   free(entry);
+#endif
+}
+
+/*
+ * See if the directory contains one of the files of Exclude Dir Containing.
+ */
+static bool have_ignoredir(findINCEXE *incexe, const char *dirname)
+{
+   struct stat sb;
+   char *ignoredir;
+   POOL_MEM fname(PM_FNAME);
+
+   for (int i = 0; i < incexe->ignoredir.size(); i++) {
+      ignoredir = (char *)incexe->ignoredir.get(i);
+      if (ignoredir) {
+         Mmsg(fname, "%s/%s", dirname, ignoredir);
+         if (stat(fname.c_str(), &sb) == 0) {
+            return true;
+         }
+      }
+   }
+
+   return false;
+}
+
+/*
+ * Check to see if we allow the file system type of a directory.
+ */
+static bool accept_fstype(alist *fstypes, const char *dirname)
+{
+   char fs[1000];
+
+   if (!fstypes || fstypes->size() == 0) {
+      return true;
+   }
+
+   if (fstype(dirname, fs, sizeof(fs))) {
+      for (int i = 0; i < fstypes->size(); i++) {
+         if (bstrcmp(fs, (char *)fstypes->get(i))) {
+            return true;
+         }
+      }
+   }
+
+   return false;
+}
+
+/*
+ * See if find_files() will descend into a subdirectory, applying the
+ * same exclusions as it does before reading a directory.
+ */
+static bool want_read_ahead(dir_walker *w, walk_dir *dir, walk_entry *entry, const char *dirname)
+{
+   FF_PKT *ff = w->ff;
+
+   if (entry->stat_errno || !S_ISDIR(entry->statp.st_mode)) {
+      return false;
+   }
+
+   if (file_is_excluded(ff, dirname)) {
+      return false;
+   }
+
+   if (entry->statp.st_dev != dir->device) {
+      if (!w->multifs || !accept_fstype(w->fstypes, dirname)) {
+         return false;
+      }
+   }
+
+   if (!accept_directory(ff->fileset, dirname)) {
+      return false;
+   }
+
+   return !have_ignoredir(ff->fileset->incexe, dirname);
+}
+
+/*
+ * Do the lstat() of a batch of entries of a directory.
+ * When reading ahead also decide which subdirectories to read ahead,
+ * so that is done without holding the walker lock.
+ */
+static void stat_batch(dir_walker *w, walk_dir *dir, int batch)
+{
+   int i, first, last, len;
+   walk_entry *entry;
+   POOL_MEM fname(PM_FNAME);
+
+   first = batch * WALK_BATCH_SIZE;
+   last = MIN(first + WALK_BATCH_SIZE, dir->num_entries);
+
+   pm_strcpy(fname, dir->path);
+   len = strlen(fname.c_str());
+
+   for (i = first; i < last && !w->quit; i++) {
+      entry = &dir->entries[i];
+      if (entry->too_long) {
+         continue;
+      }
+
+      fname.check_size(len + entry->name_length + 1);
+      memcpy(fname.c_str() + len, dir->names + entry->name_offset, entry->name_length + 1);
+      if (lstat(fname.c_str(), &entry->statp) != 0) {
+         entry->stat_errno = (errno) ? errno : ENOENT;
+      }
+
+      if (w->read_ahead) {
+         entry->read_ahead = want_read_ahead(w, dir, entry, fname.c_str());
+      }
+   }
+}
+
+/*
+ * Queue the subdirectories found in a batch for reading ahead.
+ * Entries are queued in reverse order so the first subdirectory
+ * ends up at the front of the LIFO directory queue.
+ * Should be called with the walker lock held.
+ */
+static void read_ahead_subdirs(dir_walker *w, walk_dir *dir, int batch)
+{
+   int i, first, last, len;
+   walk_entry *entry;
+   POOL_MEM path(PM_FNAME);
+
+   first = batch * WALK_BATCH_SIZE;
+   last = MIN(first + WALK_BATCH_SIZE, dir->num_entries);
+
+   pm_strcpy(path, dir->path);
+   len = strlen(path.c_str());
+
+   for (i = last - 1; i >= first; i--) {
+      entry = &dir->entries[i];
+      if (!entry->read_ahead) {
+         continue;
+      }
+
+      path.check_size(len + entry->name_length + 2);
+      memcpy(path.c_str() + len, dir->names + entry->name_offset, entry->name_length);
+      path.c_str()[len + entry->name_length] = '/';
+      path.c_str()[len + entry->name_length + 1] = '\0';
+      read_ahead_dir(w, path.c_str(), entry->statp.st_dev);
+   }
+}
+
+/*
+ * Walker thread, runs tasks until told to quit.
+ */
+extern "C" void *walker_thread(void *data)
+{
+   walk_task *task;
+   walk_dir *dir;
+   dir_walker *w = (dir_walker *)data;
+
+   P(w->lock);
+   while (!w->quit) {
+      task = (walk_task *)w->stat_tasks->first();
+      if (task) {
+         w->stat_tasks->remove(task);
+      } else {
+         task = (walk_task *)w->dir_tasks->first();
+         if (task) {
+            w->dir_tasks->remove(task);
+         }
+      }
+
+      if (!task) {
+         pthread_cond_wait(&w->work, &w->lock);
+         continue;
+      }
+
+      dir = task->dir;
+      dir->running++;
+      V(w->lock);
+
+      if (task->batch < 0) {
+         read_directory(w, dir);
+      } else {
+         stat_batch(w, dir, task->batch);
+      }
+
+      /*
+       * The directory stays marked as running until we are done with it
+       * so it cannot be dropped while reading ahead its subdirectories.
+       */
+      P(w->lock);
+      if (task->batch < 0) {
+         w->dirs_read++;
+         dir->num_batches = (dir->num_entries + WALK_BATCH_SIZE - 1) / WALK_BATCH_SIZE;
+         if (dir->num_batches > 0) {
+            dir->batch_done = (bool *)malloc(dir->num_batches * sizeof(bool));
+            memset(dir->batch_done, 0, dir->num_batches * sizeof(bool));
+            for (int i = 0; i < dir->num_batches; i++) {
+               queue_task(w->stat_tasks, dir, i, false);
+            }
+            dir->state = WALK_DIR_LISTED;
+            pthread_cond_broadcast(&w->work);
+         } else {
+            dir->state = WALK_DIR_DONE;
+         }
+      } else {
+         w->entries_stated += MIN(WALK_BATCH_SIZE, dir->num_entries - task->batch * WALK_BATCH_SIZE);
+         dir->batch_done[task->batch] = true;
+         if (w->read_ahead && !w->quit) {
+            read_ahead_subdirs(w, dir, task->batch);
+         }
+         if (dir->pending == 1) {
+            dir->state = WALK_DIR_DONE;
+         }
+      }
+      dir->running--;
+      dir->pending--;
+      pthread_cond_broadcast(&w->done);
+      free(task);
+   }
+   V(w->lock);
+
+   return NULL;
+}
+
+/*
+ * Start a directory walker for the current Include{} of find_files()
+ * with the number of threads of its options. The options determine
+ * how far the walker may read ahead.
+ */
+dir_walker *new_dir_walker(JCR *jcr, FF_PKT *ff)
+{
+   int status;
+   int threads = ff->walker_threads;
+   char *flags = ff->flags;
+   findINCEXE *incexe = ff->fileset->incexe;
+   walk_task *task = NULL;
+   walk_dir *dir = NULL;
+   dir_walker *w;
+
+   w = (dir_walker *)malloc(sizeof(dir_walker));
+   memset(w, 0, sizeof(dir_walker));
+   w->jcr = jcr;
+   w->ff = ff;
+   w->max_dirs = threads * WALK_DIRS_PER_THREAD;
+   w->multifs = bit_is_set(FO_MULTIFS, flags);
+
+   /*
+    * find_files() starts with the file system types of the last Options{},
+    * use them directly as accept_file() replaces the copy in the FF_PKT.
+    */
+   if (incexe->opts_list.size() > 0) {
+      w->fstypes = &((findFOPTS *)incexe->opts_list.get(incexe->opts_list.size() - 1))->fstype;
+   }
+
+   /*
+    * Directories we read ahead might never be visited by find_files(),
+    * so don't read ahead when that has visible side effects or is useless.
+    */
+   w->read_ahead = !bit_is_set(FO_NO_RECURSION, flags) &&
+                   !bit_is_set(FO_KEEPATIME, flags);
+
+   w->stat_tasks = New(dlist(task, &task->link));
+   w->dir_tasks = New(dlist(task, &task->link));
+   w->dirs = New(dlist(dir, &dir->link));
+   pthread_mutex_init(&w->lock, NULL);
+   pthread_cond_init(&w->work, NULL);
+   pthread_cond_init(&w->done, NULL);
+
+   w->threads = (pthread_t *)malloc(threads * sizeof(pthread_t));
+   for (int i = 0; i < threads; i++) {
+      if ((status = pthread_create(&w->threads[i], NULL, walker_thread, (void *)w)) != 0) {
+         berrno be;
+
+         Jmsg1(jcr, M_WARNING, 0, _("Cannot create directory walker thread: %s\n"), be.bstrerror(status));
+         break;
+      }
+      w->num_threads++;
+   }
+
+   if (w->num_threads == 0) {
+      free_dir_walker(w);
+      return NULL;
+   }
+
+   Dmsg1(dbglvl, "Started directory walker with %d threads\n", w->num_threads);
+
+   return w;
+}
+
+/*
+ * Stop the walker threads and free all resources.
+ */
+void free_dir_walker(dir_walker *w)
+{
+   walk_task *task;
+   walk_dir *dir;
+
+   P(w->lock);
+   w->quit = true;
+   pthread_cond_broadcast(&w->work);
+   V(w->lock);
+
+   for (int i = 0; i < w->num_threads; i++) {
+      pthread_join(w->threads[i], NULL);
+   }
+
+   Dmsg4(dbglvl, "Directory walker read %llu dirs (%llu read ahead, %llu dropped) lstat %llu entries\n",
+         w->dirs_read, w->dirs_read_ahead, w->dirs_dropped, w->entries_stated);
+
+   while ((task = (walk_task *)w->stat_tasks->first())) {
+      w->stat_tasks->remove(task);
+      free(task);
+   }
+   while ((task = (walk_task *)w->dir_tasks->first())) {
+      w->dir_tasks->remove(task);
+      free(task);
+   }
+   while ((dir = (walk_dir *)w->dirs->first())) {
+      w->dirs->remove(dir);
+      free_walk_dir(dir);
+   }
+
+   delete w->stat_tasks;
+   delete w->dir_tasks;
+   delete w->dirs;
+   pthread_mutex_destroy(&w->lock);
+   pthread_cond_destroy(&w->work);
+   pthread_cond_destroy(&w->done);
+   free(w->threads);
+   free(w);
+}
+
+/*
+ * Claim a directory for the find_files() thread and wait until
+ * its entries are known. The path must include a trailing slash.
+ * Always returns the directory, it has open_errno set when it could
+ * not be read. The walker is only stopped by the find_files() thread
+ * itself, so it cannot stop while we wait.
+ */
+walk_dir *dir_walker_get_directory(dir_walker *w, const char *path, dev_t device)
+{
+   walk_dir *dir;
+
+   P(w->lock);
+   dir = lookup_dir(w, path);
+   if (dir) {
+      w->dirs->remove(dir);
+      w->num_dirs--;
+      if (dir->state != WALK_DIR_QUEUED || dir->running > 0) {
+         w->dirs_read_ahead++;
+      } else {
+         /*
+          * Not read yet, move it to the front of the queue.
+          */
+         unqueue_tasks(w->dir_tasks, dir);
+         queue_task(w->dir_tasks, dir, -1, true);
+      }
+   } else {
+      dir = new_walk_dir(path, device);
+      queue_task(w->dir_tasks, dir, -1, true);
+      pthread_cond_signal(&w->work);
+   }
+
+   while (dir->state == WALK_DIR_QUEUED && dir->pending > 0) {
+      pthread_cond_wait(&w->done, &w->lock);
+   }
+   V(w->lock);
+
+   return dir;
+}
+
+/*
+ * Get an entry of a claimed directory, waiting for its lstat() to finish.
+ * Entries must be retrieved in order.
+ */
+walk_entry *dir_walker_get_entry(dir_walker *w, walk_dir *dir, int index)
+{
+   int batch = index / WALK_BATCH_SIZE;
+
+   if (index % WALK_BATCH_SIZE == 0) {
+      P(w->lock);
+      while (!dir->batch_done[batch]) {
+         pthread_cond_wait(&w->done, &w->lock);
+      }
+      V(w->lock);
+   }
+
+   return &dir->entries[index];
+}
+
+/*
+ * Release a claimed directory. As find_files() is done with everything
+ * below it, any unclaimed directories below it will never be claimed
+ * and are dropped.
+ */
+void dir_walker_release_directory(dir_walker *w, walk_dir *dir)
+{
+   int len;
+   walk_dir *subdir, *next;
+
+   len = strlen(dir->path);
+
+   P(w->lock);
+   unqueue_tasks(w->stat_tasks, dir);
+   unqueue_tasks(w->dir_tasks, dir);
+   while (dir->running > 0) {
+      pthread_cond_wait(&w->done, &w->lock);
+   }
+
+   subdir = (walk_dir *)w->dirs->first();
+   while (subdir) {
+      next = (walk_dir *)w->dirs->next(subdir);
+      if (subdir->running == 0 && bstrncmp(subdir->path, dir->path, len)) {
+         drop_dir(w, subdir);
+      }
+      subdir = next;
+   }
+   V(w->lock);
+
+   free_walk_dir(dir);
+}
@@ -0,0 +1,102 @@
+/*
+   BAREOS® - Backup Archiving REcovery Open Sourced
+
+   Copyright (C) 2016-2016 Bareos GmbH & Co. KG
+
+   This program is Free Software; you can redistribute it and/or
+   modify it under the terms of version three of the GNU Affero General Public
+   License as published by the Free Software Foundation and included
+   in the file LICENSE.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+   Affero General Public License for more details.
+
+   You should have received a copy of the GNU Affero General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+   02110-1301, USA.
+*/
+/**
+ * @file
+ * Parallel directory walker definitions.
+ */
+
+#ifndef __WALKER_H
+#define __WALKER_H
+
+/*
+ * Number of directory entries that get lstat()ed as one unit of work.
+ */
+#define WALK_BATCH_SIZE 256
+
+/*
+ * Number of directories per walker thread that may be read ahead.
+ */
+#define WALK_DIRS_PER_THREAD 32
+
+/*
+ * States of a directory in the walker.
+ */
+enum {
+   WALK_DIR_QUEUED = 0,                 /**< Waiting to be read */
+   WALK_DIR_LISTED,                     /**< Entries read, lstat() in progress */
+   WALK_DIR_DONE                        /**< All entries lstat()ed */
+};
+
+struct walk_entry {
+   uint32_t name_offset;                /**< Offset of the name in names */
+   uint32_t name_length;                /**< Length of the name */
+   int stat_errno;                      /**< Errno of lstat(), 0 when statp is valid */
+   bool too_long;                       /**< Name longer than allowed */
+   bool read_ahead;                     /**< Subdirectory find_files() may descend into */
+   struct stat statp;                   /**< Result of lstat() */
+};
+
+struct walk_dir {
+   dlink link;                          /**< Link in the list of read ahead directories */
+   char *path;                          /**< Directory name including trailing slash */
+   uint32_t hash;                       /**< Hash of path for quick compares */
+   dev_t device;                        /**< Device the directory lives on */
+   int state;                           /**< WALK_DIR_* */
+   int open_errno;                      /**< Errno of opendir(), 0 when opened */
+   int pending;                         /**< Number of queued or running tasks */
+   int running;                         /**< Number of running tasks */
+   char *names;                         /**< All entry names, NUL terminated */
+   walk_entry *entries;                 /**< Entries in readdir() order */
+   int num_entries;                     /**< Number of entries */
+   int num_batches;                     /**< Number of lstat() batches */
+   bool *batch_done;                    /**< Completed lstat() batches */
+};
+
+struct walk_task {
+   dlink link;                          /**< Link in the task queue */
+   walk_dir *dir;                       /**< Directory to work on */
+   int batch;                           /**< Batch to lstat() or -1 for readdir() */
+};
+
+struct dir_walker {
+   JCR *jcr;                            /**< Job we are walking for */
+   FF_PKT *ff;                          /**< Find packet with the exclusions to apply */
+   alist *fstypes;                      /**< Allowed file system types when crossing */
+   int num_threads;                     /**< Number of walker threads */
+   int max_dirs;                        /**< Maximum number of unclaimed directories */
+   int num_dirs;                        /**< Current number of unclaimed directories */
+   bool read_ahead;                     /**< Read subdirectories ahead */
+   bool multifs;                        /**< Read ahead into other filesystems */
+   bool quit;                           /**< Threads should exit */
+   pthread_t *threads;                  /**< Walker threads */
+   pthread_mutex_t lock;                /**< Protects everything below */
+   pthread_cond_t work;                 /**< Signalled when tasks get queued */
+   pthread_cond_t done;                 /**< Signalled when a task finishes */
+   dlist *stat_tasks;                   /**< Queued lstat() batches, done first */
+   dlist *dir_tasks;                    /**< Queued directories, first is read first */
+   dlist *dirs;                         /**< Unclaimed directories, oldest first */
+   uint64_t dirs_read;                  /**< Directories read */
+   uint64_t dirs_read_ahead;            /**< Directories claimed after being read ahead */
+   uint64_t dirs_dropped;               /**< Directories dropped from the read ahead */
+   uint64_t entries_stated;             /**< Entries lstat()ed */
+};
+
+#endif /* __WALKER_H */
@@ -216,6 +216,12 @@ void InitWinAPIWrapper();
  */
 #define DEFAULT_NETWORK_BUFFER_SIZE (64 * 1024)
 
+/**
+ * Maximum size of a block on a Volume, also the upper bound of
+ * the data of a single record, this is a sort of sanity check.
+ */
+#define MAX_BLOCK_LENGTH 20000000
+
 /**
  * Tape label types -- stored in catalog
  */
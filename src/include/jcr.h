@@ -194,6 +194,7 @@ struct CP_THREAD_CTX;
 #ifdef FILE_DAEMON
 class htable;
 class B_ACCURATE;
+struct compress_pipeline;
 struct acl_data_t;
 struct xattr_data_t;
 
@@ -262,6 +263,10 @@ struct CMPRS_CTX {
 #endif
 #ifdef HAVE_FASTLZ
       void *pZFAST;                       /**< FASTLZ compression session data */
+#endif
+#ifdef HAVE_ZSTD
+      void *pZSTD;                        /**< ZSTD compression session data */
+      void *pZSTDD;                       /**< ZSTD decompression session data */
 #endif
    } workset;
 };
@@ -331,6 +336,8 @@ public:
     * Global part of JCR common to all daemons
     */
    dlink link;                            /**< JCR chain link */
+   JCR *registry_next;                    /**< Next JCR in the JobId registry shard */
+   uint32_t registry_JobId;               /**< JobId the JCR is registered under */
    pthread_t my_thread_id;                /**< Id of thread controlling jcr */
    BSOCK *dir_bsock;                      /**< Director bsock or NULL if we are him */
    BSOCK *store_bsock;                    /**< Storage connection socket */
@@ -514,6 +521,7 @@ public:
    char *big_buf;                         /**< I/O buffer */
    int32_t replace;                       /**< Replace options */
    FF_PKT *ff;                            /**< Find Files packet */
+   struct compress_pipeline *compress_pipeline; /**< Parallel compression pipeline */
    char PrevJob[MAX_NAME_LENGTH];         /**< Previous job name assiciated with since time */
    uint32_t ExpectedFiles;                /**< Expected restore files */
    uint32_t StartFile;
@@ -578,6 +586,9 @@ public:
    bool Resched;                          /**< Job may be rescheduled */
    bool insert_jobmedia_records;          /**< Need to insert job media records */
    uint64_t RemainingQuota;               /**< Available bytes to use as quota */
+   char *data_streams_key;                /**< Auth key for the additional FD data connections */
+   int32_t data_streams;                  /**< Number of FD data connections granted */
+   BSOCK **data_bsocks;                   /**< Additional FD data connections */
 
    /*
     * Parameters for Open Read Session
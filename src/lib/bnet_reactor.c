@@ -0,0 +1,485 @@
+/*
+   BAREOS® - Backup Archiving REcovery Open Sourced
+
+   Copyright (C) 2016-2016 Bareos GmbH & Co. KG
+
+   This program is Free Software; you can redistribute it and/or
+   modify it under the terms of version three of the GNU Affero General Public
+   License as published by the Free Software Foundation and included
+   in the file LICENSE.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+   Affero General Public License for more details.
+
+   You should have received a copy of the GNU Affero General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+   02110-1301, USA.
+*/
+
+/*
+ * Network reactor
+ *
+ * A single thread waits for data on all idle connections handed to it
+ * by watch(). Every watch is one-shot: as soon as the connection becomes
+ * readable (or its timeout expires) it is removed from the watch set and
+ * the handler is run in a worker thread of the reactor's own work queue.
+ * Linux uses epoll, other platforms fall back to poll() or select().
+ */
+
+#include "bareos.h"
+#include "jcr.h"
+#include "bnet_reactor.h"
+
+#ifdef HAVE_SYS_EPOLL_H
+#include <sys/epoll.h>
+#elif HAVE_POLL_H
+#include <poll.h>
+#elif HAVE_SYS_POLL_H
+#include <sys/poll.h>
+#endif
+
+/*
+ * Maximum number of events handled per wakeup of the reactor thread.
+ */
+#define REACTOR_MAX_EVENTS 64
+
+/*
+ * Interval (in milliseconds) at which the reactor thread checks for
+ * watches that timed out.
+ */
+#define REACTOR_TICK 1000
+
+struct bnet_reactor_item {
+   dlink link;
+   BSOCK *bs;
+   BNET_REACTOR_HANDLER *handler;
+   void *ctx;
+   time_t deadline;                     /* 0 = wait forever */
+   bool readable;
+};
+
+static void *reactor_thread(void *arg)
+{
+   BNET_REACTOR *reactor = (BNET_REACTOR *)arg;
+
+   set_jcr_in_tsd(INVALID_JCR);
+   reactor->run();
+
+   return NULL;
+}
+
+static void *reactor_worker(void *arg)
+{
+   bnet_reactor_item *item = (bnet_reactor_item *)arg;
+
+   set_jcr_in_tsd(INVALID_JCR);
+   item->handler(item->bs, item->ctx, item->readable);
+   free(item);
+
+   return NULL;
+}
+
+BNET_REACTOR::BNET_REACTOR()
+{
+   bnet_reactor_item *item = NULL;
+
+   m_running = false;
+   m_quit = false;
+   m_epfd = -1;
+   m_wakeup[0] = m_wakeup[1] = -1;
+   m_items = New(dlist(item, &item->link));
+   pthread_mutex_init(&m_mutex, NULL);
+}
+
+BNET_REACTOR::~BNET_REACTOR()
+{
+   stop();
+   delete m_items;
+   pthread_mutex_destroy(&m_mutex);
+}
+
+/*
+ * Start the reactor thread. Handlers are run by at most max_workers
+ * threads in parallel.
+ */
+bool BNET_REACTOR::start(int max_workers)
+{
+   int status;
+
+   if (m_running) {
+      return true;
+   }
+
+   if (pipe(m_wakeup) < 0) {
+      berrno be;
+      Emsg1(M_ERROR, 0, _("Cannot create reactor wakeup pipe: ERR=%s\n"), be.bstrerror());
+      return false;
+   }
+
+#ifdef HAVE_SYS_EPOLL_H
+   struct epoll_event ev;
+
+   if ((m_epfd = epoll_create(REACTOR_MAX_EVENTS)) < 0) {
+      berrno be;
+      Emsg1(M_ERROR, 0, _("Cannot create epoll instance: ERR=%s\n"), be.bstrerror());
+      goto bail_out;
+   }
+
+   memset(&ev, 0, sizeof(ev));
+   ev.events = EPOLLIN;
+   ev.data.ptr = NULL;                  /* NULL marks the wakeup pipe */
+   if (epoll_ctl(m_epfd, EPOLL_CTL_ADD, m_wakeup[0], &ev) < 0) {
+      berrno be;
+      Emsg1(M_ERROR, 0, _("Cannot watch reactor wakeup pipe: ERR=%s\n"), be.bstrerror());
+      goto bail_out;
+   }
+#endif
+
+   if ((status = workq_init(&m_workq, max_workers, reactor_worker)) != 0) {
+      berrno be;
+      Emsg1(M_ERROR, 0, _("Could not init reactor work queue: ERR=%s\n"), be.bstrerror(status));
+      goto bail_out;
+   }
+
+   m_quit = false;
+   if ((status = pthread_create(&m_tid, NULL, reactor_thread, (void *)this)) != 0) {
+      berrno be;
+      Emsg1(M_ERROR, 0, _("Cannot create reactor thread: ERR=%s\n"), be.bstrerror(status));
+      workq_destroy(&m_workq);
+      goto bail_out;
+   }
+
+   m_running = true;
+   Dmsg1(100, "reactor started with %d workers\n", max_workers);
+   return true;
+
+bail_out:
+   if (m_epfd >= 0) {
+      close(m_epfd);
+      m_epfd = -1;
+   }
+   close(m_wakeup[0]);
+   close(m_wakeup[1]);
+   m_wakeup[0] = m_wakeup[1] = -1;
+   return false;
+}
+
+/*
+ * Stop the reactor thread. All connections still being watched are
+ * handed back to their handlers with readable set to false, after which
+ * we wait for all workers to finish.
+ */
+void BNET_REACTOR::stop()
+{
+   bnet_reactor_item *item;
+
+   if (!m_running) {
+      return;
+   }
+
+   m_quit = true;
+   wakeup();
+   pthread_join(m_tid, NULL);
+
+   lock();
+   while ((item = (bnet_reactor_item *)m_items->first())) {
+      unwatch(item);
+      dispatch(item, false);
+   }
+   unlock();
+
+   workq_destroy(&m_workq);
+
+#ifdef HAVE_SYS_EPOLL_H
+   close(m_epfd);
+   m_epfd = -1;
+#endif
+   close(m_wakeup[0]);
+   close(m_wakeup[1]);
+   m_wakeup[0] = m_wakeup[1] = -1;
+   m_running = false;
+}
+
+/*
+ * Hand a connection to the reactor. Ownership of the socket passes to the
+ * reactor until the handler is called, the caller must not touch it in
+ * the meantime. A timeout (in seconds) of zero waits forever.
+ *
+ * Returns false when the reactor is not running, the caller still owns
+ * the connection in that case.
+ */
+bool BNET_REACTOR::watch(BSOCK *bs, BNET_REACTOR_HANDLER *handler, void *ctx, int timeout)
+{
+   bnet_reactor_item *item;
+
+   if (!m_running || m_quit) {
+      return false;
+   }
+
+   /*
+    * Make sure nothing the peer waits for is held back in our buffers.
+    */
+   bs->flush();
+
+   item = (bnet_reactor_item *)malloc(sizeof(bnet_reactor_item));
+   memset(item, 0, sizeof(bnet_reactor_item));
+   item->bs = bs;
+   item->handler = handler;
+   item->ctx = ctx;
+   item->deadline = (timeout > 0) ? time(NULL) + timeout : 0;
+
+#ifdef HAVE_TLS
+   /*
+    * Data already decrypted by the TLS layer never shows up on the socket.
+    */
+   if (bs->tls_conn && tls_bsock_pending(bs) > 0) {
+      lock();
+      dispatch(item, true);
+      unlock();
+      return true;
+   }
+#endif
+
+   lock();
+   m_items->append(item);
+   Dmsg2(200, "reactor watches %s (%d connections)\n", bs->who(), m_items->size());
+
+#ifdef HAVE_SYS_EPOLL_H
+   struct epoll_event ev;
+
+   memset(&ev, 0, sizeof(ev));
+   ev.events = EPOLLIN | EPOLLONESHOT;
+#ifdef EPOLLRDHUP
+   ev.events |= EPOLLRDHUP;
+#endif
+   ev.data.ptr = item;
+   if (epoll_ctl(m_epfd, EPOLL_CTL_ADD, bs->m_fd, &ev) < 0) {
+      berrno be;
+      Dmsg2(100, "epoll_ctl for %s failed: ERR=%s\n", bs->who(), be.bstrerror());
+      m_items->remove(item);
+      unlock();
+      free(item);
+      return false;
+   }
+   unlock();
+#else
+   unlock();
+   wakeup();                            /* rebuild the poll set */
+#endif
+
+   return true;
+}
+
+void BNET_REACTOR::wakeup()
+{
+   char c = 0;
+
+   if (write(m_wakeup[1], &c, 1) < 0) {
+      Dmsg0(100, "write to reactor wakeup pipe failed\n");
+   }
+}
+
+/*
+ * Remove an item from the watch set. Must be called with the lock held.
+ */
+void BNET_REACTOR::unwatch(bnet_reactor_item *item)
+{
+#ifdef HAVE_SYS_EPOLL_H
+   struct epoll_event ev;
+
+   memset(&ev, 0, sizeof(ev));
+   epoll_ctl(m_epfd, EPOLL_CTL_DEL, item->bs->m_fd, &ev);
+#endif
+   m_items->remove(item);
+}
+
+/*
+ * Queue the handler of an item for one of the workers.
+ * Must be called with the lock held.
+ */
+void BNET_REACTOR::dispatch(bnet_reactor_item *item, bool readable)
+{
+   int status;
+
+   item->readable = readable;
+   if ((status = workq_add(&m_workq, (void *)item, NULL, 0)) != 0) {
+      berrno be;
+      Emsg1(M_ABORT, 0, _("Could not add reactor job to work queue: ERR=%s\n"), be.bstrerror(status));
+   }
+}
+
+void BNET_REACTOR::expire_timeouts(time_t now)
+{
+   bnet_reactor_item *item, *next;
+
+   lock();
+   for (item = (bnet_reactor_item *)m_items->first(); item; item = next) {
+      next = (bnet_reactor_item *)m_items->next(item);
+      if (item->deadline && item->deadline <= now) {
+         Dmsg1(200, "reactor watch for %s timed out\n", item->bs->who());
+         unwatch(item);
+         dispatch(item, false);
+      }
+   }
+   unlock();
+}
+
+#ifdef HAVE_SYS_EPOLL_H
+int BNET_REACTOR::wait_for_events(bnet_reactor_item **ready, int max_ready, int timeout_ms)
+{
+   int i, nfds, cnt = 0;
+   char buf[512];
+   struct epoll_event events[REACTOR_MAX_EVENTS];
+
+   if (max_ready > REACTOR_MAX_EVENTS) {
+      max_ready = REACTOR_MAX_EVENTS;
+   }
+
+   nfds = epoll_wait(m_epfd, events, max_ready, timeout_ms);
+   for (i = 0; i < nfds; i++) {
+      if (events[i].data.ptr == NULL) {
+         if (read(m_wakeup[0], buf, sizeof(buf)) < 0) {
+            Dmsg0(100, "read from reactor wakeup pipe failed\n");
+         }
+         continue;
+      }
+      ready[cnt++] = (bnet_reactor_item *)events[i].data.ptr;
+   }
+
+   return (nfds < 0) ? -1 : cnt;
+}
+#elif defined(HAVE_POLL)
+int BNET_REACTOR::wait_for_events(bnet_reactor_item **ready, int max_ready, int timeout_ms)
+{
+   int i, n, nfds, cnt = 0;
+   char buf[512];
+   struct pollfd *pfds;
+   bnet_reactor_item *item, **items;
+
+   lock();
+   n = m_items->size() + 1;
+   pfds = (struct pollfd *)malloc(n * sizeof(struct pollfd));
+   items = (bnet_reactor_item **)malloc(n * sizeof(bnet_reactor_item *));
+   memset(pfds, 0, n * sizeof(struct pollfd));
+   pfds[0].fd = m_wakeup[0];
+   pfds[0].events = POLLIN;
+   i = 1;
+   foreach_dlist(item, m_items) {
+      pfds[i].fd = item->bs->m_fd;
+      pfds[i].events = POLLIN;
+      items[i++] = item;
+   }
+   unlock();
+
+   nfds = poll(pfds, n, timeout_ms);
+   if (nfds > 0) {
+      if (pfds[0].revents) {
+         if (read(m_wakeup[0], buf, sizeof(buf)) < 0) {
+            Dmsg0(100, "read from reactor wakeup pipe failed\n");
+         }
+      }
+
+      /*
+       * Only the reactor thread removes items from the watch set apart
+       * from stop(), so the items collected above are still valid here.
+       */
+      for (i = 1; i < n && cnt < max_ready; i++) {
+         if (pfds[i].revents) {
+            ready[cnt++] = items[i];
+         }
+      }
+   }
+
+   free(pfds);
+   free(items);
+
+   return (nfds < 0) ? -1 : cnt;
+}
+#else
+int BNET_REACTOR::wait_for_events(bnet_reactor_item **ready, int max_ready, int timeout_ms)
+{
+   int status, maxfd, cnt = 0;
+   char buf[512];
+   fd_set fdset;
+   struct timeval tv;
+   bnet_reactor_item *item;
+
+   FD_ZERO(&fdset);
+   FD_SET((unsigned)m_wakeup[0], &fdset);
+   maxfd = m_wakeup[0];
+
+   lock();
+   foreach_dlist(item, m_items) {
+      FD_SET((unsigned)item->bs->m_fd, &fdset);
+      if (item->bs->m_fd > maxfd) {
+         maxfd = item->bs->m_fd;
+      }
+   }
+   unlock();
+
+   tv.tv_sec = timeout_ms / 1000;
+   tv.tv_usec = (timeout_ms % 1000) * 1000;
+   status = select(maxfd + 1, &fdset, NULL, NULL, &tv);
+   if (status > 0) {
+      if (FD_ISSET(m_wakeup[0], &fdset)) {
+         if (read(m_wakeup[0], buf, sizeof(buf)) < 0) {
+            Dmsg0(100, "read from reactor wakeup pipe failed\n");
+         }
+      }
+
+      lock();
+      foreach_dlist(item, m_items) {
+         if (cnt < max_ready && FD_ISSET(item->bs->m_fd, &fdset)) {
+            ready[cnt++] = item;
+         }
+      }
+      unlock();
+   }
+
+   return (status < 0) ? -1 : cnt;
+}
+#endif
+
+/*
+ * Main loop of the reactor thread.
+ */
+void BNET_REACTOR::run()
+{
+   int i, cnt;
+   time_t now, next_tick;
+   bnet_reactor_item *ready[REACTOR_MAX_EVENTS];
+
+   next_tick = time(NULL) + REACTOR_TICK / 1000;
+   while (!m_quit) {
+      cnt = wait_for_events(ready, REACTOR_MAX_EVENTS, REACTOR_TICK);
+      if (cnt < 0) {
+         berrno be;
+         if (errno == EINTR) {
+            continue;
+         }
+         Emsg1(M_ERROR, 0, _("Error waiting for network events: ERR=%s\n"), be.bstrerror());
+         bmicrosleep(1, 0);
+         continue;
+      }
+
+      if (m_quit) {
+         break;
+      }
+
+      lock();
+      for (i = 0; i < cnt; i++) {
+         unwatch(ready[i]);
+         dispatch(ready[i], true);
+      }
+      unlock();
+
+      now = time(NULL);
+      if (now >= next_tick) {
+         expire_timeouts(now);
+         next_tick = now + REACTOR_TICK / 1000;
+      }
+   }
+}
@@ -0,0 +1,73 @@
+/*
+   BAREOS® - Backup Archiving REcovery Open Sourced
+
+   Copyright (C) 2016-2016 Bareos GmbH & Co. KG
+
+   This program is Free Software; you can redistribute it and/or
+   modify it under the terms of version three of the GNU Affero General Public
+   License as published by the Free Software Foundation and included
+   in the file LICENSE.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+   Affero General Public License for more details.
+
+   You should have received a copy of the GNU Affero General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+   02110-1301, USA.
+*/
+/**
+ * @file
+ * Network reactor
+ *
+ * Watches idle connections with a single thread (epoll where available)
+ * and hands a connection to a worker thread only when data arrives,
+ * so mostly idle sessions don't each occupy a thread.
+ */
+
+#ifndef __BNET_REACTOR_H_
+#define __BNET_REACTOR_H_
+
+/*
+ * Called in a worker thread when a watched connection becomes readable,
+ * when its timeout expires or when the reactor is stopped (readable false).
+ * The handler owns the connection again and either watches it again
+ * or closes it.
+ */
+typedef void (BNET_REACTOR_HANDLER)(BSOCK *bs, void *ctx, bool readable);
+
+struct bnet_reactor_item;
+
+class BNET_REACTOR : public SMARTALLOC {
+public:
+   BNET_REACTOR();
+   ~BNET_REACTOR();
+
+   bool start(int max_workers);
+   void stop();
+   bool watch(BSOCK *bs, BNET_REACTOR_HANDLER *handler, void *ctx, int timeout = 0);
+   int size() { return m_items->size(); };
+
+   void run();                          /* reactor thread main loop */
+
+private:
+   bool m_running;
+   volatile bool m_quit;
+   int m_epfd;
+   int m_wakeup[2];
+   pthread_t m_tid;
+   workq_t m_workq;
+   dlist *m_items;
+   pthread_mutex_t m_mutex;
+
+   void lock() { P(m_mutex); };
+   void unlock() { V(m_mutex); };
+   void wakeup();
+   void dispatch(bnet_reactor_item *item, bool readable);
+   void unwatch(bnet_reactor_item *item);
+   void expire_timeouts(time_t now);
+   int wait_for_events(bnet_reactor_item **ready, int max_ready, int timeout_ms);
+};
+#endif
@@ -33,6 +33,7 @@ BSOCK::BSOCK()
 {
    m_fd = -1;
    m_spool_fd = -1;
+   m_replay_fd = -1;
    msg = get_pool_memory(PM_BSOCK);
    errmsg = get_pool_memory(PM_MESSAGE);
    m_blocking = true;
@@ -112,6 +113,154 @@ void BSOCK::clear_locking()
    return;
 }
 
+/*
+ * Add an additional data connection to this connection.
+ *
+ * While striping, the data packets and the BNET_EOD signals are sent
+ * over this connection and the additional connections in stripes. Each
+ * packet carries a sequence number, so the receiver can read whichever
+ * connection has data and put the packets back in order. The additional
+ * connections are owned by this BSOCK.
+ */
+void BSOCK::add_data_stream(BSOCK *bs)
+{
+   if (!m_data_streams) {
+      m_data_streams = New(alist(10, not_owned_by_alist));
+   }
+   if (m_use_bursting) {
+      bs->set_bwlimit_bursting();
+   }
+   m_data_streams->append(bs);
+}
+
+void BSOCK::close_data_streams()
+{
+   BSOCK *bs;
+
+   if (!m_data_streams) {
+      return;
+   }
+
+   clear_striping();
+
+   /*
+    * Give this connection back the bandwidth of the data connections.
+    */
+   m_bwlimit *= m_data_streams->size() + 1;
+
+   foreach_alist(bs, m_data_streams) {
+      bs->close();
+      delete bs;
+   }
+   delete m_data_streams;
+   m_data_streams = NULL;
+}
+
+/*
+ * Start striping the packets over the data connections.
+ * The data connections inherit the coalescing mode of this connection.
+ */
+void BSOCK::set_striping()
+{
+   int i;
+   BSOCK *bs;
+
+   if (!m_data_streams) {
+      return;
+   }
+
+   foreach_alist(bs, m_data_streams) {
+      if (m_use_coalescing) {
+         bs->set_coalescing();
+      }
+   }
+
+   if (!m_stripe_buf) {
+      m_stripe_buf = get_pool_memory(PM_BSOCK);
+   }
+   if (!m_stripe_packets) {
+      m_stripe_packets = (stripe_packet *)malloc(get_data_streams() * sizeof(stripe_packet));
+      for (i = 0; i < get_data_streams(); i++) {
+         m_stripe_packets[i].msg = get_pool_memory(PM_BSOCK);
+         m_stripe_packets[i].msglen = 0;
+         m_stripe_packets[i].seqno = 0;
+         m_stripe_packets[i].pending = false;
+      }
+   }
+   if (!m_stripe_fds) {
+      m_stripe_fds = (int *)malloc(2 * get_data_streams() * sizeof(int));
+   }
+   if (!m_stripe_pfds) {
+      m_stripe_pfds = get_pool_memory(PM_BSOCK);
+   }
+
+   m_data_stream = 0;
+   m_stripe_bytes = 0;
+   m_stripe_seqno = 0;
+   m_use_striping = true;
+}
+
+/*
+ * Stop striping, any coalesced data on the data connections is written out.
+ */
+void BSOCK::clear_striping()
+{
+   int i;
+   BSOCK *bs;
+
+   if (!m_data_streams) {
+      return;
+   }
+
+   foreach_alist(bs, m_data_streams) {
+      bs->clear_coalescing();
+   }
+
+   if (m_stripe_buf) {
+      free_pool_memory(m_stripe_buf);
+      m_stripe_buf = NULL;
+   }
+   if (m_stripe_packets) {
+      for (i = 0; i < get_data_streams(); i++) {
+         if (m_stripe_packets[i].pending) {
+            Dmsg2(100, "Dropping striped packet %u from %s\n", m_stripe_packets[i].seqno, m_who);
+         }
+         free_pool_memory(m_stripe_packets[i].msg);
+      }
+      free(m_stripe_packets);
+      m_stripe_packets = NULL;
+   }
+   if (m_stripe_fds) {
+      free(m_stripe_fds);
+      m_stripe_fds = NULL;
+   }
+   if (m_stripe_pfds) {
+      free_pool_memory(m_stripe_pfds);
+      m_stripe_pfds = NULL;
+   }
+
+   m_data_stream = 0;
+   m_stripe_bytes = 0;
+   m_use_striping = false;
+}
+
+/*
+ * Limit the bandwidth of this connection. With additional data connections
+ * the limit is shared evenly by all connections that were actually opened.
+ */
+void BSOCK::set_bwlimit(int64_t maxspeed)
+{
+   BSOCK *bs;
+
+   if (m_data_streams) {
+      maxspeed /= m_data_streams->size() + 1;
+      foreach_alist(bs, m_data_streams) {
+         bs->set_bwlimit(maxspeed);
+      }
+   }
+   m_bwlimit = maxspeed;
+}
+
 /*
  * Send a signal
  */
@@ -135,6 +284,10 @@ bool BSOCK::despool(void update_attr_spool_size(ssize_t size), ssize_t tsize)
    int count = 0;
    JCR *jcr = get_jcr();
 
+   if (!flush()) {
+      return false;
+   }
+
    if (lseek(m_spool_fd, 0, SEEK_SET) == -1) {
       Qmsg(jcr, M_FATAL, 0, _("attr spool I/O error.\n"));
       return false;
@@ -178,6 +331,65 @@ bool BSOCK::despool(void update_attr_spool_size(ssize_t size), ssize_t tsize)
    return true;
 }
 
+/*
+ * Get the next message from the replay file set with set_replay().
+ * The replay file uses the same format as the spool file above and
+ * holds messages received ahead of time, they are returned by recv()
+ * before anything is read from the connection again. The file is
+ * closed when all messages have been replayed.
+ *
+ * Returns: true if nbytes holds the result of the replayed message
+ *          false if there is nothing (left) to replay
+ */
+bool BSOCK::recv_replayed(int32_t &nbytes)
+{
+   int32_t pktsiz;
+   ssize_t status;
+
+   if (m_replay_fd < 0) {
+      return false;
+   }
+
+   status = read(m_replay_fd, (char *)&pktsiz, sizeof(int32_t));
+   if (status == sizeof(int32_t)) {
+      msglen = ntohl(pktsiz);
+      if (msglen < 0) {
+         nbytes = BNET_SIGNAL;
+         return true;
+      }
+
+      if (msglen >= (int32_t)sizeof_pool_memory(msg)) {
+         msg = realloc_pool_memory(msg, msglen + 100);
+      }
+      if (msglen > 0) {
+         status = read(m_replay_fd, msg, msglen);
+      }
+      if (msglen == 0 || status == msglen) {
+         msg[msglen] = 0;
+         nbytes = msglen;
+         return true;
+      }
+   }
+
+   if (status != 0) {
+      berrno be;
+
+      Qmsg1(get_jcr(), M_FATAL, 0, _("Read error on replay file. ERR=%s\n"), be.bstrerror());
+      b_errno = errno;
+      errors++;
+      msglen = 0;
+      nbytes = BNET_ERROR;
+      ::close(m_replay_fd);
+      m_replay_fd = -1;
+      return true;
+   }
+
+   ::close(m_replay_fd);
+   m_replay_fd = -1;
+
+   return false;
+}
+
 /*
  * Return the string for the error that occurred
  * on the socket. Only the first error is retained.
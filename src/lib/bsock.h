@@ -43,6 +43,15 @@ class BSOCK;
 btimer_t *start_bsock_timer(BSOCK *bs, uint32_t wait);
 void stop_bsock_timer(btimer_t *wid);
 
+/*
+ * A striped packet received ahead of its turn, one per connection.
+ */
+struct stripe_packet {
+   POOLMEM *msg;                      /* Packet including the stripe header */
+   int32_t msglen;                    /* Message length or signal */
+   uint32_t seqno;                    /* Sequence number of the packet */
+   bool pending;                      /* Set while waiting to be handed out */
+};
 
 class BSOCK : public SMARTALLOC {
 /**
@@ -55,6 +64,7 @@ public:
    POOLMEM *msg;                      /* Message pool buffer */
    POOLMEM *errmsg;                   /* Edited error message */
    int m_spool_fd;                    /* Spooling file */
+   int m_replay_fd;                   /* File with messages received ahead of time */
    TLS_CONNECTION *tls_conn;          /* Associated tls connection */
    IPADDR *src_addr;                  /* IP address to source connections from */
    uint32_t in_msg_no;                /* Input message number */
@@ -85,9 +95,19 @@ protected:
    bool m_use_locking:1;              /* Set to use locking */
    bool m_use_bursting:1;             /* Set to use bandwidth bursting */
    bool m_use_keepalive:1;            /* Set to use keepalive on the socket */
+   bool m_use_coalescing:1;           /* Set to coalesce small messages */
+   bool m_use_striping:1;             /* Set to stripe packets over the data streams */
    int64_t m_bwlimit;                 /* Set to limit bandwidth */
    int64_t m_nb_bytes;                /* Bytes sent/recv since the last tick */
    btime_t m_last_tick;               /* Last tick used by bwlimit */
+   alist *m_data_streams;             /* Additional data connections of a job */
+   int m_data_stream;                 /* Connection of the current stripe, 0 is this one */
+   int32_t m_stripe_bytes;            /* Bytes sent in the current stripe */
+   uint32_t m_stripe_seqno;           /* Sequence number of the next striped packet */
+   POOLMEM *m_stripe_buf;             /* Striped packet being sent */
+   stripe_packet *m_stripe_packets;   /* Striped packets received ahead of their turn */
+   int *m_stripe_fds;                 /* Sockets and connections waited on for striped packets */
+   POOLMEM *m_stripe_pfds;            /* Poll descriptors for m_stripe_fds */
 
    virtual void fin_init(JCR * jcr, int sockfd, const char *who, const char *host, int port,
                          struct sockaddr *lclient_addr) = 0;
@@ -126,11 +146,13 @@ public:
     */
    virtual int wait_data(int sec, int usec = 0) = 0;
    virtual int wait_data_intr(int sec, int usec = 0) = 0;
+   virtual bool flush() { return true; }; /* Send out coalesced messages */
    bool fsend(const char*, ...);
    void set_killable(bool killable);
    bool signal(int signal);
    const char *bstrerror();           /* last error on socket */
    bool despool(void update_attr_spool_size(ssize_t size), ssize_t tsize);
+   bool recv_replayed(int32_t &nbytes);
    bool authenticate_with_director(JCR *jcr,
                                    const char *name, s_password &password, tls_t &tls,
                                    char *response, int response_len);
@@ -138,6 +160,11 @@ public:
    void clear_locking();              /* in bsock.c */
    void set_source_address(dlist *src_addr_list);
    void control_bwlimit(int bytes);   /* in bsock.c */
+   void add_data_stream(BSOCK *bs);   /* in bsock.c */
+   void close_data_streams();         /* in bsock.c */
+   void set_striping();               /* in bsock.c */
+   void clear_striping();             /* in bsock.c */
+   void set_bwlimit(int64_t maxspeed); /* in bsock.c */
 
    /* Inline functions */
    bool authenticate_outbound_connection(JCR *jcr, const char *what,
@@ -172,13 +199,19 @@ public:
    };
    boffset_t get_data_end() { return m_data_end; };
    int32_t get_FileIndex() { return m_FileIndex; };
-   void set_bwlimit(int64_t maxspeed) { m_bwlimit = maxspeed; };
    bool use_bwlimit() { return m_bwlimit > 0;};
    void set_bwlimit_bursting() { m_use_bursting = true; };
    void clear_bwlimit_bursting() { m_use_bursting = false; };
    void set_keepalive() { m_use_keepalive = true; };
    void clear_keepalive() { m_use_keepalive = false; };
-   void set_spooling() { m_spool = true; };
+   void set_coalescing() { m_use_coalescing = true; };
+   void clear_coalescing() { flush(); m_use_coalescing = false; };
+   bool is_coalescing() { return m_use_coalescing; };
+   int get_data_streams() { return m_data_streams ? m_data_streams->size() + 1 : 1; };
+   bool is_striping() { return m_use_striping; };
+   void set_spooling() { flush(); m_spool = true; };
+   void set_replay(int fd) { m_replay_fd = fd; };
+   bool is_replaying() { return m_replay_fd >= 0; };
    void clear_spooling() { m_spool = false; };
    void set_timed_out() { m_timed_out = true; };
    void clear_timed_out() { m_timed_out = false; };
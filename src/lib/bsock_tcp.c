@@ -32,6 +32,10 @@
 #include <netdb.h>
 #include <netinet/tcp.h>
 
+#ifndef HAVE_WIN32
+#include <sys/uio.h>
+#endif
+
 #ifndef ENODATA                    /* not defined on BSD systems */
 #define ENODATA EPIPE
 #endif
@@ -86,6 +90,25 @@ BSOCK *BSOCK_TCP::clone()
    }
    clone->m_cloned = true;
 
+   /*
+    * The coalesced packets belong to the original BSOCK.
+    */
+   clone->m_cbuf = NULL;
+   clone->m_cbuf_len = 0;
+   clone->m_use_coalescing = false;
+
+   /*
+    * As are the additional data connections.
+    */
+   clone->m_data_streams = NULL;
+   clone->m_data_stream = 0;
+   clone->m_use_striping = false;
+   clone->m_stripe_buf = NULL;
+   clone->m_stripe_packets = NULL;
+   clone->m_stripe_fds = NULL;
+   clone->m_stripe_pfds = NULL;
+   clone->m_replay_fd = -1;
+
    return (BSOCK *)clone;
 }
 
@@ -374,12 +397,63 @@ bool BSOCK_TCP::set_keepalive(JCR *jcr, int sockfd, bool enable, int keepalive_s
 
 bool BSOCK_TCP::send_packet(int32_t *hdr, int32_t pktsiz)
 {
+   bool ok = true;
+
    Enter(400);
 
-   int32_t rc;
+   out_msg_no++;            /* increment message number */
+
+   if (!m_use_coalescing || is_spooling()) {
+      ok = write_packets(hdr, pktsiz);
+      goto bail_out;
+   }
+
+   /*
+    * Packets that are too big to be coalesced or that don't fit
+    * in the buffer are written together with the buffer.
+    */
+   if (pktsiz > coalesce_max_packet || (m_cbuf_len + pktsiz) > coalesce_size) {
+      ok = write_packets(hdr, pktsiz);
+      goto bail_out;
+   }
+
+   if (!m_cbuf) {
+      m_cbuf = get_pool_memory(PM_BSOCK);
+      m_cbuf = check_pool_memory_size(m_cbuf, coalesce_size);
+   }
+
+   if (m_cbuf_len == 0) {
+      m_cbuf_start = get_current_btime();
+   }
+   memcpy(m_cbuf + m_cbuf_len, (char *)hdr, pktsiz);
+   m_cbuf_len += pktsiz;
+
+   if (m_cbuf_len == coalesce_size ||
+       (get_current_btime() - m_cbuf_start) >= coalesce_timeout) {
+      ok = write_packets(NULL, 0);
+   }
+
+bail_out:
+   Leave(400);
+
+   return ok;
+}
+
+/*
+ * Write any coalesced packets followed by the given packet.
+ *
+ * Returns: false on failure
+ *          true  on success
+ */
+bool BSOCK_TCP::write_packets(int32_t *hdr, int32_t pktsiz)
+{
+   int32_t rc, nbytes;
    bool ok = true;
 
-   out_msg_no++;            /* increment message number */
+   nbytes = m_cbuf_len + pktsiz;
+   if (nbytes == 0) {
+      return true;
+   }
 
    /*
     * Send data packet
@@ -390,9 +464,14 @@ bool BSOCK_TCP::send_packet(int32_t *hdr, int32_t pktsiz)
    /*
     * Full I/O done in one write
     */
-   rc = write_nbytes((char *)hdr, pktsiz);
+   if (m_cbuf_len == 0) {
+      rc = write_nbytes((char *)hdr, pktsiz);
+   } else {
+      rc = write_nbytes2(m_cbuf, m_cbuf_len, (char *)hdr, pktsiz);
+      m_cbuf_len = 0;
+   }
    timer_start = 0;         /* clear timer */
-   if (rc != pktsiz) {
+   if (rc != nbytes) {
       errors++;
       if (errno == 0) {
          b_errno = EIO;
@@ -403,18 +482,46 @@ bool BSOCK_TCP::send_packet(int32_t *hdr, int32_t pktsiz)
          if (!m_suppress_error_msgs) {
             Qmsg5(m_jcr, M_ERROR, 0,
                   _("Write error sending %d bytes to %s:%s:%d: ERR=%s\n"),
-                  msglen, m_who,
+                  nbytes, m_who,
                   m_host, m_port, this->bstrerror());
          }
       } else {
          Qmsg5(m_jcr, M_ERROR, 0,
                _("Wrote %d bytes to %s:%s:%d, but only %d accepted.\n"),
-               msglen, m_who, m_host, m_port, rc);
+               nbytes, m_who, m_host, m_port, rc);
       }
       ok = false;
    }
 
-   Leave(400);
+   return ok;
+}
+
+/*
+ * Write out the coalesced packets.
+ *
+ * Returns: false on failure
+ *          true  on success
+ */
+bool BSOCK_TCP::flush()
+{
+   bool ok = true;
+
+   if (m_use_locking) {
+      P(m_mutex);
+   }
+
+   if (m_cbuf_len > 0) {
+      if (errors || is_terminated()) {
+         m_cbuf_len = 0;
+         ok = false;
+      } else {
+         ok = write_packets(NULL, 0);
+      }
+   }
+
+   if (m_use_locking) {
+      V(m_mutex);
+   }
 
    return ok;
 }
@@ -428,6 +535,111 @@ bool BSOCK_TCP::send_packet(int32_t *hdr, int32_t pktsiz)
  *          true  on success
  */
 bool BSOCK_TCP::send()
+{
+   /*
+    * Other signals than the end of a record always use this connection.
+    */
+   if (m_use_striping && (msglen >= 0 || msglen == BNET_EOD)) {
+      return send_striped();
+   }
+
+   return send_msg();
+}
+
+/*
+ * Send msg as striped packets. A stripe header with the sequence number
+ * and the message length or signal is put in front of each packet, so
+ * the receiver can put the packets of all connections back in order.
+ * Messages that don't fit in a single packet are split up.
+ *
+ * Returns: false on failure
+ *          true  on success
+ */
+bool BSOCK_TCP::send_striped()
+{
+   uint32_t *hdr;
+   const int32_t o_msglen = msglen;
+   int32_t len;
+   int32_t written = 0;
+   bool ok = true;
+
+   if (errors) {
+      return false;
+   }
+
+   do {
+      if (o_msglen > 0) {
+         len = MIN(o_msglen - written, max_message_len - stripe_header_length);
+      } else {
+         len = o_msglen;                   /* empty message or signal */
+      }
+
+      m_stripe_buf = check_pool_memory_size(m_stripe_buf, stripe_header_length + MAX(len, 0) + 1);
+      hdr = (uint32_t *)m_stripe_buf;
+      hdr[0] = htonl(m_stripe_seqno++);
+      hdr[1] = htonl((uint32_t)len);
+      if (len > 0) {
+         memcpy(m_stripe_buf + stripe_header_length, msg + written, len);
+         written += len;
+      }
+
+      ok = send_stripe_packet(stripe_header_length + MAX(len, 0));
+   } while (ok && written < o_msglen);
+
+   msglen = o_msglen;
+
+   return ok;
+}
+
+/*
+ * Send the packet in m_stripe_buf over the connection of the current stripe.
+ *
+ * When the stripe is full, its coalesced packets are written out before we
+ * move on to the next connection. The receiver may be waiting for one of
+ * them and we might block on a connection the receiver doesn't read from
+ * until it got it.
+ */
+bool BSOCK_TCP::send_stripe_packet(int32_t pktsiz)
+{
+   BSOCK *bs;
+   POOLMEM *o_msg;
+   bool ok;
+
+   if (m_data_stream == 0) {
+      bs = this;
+   } else {
+      bs = (BSOCK *)m_data_streams->get(m_data_stream - 1);
+   }
+
+   /*
+    * Lend the packet buffer to the connection.
+    */
+   o_msg = bs->msg;
+   bs->msg = m_stripe_buf;
+   bs->msglen = pktsiz;
+   if (bs == this) {
+      ok = send_msg();
+   } else {
+      ok = bs->send();
+   }
+   bs->msg = o_msg;
+
+   m_stripe_bytes += pktsiz;
+   if (ok && m_stripe_bytes >= stripe_size) {
+      ok = bs->flush();
+      m_stripe_bytes = 0;
+      m_data_stream = (m_data_stream + 1) % (m_data_streams->size() + 1);
+   }
+
+   if (!ok && bs != this) {
+      errors++;
+      b_errno = bs->b_errno;
+   }
+
+   return ok;
+}
+
+bool BSOCK_TCP::send_msg()
 {
    /*
     * Send msg (length: msglen).
@@ -526,6 +738,200 @@ bool BSOCK_TCP::send()
  *  Using is_bnet_stop() and is_bnet_error() you can figure this all out.
  */
 int32_t BSOCK_TCP::recv()
+{
+   int32_t nbytes;
+
+   if (m_replay_fd >= 0 && recv_replayed(nbytes)) {
+      return nbytes;
+   }
+
+   if (m_use_striping) {
+      return recv_striped();
+   }
+
+   return recv_msg();
+}
+
+/*
+ * Receive the next striped packet.
+ *
+ * The connections are read as data arrives on them. A packet that arrives
+ * ahead of its turn is kept until the packets before it were handed out.
+ * The sender keeps the packets of a connection in order, so at most one
+ * packet per connection needs to be kept and the next packet always
+ * arrives on a connection that has none waiting.
+ *
+ * Signals other than BNET_EOD are not striped and are handed out as they
+ * arrive.
+ */
+int32_t BSOCK_TCP::recv_striped()
+{
+   int i;
+   int32_t nbytes;
+
+   for ( ;; ) {
+      for (i = 0; i < get_data_streams(); i++) {
+         if (m_stripe_packets[i].pending && m_stripe_packets[i].seqno == m_stripe_seqno) {
+            return deliver_stripe_packet(i);
+         }
+      }
+
+      switch (wait_stripe_packet(-1, true, &i)) {
+      case 1:
+         break;
+      default:
+         b_errno = errno;
+         errors++;
+         return BNET_HARDEOF;
+      }
+
+      if (!read_stripe_packet(i, nbytes)) {
+         return nbytes;
+      }
+   }
+}
+
+/*
+ * Read a packet from a connection.
+ *
+ * Returns: true  when a striped packet was read and is waiting to be handed out
+ *          false when nbytes (a signal or an error) must be handed out as is
+ */
+bool BSOCK_TCP::read_stripe_packet(int stream, int32_t &nbytes)
+{
+   BSOCK *bs;
+   POOLMEM *o_msg;
+   uint32_t *hdr;
+   stripe_packet *sp = &m_stripe_packets[stream];
+
+   if (stream == 0) {
+      nbytes = recv_msg();
+   } else {
+      bs = (BSOCK *)m_data_streams->get(stream - 1);
+      nbytes = bs->recv();
+
+      /*
+       * Swap the message buffers so the data ends up in our msg.
+       */
+      o_msg = msg;
+      msg = bs->msg;
+      bs->msg = o_msg;
+      msglen = bs->msglen;
+      if (bs->errors) {
+         errors++;
+         b_errno = bs->b_errno;
+      }
+      if (bs->is_terminated()) {
+         set_terminated();
+      }
+   }
+
+   if (nbytes < 0) {
+      return false;
+   }
+
+   /*
+    * A packet that is too short, whose length doesn't match its stripe
+    * header or that was handed out already means the stream is broken.
+    */
+   if (nbytes >= stripe_header_length) {
+      hdr = (uint32_t *)msg;
+      sp->seqno = ntohl(hdr[0]);
+      sp->msglen = (int32_t)ntohl(hdr[1]);
+   }
+   if (nbytes < stripe_header_length ||
+       (sp->msglen >= 0 && sp->msglen != nbytes - stripe_header_length) ||
+       (sp->msglen < 0 && nbytes != stripe_header_length) ||
+       (int32_t)(sp->seqno - m_stripe_seqno) < 0) {
+      errors++;
+      b_errno = EIO;
+      Qmsg4(m_jcr, M_ERROR, 0, _("Bad striped packet of %d bytes from %s:%s:%d\n"),
+            nbytes, m_who, m_host, m_port);
+      nbytes = BNET_ERROR;
+      return false;
+   }
+
+   sp->pending = true;
+   o_msg = sp->msg;
+   sp->msg = msg;
+   msg = o_msg;
+
+   return true;
+}
+
+/*
+ * Hand out the packet waiting for the given connection in msg.
+ */
+int32_t BSOCK_TCP::deliver_stripe_packet(int stream)
+{
+   POOLMEM *o_msg;
+   stripe_packet *sp = &m_stripe_packets[stream];
+
+   o_msg = msg;
+   msg = sp->msg;
+   sp->msg = o_msg;
+   sp->pending = false;
+   m_stripe_seqno++;
+
+   msglen = sp->msglen;
+   if (msglen < 0) {
+      return BNET_SIGNAL;
+   }
+
+   memmove(msg, msg + stripe_header_length, msglen);
+   msg[msglen] = 0;
+
+   return msglen;
+}
+
+/*
+ * Wait for a packet on one of the connections that have none waiting.
+ * Data already decrypted by the TLS layer never shows up on the socket.
+ *
+ * Returns: 1 if data available, the connection is returned in stream
+ *          0 if timeout
+ *         -1 if error
+ */
+int BSOCK_TCP::wait_stripe_packet(int msec, bool ignore_interupts, int *stream)
+{
+   int i, nfds, ready, status;
+   int *fds, *streams;
+   BSOCK *bs;
+
+   /*
+    * The sockets waited on go in the first half of m_stripe_fds,
+    * the connection each one belongs to in the second half.
+    */
+   fds = m_stripe_fds;
+   streams = fds + get_data_streams();
+
+   nfds = 0;
+   for (i = 0; i < get_data_streams(); i++) {
+      if (m_stripe_packets[i].pending) {
+         continue;
+      }
+
+      bs = (i == 0) ? this : (BSOCK *)m_data_streams->get(i - 1);
+#ifdef HAVE_TLS
+      if (bs->tls_conn && tls_bsock_pending(bs) > 0) {
+         *stream = i;
+         return 1;
+      }
+#endif
+      fds[nfds] = bs->m_fd;
+      streams[nfds] = i;
+      nfds++;
+   }
+
+   status = wait_for_readable_fds(fds, nfds, msec, ignore_interupts, &ready, m_stripe_pfds);
+   if (status == 1) {
+      *stream = streams[ready];
+   }
+
+   return status;
+}
+
+int32_t BSOCK_TCP::recv_msg()
 {
    int32_t nbytes;
    int32_t pktsiz;
@@ -536,6 +942,13 @@ int32_t BSOCK_TCP::recv()
       return BNET_HARDEOF;
    }
 
+   /*
+    * The other end might wait for what we coalesced before it answers.
+    */
+   if (m_cbuf_len > 0) {
+      flush();
+   }
+
    if (m_use_locking) {
       P(m_mutex);
    }
@@ -864,7 +1277,33 @@ int BSOCK_TCP::wait_data(int sec, int usec)
 {
    int msec;
 
+   if (m_cbuf_len > 0) {
+      flush();
+   }
+
+   /*
+    * Messages received ahead of time are available right away.
+    */
+   if (m_replay_fd >= 0) {
+      return 1;
+   }
+
    msec = (sec * 1000) + (usec / 1000);
+
+   /*
+    * While striping the next packet may arrive on any connection.
+    */
+   if (m_use_striping && m_stripe_packets) {
+      int stream;
+
+      for (stream = 0; stream < get_data_streams(); stream++) {
+         if (m_stripe_packets[stream].pending && m_stripe_packets[stream].seqno == m_stripe_seqno) {
+            return 1;
+         }
+      }
+      return wait_stripe_packet(msec, true, &stream);
+   }
+
    switch (wait_for_readable_fd(m_fd, msec, true)) {
    case 0:
       b_errno = 0;
@@ -885,7 +1324,33 @@ int BSOCK_TCP::wait_data_intr(int sec, int usec)
 {
    int msec;
 
+   if (m_cbuf_len > 0) {
+      flush();
+   }
+
+   /*
+    * Messages received ahead of time are available right away.
+    */
+   if (m_replay_fd >= 0) {
+      return 1;
+   }
+
    msec = (sec * 1000) + (usec / 1000);
+
+   /*
+    * While striping the next packet may arrive on any connection.
+    */
+   if (m_use_striping && m_stripe_packets) {
+      int stream;
+
+      for (stream = 0; stream < get_data_streams(); stream++) {
+         if (m_stripe_packets[stream].pending && m_stripe_packets[stream].seqno == m_stripe_seqno) {
+            return 1;
+         }
+      }
+      return wait_stripe_packet(msec, false, &stream);
+   }
+
    switch (wait_for_readable_fd(m_fd, msec, false)) {
    case 0:
       b_errno = 0;
@@ -905,8 +1370,18 @@ int BSOCK_TCP::wait_data_intr(int sec, int usec)
 
 void BSOCK_TCP::close()
 {
+   if (m_cbuf_len > 0) {
+      flush();
+   }
+
    if (!m_cloned) {
       clear_locking();
+      close_data_streams();
+   }
+
+   if (m_replay_fd >= 0) {
+      ::close(m_replay_fd);
+      m_replay_fd = -1;
    }
 
    if (!m_cloned) {
@@ -940,6 +1415,13 @@ void BSOCK_TCP::destroy()
       free_pool_memory(errmsg);
       errmsg = NULL;
    }
+   if (m_cbuf) {
+      free_pool_memory(m_cbuf);
+      m_cbuf = NULL;
+   }
+   if (m_data_streams) {
+      close_data_streams();
+   }
    if (m_who) {
       free(m_who);
       m_who = NULL;
@@ -1101,3 +1583,82 @@ int32_t BSOCK_TCP::write_nbytes(char *ptr, int32_t nbytes)
 
    return nbytes - nleft;
 }
+
+/*
+ * Write two buffers to the network, using a single writev()
+ * when the data goes directly to the socket.
+ */
+int32_t BSOCK_TCP::write_nbytes2(char *ptr1, int32_t nbytes1, char *ptr2, int32_t nbytes2)
+{
+#ifndef HAVE_WIN32
+   struct iovec iov[2];
+   struct iovec *iovp;
+   int iovcnt;
+   int32_t nleft, nwritten;
+
+   if (!is_spooling() && !tls_conn && nbytes2 > 0) {
+      iov[0].iov_base = ptr1;
+      iov[0].iov_len = nbytes1;
+      iov[1].iov_base = ptr2;
+      iov[1].iov_len = nbytes2;
+      iovp = iov;
+      iovcnt = 2;
+
+      nleft = nbytes1 + nbytes2;
+      while (nleft > 0) {
+         do {
+            errno = 0;
+            nwritten = ::writev(m_fd, iovp, iovcnt);
+            if (is_timed_out() || is_terminated()) {
+               return -1;
+            }
+         } while (nwritten == -1 && errno == EINTR);
+
+         /*
+          * If connection is non-blocking, we will get EAGAIN, so
+          * use select()/poll() to keep from consuming all
+          * the CPU and try again.
+          */
+         if (nwritten == -1 && errno == EAGAIN) {
+            wait_for_writable_fd(m_fd, 1, false);
+            continue;
+         }
+
+         if (nwritten <= 0) {
+            return -1;                /* error */
+         }
+
+         nleft -= nwritten;
+         if (use_bwlimit()) {
+            control_bwlimit(nwritten);
+         }
+
+         /*
+          * Skip what was written.
+          */
+         while (nwritten > 0) {
+            if ((size_t)nwritten >= iovp->iov_len) {
+               nwritten -= iovp->iov_len;
+               iovp++;
+               iovcnt--;
+            } else {
+               iovp->iov_base = (char *)iovp->iov_base + nwritten;
+               iovp->iov_len -= nwritten;
+               nwritten = 0;
+            }
+         }
+      }
+
+      return nbytes1 + nbytes2;
+   }
+#endif
+
+   if (write_nbytes(ptr1, nbytes1) != nbytes1) {
+      return -1;
+   }
+   if (nbytes2 > 0 && write_nbytes(ptr2, nbytes2) != nbytes2) {
+      return -1;
+   }
+
+   return nbytes1 + nbytes2;
+}
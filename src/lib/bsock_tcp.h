@@ -40,6 +40,30 @@ private:
    static const int32_t max_packet_size = 1000000;
    static const int32_t max_message_len = max_packet_size - header_length;
 
+   /*
+    * When coalescing, packets up to coalesce_max_packet bytes are collected
+    * in a buffer of coalesce_size bytes. The buffer is written when it is
+    * full, when a larger packet is sent, when the oldest packet in it is
+    * older than coalesce_timeout microseconds, or before reading from the
+    * socket.
+    */
+   static const int32_t coalesce_size = 65536;
+   static const int32_t coalesce_max_packet = 16384;
+   static const btime_t coalesce_timeout = 100000;
+
+   /*
+    * While striping, every packet starts with a stripe header holding its
+    * sequence number and its message length or signal. A connection moves
+    * on to the next one after stripe_size bytes, its coalesced packets are
+    * written out at that point.
+    */
+   static const int32_t stripe_header_length = 2 * sizeof(int32_t);
+   static const int32_t stripe_size = 65536;
+
+   POOLMEM *m_cbuf;                   /* Coalesced packets */
+   int32_t m_cbuf_len;                /* Bytes in m_cbuf */
+   btime_t m_cbuf_start;              /* Time the first packet was put in m_cbuf */
+
    /* methods -- in bsock_tcp.c */
    void fin_init(JCR * jcr, int sockfd, const char *who, const char *host, int port,
                  struct sockaddr *lclient_addr);
@@ -47,6 +71,16 @@ private:
              int port, utime_t heart_beat, int *fatal);
    bool set_keepalive(JCR *jcr, int sockfd, bool enable, int keepalive_start, int keepalive_interval);
    bool send_packet(int32_t *hdr, int32_t pktsiz);
+   bool write_packets(int32_t *hdr, int32_t pktsiz);
+   int32_t write_nbytes2(char *ptr1, int32_t nbytes1, char *ptr2, int32_t nbytes2);
+   bool send_msg();
+   bool send_striped();
+   bool send_stripe_packet(int32_t pktsiz);
+   int32_t recv_msg();
+   int32_t recv_striped();
+   bool read_stripe_packet(int stream, int32_t &nbytes);
+   int32_t deliver_stripe_packet(int stream);
+   int wait_stripe_packet(int msec, bool ignore_interupts, int *stream);
 
 public:
    BSOCK_TCP();
@@ -72,6 +106,7 @@ public:
    void restore_blocking(int flags);
    int wait_data(int sec, int usec = 0);
    int wait_data_intr(int sec, int usec = 0);
+   bool flush();
 };
 
 #endif /* BRS_BSOCK_TCP_H */
@@ -34,7 +34,7 @@
 #include "ch.h"
 #include "streams.h"
 
-#if defined(HAVE_LZO) || defined(HAVE_LIBZ) || defined(HAVE_FASTLZ)
+#if defined(HAVE_LZO) || defined(HAVE_LIBZ) || defined(HAVE_FASTLZ) || defined(HAVE_ZSTD)
 
 #ifdef HAVE_LIBZ
 #include <zlib.h>
@@ -49,6 +49,10 @@
 #include <fastlzlib.h>
 #endif
 
+#ifdef HAVE_ZSTD
+#include <zstd.h>
+#endif
+
 #ifdef HAVE_LIBZ
 
 #ifndef HAVE_COMPRESS_BOUND
@@ -68,6 +72,8 @@ const char *cmprs_algo_to_text(uint32_t compression_algorithm)
       return "LZ4";
    case COMPRESS_FZ4H:
       return "LZ4HC";
+   case COMPRESS_ZSTD:
+      return "ZSTD";
    default:
       return "Unknown";
    }
@@ -116,6 +122,21 @@ bool setup_compression_buffers(JCR *jcr,
                                bool compatible,
                                uint32_t compression_algorithm,
                                uint32_t *compress_buf_size)
+{
+   return setup_compression_buffers(jcr, &jcr->compress, compatible,
+                                    compression_algorithm, compress_buf_size);
+}
+
+/**
+ * Setup the compression workset of the given compression context.
+ * This allows a caller to have multiple independent compression
+ * contexts e.g. one for each thread compressing data for a job.
+ */
+bool setup_compression_buffers(JCR *jcr,
+                               CMPRS_CTX *ctx,
+                               bool compatible,
+                               uint32_t compression_algorithm,
+                               uint32_t *compress_buf_size)
 {
    uint32_t wanted_compress_buf_size;
 
@@ -151,7 +172,7 @@ bool setup_compression_buffers(JCR *jcr,
       /*
        * See if this compression algorithm is already setup.
        */
-      if (jcr->compress.workset.pZLIB) {
+      if (ctx->workset.pZLIB) {
          return true;
       }
 
@@ -163,7 +184,7 @@ bool setup_compression_buffers(JCR *jcr,
       pZlibStream->state = Z_NULL;
 
       if (deflateInit(pZlibStream, Z_DEFAULT_COMPRESSION) == Z_OK) {
-         jcr->compress.workset.pZLIB = pZlibStream;
+         ctx->workset.pZLIB = pZlibStream;
       } else {
          Jmsg(jcr, M_FATAL, 0, _("Failed to initialize ZLIB compression\n"));
          free(pZlibStream);
@@ -192,7 +213,7 @@ bool setup_compression_buffers(JCR *jcr,
       /*
        * See if this compression algorithm is already setup.
        */
-      if (jcr->compress.workset.pLZO) {
+      if (ctx->workset.pLZO) {
          return true;
       }
 
@@ -200,7 +221,7 @@ bool setup_compression_buffers(JCR *jcr,
       memset(pLzoMem, 0, LZO1X_1_MEM_COMPRESS);
 
       if (lzo_init() == LZO_E_OK) {
-         jcr->compress.workset.pLZO = pLzoMem;
+         ctx->workset.pLZO = pLzoMem;
       } else {
          Jmsg(jcr, M_FATAL, 0, _("Failed to initialize LZO compression\n"));
          free(pLzoMem);
@@ -243,7 +264,7 @@ bool setup_compression_buffers(JCR *jcr,
       /*
        * See if this compression algorithm is already setup.
        */
-      if (jcr->compress.workset.pZFAST) {
+      if (ctx->workset.pZFAST) {
          return true;
       }
 
@@ -255,7 +276,7 @@ bool setup_compression_buffers(JCR *jcr,
       pZfastStream->state = Z_NULL;
 
       if ((zstat = fastlzlibCompressInit(pZfastStream, level)) == Z_OK) {
-         jcr->compress.workset.pZFAST = pZfastStream;
+         ctx->workset.pZFAST = pZfastStream;
       } else {
          Jmsg(jcr, M_FATAL, 0, _("Failed to initialize FASTLZ compression\n"));
          free(pZfastStream);
@@ -263,6 +284,46 @@ bool setup_compression_buffers(JCR *jcr,
       }
       break;
    }
+#endif
+#ifdef HAVE_ZSTD
+   case COMPRESS_ZSTD: {
+      ZSTD_CCtx *pZstdCtx;
+
+      if (compatible) {
+         non_compatible_compression_algorithm(jcr, compression_algorithm);
+         return false;
+      }
+
+      /*
+       * Use ZSTD_compressBound() to get the upper limit of what zstd needs
+       * to compress a buffer of x bytes. To that we add the size of an
+       * compression header.
+       *
+       * The ZSTD compression workset is initialized here to minimize
+       * the "per file" load. The jcr member is only set, if the init
+       * was successful.
+       */
+      wanted_compress_buf_size = ZSTD_compressBound(jcr->buf_size) + (int)sizeof(comp_stream_header);
+      if (wanted_compress_buf_size > *compress_buf_size) {
+         *compress_buf_size = wanted_compress_buf_size;
+      }
+
+      /*
+       * See if this compression algorithm is already setup.
+       */
+      if (ctx->workset.pZSTD) {
+         return true;
+      }
+
+      pZstdCtx = ZSTD_createCCtx();
+      if (pZstdCtx) {
+         ctx->workset.pZSTD = pZstdCtx;
+      } else {
+         Jmsg(jcr, M_FATAL, 0, _("Failed to initialize ZSTD compression\n"));
+         return false;
+      }
+      break;
+   }
 #endif
    default:
       unknown_compression_algorithm(jcr, compression_algorithm);
@@ -297,6 +358,7 @@ bool setup_decompression_buffers(JCR *jcr, uint32_t *decompress_buf_size)
 
 #ifdef HAVE_LIBZ
 static bool compress_with_zlib(JCR *jcr,
+                               CMPRS_CTX *ctx,
                                char *rbuf,
                                uint32_t rsize,
                                unsigned char *cbuf,
@@ -308,7 +370,7 @@ static bool compress_with_zlib(JCR *jcr,
 
    Dmsg3(400, "cbuf=0x%x rbuf=0x%x len=%u\n", cbuf, rbuf, rsize);
 
-   pZlibStream = (z_stream *)jcr->compress.workset.pZLIB;
+   pZlibStream = (z_stream *)ctx->workset.pZLIB;
    pZlibStream->next_in = (Bytef *)rbuf;
    pZlibStream->avail_in = rsize;
    pZlibStream->next_out = (Bytef *)cbuf;
@@ -339,6 +401,7 @@ static bool compress_with_zlib(JCR *jcr,
 
 #ifdef HAVE_LZO
 static bool compress_with_lzo(JCR *jcr,
+                              CMPRS_CTX *ctx,
                               char *rbuf,
                               uint32_t rsize,
                               unsigned char *cbuf,
@@ -351,7 +414,7 @@ static bool compress_with_lzo(JCR *jcr,
    Dmsg3(400, "cbuf=0x%x rbuf=0x%x len=%u\n", cbuf, rbuf, rsize);
 
    lzores = lzo1x_1_compress((const unsigned char *)rbuf, rsize,
-                             cbuf, &len, jcr->compress.workset.pLZO);
+                             cbuf, &len, ctx->workset.pLZO);
    *compress_len = len;
 
    if (lzores != LZO_E_OK || *compress_len > max_compress_len) {
@@ -371,6 +434,7 @@ static bool compress_with_lzo(JCR *jcr,
 
 #ifdef HAVE_FASTLZ
 static bool compress_with_fastlz(JCR *jcr,
+                                 CMPRS_CTX *ctx,
                                  char *rbuf,
                                  uint32_t rsize,
                                  unsigned char *cbuf,
@@ -382,7 +446,7 @@ static bool compress_with_fastlz(JCR *jcr,
 
    Dmsg3(400, "cbuf=0x%x rbuf=0x%x len=%u\n", cbuf, rbuf, rsize);
 
-   pZfastStream = (zfast_stream *)jcr->compress.workset.pZFAST;
+   pZfastStream = (zfast_stream *)ctx->workset.pZFAST;
    pZfastStream->next_in = (Bytef *)rbuf;
    pZfastStream->avail_in = rsize;
    pZfastStream->next_out = (Bytef *)cbuf;
@@ -411,6 +475,38 @@ static bool compress_with_fastlz(JCR *jcr,
 }
 #endif
 
+#ifdef HAVE_ZSTD
+static bool compress_with_zstd(JCR *jcr,
+                               CMPRS_CTX *ctx,
+                               char *rbuf,
+                               uint32_t rsize,
+                               unsigned char *cbuf,
+                               uint32_t max_compress_len,
+                               uint32_t *compress_len)
+{
+   size_t len;
+
+   Dmsg3(400, "cbuf=0x%x rbuf=0x%x len=%u\n", cbuf, rbuf, rsize);
+
+   /*
+    * ZSTD_compress2() starts a new frame each time using the
+    * parameters (e.g. the compression level) set on the context.
+    */
+   len = ZSTD_compress2((ZSTD_CCtx *)ctx->workset.pZSTD, cbuf, max_compress_len, rbuf, rsize);
+   if (ZSTD_isError(len)) {
+      Jmsg(jcr, M_FATAL, 0, _("Compression ZSTD_compress2 error: %s\n"), ZSTD_getErrorName(len));
+      jcr->setJobStatus(JS_ErrorTerminated);
+      return false;
+   }
+
+   *compress_len = len;
+
+   Dmsg2(400, "ZSTD compressed len=%d uncompressed len=%d\n", *compress_len, rsize);
+
+   return true;
+}
+#endif
+
 bool compress_data(JCR *jcr,
                    uint32_t compression_algorithm,
                    char *rbuf,
@@ -418,13 +514,26 @@ bool compress_data(JCR *jcr,
                    unsigned char *cbuf,
                    uint32_t max_compress_len,
                    uint32_t *compress_len)
+{
+   return compress_data(jcr, &jcr->compress, compression_algorithm, rbuf,
+                        rsize, cbuf, max_compress_len, compress_len);
+}
+
+bool compress_data(JCR *jcr,
+                   CMPRS_CTX *ctx,
+                   uint32_t compression_algorithm,
+                   char *rbuf,
+                   uint32_t rsize,
+                   unsigned char *cbuf,
+                   uint32_t max_compress_len,
+                   uint32_t *compress_len)
 {
    *compress_len = 0;
    switch (compression_algorithm) {
 #ifdef HAVE_LIBZ
    case COMPRESS_GZIP:
-      if (jcr->compress.workset.pZLIB) {
-         if (!compress_with_zlib(jcr, rbuf, rsize, cbuf, max_compress_len, compress_len)) {
+      if (ctx->workset.pZLIB) {
+         if (!compress_with_zlib(jcr, ctx, rbuf, rsize, cbuf, max_compress_len, compress_len)) {
             return false;
          }
       }
@@ -432,8 +541,8 @@ bool compress_data(JCR *jcr,
 #endif
 #ifdef HAVE_LZO
    case COMPRESS_LZO1X:
-      if (jcr->compress.workset.pLZO) {
-         if (!compress_with_lzo(jcr, rbuf, rsize, cbuf, max_compress_len, compress_len)) {
+      if (ctx->workset.pLZO) {
+         if (!compress_with_lzo(jcr, ctx, rbuf, rsize, cbuf, max_compress_len, compress_len)) {
             return false;
          }
       }
@@ -443,8 +552,17 @@ bool compress_data(JCR *jcr,
    case COMPRESS_FZFZ:
    case COMPRESS_FZ4L:
    case COMPRESS_FZ4H:
-      if (jcr->compress.workset.pZFAST) {
-         if (!compress_with_fastlz(jcr, rbuf, rsize, cbuf, max_compress_len, compress_len)) {
+      if (ctx->workset.pZFAST) {
+         if (!compress_with_fastlz(jcr, ctx, rbuf, rsize, cbuf, max_compress_len, compress_len)) {
+            return false;
+         }
+      }
+      break;
+#endif
+#ifdef HAVE_ZSTD
+   case COMPRESS_ZSTD:
+      if (ctx->workset.pZSTD) {
+         if (!compress_with_zstd(jcr, ctx, rbuf, rsize, cbuf, max_compress_len, compress_len)) {
             return false;
          }
       }
@@ -694,6 +812,93 @@ cleanup:
 }
 #endif
 
+#ifdef HAVE_ZSTD
+static bool decompress_with_zstd(JCR *jcr,
+                                 const char *last_fname,
+                                 char **data,
+                                 uint32_t *length,
+                                 bool sparse,
+                                 bool want_data_stream)
+{
+   size_t status;
+   unsigned long long content_size;
+   const char *cbuf;
+   char *wbuf;
+   uint32_t real_compress_len, wanted_size, compress_len;
+   char ec1[50]; /* Buffer printing huge values */
+
+   cbuf = *data + sizeof(comp_stream_header);
+   real_compress_len = *length - sizeof(comp_stream_header);
+
+   /*
+    * The compressed frame contains the size of the original data so we can
+    * make sure the decompression buffer is big enough before decompressing.
+    */
+   content_size = ZSTD_getFrameContentSize(cbuf, real_compress_len);
+   if (content_size == ZSTD_CONTENTSIZE_ERROR || content_size == ZSTD_CONTENTSIZE_UNKNOWN) {
+      Qmsg(jcr, M_ERROR, 0, _("Uncompression error on file %s. ERR=%s\n"), last_fname,
+           _("ZSTD frame header error"));
+      return false;
+   }
+
+   /*
+    * The data of a record never exceeds the maximum block size, so anything
+    * bigger is a corrupt frame header. It would also overflow wanted_size.
+    */
+   if (content_size > MAX_BLOCK_LENGTH) {
+      Qmsg(jcr, M_ERROR, 0, _("Uncompression error on file %s. ERR=%s\n"), last_fname,
+           _("ZSTD frame content size too big"));
+      return false;
+   }
+
+   wanted_size = content_size + OFFSET_FADDR_SIZE;
+   if (wanted_size > jcr->compress.inflate_buffer_size) {
+      jcr->compress.inflate_buffer = check_pool_memory_size(jcr->compress.inflate_buffer, wanted_size);
+      jcr->compress.inflate_buffer_size = wanted_size;
+   }
+
+   if (!jcr->compress.workset.pZSTDD) {
+      jcr->compress.workset.pZSTDD = ZSTD_createDCtx();
+      if (!jcr->compress.workset.pZSTDD) {
+         Qmsg(jcr, M_ERROR, 0, _("Failed to initialize ZSTD decompression\n"));
+         return false;
+      }
+   }
+
+   if (sparse && want_data_stream) {
+      wbuf = jcr->compress.inflate_buffer + OFFSET_FADDR_SIZE;
+      compress_len = jcr->compress.inflate_buffer_size - OFFSET_FADDR_SIZE;
+   } else {
+      wbuf = jcr->compress.inflate_buffer;
+      compress_len = jcr->compress.inflate_buffer_size;
+   }
+
+   Dmsg2(400, "Comp_len=%d msglen=%d\n", compress_len, *length);
+
+   status = ZSTD_decompressDCtx((ZSTD_DCtx *)jcr->compress.workset.pZSTDD,
+                                wbuf, compress_len, cbuf, real_compress_len);
+   if (ZSTD_isError(status)) {
+      Qmsg(jcr, M_ERROR, 0, _("Uncompression error on file %s. ERR=%s\n"), last_fname,
+           ZSTD_getErrorName(status));
+      return false;
+   }
+
+   /*
+    * We return a decompressed data stream with the fileoffset encoded when this was a sparse stream.
+    */
+   if (sparse && want_data_stream) {
+      memcpy(jcr->compress.inflate_buffer, *data, OFFSET_FADDR_SIZE);
+   }
+
+   *data = jcr->compress.inflate_buffer;
+   *length = status;
+
+   Dmsg2(400, "Write uncompressed %d bytes, total before write=%s\n", *length, edit_uint64(jcr->JobBytes, ec1));
+
+   return true;
+}
+#endif
+
 bool decompress_data(JCR *jcr,
                      const char *last_fname,
                      int32_t stream,
@@ -773,6 +978,15 @@ bool decompress_data(JCR *jcr,
             default:
                return decompress_with_fastlz(jcr, last_fname, data, length, comp_magic, false, want_data_stream);
             }
+#endif
+#ifdef HAVE_ZSTD
+         case COMPRESS_ZSTD:
+            switch (stream) {
+            case STREAM_SPARSE_COMPRESSED_DATA:
+               return decompress_with_zstd(jcr, last_fname, data, length, true, want_data_stream);
+            default:
+               return decompress_with_zstd(jcr, last_fname, data, length, false, want_data_stream);
+            }
 #endif
          default:
             Qmsg(jcr, M_ERROR, 0, _("Compression algorithm 0x%x found, but not supported!\n"), comp_magic);
@@ -807,28 +1021,45 @@ void cleanup_compression(JCR *jcr)
       jcr->compress.inflate_buffer = NULL;
    }
 
+   cleanup_compression_workset(&jcr->compress);
+}
+
+void cleanup_compression_workset(CMPRS_CTX *ctx)
+{
 #ifdef HAVE_LIBZ
-   if (jcr->compress.workset.pZLIB) {
+   if (ctx->workset.pZLIB) {
       /*
        * Free the zlib stream
        */
-      deflateEnd((z_stream *)jcr->compress.workset.pZLIB);
-      free(jcr->compress.workset.pZLIB);
-      jcr->compress.workset.pZLIB = NULL;
+      deflateEnd((z_stream *)ctx->workset.pZLIB);
+      free(ctx->workset.pZLIB);
+      ctx->workset.pZLIB = NULL;
    }
 #endif
 
 #ifdef HAVE_LZO
-   if (jcr->compress.workset.pLZO) {
-      free(jcr->compress.workset.pLZO);
-      jcr->compress.workset.pLZO = NULL;
+   if (ctx->workset.pLZO) {
+      free(ctx->workset.pLZO);
+      ctx->workset.pLZO = NULL;
    }
 #endif
 
 #ifdef HAVE_FASTLZ
-   if (jcr->compress.workset.pZFAST) {
-      free(jcr->compress.workset.pZFAST);
-      jcr->compress.workset.pZFAST = NULL;
+   if (ctx->workset.pZFAST) {
+      free(ctx->workset.pZFAST);
+      ctx->workset.pZFAST = NULL;
+   }
+#endif
+
+#ifdef HAVE_ZSTD
+   if (ctx->workset.pZSTD) {
+      ZSTD_freeCCtx((ZSTD_CCtx *)ctx->workset.pZSTD);
+      ctx->workset.pZSTD = NULL;
+   }
+
+   if (ctx->workset.pZSTDD) {
+      ZSTD_freeDCtx((ZSTD_DCtx *)ctx->workset.pZSTDD);
+      ctx->workset.pZSTDD = NULL;
    }
 #endif
 
@@ -847,6 +1078,15 @@ bool setup_compression_buffers(JCR *jcr,
    return true;
 }
 
+bool setup_compression_buffers(JCR *jcr,
+                               CMPRS_CTX *ctx,
+                               bool compatible,
+                               uint32_t compression_algorithm,
+                               uint32_t *compress_buf_size)
+{
+   return true;
+}
+
 bool setup_decompression_buffers(JCR *jcr, uint32_t *decompress_buf_size)
 {
    *decompress_buf_size = 0;
@@ -864,6 +1104,18 @@ bool compress_data(JCR *jcr,
    return true;
 }
 
+bool compress_data(JCR *jcr,
+                   CMPRS_CTX *ctx,
+                   uint32_t compression_algorithm,
+                   char *rbuf,
+                   uint32_t rsize,
+                   unsigned char *cbuf,
+                   uint32_t max_compress_len,
+                   uint32_t *compress_len)
+{
+   return true;
+}
+
 bool decompress_data(JCR *jcr,
                      const char *last_fname,
                      int32_t stream,
@@ -878,4 +1130,8 @@ bool decompress_data(JCR *jcr,
 void cleanup_compression(JCR *jcr)
 {
 }
-#endif /* defined(HAVE_LZO) || defined(HAVE_LIBZ) || defined(HAVE_FASTLZ) */
+
+void cleanup_compression_workset(CMPRS_CTX *ctx)
+{
+}
+#endif /* defined(HAVE_LZO) || defined(HAVE_LIBZ) || defined(HAVE_FASTLZ) || defined(HAVE_ZSTD) */
@@ -26,6 +26,12 @@
 #include "bareos.h"
 #include "connection_pool.h"
 
+#ifdef HAVE_POLL_H
+#include <poll.h>
+#elif HAVE_SYS_POLL_H
+#include <sys/poll.h>
+#endif
+
 /*
  * Connection
  */
@@ -129,6 +135,59 @@ CONNECTION_POOL::~CONNECTION_POOL()
    pthread_cond_destroy(&m_add_cond_var);
 }
 
+#ifdef HAVE_POLL
+/*
+ * Remove terminated connections.
+ *
+ * Only idle connections that have data pending (heartbeats)
+ * or have been closed by the client need a closer look,
+ * so find them with a single poll() over all idle connections
+ * instead of checking every connection on its own.
+ */
+void CONNECTION_POOL::cleanup()
+{
+   CONNECTION *connection = NULL;
+   struct pollfd *pfds;
+   int i = 0;
+   int n = m_connections->size();
+
+   if (n <= 0) {
+      return;
+   }
+
+   pfds = (struct pollfd *)malloc(n * sizeof(struct pollfd));
+   memset(pfds, 0, n * sizeof(struct pollfd));
+   for (i = 0; i < n; i++) {
+      connection = (CONNECTION *)m_connections->get(i);
+      pfds[i].fd = (!connection->in_use() && connection->bsock()) ? connection->bsock()->m_fd : -1;
+      pfds[i].events = POLLIN;
+   }
+
+   if (poll(pfds, n, 0) < 0) {
+      /*
+       * Fall back to checking every connection.
+       */
+      for (i = 0; i < n; i++) {
+         pfds[i].revents = POLLIN;
+      }
+   }
+
+   for (i = n - 1; i >= 0; i--) {
+      if (!pfds[i].revents) {
+         continue;
+      }
+      connection = (CONNECTION *)m_connections->get(i);
+      Dmsg2(120, "checking connection %s (%d)\n", connection->name(), i);
+      if (!connection->check()) {
+         Dmsg2(120, "connection %s (%d) is terminated => removed\n", connection->name(), i);
+         m_connections->remove(i);
+         delete(connection);
+      }
+   }
+
+   free(pfds);
+}
+#else
 void CONNECTION_POOL::cleanup()
 {
    CONNECTION *connection = NULL;
@@ -143,6 +202,7 @@ void CONNECTION_POOL::cleanup()
       }
    }
 }
+#endif
 
 alist *CONNECTION_POOL::get_as_alist()
 {
@@ -183,11 +243,14 @@ CONNECTION *CONNECTION_POOL::get_connection(const char *name)
       return NULL;
    }
    foreach_alist(connection, m_connections) {
-      if (connection->check()
+      /*
+       * Only check the state of the socket for the connection we are looking for.
+       */
+      if (bstrcmp(name, connection->name())
           && connection->authenticated()
           && connection->bsock()
           && (!connection->in_use())
-          && bstrcmp(name, connection->name())) {
+          && connection->check()) {
          Dmsg1(120, "found connection from client %s\n", connection->name());
          return connection;
       }
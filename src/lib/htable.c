@@ -489,6 +489,34 @@ void *htable::lookup(char *key)
    return NULL;
 }
 
+/*
+ * Unlink the item with the given key from the table and return it.
+ * Only usable for items that are not allocated with hash_malloc(),
+ * as those can't be given back separately.
+ */
+void *htable::remove(char *key)
+{
+   hlink *prev = NULL;
+
+   hash_index(key);
+   for (hlink *hp = table[index]; hp; hp = (hlink *)hp->next) {
+      ASSERT(hp->key_type == KEY_TYPE_CHAR);
+      if (hash == hp->hash && bstrcmp(key, hp->key.char_key)) {
+         if (prev) {
+            prev->next = hp->next;
+         } else {
+            table[index] = (hlink *)hp->next;
+         }
+         num_items--;
+         Dmsg1(dbglvl, "remove return %p\n", ((char *)hp) - loffset);
+         return ((char *)hp) - loffset;
+      }
+      prev = hp;
+   }
+
+   return NULL;
+}
+
 void *htable::lookup(uint32_t key)
 {
    hash_index(key);
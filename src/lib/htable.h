@@ -111,6 +111,7 @@ public:
    void *lookup(uint32_t key);
    void *lookup(uint64_t key);
    void *lookup(uint8_t *key, uint32_t key_len);
+   void *remove(char *key);           /* Unlink item, caller frees it */
    void *first();                     /* Get first item in table */
    void *next();                      /* Get next item in table */
    void destroy();
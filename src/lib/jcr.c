@@ -41,6 +41,17 @@
  *  exception of the global locking of the list during the
  *  re-reading of the config file, no recursion is needed.
  *
+ *  Lookups by JobId go through a registry sharded by JobId so they
+ *  don't need the chain lock. As the daemons set the JobId of a JCR
+ *  whenever they learn it, a JCR is put into the registry the first
+ *  time it is looked up by walking the chain, and every hit is checked
+ *  against the current JobId of the JCR. Everywhere a JCR gets a JobId
+ *  it is registered right away with register_jcr_jobid(), so the
+ *  number of registered JCRs returned by job_count() is the number of
+ *  JCRs with a JobId, as counted by walking the chain before. Several
+ *  JCRs may have the same JobId, they are all kept in the registry in
+ *  the order they were registered and a lookup returns the first one.
+ *
  */
 
 #include "bareos.h"
@@ -71,6 +82,17 @@ dlist *last_jobs = NULL;
 const int max_last_jobs = 10;
 
 static dlist *jcrs = NULL;            /* JCR chain */
+
+#define JCR_REGISTRY_SHARDS 256
+
+struct jcr_registry_shard {
+   pthread_mutex_t mutex;
+   JCR *first;                        /* JCRs registered in this shard */
+};
+
+static pthread_once_t jcr_registry_once = PTHREAD_ONCE_INIT;
+static jcr_registry_shard jcr_registry[JCR_REGISTRY_SHARDS];
+static volatile int32_t registered_jcrs = 0; /* Number of JCRs in the registry */
 static int watch_dog_timeout = 0;
 
 static pthread_mutex_t jcr_lock = PTHREAD_MUTEX_INITIALIZER;
@@ -453,6 +475,87 @@ JCR *new_jcr(int size, JCR_free_HANDLER *daemon_free_jcr)
 }
 
 
+static void jcr_registry_setup(void)
+{
+   for (int i = 0; i < JCR_REGISTRY_SHARDS; i++) {
+      pthread_mutex_init(&jcr_registry[i].mutex, NULL);
+      jcr_registry[i].first = NULL;
+   }
+}
+
+static inline jcr_registry_shard *get_registry_shard(uint32_t JobId)
+{
+   pthread_once(&jcr_registry_once, jcr_registry_setup);
+   return &jcr_registry[JobId % JCR_REGISTRY_SHARDS];
+}
+
+/*
+ * Remove a JCR from its registry shard.
+ *
+ * NOTE! The chain and the shard must be locked prior to calling this routine.
+ */
+static void unlink_registered_jcr(jcr_registry_shard *shard, JCR *jcr)
+{
+   JCR **pp;
+
+   for (pp = &shard->first; *pp; pp = &(*pp)->registry_next) {
+      if (*pp == jcr) {
+         *pp = jcr->registry_next;
+         __sync_sub_and_fetch(&registered_jcrs, 1);
+         break;
+      }
+   }
+   jcr->registry_next = NULL;
+   jcr->registry_JobId = 0;
+}
+
+/*
+ * Register a JCR under its current JobId. A JCR already registered
+ * under the same JobId stays registered in front of it.
+ *
+ * NOTE! The chain must be locked prior to calling this routine.
+ */
+static void register_jcr(JCR *jcr)
+{
+   JCR **pp;
+   jcr_registry_shard *shard;
+
+   if (jcr->registry_JobId == jcr->JobId) {
+      return;
+   }
+
+   if (jcr->registry_JobId) {
+      shard = get_registry_shard(jcr->registry_JobId);
+      P(shard->mutex);
+      unlink_registered_jcr(shard, jcr);
+      V(shard->mutex);
+   }
+
+   shard = get_registry_shard(jcr->JobId);
+   P(shard->mutex);
+   for (pp = &shard->first; *pp; pp = &(*pp)->registry_next);
+   jcr->registry_JobId = jcr->JobId;
+   jcr->registry_next = NULL;
+   *pp = jcr;
+   __sync_add_and_fetch(&registered_jcrs, 1);
+   V(shard->mutex);
+}
+
+/*
+ * Register a JCR under the JobId it just got, so that it is found
+ * without walking the chain and counted by job_count().
+ */
+void register_jcr_jobid(JCR *jcr)
+{
+   if (jcr->JobId == 0) {
+      return;
+   }
+
+   lock_jcr_chain();
+   register_jcr(jcr);
+   unlock_jcr_chain();
+}
+
 /*
  * Remove a JCR from the chain
  *
@@ -561,6 +664,7 @@ static void free_common_jcr(JCR *jcr)
 void b_free_jcr(const char *file, int line, JCR *jcr)
 {
    struct s_last_job *je;
+   jcr_registry_shard *shard;
 
    Dmsg3(dbglvl, "Enter free_jcr jid=%u from %s:%d\n", jcr->JobId, file, line);
 
@@ -569,13 +673,22 @@ void b_free_jcr(const char *file, int line, JCR *jcr)
 void free_jcr(JCR *jcr)
 {
    struct s_last_job *je;
+   jcr_registry_shard *shard;
 
    Dmsg3(dbglvl, "Enter free_jcr jid=%u use_count=%d Job=%s\n",
          jcr->JobId, jcr->use_count(), jcr->Job);
 
 #endif
 
+   /*
+    * Lookups in the registry take a reference holding only the lock of
+    * the shard, so it must be held while dropping the last reference.
+    */
    lock_jcr_chain();
+   shard = jcr->registry_JobId ? get_registry_shard(jcr->registry_JobId) : NULL;
+   if (shard) {
+      P(shard->mutex);
+   }
    jcr->dec_use_count();              /* decrement use count */
    if (jcr->use_count() < 0) {
       Jmsg2(jcr, M_ERROR, 0, _("JCR use_count=%d JobId=%d\n"),
@@ -586,6 +699,9 @@ void free_jcr(JCR *jcr)
          jcr->JobId, jcr->use_count(), jcr->Job);
    }
    if (jcr->use_count() > 0) {          /* if in use */
+      if (shard) {
+         V(shard->mutex);
+      }
       unlock_jcr_chain();
       return;
    }
@@ -593,6 +709,10 @@ void free_jcr(JCR *jcr)
       Dmsg3(dbglvl, "remove jcr jid=%u use_count=%d Job=%s\n",
             jcr->JobId, jcr->use_count(), jcr->Job);
    }
+   if (shard) {
+      unlink_registered_jcr(shard, jcr);
+      V(shard->mutex);
+   }
    remove_jcr(jcr);                   /* remove Jcr from chain */
    unlock_jcr_chain();
 
@@ -755,16 +875,42 @@ uint32_t get_jobid_from_tsd()
 JCR *get_jcr_by_id(uint32_t JobId)
 {
    JCR *jcr;
+   jcr_registry_shard *shard;
+
+   if (JobId > 0) {
+      shard = get_registry_shard(JobId);
+      P(shard->mutex);
+      for (jcr = shard->first; jcr; jcr = jcr->registry_next) {
+         if (jcr->registry_JobId == JobId && jcr->JobId == JobId) {
+            break;
+         }
+      }
+      if (jcr) {
+         jcr->inc_use_count();
+         Dmsg3(dbglvl, "Inc get_jcr jid=%u use_count=%d Job=%s\n",
+            jcr->JobId, jcr->use_count(), jcr->Job);
+         V(shard->mutex);
+         return jcr;
+      }
+      V(shard->mutex);
+   }
 
-   foreach_jcr(jcr) {
+   /*
+    * Not registered under this JobId (yet), walk the chain.
+    */
+   lock_jcr_chain();
+   for (jcr = (JCR *)jcrs->first(); jcr; jcr = (JCR *)jcrs->next(jcr)) {
       if (jcr->JobId == JobId) {
          jcr->inc_use_count();
          Dmsg3(dbglvl, "Inc get_jcr jid=%u use_count=%d Job=%s\n",
             jcr->JobId, jcr->use_count(), jcr->Job);
+         if (JobId > 0) {
+            register_jcr(jcr);
+         }
          break;
       }
    }
-   endeach_jcr(jcr);
+   unlock_jcr_chain();
 
    return jcr;
 }
@@ -1100,6 +1246,11 @@ JCR *jcr_walk_start()
 
 /*
  * Get next jcr from chain, and release current one
+ *
+ * When the walk doesn't hold the last reference to the current jcr it
+ * is released under the same lock, so a step normally locks the chain
+ * only once. The last reference can only be dropped with the chain
+ * locked, so the use count can't drop to zero in between.
  */
 JCR *jcr_walk_next(JCR *prev_jcr)
 {
@@ -1114,6 +1265,10 @@ JCR *jcr_walk_next(JCR *prev_jcr)
             jcr->JobId, jcr->use_count(), jcr->Job);
       }
    }
+   if (prev_jcr && prev_jcr->use_count() > 1) {
+      prev_jcr->dec_use_count();
+      prev_jcr = NULL;
+   }
    unlock_jcr_chain();
    if (prev_jcr) {
       free_jcr(prev_jcr);
@@ -1136,21 +1291,13 @@ void jcr_walk_end(JCR *jcr)
 }
 
 /*
- * Return number of Jobs
+ * Return number of Jobs, that is the number of JCRs with a JobId.
+ * They are all registered, so unlike walking the chain this doesn't
+ * take the chain lock.
  */
 int job_count()
 {
-   JCR *jcr;
-   int count = 0;
-
-   lock_jcr_chain();
-   for (jcr = (JCR *)jcrs->first(); (jcr = (JCR *)jcrs->next(jcr)); ) {
-      if (jcr->JobId > 0) {
-         count++;
-      }
-   }
-   unlock_jcr_chain();
-   return count;
+   return __sync_add_and_fetch(&registered_jcrs, 0);
 }
 
 
@@ -63,5 +63,6 @@
 #include "var.h"
 #include "guid_to_name.h"
 #include "htable.h"
+#include "ohtable.h"
 #include "sellist.h"
 #include "protos.h"
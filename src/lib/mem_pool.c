@@ -37,6 +37,10 @@
 
 #include "bareos.h"
 
+#ifdef HAVE_SYS_MMAN_H
+#include <sys/mman.h>
+#endif
+
 #define HEAD_SIZE BALIGN(sizeof(struct abufhead))
 
 #ifdef HAVE_MALLOC_TRIM
@@ -103,8 +107,259 @@ struct abufhead {
 
 static pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
 
+/*
+ * Per thread magazines of free buffers.
+ *
+ * Every thread keeps a few free buffers of each pool for itself so getting
+ * and freeing pool memory normally doesn't take the global lock. When a
+ * magazine runs empty or full it exchanges half its buffers with the
+ * global free list, and every MAGAZINE_FOLD_OPS operations it folds its
+ * usage counters into the pool statistics. The lock of a magazine is only
+ * contended when another thread collects the magazines.
+ */
+#define MAGAZINE_SIZE 16
+#define MAGAZINE_FOLD_OPS 64
+
+struct pool_magazine {
+   pthread_mutex_t lock;
+   struct pool_magazine *next;        /* next magazine of all threads */
+   int32_t ops;                       /* operations since the last fold */
+   int32_t count[PM_MAX + 1];         /* number of free buffers */
+   int32_t in_use[PM_MAX + 1];        /* in use change since the last fold */
+   struct abufhead *free_buf[PM_MAX + 1];
+};
+
+static pthread_once_t magazine_once = PTHREAD_ONCE_INIT;
+static pthread_key_t magazine_key;
+static pthread_mutex_t magazines_mutex = PTHREAD_MUTEX_INITIALIZER;
+static struct pool_magazine *magazines = NULL;
+
+/*
+ * Fold the usage counters of a magazine into the pool statistics.
+ * Called with the magazine lock and the global mutex held.
+ */
+static void fold_magazine_stats(struct pool_magazine *mag)
+{
+   for (int i = 0; i <= PM_MAX; i++) {
+      if (mag->in_use[i] != 0) {
+         pool_ctl[i].in_use += mag->in_use[i];
+         if (pool_ctl[i].in_use > pool_ctl[i].max_used) {
+            pool_ctl[i].max_used = pool_ctl[i].in_use;
+         }
+         mag->in_use[i] = 0;
+      }
+   }
+   mag->ops = 0;
+}
+
+/*
+ * Move free buffers of a magazine to the global free list until keep are left.
+ * Called with the magazine lock and the global mutex held.
+ */
+static void drain_magazine(struct pool_magazine *mag, int pool, int keep)
+{
+   struct abufhead *buf;
+
+   while (mag->count[pool] > keep) {
+      buf = mag->free_buf[pool];
+      mag->free_buf[pool] = buf->next;
+      buf->next = pool_ctl[pool].free_buf;
+      pool_ctl[pool].free_buf = buf;
+      mag->count[pool]--;
+   }
+}
+
+/*
+ * Take up to half a magazine of buffers from the global free list.
+ * Called with the magazine lock and the global mutex held.
+ */
+static void refill_magazine(struct pool_magazine *mag, int pool)
+{
+   struct abufhead *buf;
+
+   while (mag->count[pool] < MAGAZINE_SIZE / 2 && pool_ctl[pool].free_buf) {
+      buf = pool_ctl[pool].free_buf;
+      pool_ctl[pool].free_buf = buf->next;
+      buf->next = mag->free_buf[pool];
+      mag->free_buf[pool] = buf;
+      mag->count[pool]++;
+   }
+}
+
+/*
+ * Fold the statistics of all magazines and optionally return all
+ * their free buffers to the global free list.
+ */
+static void collect_magazines(bool drain)
+{
+   struct pool_magazine *mag;
+
+   P(magazines_mutex);
+   for (mag = magazines; mag; mag = mag->next) {
+      P(mag->lock);
+      P(mutex);
+      if (drain) {
+         for (int i = 0; i <= PM_MAX; i++) {
+            drain_magazine(mag, i, 0);
+         }
+      }
+      fold_magazine_stats(mag);
+      V(mutex);
+      V(mag->lock);
+   }
+   V(magazines_mutex);
+}
+
+/*
+ * Return the magazine of an exiting thread.
+ *
+ * This runs after the lock manager forgot about the thread, so the
+ * mutexes are taken without going through it.
+ */
+static void free_magazine(void *arg)
+{
+   struct pool_magazine *mag = (struct pool_magazine *)arg;
+   struct pool_magazine **pp;
+
+   lmgr_p(&magazines_mutex);
+   for (pp = &magazines; *pp; pp = &(*pp)->next) {
+      if (*pp == mag) {
+         *pp = mag->next;
+         break;
+      }
+   }
+   lmgr_v(&magazines_mutex);
+
+   lmgr_p(&mag->lock);
+   lmgr_p(&mutex);
+   for (int i = 0; i <= PM_MAX; i++) {
+      drain_magazine(mag, i, 0);
+   }
+   fold_magazine_stats(mag);
+   lmgr_v(&mutex);
+   lmgr_v(&mag->lock);
+
+   pthread_mutex_destroy(&mag->lock);
+   actuallyfree(mag);
+}
+
+static void create_magazine_key(void)
+{
+   pthread_key_create(&magazine_key, free_magazine);
+}
+
+static struct pool_magazine *get_magazine(void)
+{
+   struct pool_magazine *mag;
+
+   pthread_once(&magazine_once, create_magazine_key);
+   mag = (struct pool_magazine *)pthread_getspecific(magazine_key);
+   if (!mag) {
+      mag = (struct pool_magazine *)actuallymalloc(sizeof(struct pool_magazine));
+      if (!mag) {
+         return NULL;
+      }
+      memset(mag, 0, sizeof(struct pool_magazine));
+      pthread_mutex_init(&mag->lock, NULL);
+
+      P(magazines_mutex);
+      mag->next = magazines;
+      magazines = mag;
+      V(magazines_mutex);
+
+      pthread_setspecific(magazine_key, (void *)mag);
+   }
+
+   return mag;
+}
+
+/*
+ * Get a free buffer of a pool and account for it being in use.
+ * Returns NULL when a new buffer needs to be allocated.
+ */
+static struct abufhead *magazine_get(int pool)
+{
+   struct abufhead *buf;
+   struct pool_magazine *mag;
+
+   mag = get_magazine();
+   if (!mag) {
+      P(mutex);
+      buf = pool_ctl[pool].free_buf;
+      if (buf) {
+         pool_ctl[pool].free_buf = buf->next;
+      }
+      pool_ctl[pool].in_use++;
+      if (pool_ctl[pool].in_use > pool_ctl[pool].max_used) {
+         pool_ctl[pool].max_used = pool_ctl[pool].in_use;
+      }
+      V(mutex);
+      return buf;
+   }
+
+   P(mag->lock);
+   mag->in_use[pool]++;
+   if (!mag->free_buf[pool] || ++mag->ops >= MAGAZINE_FOLD_OPS) {
+      P(mutex);
+      if (!mag->free_buf[pool]) {
+         refill_magazine(mag, pool);
+      }
+      fold_magazine_stats(mag);
+      V(mutex);
+   }
+
+   buf = mag->free_buf[pool];
+   if (buf) {
+      mag->free_buf[pool] = buf->next;
+      mag->count[pool]--;
+   }
+   V(mag->lock);
+
+   return buf;
+}
+
+/*
+ * Put a buffer of a pool back on the free list.
+ */
+static void magazine_put(struct abufhead *buf, int pool)
+{
+   struct pool_magazine *mag;
 
+   mag = get_magazine();
+   if (!mag) {
+      P(mutex);
+      pool_ctl[pool].in_use--;
+      buf->next = pool_ctl[pool].free_buf;
+      pool_ctl[pool].free_buf = buf;
+      V(mutex);
+      return;
+   }
 
+   P(mag->lock);
+#ifdef DEBUG
+   struct abufhead *next;
+   /* Don't let him free the same buffer twice */
+   for (next = mag->free_buf[pool]; next; next = next->next) {
+      if (next == buf) {
+         V(mag->lock);
+         ASSERT(next != buf);         /* attempt to free twice */
+      }
+   }
+#endif
+   buf->next = mag->free_buf[pool];
+   mag->free_buf[pool] = buf;
+   mag->count[pool]++;
+   mag->in_use[pool]--;
+   if (mag->count[pool] > MAGAZINE_SIZE || ++mag->ops >= MAGAZINE_FOLD_OPS) {
+      P(mutex);
+      if (mag->count[pool] > MAGAZINE_SIZE) {
+         drain_magazine(mag, pool, MAGAZINE_SIZE / 2);
+      }
+      fold_magazine_stats(mag);
+      V(mutex);
+   }
+   V(mag->lock);
+}
 
 /*
  * Special version of error reporting using a static buffer so we don't use
@@ -132,6 +387,283 @@ static void smart_alloc_msg(const char *file, int line, const char *fmt, ...)
 }
 
 
+/*
+ * Large buffer pool.
+ *
+ * Device blocks, spool buffers and compression buffers are often several
+ * megabytes large. Allocating and freeing them with malloc for every job
+ * fragments the heap, so they are kept in power of two size classes from
+ * 64K up to 16M and reused by later jobs. The buffers are aligned to the
+ * page size, or to the huge page size for classes of 2M and up, so the
+ * kernel can back them with huge pages.
+ *
+ * Buffers are POOLMEM of the internal pool PM_LARGE, so sizeof_pool_memory(),
+ * check_pool_memory_size() and free_pool_memory() work on them as usual.
+ *
+ * The number of free buffers a class keeps is bounded by the high water
+ * mark of its use: every LARGE_POOL_TRIM_INTERVAL seconds the buffers that
+ * were not needed at the peak of the last interval are released, and the
+ * total size of the free buffers never exceeds LARGE_POOL_MAX_CACHED.
+ */
+#define PM_LARGE (PM_MAX + 1)
+
+#define LARGE_POOL_MIN_SHIFT 16                  /* 64K */
+#define LARGE_POOL_MAX_SHIFT 24                  /* 16M */
+#define LARGE_POOL_CLASSES (LARGE_POOL_MAX_SHIFT - LARGE_POOL_MIN_SHIFT + 1)
+#define LARGE_POOL_HUGE_PAGE (2 * 1024 * 1024)
+#define LARGE_POOL_MAX_CACHED ((uint64_t)256 * 1024 * 1024)
+#define LARGE_POOL_TRIM_INTERVAL (5 * 60)
+
+struct s_large_ctl {
+   int32_t in_use;                    /* number in use */
+   int32_t max_used;                  /* max buffers used */
+   int32_t high_water;                /* max buffers used since the last trim */
+   int32_t count;                     /* number of free buffers */
+   struct abufhead *free_buf;         /* pointer to free buffers */
+};
+
+static pthread_mutex_t large_mutex = PTHREAD_MUTEX_INITIALIZER;
+static struct s_large_ctl large_ctl[LARGE_POOL_CLASSES + 1]; /* last is oversized */
+static uint64_t large_in_use_bytes = 0;
+static uint64_t large_cached_bytes = 0;
+static uint64_t large_max_bytes = 0;
+static time_t large_last_trim = 0;
+
+/*
+ * Size of the allocation of a size class, header included.
+ */
+static inline uint32_t large_class_size(int cls)
+{
+   return (uint32_t)1 << (LARGE_POOL_MIN_SHIFT + cls);
+}
+
+/*
+ * Size class of an allocation of bytes, header included.
+ * Returns LARGE_POOL_CLASSES for allocations too big to be pooled.
+ */
+static int large_class(uint32_t bytes)
+{
+   int cls;
+
+   for (cls = 0; cls < LARGE_POOL_CLASSES; cls++) {
+      if (bytes <= large_class_size(cls)) {
+         break;
+      }
+   }
+
+   return cls;
+}
+
+static struct abufhead *alloc_large_buffer(uint32_t bytes)
+{
+   void *ptr;
+
+#if defined(HAVE_WIN32)
+   ptr = actuallymalloc(bytes);
+#else
+   size_t alignment;
+
+   alignment = (bytes >= LARGE_POOL_HUGE_PAGE) ? LARGE_POOL_HUGE_PAGE : (size_t)getpagesize();
+   if (posix_memalign(&ptr, alignment, bytes) != 0) {
+      ptr = NULL;
+   }
+#if defined(HAVE_SYS_MMAN_H) && defined(MADV_HUGEPAGE)
+   if (ptr && alignment == LARGE_POOL_HUGE_PAGE) {
+      madvise(ptr, bytes, MADV_HUGEPAGE);
+   }
+#endif
+#endif
+
+   return (struct abufhead *)ptr;
+}
+
+/*
+ * Release the free buffers of a class above keep to the system.
+ * Called with the large pool mutex held, the buffers are chained on list.
+ */
+static void trim_large_class(int cls, int32_t keep, struct abufhead **list)
+{
+   struct abufhead *buf;
+
+   while (large_ctl[cls].count > keep) {
+      buf = large_ctl[cls].free_buf;
+      large_ctl[cls].free_buf = buf->next;
+      large_ctl[cls].count--;
+      large_cached_bytes -= large_class_size(cls);
+      buf->next = *list;
+      *list = buf;
+   }
+}
+
+/*
+ * Release the buffers each class did not need at the peak of the
+ * last interval. Called with the large pool mutex held.
+ */
+static void trim_large_pool(time_t now, struct abufhead **list)
+{
+   int32_t keep;
+
+   for (int cls = 0; cls < LARGE_POOL_CLASSES; cls++) {
+      keep = large_ctl[cls].high_water - large_ctl[cls].in_use;
+      trim_large_class(cls, keep > 0 ? keep : 0, list);
+      large_ctl[cls].high_water = large_ctl[cls].in_use;
+   }
+   large_last_trim = now;
+}
+
+static void free_large_list(struct abufhead *list)
+{
+   struct abufhead *next;
+
+   while (list) {
+      next = list->next;
+      actuallyfree(list);
+      list = next;
+   }
+}
+
+/*
+ * Get a buffer of at least size bytes from the large buffer pool.
+ */
+POOLMEM *get_large_memory(int32_t size)
+{
+   int cls;
+   uint32_t bytes;
+   struct abufhead *buf;
+
+   bytes = size + HEAD_SIZE;
+   cls = large_class(bytes);
+   if (cls < LARGE_POOL_CLASSES) {
+      bytes = large_class_size(cls);
+   } else {
+      bytes = (bytes + LARGE_POOL_HUGE_PAGE - 1) & ~(LARGE_POOL_HUGE_PAGE - 1);
+   }
+
+   P(large_mutex);
+   buf = large_ctl[cls].free_buf;
+   if (buf) {
+      large_ctl[cls].free_buf = buf->next;
+      large_ctl[cls].count--;
+      large_cached_bytes -= bytes;
+   }
+   large_ctl[cls].in_use++;
+   if (large_ctl[cls].in_use > large_ctl[cls].max_used) {
+      large_ctl[cls].max_used = large_ctl[cls].in_use;
+   }
+   if (large_ctl[cls].in_use > large_ctl[cls].high_water) {
+      large_ctl[cls].high_water = large_ctl[cls].in_use;
+   }
+   large_in_use_bytes += bytes;
+   if (large_in_use_bytes + large_cached_bytes > large_max_bytes) {
+      large_max_bytes = large_in_use_bytes + large_cached_bytes;
+   }
+   V(large_mutex);
+
+   if (!buf) {
+      if ((buf = alloc_large_buffer(bytes)) == NULL) {
+         smart_alloc_msg(__FILE__, __LINE__, _("Out of memory requesting %d bytes\n"), size);
+         return NULL;
+      }
+   }
+
+   buf->ablen = bytes - HEAD_SIZE;
+   buf->pool = PM_LARGE;
+   buf->next = NULL;
+
+   return (POOLMEM *)((char *)buf + HEAD_SIZE);
+}
+
+/*
+ * Give a buffer back to the large buffer pool.
+ */
+static void free_large_memory(struct abufhead *buf)
+{
+   int cls;
+   time_t now;
+   uint32_t bytes;
+   struct abufhead *list = NULL;
+
+   bytes = buf->ablen + HEAD_SIZE;
+   cls = large_class(bytes);
+   now = time(NULL);
+
+   P(large_mutex);
+   large_ctl[cls].in_use--;
+   large_in_use_bytes -= bytes;
+   if (cls < LARGE_POOL_CLASSES &&
+       large_cached_bytes + bytes <= LARGE_POOL_MAX_CACHED) {
+      buf->next = large_ctl[cls].free_buf;
+      large_ctl[cls].free_buf = buf;
+      large_ctl[cls].count++;
+      large_cached_bytes += bytes;
+   } else {
+      buf->next = NULL;
+      list = buf;
+   }
+   if (now >= large_last_trim + LARGE_POOL_TRIM_INTERVAL) {
+      trim_large_pool(now, &list);
+   }
+   V(large_mutex);
+
+   free_large_list(list);
+}
+
+/*
+ * Resize a buffer of the large buffer pool keeping its content.
+ */
+static POOLMEM *realloc_large_memory(POOLMEM *obuf, int32_t size)
+{
+   POOLMEM *buf;
+   struct abufhead *head;
+
+   head = (struct abufhead *)((char *)obuf - HEAD_SIZE);
+   if (size <= head->ablen &&
+       large_class(size + HEAD_SIZE) == large_class(head->ablen + HEAD_SIZE)) {
+      return obuf;
+   }
+
+   buf = get_large_memory(size);
+   if (buf) {
+      memcpy(buf, obuf, MIN(size, head->ablen));
+      free_large_memory(head);
+   }
+
+   return buf;
+}
+
+/*
+ * Release all free buffers of the large buffer pool.
+ */
+static void close_large_pool()
+{
+   struct abufhead *list = NULL;
+
+   P(large_mutex);
+   for (int cls = 0; cls < LARGE_POOL_CLASSES; cls++) {
+      trim_large_class(cls, 0, &list);
+   }
+   V(large_mutex);
+
+   free_large_list(list);
+}
+
+/*
+ * Get the usage of the large buffer pool.
+ */
+void get_large_memory_stats(LARGE_POOL_STATS *stats)
+{
+   memset(stats, 0, sizeof(LARGE_POOL_STATS));
+   P(large_mutex);
+   for (int cls = 0; cls <= LARGE_POOL_CLASSES; cls++) {
+      stats->in_use += large_ctl[cls].in_use;
+      stats->cached += large_ctl[cls].count;
+   }
+   stats->in_use_bytes = large_in_use_bytes;
+   stats->cached_bytes = large_cached_bytes;
+   stats->max_bytes = large_max_bytes;
+   V(large_mutex);
+}
+
 #ifdef SMARTALLOC
 POOLMEM *sm_get_pool_memory(const char *fname, int lineno, int pool)
 {
@@ -142,32 +674,18 @@ POOLMEM *sm_get_pool_memory(const char *fname, int lineno, int pool)
       return NULL;
    }
 
-   P(mutex);
-   if (pool_ctl[pool].free_buf) {
-      buf = pool_ctl[pool].free_buf;
-      pool_ctl[pool].free_buf = buf->next;
-      pool_ctl[pool].in_use++;
-      if (pool_ctl[pool].in_use > pool_ctl[pool].max_used) {
-         pool_ctl[pool].max_used = pool_ctl[pool].in_use;
-      }
-      V(mutex);
+   if ((buf = magazine_get(pool)) != NULL) {
       sm_new_owner(fname, lineno, (char *)buf);
       return (POOLMEM *)((char *)buf + HEAD_SIZE);
    }
 
    if ((buf = (struct abufhead *)sm_malloc(fname, lineno, pool_ctl[pool].size + HEAD_SIZE)) == NULL) {
-      V(mutex);
       smart_alloc_msg(__FILE__, __LINE__, _("Out of memory requesting %d bytes\n"), pool_ctl[pool].size);
       return NULL;
    }
 
    buf->ablen = pool_ctl[pool].size;
    buf->pool = pool;
-   pool_ctl[pool].in_use++;
-   if (pool_ctl[pool].in_use > pool_ctl[pool].max_used) {
-      pool_ctl[pool].max_used = pool_ctl[pool].in_use;
-   }
-   V(mutex);
    return (POOLMEM *)((char *)buf + HEAD_SIZE);
 }
 
@@ -215,11 +733,12 @@ POOLMEM *sm_realloc_pool_memory(const char *fname, int lineno, POOLMEM *obuf, in
    int pool;
 
    ASSERT(obuf);
-   P(mutex);
    cp -= HEAD_SIZE;
+   if (((struct abufhead *)cp)->pool == PM_LARGE) {
+      return realloc_large_memory(obuf, size);
+   }
    buf = sm_realloc(fname, lineno, cp, size + HEAD_SIZE);
    if (buf == NULL) {
-      V(mutex);
       smart_alloc_msg(__FILE__, __LINE__, _("Out of memory requesting %d bytes\n"), size);
       return NULL;
    }
@@ -227,9 +746,12 @@ POOLMEM *sm_realloc_pool_memory(const char *fname, int lineno, POOLMEM *obuf, in
    ((struct abufhead *)buf)->ablen = size;
    pool = ((struct abufhead *)buf)->pool;
    if (size > pool_ctl[pool].max_allocated) {
-      pool_ctl[pool].max_allocated = size;
+      P(mutex);
+      if (size > pool_ctl[pool].max_allocated) {
+         pool_ctl[pool].max_allocated = size;
+      }
+      V(mutex);
    }
-   V(mutex);
    return (POOLMEM *)(((char *)buf) + HEAD_SIZE);
 }
 
@@ -249,27 +771,18 @@ void sm_free_pool_memory(const char *fname, int lineno, POOLMEM *obuf)
    int pool;
 
    ASSERT(obuf);
-   P(mutex);
    buf = (struct abufhead *)((char *)obuf - HEAD_SIZE);
    pool = buf->pool;
-   pool_ctl[pool].in_use--;
    if (pool == 0) {
+      P(mutex);
+      pool_ctl[pool].in_use--;
+      V(mutex);
       free((char *)buf);              /* free nonpooled memory */
+   } else if (pool == PM_LARGE) {
+      free_large_memory(buf);
    } else {                           /* otherwise link it to the free pool chain */
-#ifdef DEBUG
-      struct abufhead *next;
-      /* Don't let him free the same buffer twice */
-      for (next=pool_ctl[pool].free_buf; next; next=next->next) {
-         if (next == buf) {
-            V(mutex);                 /* unblock the pool */
-            ASSERT(next != buf);      /* attempt to free twice */
-         }
-      }
-#endif
-      buf->next = pool_ctl[pool].free_buf;
-      pool_ctl[pool].free_buf = buf;
+      magazine_put(buf, pool);
    }
-   V(mutex);
 }
 
 #else
@@ -280,16 +793,11 @@ POOLMEM *get_pool_memory(int pool)
 {
    struct abufhead *buf;
 
-   P(mutex);
-   if (pool_ctl[pool].free_buf) {
-      buf = pool_ctl[pool].free_buf;
-      pool_ctl[pool].free_buf = buf->next;
-      V(mutex);
+   if ((buf = magazine_get(pool)) != NULL) {
       return (POOLMEM *)((char *)buf + HEAD_SIZE);
    }
 
    if ((buf = (struct abufhead *)malloc(pool_ctl[pool].size + HEAD_SIZE)) == NULL) {
-      V(mutex);
       smart_alloc_msg(__FILE__, __LINE__, _("Out of memory requesting %d bytes\n"), pool_ctl[pool].size);
       return NULL;
    }
@@ -297,11 +805,6 @@ POOLMEM *get_pool_memory(int pool)
    buf->ablen = pool_ctl[pool].size;
    buf->pool = pool;
    buf->next = NULL;
-   pool_ctl[pool].in_use++;
-   if (pool_ctl[pool].in_use > pool_ctl[pool].max_used) {
-      pool_ctl[pool].max_used = pool_ctl[pool].in_use;
-   }
-   V(mutex);
    return (POOLMEM *)(((char *)buf) + HEAD_SIZE);
 }
 
@@ -344,11 +847,12 @@ POOLMEM *realloc_pool_memory(POOLMEM *obuf, int32_t size)
    int pool;
 
    ASSERT(obuf);
-   P(mutex);
    cp -= HEAD_SIZE;
+   if (((struct abufhead *)cp)->pool == PM_LARGE) {
+      return realloc_large_memory(obuf, size);
+   }
    buf = realloc(cp, size + HEAD_SIZE);
    if (buf == NULL) {
-      V(mutex);
       smart_alloc_msg(__FILE__, __LINE__, _("Out of memory requesting %d bytes\n"), size);
       return NULL;
    }
@@ -356,9 +860,12 @@ POOLMEM *realloc_pool_memory(POOLMEM *obuf, int32_t size)
    ((struct abufhead *)buf)->ablen = size;
    pool = ((struct abufhead *)buf)->pool;
    if (size > pool_ctl[pool].max_allocated) {
-      pool_ctl[pool].max_allocated = size;
+      P(mutex);
+      if (size > pool_ctl[pool].max_allocated) {
+         pool_ctl[pool].max_allocated = size;
+      }
+      V(mutex);
    }
-   V(mutex);
    return (POOLMEM *)(((char *)buf) + HEAD_SIZE);
 }
 
@@ -378,27 +885,18 @@ void free_pool_memory(POOLMEM *obuf)
    int pool;
 
    ASSERT(obuf);
-   P(mutex);
    buf = (struct abufhead *)((char *)obuf - HEAD_SIZE);
    pool = buf->pool;
-   pool_ctl[pool].in_use--;
    if (pool == 0) {
+      P(mutex);
+      pool_ctl[pool].in_use--;
+      V(mutex);
       free((char *)buf);              /* free nonpooled memory */
+   } else if (pool == PM_LARGE) {
+      free_large_memory(buf);
    } else {                           /* otherwise link it to the free pool chain */
-#ifdef DEBUG
-      struct abufhead *next;
-      /* Don't let him free the same buffer twice */
-      for (next=pool_ctl[pool].free_buf; next; next=next->next) {
-         if (next == buf) {
-            V(mutex);
-            ASSERT(next != buf);  /* attempt to free twice */
-         }
-      }
-#endif
-      buf->next = pool_ctl[pool].free_buf;
-      pool_ctl[pool].free_buf = buf;
+      magazine_put(buf, pool);
    }
-   V(mutex);
 }
 #endif /* SMARTALLOC */
 
@@ -437,6 +935,7 @@ void close_memory_pool()
    uint64_t bytes = 0;
 
    sm_check(__FILE__, __LINE__, false);
+   collect_magazines(true);
    P(mutex);
    for (int i=1; i<=PM_MAX; i++) {
       buf = pool_ctl[i].free_buf;
@@ -450,6 +949,7 @@ void close_memory_pool()
       pool_ctl[i].free_buf = NULL;
    }
    V(mutex);
+   close_large_pool();
 
    if (debug_level >= 1) {
       print_memory_pool_stats();
@@ -497,6 +997,8 @@ static const char *pool_name(int pool)
  */
 void print_memory_pool_stats()
 {
+   collect_magazines(false);
+
    Pmsg0(-1, "Pool   Maxsize  Maxused  Inuse\n");
    for (int i = 0; i <= PM_MAX; i++) {
       Pmsg4(-1, "%5s  %7d  %7d  %5d\n",
@@ -506,6 +1008,26 @@ void print_memory_pool_stats()
             pool_ctl[i].in_use);
    }
 
+   Pmsg0(-1, "\nLarge    Maxused  Inuse  Cached\n");
+   P(large_mutex);
+   for (int cls = 0; cls <= LARGE_POOL_CLASSES; cls++) {
+      if (large_ctl[cls].max_used == 0) {
+         continue;
+      }
+      if (cls < LARGE_POOL_CLASSES) {
+         Pmsg4(-1, "%5dK  %7d  %5d  %6d\n",
+               large_class_size(cls) / 1024,
+               large_ctl[cls].max_used,
+               large_ctl[cls].in_use,
+               large_ctl[cls].count);
+      } else {
+         Pmsg2(-1, "Larger  %7d  %5d\n",
+               large_ctl[cls].max_used,
+               large_ctl[cls].in_use);
+      }
+   }
+   V(large_mutex);
+
    Pmsg0(-1, "\n");
 }
 #else
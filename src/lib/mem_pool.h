@@ -68,6 +68,20 @@ void free_pool_memory(POOLMEM *buf);
  */
 #define free_and_null_pool_memory(a) do { if (a) { free_pool_memory(a); (a) = NULL;} } while (0)
 
+/**
+ * Large buffers (device blocks, compression buffers) kept in size classes
+ */
+struct LARGE_POOL_STATS {
+   uint32_t in_use;                   /* number of buffers in use */
+   uint32_t cached;                   /* number of free buffers kept */
+   uint64_t in_use_bytes;             /* bytes in use */
+   uint64_t cached_bytes;             /* bytes of free buffers kept */
+   uint64_t max_bytes;                /* max bytes allocated */
+};
+
+POOLMEM *get_large_memory(int32_t size);
+void get_large_memory_stats(LARGE_POOL_STATS *stats);
+
 void garbage_collect_memory_pool();
 void close_memory_pool();
 void print_memory_pool_stats();
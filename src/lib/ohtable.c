@@ -0,0 +1,586 @@
+/*
+   BAREOS® - Backup Archiving REcovery Open Sourced
+
+   Copyright (C) 2016-2016 Bareos GmbH & Co. KG
+
+   This program is Free Software; you can redistribute it and/or
+   modify it under the terms of version three of the GNU Affero General Public
+   License as published by the Free Software Foundation and included
+   in the file LICENSE.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+   Affero General Public License for more details.
+
+   You should have received a copy of the GNU Affero General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+   02110-1301, USA.
+*/
+/*
+ * BAREOS open addressing hash table routines
+ *
+ * ohtable has the same interface as htable but instead of chaining the
+ * items through the next pointer in their hlink it keeps one flat array
+ * of slots each holding the full 64 bits hash of the key and a pointer to
+ * the hlink of the item. Collisions are resolved using linear probing with
+ * Robin Hood displacement: on insert an item that is further away from its
+ * home slot than the occupant takes over the slot and the occupant moves
+ * on. This keeps the variance of the probe lengths low and allows a lookup
+ * to stop as soon as it sees a slot whose occupant is closer to its home
+ * than we are to ours.
+ *
+ * As the full hash is kept in the slot array, probing only walks sequential
+ * memory and the item itself is only referenced when the hashes match. The
+ * string and binary keys are hashed using MurmurHash64A, the integer keys
+ * are scrambled using the 64 bits finalizer of MurmurHash3 so the low bits
+ * of the hash can be used directly as the slot index.
+ *
+ * The memory for the items can be allocated with hash_malloc() exactly as
+ * for the htable class.
+ */
+
+#include "bareos.h"
+
+#define B_PAGE_SIZE 4096
+#define MIN_PAGES 32
+#define MAX_PAGES 2400
+#define MIN_BUF_SIZE (MIN_PAGES * B_PAGE_SIZE) /* 128 Kb */
+#define MAX_BUF_SIZE (MAX_PAGES * B_PAGE_SIZE) /* approx 10MB */
+
+#define MIN_BUCKETS 32
+#define HASH_SEED 0x9e3779b97f4a7c15ULL
+
+static const int dbglvl = 500;
+
+/*
+ * Scramble all bits of a 64 bits value (MurmurHash3 fmix64).
+ */
+static inline uint64_t hash_mix(uint64_t h)
+{
+   h ^= h >> 33;
+   h *= 0xff51afd7ed558ccdULL;
+   h ^= h >> 33;
+   h *= 0xc4ceb9fe1a85ec53ULL;
+   h ^= h >> 33;
+
+   return h;
+}
+
+/*
+ * MurmurHash64A by Austin Appleby (public domain).
+ */
+static inline uint64_t hash_bytes(const uint8_t *data, uint32_t len)
+{
+   const uint64_t m = 0xc6a4a7935bd1e995ULL;
+   const int r = 47;
+   const uint8_t *end;
+   uint64_t h, k;
+
+   h = HASH_SEED ^ (len * m);
+   end = data + (len & ~7);
+   while (data != end) {
+      memcpy(&k, data, sizeof(k));
+      data += sizeof(k);
+
+      k *= m;
+      k ^= k >> r;
+      k *= m;
+
+      h ^= k;
+      h *= m;
+   }
+
+   switch (len & 7) {
+   case 7:
+      h ^= (uint64_t)data[6] << 48;
+   case 6:
+      h ^= (uint64_t)data[5] << 40;
+   case 5:
+      h ^= (uint64_t)data[4] << 32;
+   case 4:
+      h ^= (uint64_t)data[3] << 24;
+   case 3:
+      h ^= (uint64_t)data[2] << 16;
+   case 2:
+      h ^= (uint64_t)data[1] << 8;
+   case 1:
+      h ^= (uint64_t)data[0];
+      h *= m;
+   }
+
+   h ^= h >> r;
+   h *= m;
+   h ^= h >> r;
+
+   return h;
+}
+
+/*
+ * ohtable (Open addressing Hash Table) class.
+ */
+
+/*
+ * This subroutine gets a big buffer.
+ */
+void ohtable::malloc_big_buf(int size)
+{
+   struct h_mem *hmem;
+
+   hmem = (struct h_mem *)malloc(size);
+   total_size += size;
+   blocks++;
+   hmem->next = mem_block;
+   mem_block = hmem;
+   hmem->mem = mem_block->first;
+   hmem->rem = (char *)hmem + size - hmem->mem;
+   Dmsg3(100, "malloc buf=%p size=%d rem=%d\n", hmem, size, hmem->rem);
+}
+
+/*
+ * This routine frees the whole tree.
+ */
+void ohtable::hash_big_free()
+{
+   struct h_mem *hmem, *rel;
+
+   for (hmem = mem_block; hmem; ) {
+      rel = hmem;
+      hmem = hmem->next;
+      Dmsg1(100, "free malloc buf=%p\n", rel);
+      free(rel);
+   }
+   mem_block = NULL;
+}
+
+/*
+ * Normal hash malloc routine that gets a "small" buffer from the big buffer
+ */
+char *ohtable::hash_malloc(int size)
+{
+   int mb_size;
+   char *buf;
+   int asize = BALIGN(size);
+
+   if (mem_block->rem < asize) {
+      if (total_size >= (extend_length / 2)) {
+         mb_size = extend_length;
+      } else {
+         mb_size = extend_length / 2;
+      }
+      malloc_big_buf(mb_size);
+      Dmsg1(100, "Created new big buffer of %ld bytes\n", mb_size);
+   }
+   mem_block->rem -= asize;
+   buf = mem_block->mem;
+   mem_block->mem += asize;
+   return buf;
+}
+
+/*
+ * Create hash of key, stored in hash then
+ * create and return the home slot index
+ */
+void ohtable::hash_index(char *key)
+{
+   hash = hash_bytes((uint8_t *)key, strlen(key));
+   index = hash & mask;
+   Dmsg2(dbglvl, "Leave hash_index hash=0x%llx index=%d\n", hash, index);
+}
+
+void ohtable::hash_index(uint32_t key)
+{
+   hash = hash_mix(key);
+   index = hash & mask;
+   Dmsg2(dbglvl, "Leave hash_index hash=0x%llx index=%d\n", hash, index);
+}
+
+void ohtable::hash_index(uint64_t key)
+{
+   hash = hash_mix(key);
+   index = hash & mask;
+   Dmsg2(dbglvl, "Leave hash_index hash=0x%llx index=%d\n", hash, index);
+}
+
+void ohtable::hash_index(uint8_t *key, uint32_t key_len)
+{
+   hash = hash_bytes(key, key_len);
+   index = hash & mask;
+   Dmsg2(dbglvl, "Leave hash_index hash=0x%llx index=%d\n", hash, index);
+}
+
+/*
+ * tsize is the estimated number of entries in the hash table
+ */
+ohtable::ohtable(void *item, void *link, int tsize, int nr_pages, int nr_entries)
+{
+   init(item, link, tsize, nr_pages, nr_entries);
+}
+
+/*
+ * nr_entries is only there for interface compatibility with htable,
+ * an open addressing table always holds at most one item per slot.
+ */
+void ohtable::init(void *item, void *link, int tsize, int nr_pages, int nr_entries)
+{
+   int pagesize;
+   int buffer_size;
+
+   memset(this, 0, sizeof(ohtable));
+
+   /*
+    * Size the table so tsize items fit without growing it.
+    */
+   buckets = MIN_BUCKETS;
+   while (tsize > 0 && buckets - (buckets >> 3) <= (uint32_t)tsize && buckets < 0x80000000) {
+      buckets <<= 1;
+   }
+   loffset = (char *)link - (char *)item;
+   mask = buckets - 1;
+   max_items = buckets - (buckets >> 3); /* Keep load factor below 7/8 */
+   table = (oh_slot *)malloc(buckets * sizeof(oh_slot));
+   memset(table, 0, buckets * sizeof(oh_slot));
+
+#ifdef HAVE_GETPAGESIZE
+   pagesize = getpagesize();
+#else
+   pagesize = B_PAGE_SIZE;
+#endif
+   if (nr_pages == 0) {
+      buffer_size = MAX_BUF_SIZE;
+   } else {
+      buffer_size = pagesize * nr_pages;
+      if (buffer_size > MAX_BUF_SIZE) {
+         buffer_size = MAX_BUF_SIZE;
+      } else if (buffer_size < MIN_BUF_SIZE) {
+         buffer_size = MIN_BUF_SIZE;
+      }
+   }
+   malloc_big_buf(buffer_size);
+   extend_length = buffer_size;
+   Dmsg2(100, "Allocated %d slots and big buffer of %ld bytes\n", buckets, buffer_size);
+}
+
+uint32_t ohtable::size()
+{
+   return num_items;
+}
+
+/*
+ * Count for each item how far it is away from its home slot
+ * and report the distribution of these probe lengths.
+ */
+#define MAX_COUNT 20
+void ohtable::stats()
+{
+   int hits[MAX_COUNT];
+   uint32_t max = 0;
+   uint32_t i, dist;
+   uint64_t total_dist = 0;
+
+   printf("\n\nNumItems=%d\nTotal slots=%d\n", num_items, buckets);
+   printf("Probe length: items\n");
+   for (i = 0; i < MAX_COUNT; i++) {
+      hits[i] = 0;
+   }
+   for (i = 0; i < buckets; i++) {
+      if (!table[i].link) {
+         continue;
+      }
+      dist = (i - (table[i].hash & mask)) & mask;
+      total_dist += dist;
+      if (dist > max) {
+         max = dist;
+      }
+      if (dist < MAX_COUNT) {
+         hits[dist]++;
+      }
+   }
+   for (i = 0; i < MAX_COUNT; i++) {
+      printf("%2d:           %d\n", i, hits[i]);
+   }
+   printf("buckets=%d num_items=%d max_items=%d\n", buckets, num_items, max_items);
+   printf("max probe length = %d\n", max);
+   printf("avg probe length = %.2f\n", num_items ? (double)total_dist / num_items : 0.0);
+   printf("total bytes malloced = %lld\n", (long long int)total_size);
+   printf("total blocks malloced = %d\n", blocks);
+}
+
+/*
+ * Put a link into the slot array using Robin Hood displacement.
+ * The caller makes sure the key is not in the table yet and that
+ * there is at least one free slot.
+ */
+void ohtable::insert_slot(uint64_t slot_hash, hlink *hp)
+{
+   uint32_t i, dist, slot_dist;
+   uint64_t tmp_hash;
+   hlink *tmp_hp;
+
+   i = slot_hash & mask;
+   dist = 0;
+   while (table[i].link) {
+      slot_dist = (i - (table[i].hash & mask)) & mask;
+      if (slot_dist < dist) {
+         /*
+          * The occupant is closer to its home than we are to ours,
+          * so we take its place and continue inserting the occupant.
+          */
+         tmp_hash = table[i].hash;
+         tmp_hp = table[i].link;
+         table[i].hash = slot_hash;
+         table[i].link = hp;
+         slot_hash = tmp_hash;
+         hp = tmp_hp;
+         dist = slot_dist;
+      }
+      i = (i + 1) & mask;
+      dist++;
+   }
+
+   table[i].hash = slot_hash;
+   table[i].link = hp;
+}
+
+void ohtable::grow_table()
+{
+   oh_slot *old_table;
+   uint32_t old_buckets;
+
+   Dmsg1(100, "Grow called old size = %d\n", buckets);
+
+   old_table = table;
+   old_buckets = buckets;
+
+   buckets = old_buckets * 2;
+   mask = buckets - 1;
+   max_items = buckets - (buckets >> 3);
+   table = (oh_slot *)malloc(buckets * sizeof(oh_slot));
+   memset(table, 0, buckets * sizeof(oh_slot));
+
+   /*
+    * The full hash is kept in the slots so there is no need
+    * to look at the items or to hash their keys again.
+    */
+   for (uint32_t i = 0; i < old_buckets; i++) {
+      if (old_table[i].link) {
+         insert_slot(old_table[i].hash, old_table[i].link);
+      }
+   }
+
+   free(old_table);
+   walk_index = 0;
+
+   Dmsg1(100, "Exit grow new size = %d\n", buckets);
+}
+
+bool ohtable::key_equal(hlink *hp, key_type_t key_type, void *key, uint32_t key_len)
+{
+   ASSERT(hp->key_type == key_type);
+   switch (key_type) {
+   case KEY_TYPE_CHAR:
+      return bstrcmp((char *)key, hp->key.char_key);
+   case KEY_TYPE_UINT32:
+      return *(uint32_t *)key == hp->key.uint32_key;
+   case KEY_TYPE_UINT64:
+      return *(uint64_t *)key == hp->key.uint64_key;
+   case KEY_TYPE_BINARY:
+      return key_len == hp->key_len && memcmp(key, hp->key.binary_key, key_len) == 0;
+   default:
+      return false;
+   }
+}
+
+/*
+ * Probe for a key starting at its home slot (hash and index were set
+ * by hash_index()). An empty slot or a slot whose occupant is closer to
+ * its home than we are to ours ends the search.
+ */
+void *ohtable::find(key_type_t key_type, void *key, uint32_t key_len)
+{
+   uint32_t i, dist;
+
+   for (i = index, dist = 0; table[i].link; i = (i + 1) & mask, dist++) {
+      if (((i - (table[i].hash & mask)) & mask) < dist) {
+         break;
+      }
+      if (table[i].hash == hash && key_equal(table[i].link, key_type, key, key_len)) {
+         Dmsg1(dbglvl, "lookup return %p\n", ((char *)table[i].link) - loffset);
+         return ((char *)table[i].link) - loffset;
+      }
+   }
+
+   return NULL;
+}
+
+bool ohtable::insert(char *key, void *item)
+{
+   hlink *hp;
+
+   if (lookup(key)) {
+      return false;                   /* Already exists */
+   }
+
+   hp = (hlink *)(((char *)item) + loffset);
+   Dmsg4(dbglvl, "Insert hp=%p index=%d item=%p offset=%u\n", hp, index, item, loffset);
+
+   hp->next = NULL;
+   hp->hash = hash;
+   hp->key_type = KEY_TYPE_CHAR;
+   hp->key.char_key = key;
+   hp->key_len = 0;
+   insert_slot(hash, hp);
+
+   if (++num_items >= max_items) {
+      Dmsg2(dbglvl, "num_items=%d max_items=%d\n", num_items, max_items);
+      grow_table();
+   }
+
+   Dmsg3(dbglvl, "Leave insert index=%d num_items=%d key=%s\n", index, num_items, key);
+
+   return true;
+}
+
+bool ohtable::insert(uint32_t key, void *item)
+{
+   hlink *hp;
+
+   if (lookup(key)) {
+      return false;                   /* Already exists */
+   }
+
+   hp = (hlink *)(((char *)item) + loffset);
+   Dmsg4(dbglvl, "Insert hp=%p index=%d item=%p offset=%u\n", hp, index, item, loffset);
+
+   hp->next = NULL;
+   hp->hash = hash;
+   hp->key_type = KEY_TYPE_UINT32;
+   hp->key.uint32_key = key;
+   hp->key_len = 0;
+   insert_slot(hash, hp);
+
+   if (++num_items >= max_items) {
+      Dmsg2(dbglvl, "num_items=%d max_items=%d\n", num_items, max_items);
+      grow_table();
+   }
+
+   Dmsg3(dbglvl, "Leave insert index=%d num_items=%d key=%ld\n", index, num_items, key);
+
+   return true;
+}
+
+bool ohtable::insert(uint64_t key, void *item)
+{
+   hlink *hp;
+
+   if (lookup(key)) {
+      return false;                   /* Already exists */
+   }
+
+   hp = (hlink *)(((char *)item) + loffset);
+   Dmsg4(dbglvl, "Insert hp=%p index=%d item=%p offset=%u\n", hp, index, item, loffset);
+
+   hp->next = NULL;
+   hp->hash = hash;
+   hp->key_type = KEY_TYPE_UINT64;
+   hp->key.uint64_key = key;
+   hp->key_len = 0;
+   insert_slot(hash, hp);
+
+   if (++num_items >= max_items) {
+      Dmsg2(dbglvl, "num_items=%d max_items=%d\n", num_items, max_items);
+      grow_table();
+   }
+
+   Dmsg3(dbglvl, "Leave insert index=%d num_items=%d key=%lld\n", index, num_items, key);
+
+   return true;
+}
+
+bool ohtable::insert(uint8_t *key, uint32_t key_len, void *item)
+{
+   hlink *hp;
+
+   if (lookup(key, key_len)) {
+      return false;                   /* Already exists */
+   }
+
+   hp = (hlink *)(((char *)item) + loffset);
+   Dmsg4(dbglvl, "Insert hp=%p index=%d item=%p offset=%u\n", hp, index, item, loffset);
+
+   hp->next = NULL;
+   hp->hash = hash;
+   hp->key_type = KEY_TYPE_BINARY;
+   hp->key.binary_key = key;
+   hp->key_len = key_len;
+   insert_slot(hash, hp);
+
+   if (++num_items >= max_items) {
+      Dmsg2(dbglvl, "num_items=%d max_items=%d\n", num_items, max_items);
+      grow_table();
+   }
+
+   Dmsg2(dbglvl, "Leave insert index=%d num_items=%d\n", index, num_items);
+
+   return true;
+}
+
+void *ohtable::lookup(char *key)
+{
+   hash_index(key);
+   return find(KEY_TYPE_CHAR, key, 0);
+}
+
+void *ohtable::lookup(uint32_t key)
+{
+   hash_index(key);
+   return find(KEY_TYPE_UINT32, &key, 0);
+}
+
+void *ohtable::lookup(uint64_t key)
+{
+   hash_index(key);
+   return find(KEY_TYPE_UINT64, &key, 0);
+}
+
+void *ohtable::lookup(uint8_t *key, uint32_t key_len)
+{
+   hash_index(key, key_len);
+   return find(KEY_TYPE_BINARY, key, key_len);
+}
+
+void *ohtable::next()
+{
+   Dmsg1(dbglvl, "Enter next: walk_index=%d\n", walk_index);
+   while (walk_index < buckets) {
+      if (table[walk_index++].link) {
+         Dmsg2(dbglvl, "next: rtn %p walk_index=%d\n",
+               ((char *)table[walk_index - 1].link) - loffset, walk_index);
+         return ((char *)table[walk_index - 1].link) - loffset;
+      }
+   }
+   Dmsg0(dbglvl, "next: return NULL\n");
+
+   return NULL;
+}
+
+void *ohtable::first()
+{
+   Dmsg0(dbglvl, "Enter first\n");
+   walk_index = 0;
+   return next();
+}
+
+/* Destroy the table and its contents */
+void ohtable::destroy()
+{
+   hash_big_free();
+
+   if (table) {
+      free(table);
+      table = NULL;
+   }
+   garbage_collect_memory();
+   Dmsg0(100, "Done destroy.\n");
+}
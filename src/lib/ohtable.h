@@ -0,0 +1,88 @@
+/*
+   BAREOS® - Backup Archiving REcovery Open Sourced
+
+   Copyright (C) 2016-2016 Bareos GmbH & Co. KG
+
+   This program is Free Software; you can redistribute it and/or
+   modify it under the terms of version three of the GNU Affero General Public
+   License as published by the Free Software Foundation and included
+   in the file LICENSE.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+   Affero General Public License for more details.
+
+   You should have received a copy of the GNU Affero General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+   02110-1301, USA.
+*/
+/**
+ * @file
+ * Open addressing hash table class -- ohtable
+ *
+ * Drop-in alternative for the chained htable class. Items still embed
+ * a hlink which is used to store the key, but the table itself is a
+ * flat array of (hash, link) slots which is probed using Robin Hood
+ * linear probing. A lookup therefore only touches the item itself
+ * when the full 64 bits hash matches.
+ */
+
+#ifndef OHTABLE_H
+#define OHTABLE_H
+
+#include "htable.h"
+
+struct oh_slot {
+   uint64_t hash;                     /* Full hash of the key */
+   hlink *link;                       /* Link in item, NULL when slot is empty */
+};
+
+class ohtable : public SMARTALLOC {
+   oh_slot *table;                    /* Slot array */
+   int loffset;                       /* Link offset in item */
+   uint64_t hash;                     /* Temp storage */
+   uint64_t total_size;               /* Total bytes malloced */
+   uint32_t extend_length;            /* Number of bytes to allocate when extending buffer */
+   uint32_t walk_index;               /* Table walk index */
+   uint32_t num_items;                /* Current number of items */
+   uint32_t max_items;                /* Maximum items before growing */
+   uint32_t buckets;                  /* Size of hash table */
+   uint32_t index;                    /* Temp storage */
+   uint32_t mask;                     /* "Remainder" mask */
+   uint32_t blocks;                   /* Blocks malloced */
+   struct h_mem *mem_block;           /* Malloc'ed memory block chain */
+   void malloc_big_buf(int size);     /* Get a big buffer */
+   void hash_index(char *key);        /* Produce hash key,index */
+   void hash_index(uint32_t key);     /* Produce hash key,index */
+   void hash_index(uint64_t key);     /* Produce hash key,index */
+   void hash_index(uint8_t *key, uint32_t key_len); /* Produce hash key,index */
+   bool key_equal(hlink *hp, key_type_t key_type, void *key, uint32_t key_len);
+   void *find(key_type_t key_type, void *key, uint32_t key_len);
+   void insert_slot(uint64_t hash, hlink *hp);
+   void grow_table();                 /* Grow the table */
+
+public:
+   ohtable(void *item, void *link, int tsize = 31,
+           int nr_pages = 0, int nr_entries = 4);
+   ~ohtable() { destroy(); }
+   void init(void *item, void *link, int tsize = 31,
+             int nr_pages = 0, int nr_entries = 4);
+   bool insert(char *key, void *item);
+   bool insert(uint32_t key, void *item);
+   bool insert(uint64_t key, void *item);
+   bool insert(uint8_t *key, uint32_t key_len, void *item);
+   void *lookup(char *key);
+   void *lookup(uint32_t key);
+   void *lookup(uint64_t key);
+   void *lookup(uint8_t *key, uint32_t key_len);
+   void *first();                     /* Get first item in table */
+   void *next();                      /* Get next item in table */
+   void destroy();
+   void stats();                      /* Print stats about the table */
+   uint32_t size();                   /* Return size of table */
+   char *hash_malloc(int size);       /* Malloc bytes for a hash entry */
+   void hash_big_free();              /* Free all hash allocated big buffers */
+};
+#endif  /* OHTABLE_H */
@@ -74,6 +74,7 @@ public:
    bool full() { return m_size == (m_capacity - m_reserved); };
    bool empty() { return m_size == 0; };
    bool is_flushing() { return m_flush; };
+   int size() const { return m_size; };
    int capacity() const { return m_capacity; };
 };
 
@@ -178,7 +178,7 @@ struct RES_ITEM {
 /* For storing name_addr items in res_items table */
 #define ITEM(x) {(char **)&res_all.x}
 
-#define MAX_RES_ITEMS 90                /* maximum resource items per RES */
+#define MAX_RES_ITEMS 95                /* maximum resource items per RES */
 
 /*
  * This is the universal header that is at the beginning of every resource record.
@@ -117,6 +117,67 @@ int wait_for_writable_fd(int fd, int msec, bool ignore_interupts)
       }
    }
 }
+
+/*
+ * Wait for one of multiple file descriptors to become readable,
+ * the index of a readable one is returned in ready. The poll
+ * descriptors are built in pfds_buf, which the caller keeps
+ * between calls.
+ *
+ *   Returns: 1 if data available
+ *            0 if timeout
+ *           -1 if error
+ */
+int wait_for_readable_fds(int *fds, int nfds, int msec, bool ignore_interupts, int *ready,
+                          POOLMEM *&pfds_buf)
+{
+   int i, status;
+   struct pollfd *pfds;
+   int events;
+
+   events = POLLIN;
+#if defined(POLLRDNORM)
+   events |= POLLRDNORM;
+#endif
+#if defined(POLLRDBAND)
+   events |= POLLRDBAND;
+#endif
+#if defined(POLLPRI)
+   events |= POLLPRI;
+#endif
+
+   pfds_buf = check_pool_memory_size(pfds_buf, nfds * sizeof(struct pollfd));
+   pfds = (struct pollfd *)pfds_buf;
+   memset(pfds, 0, nfds * sizeof(struct pollfd));
+   for (i = 0; i < nfds; i++) {
+      pfds[i].fd = fds[i];
+      pfds[i].events = events;
+   }
+
+   for ( ;; ) {
+      status = poll(pfds, nfds, msec);
+      if (status == -1 && ignore_interupts && (errno == EINTR || errno == EAGAIN)) {
+         continue;
+      }
+      break;
+   }
+
+   if (status > 0) {
+      /*
+       * A hangup or an error is reported by reading the connection.
+       */
+      status = 0;
+      for (i = 0; i < nfds; i++) {
+         if (pfds[i].revents & (events | POLLHUP | POLLERR)) {
+            *ready = i;
+            status = 1;
+            break;
+         }
+      }
+   }
+
+   return status;
+}
 #else
 /*
  *   Returns: 1 if data available
@@ -181,4 +242,51 @@ int wait_for_writable_fd(int fd, int msec, bool ignore_interupts)
    }
 #endif /* defined(HAVE_WIN32) */
 }
+
+/*
+ * Wait for one of multiple file descriptors to become readable,
+ * the index of a readable one is returned in ready. pfds_buf is
+ * only used by the poll() version.
+ *
+ *   Returns: 1 if data available
+ *            0 if timeout
+ *           -1 if error
+ */
+int wait_for_readable_fds(int *fds, int nfds, int msec, bool ignore_interupts, int *ready,
+                          POOLMEM *&pfds_buf)
+{
+   int i, maxfd;
+   fd_set fdset;
+   struct timeval tv;
+
+   for ( ;; ) {
+      tv.tv_sec = msec / 1000;
+      tv.tv_usec = (msec % 1000) * 1000;
+      FD_ZERO(&fdset);
+      maxfd = 0;
+      for (i = 0; i < nfds; i++) {
+         FD_SET((unsigned)fds[i], &fdset);
+         if (fds[i] > maxfd) {
+            maxfd = fds[i];
+         }
+      }
+      switch(select(maxfd + 1, &fdset, NULL, NULL, (msec < 0) ? NULL : &tv)) {
+      case 0:                         /* timeout */
+         return 0;
+      case -1:
+         if (ignore_interupts && (errno == EINTR || errno == EAGAIN)) {
+            continue;
+         }
+         return -1;                  /* error return */
+      default:
+         for (i = 0; i < nfds; i++) {
+            if (FD_ISSET((unsigned)fds[i], &fdset)) {
+               *ready = i;
+               return 1;
+            }
+         }
+         return 0;
+      }
+   }
+}
 #endif /* HAVE_POLL */
@@ -29,6 +29,7 @@
 #define __LIBPROTOS_H
 
 class JCR;
+struct CMPRS_CTX;
 
 /* attr.c */
 ATTR *new_attr(JCR *jcr);
@@ -154,13 +155,20 @@ const char *cmprs_algo_to_text(uint32_t compression_algorithm);
 bool setup_compression_buffers(JCR *jcr, bool compatible,
                                uint32_t compression_algorithm,
                                uint32_t *compress_buf_size);
+bool setup_compression_buffers(JCR *jcr, CMPRS_CTX *ctx, bool compatible,
+                               uint32_t compression_algorithm,
+                               uint32_t *compress_buf_size);
 bool setup_decompression_buffers(JCR *jcr, uint32_t *decompress_buf_size);
 bool compress_data(JCR *jcr, uint32_t compression_algorithm, char *rbuf,
                    uint32_t rsize, unsigned char *cbuf,
                    uint32_t max_compress_len, uint32_t *compress_len);
+bool compress_data(JCR *jcr, CMPRS_CTX *ctx, uint32_t compression_algorithm,
+                   char *rbuf, uint32_t rsize, unsigned char *cbuf,
+                   uint32_t max_compress_len, uint32_t *compress_len);
 bool decompress_data(JCR *jcr, const char *last_fname, int32_t stream,
                      char **data, uint32_t *length, bool want_data_stream);
 void cleanup_compression(JCR *jcr);
+void cleanup_compression_workset(CMPRS_CTX *ctx);
 
 /* cram-md5.c */
 bool cram_md5_respond(BSOCK *bs, const char *password, int *tls_remote_need, bool *compatible);
@@ -257,6 +265,7 @@ JCR *jcr_walk_start();
 JCR *jcr_walk_next(JCR *prev_jcr);
 void jcr_walk_end(JCR *jcr);
 int job_count();
+void register_jcr_jobid(JCR *jcr);
 JCR *get_jcr_from_tsd();
 void set_jcr_in_tsd(JCR *jcr);
 void remove_jcr_from_tsd(JCR *jcr);
@@ -317,6 +326,8 @@ void free_path_list(htable *path_list);
 /* poll.c */
 int wait_for_readable_fd(int fd, int sec, bool ignore_interupts);
 int wait_for_writable_fd(int fd, int sec, bool ignore_interupts);
+int wait_for_readable_fds(int *fds, int nfds, int msec, bool ignore_interupts, int *ready,
+                          POOLMEM *&pfds_buf);
 
 /* pythonlib.c */
 int generate_daemon_event(JCR *jcr, const char *event);
@@ -393,6 +404,7 @@ TLS_CONNECTION *new_tls_connection(TLS_CONTEXT *ctx, int fd, bool server);
 bool tls_bsock_accept(BSOCK *bsock);
 int tls_bsock_writen(BSOCK *bsock, char *ptr, int32_t nbytes);
 int tls_bsock_readn(BSOCK *bsock, char *ptr, int32_t nbytes);
+int tls_bsock_pending(BSOCK *bsock);
 #endif /* HAVE_TLS */
 bool tls_bsock_connect(BSOCK *bsock);
 void tls_bsock_shutdown(BSOCK *bsock);
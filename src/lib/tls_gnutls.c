@@ -727,4 +727,19 @@ int tls_bsock_readn(BSOCK *bsock, char *ptr, int32_t nbytes)
 {
    return gnutls_bsock_readwrite(bsock, ptr, nbytes, false);
 }
+
+/*
+ * Return the number of bytes already decrypted by the TLS layer
+ * which can be read without touching the underlying socket.
+ */
+int tls_bsock_pending(BSOCK *bsock)
+{
+   TLS_CONNECTION *tls = bsock->tls_conn;
+
+   if (!tls) {
+      return 0;
+   }
+
+   return gnutls_record_check_pending(tls->gnutls_state);
+}
 #endif /* HAVE_TLS && HAVE_GNUTLS */
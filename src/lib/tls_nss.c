@@ -160,4 +160,9 @@ int tls_bsock_readn(BSOCK *bsock, char *ptr, int32_t nbytes)
 {
    return -1;
 }
+
+int tls_bsock_pending(BSOCK *bsock)
+{
+   return 0;
+}
 #endif /* HAVE_TLS && HAVE_NSS */
@@ -2,6 +2,7 @@
    BAREOS® - Backup Archiving REcovery Open Sourced
 
    Copyright (C) 2002-2012 Free Software Foundation Europe e.V.
+   Copyright (C) 2016-2016 Bareos GmbH & Co. KG
 
    This program is Free Software; you can redistribute it and/or
    modify it under the terms of version three of the GNU Affero General Public
@@ -29,6 +30,7 @@
 #define B_PAGE_SIZE 4096
 #define MAX_PAGES 2400
 #define MAX_BUF_SIZE (MAX_PAGES * B_PAGE_SIZE)  /* approx 10MB */
+#define MIN_HASH_SIZE 1024
 
 /* Forward referenced subroutines */
 static TREE_NODE *search_and_insert_tree_node(char *fname, int type,
@@ -64,11 +66,26 @@ static void malloc_buf(TREE_ROOT *root, int size)
    Dmsg2(200, "malloc buf size=%d rem=%d\n", size, mem->rem);
 }
 
+/*
+ * Round up to a power of 2 for the hash tables.
+ */
+static uint32_t hash_table_size(uint32_t count)
+{
+   uint32_t size = MIN_HASH_SIZE;
+
+   while (size < count && size < 0x80000000) {
+      size <<= 1;
+   }
+
+   return size;
+}
+
 /*
  * Note, we allocate a big buffer in the tree root
- * from which we allocate nodes. This runs more
+ * from which we allocate names. This runs more
  * than 100 times as fast as directly using malloc()
- * for each of the nodes.
+ * for each of the names. The nodes themselves
+ * are allocated in chunks.
  */
 TREE_ROOT *new_tree(int count)
 {
@@ -82,18 +99,36 @@ TREE_ROOT *new_tree(int count)
    memset(root, 0, sizeof(TREE_ROOT));
 
    /*
-    * Assume filename + node  = 40 characters average length
+    * Assume unique filenames = 16 characters average length per node
     */
-   size = count * (BALIGN(sizeof(TREE_NODE)) + 40);
+   size = count * 16;
    if (count > 1000000 || size > (MAX_BUF_SIZE / 2)) {
       size = MAX_BUF_SIZE;
    }
    Dmsg2(400, "count=%d size=%d\n", count, size);
    malloc_buf(root, size);
+
+   /*
+    * Size the hash tables so they don't need to grow while
+    * inserting the estimated number of files.
+    */
+   root->child_hash_size = hash_table_size((uint32_t)count + (count / 3));
+   root->child_hash = (uint32_t *)calloc(root->child_hash_size, sizeof(uint32_t));
+   root->names_size = hash_table_size((uint32_t)count / 4);
+   root->names = (char **)calloc(root->names_size, sizeof(char *));
+   root->total_size += root->child_hash_size * sizeof(uint32_t) +
+                       root->names_size * sizeof(char *);
+
+   /*
+    * Index 0 is the root itself, so nodes start at index 1.
+    */
+   root->num_nodes = 1;
+
    root->cached_path_len = -1;
    root->cached_path = get_pool_memory(PM_FNAME);
    root->type = TN_ROOT;
    root->fname = "";
+   root->loaded = true;
    HL_ENTRY* entry = NULL;
    root->hardlinks.init(entry, &entry->link, 0, 1);
    return root;
@@ -105,34 +140,29 @@ TREE_ROOT *new_tree(int count)
 static TREE_NODE *new_tree_node(TREE_ROOT *root)
 {
    TREE_NODE *node;
-   int size = sizeof(TREE_NODE);
-   node = (TREE_NODE *)tree_alloc(root, size);
-   memset(node, 0, size);
+   uint32_t index = root->num_nodes;
+
+   if ((index >> TREE_NODE_CHUNK_SHIFT) >= root->num_chunks) {
+      root->chunks = (TREE_NODE **)realloc(root->chunks, (root->num_chunks + 1) * sizeof(TREE_NODE *));
+      root->chunks[root->num_chunks] = (TREE_NODE *)malloc(TREE_NODE_CHUNK_SIZE * sizeof(TREE_NODE));
+      if (root->ext_chunks) {
+         root->ext_chunks = (struct s_tree_ext **)realloc(root->ext_chunks,
+                                                        (root->num_chunks + 1) * sizeof(struct s_tree_ext *));
+         root->ext_chunks[root->num_chunks] = NULL;
+      }
+      root->num_chunks++;
+      root->total_size += TREE_NODE_CHUNK_SIZE * sizeof(TREE_NODE);
+      root->blocks++;
+   }
+
+   root->num_nodes++;
+   node = tree_node(root, index);
+   memset(node, 0, sizeof(TREE_NODE));
+   node->index = index;
    node->delta_seq = -1;
    return node;
 }
 
-/*
- * This routine can be called to release the previously allocated tree node.
- */
-static void free_tree_node(TREE_ROOT *root)
-{
-   int asize = BALIGN(sizeof(TREE_NODE));
-   root->mem->rem += asize;
-   root->mem->mem -= asize;
-}
-
-void tree_remove_node(TREE_ROOT *root, TREE_NODE *node)
-{
-   int asize = BALIGN(sizeof(TREE_NODE));
-   node->parent->child.remove(node);
-   if ((root->mem->mem - asize) == (char *)node) {
-      free_tree_node(root);
-   } else {
-      Dmsg0(0, "Can't release tree node\n");
-   }
-}
-
 /*
  * Allocate bytes for filename in tree structure.
  * Keep the pointers properly aligned by allocating
@@ -173,16 +203,220 @@ void free_tree(TREE_ROOT *root)
       free(rel);
       freed_blocks++;
    }
+   for (uint32_t i = 0; i < root->num_chunks; i++) {
+      free(root->chunks[i]);
+      freed_blocks++;
+      if (root->ext_chunks && root->ext_chunks[i]) {
+         free(root->ext_chunks[i]);
+      }
+   }
+   if (root->chunks) {
+      free(root->chunks);
+   }
+   if (root->ext_chunks) {
+      free(root->ext_chunks);
+   }
+   free(root->child_hash);
+   free(root->names);
    if (root->cached_path) {
       free_pool_memory(root->cached_path);
       root->cached_path = NULL;
    }
-   Dmsg3(100, "Total size=%u blocks=%u freed_blocks=%u\n", root->total_size, root->blocks, freed_blocks);
+   Dmsg3(100, "Total size=%llu blocks=%u freed_blocks=%u\n", root->total_size, root->blocks, freed_blocks);
    free(root);
    garbage_collect_memory();
    return;
 }
 
+/*
+ * Hash of a file name for the interned names table.
+ */
+static inline uint32_t name_hash(const char *fname)
+{
+   uint32_t hash = 2166136261U;
+
+   while (*fname) {
+      hash ^= (uint8_t)*fname++;
+      hash *= 16777619U;
+   }
+
+   return hash;
+}
+
+/*
+ * Hash of a (parent, interned name) pair for the child lookup table.
+ */
+static inline uint32_t child_hash(uint32_t parent, const char *fname)
+{
+   uint64_t key = ((uint64_t)parent << 32) ^ (uint64_t)(intptr_t)fname;
+
+   key ^= key >> 33;
+   key *= 0xff51afd7ed558ccdULL;
+   key ^= key >> 33;
+   key *= 0xc4ceb9fe1a85ec53ULL;
+   key ^= key >> 33;
+
+   return (uint32_t)key;
+}
+
+/*
+ * Store each distinct file name only once, all nodes with the same
+ * name share it. This also allows comparing names by pointer.
+ */
+static char *intern_name(TREE_ROOT *root, const char *fname)
+{
+   uint32_t i, mask;
+   char *name;
+
+   mask = root->names_size - 1;
+   for (i = name_hash(fname) & mask; root->names[i]; i = (i + 1) & mask) {
+      if (bstrcmp(root->names[i], fname)) {
+         return root->names[i];
+      }
+   }
+
+   name = tree_alloc(root, strlen(fname) + 1);
+   strcpy(name, fname);
+   root->names[i] = name;
+   root->names_count++;
+
+   /*
+    * Keep the load factor below 75%.
+    */
+   if (root->names_count * 4 > root->names_size * 3 && root->names_size < 0x80000000) {
+      char **old_names = root->names;
+      uint32_t old_size = root->names_size;
+
+      root->names_size = old_size * 2;
+      root->names = (char **)calloc(root->names_size, sizeof(char *));
+      root->total_size += old_size * sizeof(char *);
+      mask = root->names_size - 1;
+      for (uint32_t j = 0; j < old_size; j++) {
+         if (old_names[j]) {
+            for (i = name_hash(old_names[j]) & mask; root->names[i]; i = (i + 1) & mask);
+            root->names[i] = old_names[j];
+         }
+      }
+      free(old_names);
+   }
+
+   return name;
+}
+
+/*
+ * Lookup the child with the given interned name.
+ */
+static TREE_NODE *lookup_child(TREE_ROOT *root, TREE_NODE *parent, const char *fname)
+{
+   uint32_t i, mask;
+   TREE_NODE *node;
+
+   mask = root->child_hash_size - 1;
+   for (i = child_hash(parent->index, fname) & mask; root->child_hash[i]; i = (i + 1) & mask) {
+      node = tree_node(root, root->child_hash[i]);
+      if (node->parent == parent && node->fname == fname) {
+         return node;
+      }
+   }
+
+   return NULL;
+}
+
+static void child_hash_insert(TREE_ROOT *root, TREE_NODE *node)
+{
+   uint32_t i, mask;
+
+   mask = root->child_hash_size - 1;
+   for (i = child_hash(node->parent->index, node->fname) & mask; root->child_hash[i]; i = (i + 1) & mask);
+   root->child_hash[i] = node->index;
+   root->child_hash_count++;
+
+   /*
+    * Keep the load factor below 75%.
+    */
+   if (root->child_hash_count * 4 > root->child_hash_size * 3 && root->child_hash_size < 0x80000000) {
+      uint32_t *old_hash = root->child_hash;
+      uint32_t old_size = root->child_hash_size;
+      TREE_NODE *n;
+
+      root->child_hash_size = old_size * 2;
+      root->child_hash = (uint32_t *)calloc(root->child_hash_size, sizeof(uint32_t));
+      root->total_size += old_size * sizeof(uint32_t);
+      mask = root->child_hash_size - 1;
+      for (uint32_t j = 0; j < old_size; j++) {
+         if (old_hash[j]) {
+            n = tree_node(root, old_hash[j]);
+            for (i = child_hash(n->parent->index, n->fname) & mask; root->child_hash[i]; i = (i + 1) & mask);
+            root->child_hash[i] = old_hash[j];
+         }
+      }
+      free(old_hash);
+   }
+}
+
+/*
+ * Remove a node from the child lookup table, moving back any entries
+ * that follow it in the probe sequence.
+ */
+static void child_hash_remove(TREE_ROOT *root, TREE_NODE *node)
+{
+   uint32_t i, j, k, mask;
+   TREE_NODE *n;
+
+   mask = root->child_hash_size - 1;
+   for (i = child_hash(node->parent->index, node->fname) & mask; root->child_hash[i]; i = (i + 1) & mask) {
+      if (root->child_hash[i] == node->index) {
+         break;
+      }
+   }
+   if (!root->child_hash[i]) {
+      return;
+   }
+
+   for (j = (i + 1) & mask; root->child_hash[j]; j = (j + 1) & mask) {
+      n = tree_node(root, root->child_hash[j]);
+      k = child_hash(n->parent->index, n->fname) & mask;
+
+      /*
+       * Move the entry when its home slot is not cyclically between i and j.
+       */
+      if ((i <= j) ? (i < k && k <= j) : (i < k || k <= j)) {
+         continue;
+      }
+      root->child_hash[i] = root->child_hash[j];
+      i = j;
+   }
+   root->child_hash[i] = 0;
+   root->child_hash_count--;
+}
+
+void tree_remove_node(TREE_ROOT *root, TREE_NODE *node)
+{
+   uint32_t *link;
+   TREE_NODE *n;
+
+   /*
+    * Unlink the node from the children of its parent.
+    */
+   for (link = &node->parent->first_child; *link; link = &n->next_sibling) {
+      n = tree_node(root, *link);
+      if (n == node) {
+         *link = node->next_sibling;
+         break;
+      }
+   }
+
+   child_hash_remove(root, node);
+   node->removed = true;
+
+   /*
+    * Reuse the index if this is the last allocated node.
+    */
+   if (node->index == root->num_nodes - 1) {
+      root->num_nodes--;
+   }
+}
+
 /*
  * Add Delta part for this node
  */
@@ -198,6 +432,91 @@ void tree_add_delta_part(TREE_ROOT *root, TREE_NODE *node,
    node->delta_list = elt;
 }
 
+/*
+ * Store the extra information of a node, the storage is only allocated
+ * for the chunks of nodes that have it.
+ */
+static void tree_set_ext(TREE_ROOT *root, TREE_NODE *node, uint64_t val0, uint64_t val1)
+{
+   uint32_t chunk = node->index >> TREE_NODE_CHUNK_SHIFT;
+   struct s_tree_ext *ext;
+
+   if (!root->ext_chunks) {
+      if (val0 == 0 && val1 == 0) {
+         return;
+      }
+      root->ext_chunks = (struct s_tree_ext **)calloc(root->num_chunks, sizeof(struct s_tree_ext *));
+   }
+
+   if (!root->ext_chunks[chunk]) {
+      if (val0 == 0 && val1 == 0) {
+         return;
+      }
+      root->ext_chunks[chunk] = (struct s_tree_ext *)calloc(TREE_NODE_CHUNK_SIZE, sizeof(struct s_tree_ext));
+      root->total_size += TREE_NODE_CHUNK_SIZE * sizeof(struct s_tree_ext);
+      root->blocks++;
+   }
+
+   ext = &root->ext_chunks[chunk][node->index & (TREE_NODE_CHUNK_SIZE - 1)];
+   ext->val[0] = val0;
+   ext->val[1] = val1;
+}
+
+static inline struct s_tree_ext *tree_get_ext(TREE_ROOT *root, TREE_NODE *node)
+{
+   uint32_t chunk = node->index >> TREE_NODE_CHUNK_SHIFT;
+
+   if (!root->ext_chunks || node->index == 0 || !root->ext_chunks[chunk]) {
+      return NULL;
+   }
+
+   return &root->ext_chunks[chunk][node->index & (TREE_NODE_CHUNK_SIZE - 1)];
+}
+
+/*
+ * Store the NDMP file history information of a node.
+ */
+void tree_set_fh(TREE_ROOT *root, TREE_NODE *node, uint64_t fhinfo, uint64_t fhnode)
+{
+   tree_set_ext(root, node, fhinfo, fhnode);
+}
+
+uint64_t tree_get_fhinfo(TREE_ROOT *root, TREE_NODE *node)
+{
+   struct s_tree_ext *ext = tree_get_ext(root, node);
+
+   return (ext) ? ext->val[0] : 0;
+}
+
+uint64_t tree_get_fhnode(TREE_ROOT *root, TREE_NODE *node)
+{
+   struct s_tree_ext *ext = tree_get_ext(root, node);
+
+   return (ext) ? ext->val[1] : 0;
+}
+
+/*
+ * Store the catalog PathId and FileId of a node of a lazy tree.
+ */
+void tree_set_dbids(TREE_ROOT *root, TREE_NODE *node, uint64_t PathId, uint64_t FileId)
+{
+   tree_set_ext(root, node, PathId, FileId);
+}
+
+uint64_t tree_get_pathid(TREE_ROOT *root, TREE_NODE *node)
+{
+   struct s_tree_ext *ext = tree_get_ext(root, node);
+
+   return (ext) ? ext->val[0] : 0;
+}
+
+uint64_t tree_get_fileid(TREE_ROOT *root, TREE_NODE *node)
+{
+   struct s_tree_ext *ext = tree_get_ext(root, node);
+
+   return (ext) ? ext->val[1] : 0;
+}
+
 /*
  * Insert a node in the tree. This is the main subroutine called when building a tree.
  */
@@ -310,20 +629,6 @@ TREE_NODE *make_tree_path(char *path, TREE_ROOT *root)
    return node;
 }
 
-static int node_compare(void *item1, void *item2)
-{
-   TREE_NODE *tn1 = (TREE_NODE *)item1;
-   TREE_NODE *tn2 = (TREE_NODE *)item2;
-
-   if (tn1->fname[0] > tn2->fname[0]) {
-      return 1;
-   } else if (tn1->fname[0] < tn2->fname[0]) {
-      return -1;
-   }
-
-   return strcmp(tn1->fname, tn2->fname);
-}
-
 /*
  * See if the fname already exists. If not insert a new node for it.
  */
@@ -331,38 +636,144 @@ static TREE_NODE *search_and_insert_tree_node(char *fname, int type,
                                               TREE_ROOT *root, TREE_NODE *parent)
 {
    TREE_NODE *node, *found_node;
+   char *name;
 
-   node = new_tree_node(root);
-   node->fname = fname;
-   found_node = (TREE_NODE *)parent->child.insert(node, node_compare);
-   if (found_node != node) {          /* already in list */
-      free_tree_node(root);           /* free node allocated above */
+   name = intern_name(root, fname);
+   found_node = lookup_child(root, parent, name);
+   if (found_node) {                  /* already in list */
       found_node->inserted = false;
       return found_node;
    }
 
    /*
-    * It was not found, but is now inserted
+    * It was not found, insert it. The children are kept in insertion
+    * order and only get sorted when they are listed.
     */
-   node->fname_len = strlen(fname);
-   node->fname = tree_alloc(root, node->fname_len + 1);
-   strcpy(node->fname, fname);
+   node = new_tree_node(root);
+   node->fname = name;
    node->parent = parent;
    node->type = type;
+   node->loaded = (root->load_children == NULL);
+   node->next_sibling = parent->first_child;
+   parent->first_child = node->index;
+   parent->sorted = false;
+   child_hash_insert(root, node);
+
+   node->inserted = true;             /* inserted into tree */
+   return node;
+}
+
+/*
+ * Merge two sorted lists of siblings.
+ */
+static uint32_t merge_siblings(TREE_ROOT *root, uint32_t a, uint32_t b)
+{
+   uint32_t head = 0;
+   uint32_t *tail = &head;
+   TREE_NODE *na, *nb;
+
+   while (a && b) {
+      na = tree_node(root, a);
+      nb = tree_node(root, b);
+      if (strcmp(na->fname, nb->fname) <= 0) {
+         *tail = a;
+         tail = &na->next_sibling;
+         a = na->next_sibling;
+      } else {
+         *tail = b;
+         tail = &nb->next_sibling;
+         b = nb->next_sibling;
+      }
+   }
+   *tail = (a) ? a : b;
+
+   return head;
+}
+
+/*
+ * Sort the children of a node by name using a bottom up merge sort.
+ */
+static void sort_children(TREE_ROOT *root, TREE_NODE *node)
+{
+   int i;
+   uint32_t list, cur;
+   uint32_t parts[32];
+   TREE_NODE *n;
+
+   memset(parts, 0, sizeof(parts));
+   list = node->first_child;
+   while (list) {
+      cur = list;
+      n = tree_node(root, cur);
+      list = n->next_sibling;
+      n->next_sibling = 0;
+
+      for (i = 0; i < 31 && parts[i]; i++) {
+         cur = merge_siblings(root, parts[i], cur);
+         parts[i] = 0;
+      }
+      parts[i] = merge_siblings(root, parts[i], cur);
+   }
+
+   cur = 0;
+   for (i = 0; i < 32; i++) {
+      if (parts[i]) {
+         cur = merge_siblings(root, parts[i], cur);
+      }
+   }
 
+   node->first_child = cur;
+   node->sorted = true;
+}
+
+TREE_NODE *tree_first_child(TREE_ROOT *root, TREE_NODE *node)
+{
    /*
-    * Maintain a linear chain of nodes
+    * In a lazy tree the children of a directory are only
+    * inserted the first time somebody looks at them.
     */
-   if (!root->first) {
-      root->first = node;
-      root->last = node;
-   } else {
-      root->last->next = node;
-      root->last = node;
+   if (!node->loaded) {
+      node->loaded = true;
+      if (root->load_children) {
+         root->load_children(root, node, root->load_ctx);
+      }
    }
 
-   node->inserted = true;             /* inserted into tree */
-   return node;
+   if (!node->first_child) {
+      return NULL;
+   }
+
+   if (!node->sorted) {
+      sort_children(root, node);
+   }
+
+   return tree_node(root, node->first_child);
+}
+
+TREE_NODE *tree_next_sibling(TREE_ROOT *root, TREE_NODE *node)
+{
+   if (!node->next_sibling) {
+      return NULL;
+   }
+
+   return tree_node(root, node->next_sibling);
+}
+
+/*
+ * Return the node inserted after the given one.
+ */
+TREE_NODE *tree_next_node(TREE_ROOT *root, TREE_NODE *node)
+{
+   TREE_NODE *next;
+
+   for (uint32_t index = node->index + 1; index < root->num_nodes; index++) {
+      next = tree_node(root, index);
+      if (!next->removed) {
+         return next;
+      }
+   }
+
+   return NULL;
 }
 
 static void tree_getpath_item(TREE_NODE *node, POOLMEM *&path)
@@ -473,7 +884,7 @@ TREE_NODE *tree_relcwd(char *path, TREE_ROOT *root, TREE_NODE *node)
 
    Dmsg2(100, "tree_relcwd: len=%d path=%s\n", len, path);
 
-   foreach_child(cd, node) {
+   foreach_child(cd, root, node) {
       Dmsg1(100, "tree_relcwd: test cd=%s\n", cd->fname);
       if (cd->fname[0] == path[0] && len == (int)strlen(cd->fname)
           && bstrncmp(cd->fname, path, len)) {
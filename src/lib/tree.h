@@ -27,7 +27,7 @@
  * Directory tree build/traverse routines
  */
 
-#include "htable.h"
+#include "ohtable.h"
 
 struct s_mem {
    struct s_mem *next;                /* next buffer */
@@ -36,16 +36,28 @@ struct s_mem {
    char first[1];                     /* first byte */
 };
 
-#define USE_DLIST
+/*
+ * Nodes are allocated in chunks of TREE_NODE_CHUNK_SIZE nodes and are
+ * referenced by their 32 bit index. Index 0 is the root of the tree which
+ * is not stored in a chunk but is the TREE_ROOT itself.
+ */
+#define TREE_NODE_CHUNK_SHIFT 16
+#define TREE_NODE_CHUNK_SIZE (1 << TREE_NODE_CHUNK_SHIFT)
 
-#define foreach_child(var, list) \
-    for((var)=NULL; (*((TREE_NODE **)&(var))=(TREE_NODE*)(list->child.next(var))); )
+#define tree_node(root, idx) \
+        (&(root)->chunks[(idx) >> TREE_NODE_CHUNK_SHIFT][(idx) & (TREE_NODE_CHUNK_SIZE - 1)])
 
-#define tree_node_has_child(node) \
-        ((node)->child.size() > 0)
+/*
+ * Loop var through each child of node, the children are sorted by name.
+ */
+#define foreach_child(var, root, node) \
+    for ((var) = tree_first_child((root), (node)); (var); (var) = tree_next_sibling((root), (var)))
 
-#define first_child(node) \
-        ((TREE_NODE *)(node->child.first())
+/*
+ * A directory of a lazy tree that is not loaded yet may have children.
+ */
+#define tree_node_has_child(node) \
+        ((node)->first_child != 0 || !(node)->loaded)
 
 struct delta_list {
    struct delta_list *next;
@@ -58,60 +70,81 @@ struct delta_list {
  *   there is one for each file.
  */
 struct s_tree_node {
-   /* KEEP sibling as the first member to avoid having to
-    *  do initialization of child */
-   rblink sibling;
-   rblist child;
-   char *fname;                       /* file name */
+   char *fname;                       /* file name, shared by all nodes with this name */
+   struct s_tree_node *parent;
+   struct delta_list *delta_list;     /* delta parts for this node */
    int32_t FileIndex;                 /* file index */
    uint32_t JobId;                    /* JobId */
    int32_t delta_seq;                 /* current delta sequence */
-   uint16_t fname_len;                /* filename length */
+   uint32_t index;                    /* index of this node */
+   uint32_t first_child;              /* index of first child, 0 if none */
+   uint32_t next_sibling;             /* index of next sibling, 0 if none */
    unsigned int type:8;               /* node type */
    unsigned int extract:1;            /* extract item */
    unsigned int extract_dir:1;        /* extract dir entry only */
    unsigned int hard_link:1;          /* set if have hard link */
    unsigned int soft_link:1;          /* set if is soft link */
    unsigned int inserted:1;           /* set when node newly inserted */
-   unsigned int loaded:1;             /* set when the dir is in the tree */
-   struct s_tree_node *parent;
-   struct s_tree_node *next;          /* next hash of FileIndex */
-   struct delta_list *delta_list;     /* delta parts for this node */
-   uint64_t fhinfo;                   /* NDMP Fh_info */
-   uint64_t fhnode;                   /* NDMP Fh_node */
+   unsigned int loaded:1;             /* set when the children are in the tree */
+   unsigned int removed:1;            /* set when node is removed from the tree */
+   unsigned int sorted:1;             /* set when the children are sorted */
 };
 typedef struct s_tree_node TREE_NODE;
 
+/*
+ * Extra node information, only allocated for trees that have it.
+ * This is the NDMP Fh_info and Fh_node for NDMP restores or the
+ * catalog PathId and FileId for lazy trees.
+ */
+struct s_tree_ext {
+   uint64_t val[2];
+};
+
+/*
+ * Called to insert the children of a node of a lazy tree.
+ */
+typedef void (TREE_LOAD_HANDLER)(struct s_tree_root *root, TREE_NODE *node, void *ctx);
+
 struct s_tree_root {
-   /* KEEP sibling as the first member to avoid having to
-    *  do initialization of child */
-   rblink sibling;
-   rblist child;
    const char *fname;                 /* file name */
+   struct s_tree_node *parent;
+   struct delta_list *delta_list;     /* delta parts for this node */
    int32_t FileIndex;                 /* file index */
    uint32_t JobId;                    /* JobId */
    int32_t delta_seq;                 /* current delta sequence */
-   uint16_t fname_len;                /* filename length */
+   uint32_t index;                    /* index of this node */
+   uint32_t first_child;              /* index of first child, 0 if none */
+   uint32_t next_sibling;             /* index of next sibling, 0 if none */
    unsigned int type:8;               /* node type */
    unsigned int extract:1;            /* extract item */
    unsigned int extract_dir:1;        /* extract dir entry only */
-   unsigned int have_link:1;          /* set if have hard link */
+   unsigned int hard_link:1;          /* set if have hard link */
+   unsigned int soft_link:1;          /* set if is soft link */
    unsigned int inserted:1;           /* set when newly inserted */
-   unsigned int loaded:1;             /* set when the dir is in the tree */
-   struct s_tree_node *parent;
-   struct s_tree_node *next;          /* next hash of FileIndex */
-   struct delta_list *delta_list;     /* delta parts for this node */
+   unsigned int loaded:1;             /* set when the children are in the tree */
+   unsigned int removed:1;            /* set when node is removed from the tree */
+   unsigned int sorted:1;             /* set when the children are sorted */
 
    /* The above ^^^ must be identical to a TREE_NODE structure */
-   struct s_tree_node *first;         /* first entry in the tree */
-   struct s_tree_node *last;          /* last entry in tree */
-   struct s_mem *mem;                 /* tree memory */
-   uint32_t total_size;               /* total bytes allocated */
+   TREE_NODE **chunks;                /* node chunks */
+   struct s_tree_ext **ext_chunks;    /* extra info chunks, allocated on first use */
+   uint32_t num_chunks;               /* number of node chunks */
+   uint32_t num_nodes;                /* number of node indexes in use */
+   uint32_t *child_hash;              /* node indexes hashed on parent and name */
+   uint32_t child_hash_size;          /* size of child_hash, a power of 2 */
+   uint32_t child_hash_count;         /* entries in child_hash */
+   char **names;                      /* interned file names */
+   uint32_t names_size;               /* size of names, a power of 2 */
+   uint32_t names_count;              /* entries in names */
+   struct s_mem *mem;                 /* tree memory for names and delta parts */
+   uint64_t total_size;               /* total bytes allocated */
    uint32_t blocks;                   /* total mallocs */
    int cached_path_len;               /* length of cached path */
    char *cached_path;                 /* cached current path */
    TREE_NODE *cached_parent;          /* cached parent for above path */
-   htable hardlinks;                  /* references to first occurence of hardlinks */
+   ohtable hardlinks;                 /* references to first occurence of hardlinks */
+   TREE_LOAD_HANDLER *load_children;  /* loads directories of a lazy tree */
+   void *load_ctx;                    /* context passed to load_children */
 };
 typedef struct s_tree_root TREE_ROOT;
 
@@ -142,11 +175,20 @@ void tree_add_delta_part(TREE_ROOT *root, TREE_NODE *node,
 void free_tree(TREE_ROOT *root);
 POOLMEM *tree_getpath(TREE_NODE *node);
 void tree_remove_node(TREE_ROOT *root, TREE_NODE *node);
+TREE_NODE *tree_first_child(TREE_ROOT *root, TREE_NODE *node);
+TREE_NODE *tree_next_sibling(TREE_ROOT *root, TREE_NODE *node);
+TREE_NODE *tree_next_node(TREE_ROOT *root, TREE_NODE *node);
+void tree_set_fh(TREE_ROOT *root, TREE_NODE *node, uint64_t fhinfo, uint64_t fhnode);
+uint64_t tree_get_fhinfo(TREE_ROOT *root, TREE_NODE *node);
+uint64_t tree_get_fhnode(TREE_ROOT *root, TREE_NODE *node);
+void tree_set_dbids(TREE_ROOT *root, TREE_NODE *node, uint64_t PathId, uint64_t FileId);
+uint64_t tree_get_pathid(TREE_ROOT *root, TREE_NODE *node);
+uint64_t tree_get_fileid(TREE_ROOT *root, TREE_NODE *node);
 
 /**
  * Use the following for traversing the whole tree. It will be
  *   traversed in the order the entries were inserted into the
  *   tree.
  */
-#define first_tree_node(r) (r)->first
-#define next_tree_node(n)  (n)->next
+#define first_tree_node(r) tree_next_node((r), (TREE_NODE *)(r))
+#define next_tree_node(r, n) tree_next_node((r), (n))
@@ -0,0 +1,219 @@
+/*
+   BAREOS® - Backup Archiving REcovery Open Sourced
+
+   Copyright (C) 2016-2016 Bareos GmbH & Co. KG
+
+   This program is Free Software; you can redistribute it and/or
+   modify it under the terms of version three of the GNU Affero General Public
+   License as published by the Free Software Foundation and included
+   in the file LICENSE.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+   Affero General Public License for more details.
+
+   You should have received a copy of the GNU Affero General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+   02110-1301, USA.
+*/
+/*
+ * Microbenchmark comparing the chained htable with the open addressing
+ * ohtable using the same kind of keys as the accurate file list (path
+ * names) and the restore tree hardlink table (64 bits integers).
+ *
+ * Usage: htable_bench [-n items] [-s]
+ */
+#include "bareos.h"
+
+#define DEFAULT_NITEMS 1000000
+#define MAX_KEY_LENGTH 256
+
+struct BENCHITEM {
+   char *key;
+   uint64_t id;
+   hlink link;
+};
+
+static double elapsed(btime_t start)
+{
+   return (double)(get_current_btime() - start) / 1000000.0;
+}
+
+static void report(const char *engine, const char *what, int nitems, btime_t start)
+{
+   double secs = elapsed(start);
+
+   printf("%-8s %-16s %10d items %8.3f sec %8.1f ns/op\n", engine, what,
+          nitems, secs, secs * 1000000000.0 / nitems);
+}
+
+/*
+ * Shuffle the lookup order so we don't simply walk the items
+ * in the same order as they were allocated.
+ */
+static void shuffle(int *order, int nitems)
+{
+   for (int i = nitems - 1; i > 0; i--) {
+      int j = random() % (i + 1);
+      int tmp = order[i];
+
+      order[i] = order[j];
+      order[j] = tmp;
+   }
+}
+
+template <class T>
+static void bench_char_keys(const char *engine, int nitems, int *order, bool print_stats)
+{
+   T *tbl;
+   char key[MAX_KEY_LENGTH];
+   BENCHITEM *item = NULL;
+   BENCHITEM **items;
+   btime_t start;
+   int found = 0;
+
+   items = (BENCHITEM **)malloc(nitems * sizeof(BENCHITEM *));
+   tbl = (T *)malloc(sizeof(T));
+   tbl->init(item, &item->link, nitems);
+
+   start = get_current_btime();
+   for (int i = 0; i < nitems; i++) {
+      int len;
+
+      len = bsnprintf(key, sizeof(key), "/export/home/user%d/project/dir%d/file%d.dat",
+                      i % 997, i % 10007, i) + 1;
+      item = (BENCHITEM *)tbl->hash_malloc(sizeof(BENCHITEM));
+      item->key = (char *)tbl->hash_malloc(len);
+      memcpy(item->key, key, len);
+      items[i] = item;
+      tbl->insert(item->key, item);
+   }
+   report(engine, "insert char", nitems, start);
+
+   start = get_current_btime();
+   for (int i = 0; i < nitems; i++) {
+      if (tbl->lookup(items[order[i]]->key)) {
+         found++;
+      }
+   }
+   report(engine, "lookup char hit", nitems, start);
+
+   start = get_current_btime();
+   for (int i = 0; i < nitems; i++) {
+      bsnprintf(key, sizeof(key), "/export/home/user%d/project/dir%d/missing%d.dat",
+                i % 997, i % 10007, i);
+      if (tbl->lookup(key)) {
+         found++;
+      }
+   }
+   report(engine, "lookup char miss", nitems, start);
+
+   start = get_current_btime();
+   foreach_htable(item, tbl) {
+      found--;
+   }
+   report(engine, "walk", nitems, start);
+
+   if (found != 0) {
+      printf("%s: found %d items too many\n", engine, found);
+   }
+
+   if (print_stats) {
+      tbl->stats();
+   }
+
+   tbl->destroy();
+   free(tbl);
+   free(items);
+}
+
+template <class T>
+static void bench_uint64_keys(const char *engine, int nitems, int *order)
+{
+   T *tbl;
+   BENCHITEM *item = NULL;
+   btime_t start;
+   int found = 0;
+
+   tbl = (T *)malloc(sizeof(T));
+   tbl->init(item, &item->link, 0, 1);
+
+   /*
+    * Hardlink keys are built from JobId and FileIndex.
+    */
+   start = get_current_btime();
+   for (int i = 0; i < nitems; i++) {
+      item = (BENCHITEM *)tbl->hash_malloc(sizeof(BENCHITEM));
+      item->id = (((uint64_t)(i % 16) + 1) << 32) | (uint64_t)i;
+      tbl->insert(item->id, item);
+   }
+   report(engine, "insert uint64", nitems, start);
+
+   start = get_current_btime();
+   for (int i = 0; i < nitems; i++) {
+      int j = order[i];
+
+      if (tbl->lookup((((uint64_t)(j % 16) + 1) << 32) | (uint64_t)j)) {
+         found++;
+      }
+   }
+   report(engine, "lookup uint64", nitems, start);
+
+   if (found != nitems) {
+      printf("%s: found %d of %d items\n", engine, found, nitems);
+   }
+
+   tbl->destroy();
+   free(tbl);
+}
+
+static void usage()
+{
+   fprintf(stderr, "Usage: htable_bench [-n items] [-s]\n"
+                   "       -n <items>  number of items to insert (default %d)\n"
+                   "       -s          print table statistics\n", DEFAULT_NITEMS);
+   exit(1);
+}
+
+int main(int argc, char *argv[])
+{
+   int ch;
+   int *order;
+   int nitems = DEFAULT_NITEMS;
+   bool print_stats = false;
+
+   while ((ch = getopt(argc, argv, "n:s?")) != -1) {
+      switch (ch) {
+      case 'n':
+         nitems = str_to_int64(optarg);
+         break;
+      case 's':
+         print_stats = true;
+         break;
+      case '?':
+      default:
+         usage();
+      }
+   }
+
+   if (nitems <= 0) {
+      usage();
+   }
+
+   order = (int *)malloc(nitems * sizeof(int));
+   for (int i = 0; i < nitems; i++) {
+      order[i] = i;
+   }
+   srandom(1);
+   shuffle(order, nitems);
+
+   bench_char_keys<htable>("htable", nitems, order, print_stats);
+   bench_char_keys<ohtable>("ohtable", nitems, order, print_stats);
+   bench_uint64_keys<htable>("htable", nitems, order);
+   bench_uint64_keys<ohtable>("ohtable", nitems, order);
+
+   free(order);
+   return 0;
+}
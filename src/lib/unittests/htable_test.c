@@ -101,6 +101,132 @@ void test_htable(void **state) {
 
 }
 
+#define REMOVE_NITEMS 1000
+
+struct REMOVEITEM {
+   hlink link;
+   char key[30];
+};
+
+void test_htable_remove(void **state) {
+   (void) state;
+
+   char mkey[30];
+   htable *tbl;
+   REMOVEITEM *item = NULL;
+   int count = 0;
+
+   tbl = New(htable(item, &item->link, 31));
+   for (int i = 0; i < REMOVE_NITEMS; i++) {
+      item = (REMOVEITEM *)malloc(sizeof(REMOVEITEM));
+      sprintf(item->key, "%d", i);
+      assert_true(tbl->insert(item->key, item));
+   }
+
+   /*
+    * Remove the even keys, the odd ones must stay reachable.
+    */
+   for (int i = 0; i < REMOVE_NITEMS; i += 2) {
+      sprintf(mkey, "%d", i);
+      assert_non_null(item = (REMOVEITEM *)tbl->remove(mkey));
+      assert_string_equal(item->key, mkey);
+      free(item);
+   }
+   assert_null(tbl->remove((char *)"0"));
+   assert_int_equal(tbl->size(), REMOVE_NITEMS / 2);
+
+   for (int i = 0; i < REMOVE_NITEMS; i++) {
+      sprintf(mkey, "%d", i);
+      if (i % 2) {
+         assert_non_null(tbl->lookup(mkey));
+      } else {
+         assert_null(tbl->lookup(mkey));
+      }
+   }
+
+   foreach_htable (item, tbl) {
+      count++;
+   }
+   assert_int_equal(count, REMOVE_NITEMS / 2);
+
+   for (int i = 1; i < REMOVE_NITEMS; i += 2) {
+      sprintf(mkey, "%d", i);
+      free(tbl->remove(mkey));
+   }
+   assert_int_equal(tbl->size(), 0);
+   delete tbl;
+
+   sm_dump(false);   /* unit test */
+}
+
+#define OHTABLE_NITEMS 500000
+
+struct OHTABLEITEM {
+   char *key;
+   uint64_t id;
+   hlink link;
+   hlink id_link;
+};
+
+void test_ohtable(void **state) {
+   (void) state;
+
+   char mkey[30];
+   ohtable *strtbl, *idtbl;
+   OHTABLEITEM *item = NULL;
+   int count = 0;
+
+   strtbl = (ohtable *)malloc(sizeof(ohtable));
+   idtbl = (ohtable *)malloc(sizeof(ohtable));
+
+   /*
+    * Start with small tables so growing gets exercised.
+    */
+   strtbl->init(item, &item->link, 31);
+   idtbl->init(item, &item->id_link, 31);
+   for (int i = 0; i < OHTABLE_NITEMS; i++) {
+      int len;
+      len = sprintf(mkey, "%d", i) + 1;
+
+      item = (OHTABLEITEM *)strtbl->hash_malloc(sizeof(OHTABLEITEM));
+      item->key = (char *)strtbl->hash_malloc(len);
+      memcpy(item->key, mkey, len);
+      item->id = (uint64_t)i << 32;
+
+      assert_true(strtbl->insert(item->key, item));
+      assert_true(idtbl->insert(item->id, item));
+   }
+   assert_int_equal(strtbl->size(), OHTABLE_NITEMS);
+   assert_int_equal(idtbl->size(), OHTABLE_NITEMS);
+
+   /*
+    * Duplicates are refused.
+    */
+   assert_false(strtbl->insert(item->key, item));
+   assert_false(idtbl->insert(item->id, item));
+
+   for (int i = 0; i < OHTABLE_NITEMS; i++) {
+      sprintf(mkey, "%d", i);
+      assert_non_null(item = (OHTABLEITEM *)strtbl->lookup(mkey));
+      assert_string_equal(item->key, mkey);
+      assert_ptr_equal(idtbl->lookup((uint64_t)i << 32), item);
+   }
+   assert_null(strtbl->lookup((char *)"not there"));
+   assert_null(idtbl->lookup((uint64_t)1));
+
+   foreach_htable (item, strtbl) {
+      count++;
+   }
+   assert_int_equal(count, OHTABLE_NITEMS);
+
+   idtbl->destroy();
+   free(idtbl);
+   strtbl->destroy();
+   free(strtbl);
+
+   sm_dump(false);   /* unit test */
+}
+
 struct RBLISTJCR {
    char *buf;
 };
@@ -0,0 +1,111 @@
+/*
+   BAREOS® - Backup Archiving REcovery Open Sourced
+
+   Copyright (C) 2016-2016 Bareos GmbH & Co. KG
+
+   This program is Free Software; you can redistribute it and/or
+   modify it under the terms of version three of the GNU Affero General Public
+   License as published by the Free Software Foundation and included
+   in the file LICENSE.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+   Affero General Public License for more details.
+
+   You should have received a copy of the GNU Affero General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+   02110-1301, USA.
+*/
+/*
+ * Test the lookup of JCRs by JobId and the job count.
+ */
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+
+extern "C" {
+#include <cmocka.h>
+}
+
+#include "bareos.h"
+#include "jcr.h"
+#include "protos.h"
+
+static JCR *new_test_jcr(uint32_t JobId)
+{
+   JCR *jcr;
+
+   jcr = new_jcr(sizeof(JCR), NULL);
+   jcr->JobId = JobId;
+   register_jcr_jobid(jcr);
+
+   return jcr;
+}
+
+/*
+ * Look up a JCR without keeping a reference.
+ */
+static JCR *lookup_jcr(uint32_t JobId)
+{
+   JCR *jcr;
+
+   jcr = get_jcr_by_id(JobId);
+   if (jcr) {
+      free_jcr(jcr);
+   }
+
+   return jcr;
+}
+
+void test_jcr_registry(void **state)
+{
+   (void) state;
+
+   int count;
+   JCR *jcr1, *jcr2, *other, *control;
+
+   count = job_count();
+
+   /*
+    * A JCR without a JobId is not a job.
+    */
+   control = new_jcr(sizeof(JCR), NULL);
+   register_jcr_jobid(control);
+   assert_int_equal(job_count(), count);
+
+   jcr1 = new_test_jcr(4711);
+   other = new_test_jcr(4711 + 256);  /* same registry shard */
+   assert_int_equal(job_count(), count + 2);
+   assert_ptr_equal(lookup_jcr(4711), jcr1);
+   assert_ptr_equal(lookup_jcr(4711 + 256), other);
+
+   /*
+    * A second JCR with the same JobId neither replaces nor shadows
+    * the first one, and both are counted.
+    */
+   jcr2 = new_test_jcr(4711);
+   assert_int_equal(job_count(), count + 3);
+   assert_ptr_equal(lookup_jcr(4711), jcr1);
+   assert_ptr_equal(lookup_jcr(4711 + 256), other);
+
+   free_jcr(jcr1);
+   assert_int_equal(job_count(), count + 2);
+   assert_ptr_equal(lookup_jcr(4711), jcr2);
+
+   /*
+    * A JCR that gets another JobId is moved.
+    */
+   jcr2->JobId = 4712;
+   register_jcr_jobid(jcr2);
+   assert_int_equal(job_count(), count + 2);
+   assert_null(lookup_jcr(4711));
+   assert_ptr_equal(lookup_jcr(4712), jcr2);
+
+   free_jcr(jcr2);
+   free_jcr(other);
+   free_jcr(control);
+   assert_int_equal(job_count(), count);
+   assert_null(lookup_jcr(4712));
+}
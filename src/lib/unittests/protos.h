@@ -22,6 +22,8 @@
 void test_alist(void **state);
 void test_dlist(void **state);
 void test_htable(void **state);
+void test_ohtable(void **state);
+void test_htable_remove(void **state);
 void test_rblist(void **state);
 void test_edit(void **state);
 void test_generate_crypto_passphrase(void **state);
@@ -31,6 +33,8 @@ void test_scan(void **state);
 void test_base64(void **state);
 void test_rwlock(void **state);
 void test_devlock(void **state);
+void test_tree(void **state);
+void test_jcr_registry(void **state);
 #ifdef HAVE_WIN32
 void test_junction(void **state);
 #endif
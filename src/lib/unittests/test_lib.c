@@ -49,6 +49,10 @@ int main(void) {
       cmocka_unit_test(test_dlist),
       cmocka_unit_test(test_bsnprintf),
       cmocka_unit_test(test_alist),
+      cmocka_unit_test(test_ohtable),
+      cmocka_unit_test(test_htable_remove),
+      cmocka_unit_test(test_tree),
+      cmocka_unit_test(test_jcr_registry),
 //      cmocka_unit_test(test_base64),
 //      cmocka_unit_test(test_htable),
 //      cmocka_unit_test(test_generate_crypto_passphrase),
@@ -56,7 +60,6 @@ int main(void) {
 //      cmocka_unit_test(test_guid_to_name),
 //      cmocka_unit_test(test_ini),
 //      cmocka_unit_test(test_rblist),  // stops in malloc()
-//      cmocka_unit_test(test_tree),
    };
    return cmocka_run_group_tests(tests, NULL, NULL);
 }
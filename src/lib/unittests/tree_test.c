@@ -26,164 +26,197 @@
  *
  * Philipp Storz, April 2015
  */
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+
+extern "C" {
+#include <cmocka.h>
+}
+
 #include "bareos.h"
+#include "../lib/protos.h"
+#include "protos.h"
 
-#define B_PAGE_SIZE 4096
-#define MAX_PAGES 2400
-void FillDirectoryTree(char *path, TREE_ROOT *root, TREE_NODE *parent);
-static uint32_t FileIndex = 0;
+#define NUM_DIRS 4
+#define NUM_FILES 3000                /* more than new_tree() sizes the hash for */
 
 /*
- * Simple test program for tree routines
+ * Insert a file, or look it up when it is already in the tree.
  */
-int main(int argc, char *argv[])
+static TREE_NODE *insert_file(TREE_ROOT *root, const char *dir, int i)
 {
-    TREE_ROOT *root;
-    TREE_NODE *node;
-    char buf[MAXPATHLEN];
-
-    root = new_tree();
-    root->fname = tree_alloc(root, 1);
-    *root->fname = 0;
-    root->fname_len = 0;
-
-    FillDirectoryTree("/home/user/bareos", root, NULL);
-
-    for (node = first_tree_node(root); node; node=next_tree_node(node)) {
-       tree_getpath(node, buf, sizeof(buf));
-       Dmsg2(100, "%d: %s\n", node->FileIndex, buf);
-    }
-
-    node = (TREE_NODE *)root;
-    Pmsg0(000, "doing cd /home/user/bareos/techlogs\n");
-    node = tree_cwd("/home/user/bareos/techlogs", root, node);
-    if (node) {
-       tree_getpath(node, buf, sizeof(buf));
-       Dmsg2(100, "findex=%d: cwd=%s\n", node->FileIndex, buf);
-    }
-
-    Pmsg0(000, "doing cd /home/user/bareos/src/testprogs\n");
-    node = tree_cwd("/home/user/bareos/src/testprogs", root, node);
-    if (node) {
-       tree_getpath(node, buf, sizeof(buf));
-       Dmsg2(100, "findex=%d: cwd=%s\n", node->FileIndex, buf);
-    } else {
-       Dmsg0(100, "testprogs not found.\n");
-    }
-
-    free_tree((TREE_NODE *)root);
-
-    return 0;
+   char path[100], fname[100];
+   TREE_NODE *node;
+
+   bstrncpy(path, dir, sizeof(path));
+   bsnprintf(fname, sizeof(fname), "file%05d", i);
+
+   /*
+    * Like the callers in the director, set the type ourselves.
+    */
+   node = insert_tree_node(path, fname, TN_FILE, root, NULL);
+   node->type = TN_FILE;
+
+   return node;
 }
 
-void FillDirectoryTree(char *path, TREE_ROOT *root, TREE_NODE *parent)
+static void check_path(TREE_NODE *node, const char *expected)
 {
-   TREE_NODE *newparent = NULL;
-   TREE_NODE *node;
-   struct stat statbuf;
-   DIR *dp;
-   struct dirent *dir;
-   char pathbuf[MAXPATHLEN];
-   char file[MAXPATHLEN];
-   int type;
-   int i;
+   POOLMEM *path;
 
-   Dmsg1(100, "FillDirectoryTree: %s\n", path);
+   path = tree_getpath(node);
+   assert_string_equal(path, expected);
+   free_pool_memory(path);
+}
 
-   dp = opendir(path);
-   if (!dp) {
-      return;
+/*
+ * Check the children of a directory are listed sorted by name
+ * and return how many there are.
+ */
+static int check_children(TREE_ROOT *root, TREE_NODE *dir)
+{
+   int count = 0;
+   TREE_NODE *node, *prev = NULL;
+
+   foreach_child(node, root, dir) {
+      assert_ptr_equal(node->parent, dir);
+      assert_false(node->removed);
+      if (prev) {
+         assert_true(strcmp(prev->fname, node->fname) < 0);
+      }
+      prev = node;
+      count++;
    }
 
-   while ((dir = readdir(dp))) {
-      if (strcmp(dir->d_name, ".") == 0 || strcmp(dir->d_name, "..") == 0) {
-         continue;
-      }
-      bstrncpy(file, dir->d_name, sizeof(file));
-      snprintf(pathbuf, MAXPATHLEN-1, "%s/%s", path, file);
-      if (lstat(pathbuf, &statbuf) < 0) {
-         berrno be;
-         printf("lstat() failed. ERR=%s\n", be.bstrerror(errno));
-         continue;
-      }
-//      printf("got file=%s, pathbuf=%s\n", file, pathbuf);
-      type = TN_FILE;
-      if (S_ISLNK(statbuf.st_mode))
-         type =  TN_FILE;  /* link */
-      else if (S_ISREG(statbuf.st_mode))
-         type = TN_FILE;
-      else if (S_ISDIR(statbuf.st_mode)) {
-         type = TN_DIR;
-      } else if (S_ISCHR(statbuf.st_mode))
-         type = TN_FILE; /* char dev */
-      else if (S_ISBLK(statbuf.st_mode))
-         type = TN_FILE; /* block dev */
-      else if (S_ISFIFO(statbuf.st_mode))
-         type = TN_FILE; /* fifo */
-      else if (S_ISSOCK(statbuf.st_mode))
-         type = TN_FILE; /* sock */
-      else {
-         type = TN_FILE;
-         printf("Unknown file type: 0x%x\n", statbuf.st_mode);
-      }
+   return count;
+}
 
-      Dmsg2(100, "Doing: %d %s\n", type, pathbuf);
-      node = new_tree_node(root);
-      node->FileIndex = ++FileIndex;
-      parent = insert_tree_node(pathbuf, node, root, parent);
+/*
+ * Walk the tree in insertion order and return the number of nodes.
+ */
+static int count_nodes(TREE_ROOT *root)
+{
+   int count = 0;
+   uint32_t index = 0;
+   TREE_NODE *node;
 
-      if (S_ISDIR(statbuf.st_mode) && !S_ISLNK(statbuf.st_mode)) {
-         Dmsg2(100, "calling fill. pathbuf=%s, file=%s\n", pathbuf, file);
-         FillDirectoryTree(pathbuf, root, node);
-      }
+   for (node = first_tree_node(root); node; node = next_tree_node(root, node)) {
+      assert_true(node->index > index);
+      assert_false(node->removed);
+      index = node->index;
+      count++;
    }
-   closedir(dp);
-}
 
-#ifndef MAXPATHLEN
-#define MAXPATHLEN 2000
-#endif
+   return count;
+}
 
-void print_tree(char *path, TREE_NODE *tree)
+void test_tree(void **state)
 {
-   char buf[MAXPATHLEN];
-   char *termchr;
+   (void) state;
 
-   if (!tree) {
-      return;
+   int i;
+   char dirs[NUM_DIRS][100];
+   char path[100];
+   uint32_t index;
+   TREE_ROOT *root;
+   TREE_NODE *node, *dir, *subdir, *first[NUM_FILES];
+
+   root = new_tree(0);
+
+   /*
+    * Insert the files in a scrambled order so they need sorting.
+    */
+   for (int d = 0; d < NUM_DIRS; d++) {
+      bsnprintf(dirs[d], sizeof(dirs[d]), "/home/user/dir%d/", d);
+      for (int j = 0; j < NUM_FILES; j++) {
+         i = (j * 7919) % NUM_FILES;
+         node = insert_file(root, dirs[d], i);
+         assert_non_null(node);
+         assert_true(node->inserted);
+         if (d == 0) {
+            first[i] = node;
+         } else {
+            /*
+             * Nodes with the same name share the interned name.
+             */
+            assert_ptr_equal(node->fname, first[i]->fname);
+            assert_ptr_not_equal(node, first[i]);
+         }
+      }
    }
-
-   switch (tree->type) {
-   case TN_DIR_NLS:
-   case TN_DIR:
-   case TN_NEWDIR:
-      termchr = "/";
-      break;
-   case TN_ROOT:
-   case TN_FILE:
-   default:
-      termchr = "";
-      break;
+   assert_int_equal(count_nodes(root), 2 + NUM_DIRS + NUM_DIRS * NUM_FILES);
+
+   /*
+    * Looking up existing files returns the same node.
+    */
+   for (i = 0; i < NUM_FILES; i++) {
+      node = insert_file(root, dirs[0], i);
+      assert_ptr_equal(node, first[i]);
+      assert_false(node->inserted);
    }
 
-   Pmsg3(-1, "%s/%s%s\n", path, tree->fname, termchr);
-
-   switch (tree->type) {
-   case TN_FILE:
-   case TN_NEWDIR:
-   case TN_DIR:
-   case TN_DIR_NLS:
-      bsnprintf(buf, sizeof(buf), "%s/%s", path, tree->fname);
-      print_tree(buf, first_child(tree));
-      break;
-   case TN_ROOT:
-      print_tree(path, first_child(tree));
-      break;
-   default:
-      Pmsg1(000, "Unknown node type %d\n", tree->type);
+   bstrncpy(path, "/home/user/dir2", sizeof(path));
+   dir = tree_cwd(path, root, (TREE_NODE *)root);
+   assert_non_null(dir);
+   check_path(dir, "/home/user/dir2/");
+   check_path(first[42], "/home/user/dir0/file00042");
+   bstrncpy(path, "nothere", sizeof(path));
+   assert_null(tree_cwd(path, root, dir));
+
+   bstrncpy(path, "/home/user", sizeof(path));
+   node = tree_cwd(path, root, (TREE_NODE *)root);
+   assert_int_equal(check_children(root, node), NUM_DIRS);
+   assert_int_equal(check_children(root, dir), NUM_FILES);
+
+   /*
+    * Remove every second file of one directory, the others must
+    * still be found through the hashed children.
+    */
+   bstrncpy(path, "/home/user/dir1", sizeof(path));
+   dir = tree_cwd(path, root, (TREE_NODE *)root);
+   assert_non_null(dir);
+   foreach_child(node, root, dir) {
+      if (node->index % 2 == 0) {
+         tree_remove_node(root, node);
+      }
+   }
+   i = check_children(root, dir);
+   assert_int_equal(i, NUM_FILES / 2);
+   assert_int_equal(count_nodes(root), 2 + NUM_DIRS + NUM_DIRS * NUM_FILES - NUM_FILES / 2);
+
+   for (int j = 0; j < NUM_FILES; j++) {
+      node = insert_file(root, dirs[1], j);
+      if (node->inserted) {
+         i++;
+      }
+      assert_ptr_equal(node->parent, dir);
+   }
+   assert_int_equal(i, NUM_FILES);
+
+   /*
+    * The files inserted again are listed in order with the others.
+    */
+   assert_int_equal(check_children(root, dir), NUM_FILES);
+   for (i = 0; i < NUM_FILES; i++) {
+      node = insert_file(root, dirs[3], i);
+      assert_false(node->inserted);
    }
 
-   print_tree(path, tree->sibling_);
-
-   return;
+   /*
+    * The index of the last node gets reused.
+    */
+   node = insert_file(root, "/tmp/", 1);
+   subdir = node->parent;
+   index = node->index;
+   tree_remove_node(root, node);
+   assert_null(tree_first_child(root, subdir));
+   node = insert_file(root, "/tmp/", 2);
+   assert_true(node->inserted);
+   assert_int_equal(node->index, index);
+   check_path(node, "/tmp/file00002");
+
+   free_tree(root);
+
+   sm_dump(false);   /* unit test */
 }
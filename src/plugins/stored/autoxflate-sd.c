@@ -37,6 +37,10 @@
 #include <fastlzlib.h>
 #endif
 
+#if defined(HAVE_ZSTD)
+#include <zstd.h>
+#endif
+
 #define PLUGIN_LICENSE      "Bareos AGPLv3"
 #define PLUGIN_AUTHOR       "Marco van Wieringen"
 #define PLUGIN_DATE         "June 2013"
@@ -56,6 +60,7 @@
 #define COMPRESSOR_NAME_FZLZ (char *)"FASTLZ"
 #define COMPRESSOR_NAME_FZ4L (char *)"LZ4"
 #define COMPRESSOR_NAME_FZ4H (char *)"LZ4HC"
+#define COMPRESSOR_NAME_ZSTD (char *)"ZSTD"
 #define COMPRESSOR_NAME_UNSET (char *)"unknown"
 
 /**
@@ -514,7 +519,7 @@ static bool setup_auto_deflation(bpContext *ctx, DCR *dcr)
     * See if we need to create a new compression buffer or make sure the existing is big enough.
     */
    if (!jcr->compress.deflate_buffer) {
-      jcr->compress.deflate_buffer = get_memory(compress_buf_size);
+      jcr->compress.deflate_buffer = get_large_memory(compress_buf_size);
       jcr->compress.deflate_buffer_size = compress_buf_size;
    } else {
       if (compress_buf_size > jcr->compress.deflate_buffer_size) {
@@ -570,6 +575,22 @@ static bool setup_auto_deflation(bpContext *ctx, DCR *dcr)
       }
       break;
    }
+#endif
+#if defined(HAVE_ZSTD)
+   case COMPRESS_ZSTD: {
+      compressorname = COMPRESSOR_NAME_ZSTD;
+      size_t zstat;
+
+      zstat = ZSTD_CCtx_setParameter((ZSTD_CCtx *)jcr->compress.workset.pZSTD,
+                                     ZSTD_c_compressionLevel, dcr->device->autodeflate_level);
+      if (ZSTD_isError(zstat)) {
+         Jmsg(ctx, M_FATAL, _("autoxflate-sd: Compression ZSTD_CCtx_setParameter error: %s\n"),
+              ZSTD_getErrorName(zstat));
+         jcr->setJobStatus(JS_ErrorTerminated);
+         goto bail_out;
+      }
+      break;
+   }
 #endif
    default:
       break;
@@ -600,7 +621,7 @@ static bool setup_auto_inflation(bpContext *ctx, DCR *dcr)
        * See if we need to create a new compression buffer or make sure the existing is big enough.
        */
       if (!jcr->compress.inflate_buffer) {
-         jcr->compress.inflate_buffer = get_memory(decompress_buf_size);
+         jcr->compress.inflate_buffer = get_large_memory(decompress_buf_size);
          jcr->compress.inflate_buffer_size = decompress_buf_size;
       } else {
          if (decompress_buf_size > jcr->compress.inflate_buffer_size) {
@@ -126,6 +126,16 @@ bool do_append_data(JCR *jcr, BSOCK *bs, const char *what)
       ok = false;
    }
 
+   /*
+    * Coalesce the attributes we send to the director.
+    */
+   jcr->dir_bsock->set_coalescing();
+
+   /*
+    * Read the striped packets from the data streams of the FD, if any.
+    */
+   bs->set_striping();
+
    /*
     * Get Data from daemon, write to device.  To clarify what is
     * going on here.  We expect:
@@ -250,6 +260,9 @@ fi_checked:
       }
    }
 
+   bs->clear_striping();
+   jcr->dir_bsock->clear_coalescing();
+
    /*
     * Create Job status for end of session label
     */
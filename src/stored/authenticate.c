@@ -181,6 +181,29 @@ bool authenticate_filedaemon(JCR *jcr)
    return true;
 }
 
+/**
+ * Authenticate an additional data connection of a File daemon.
+ *
+ * This is used for FD backups that stripe their data over multiple connections.
+ */
+bool authenticate_filedaemon_data_stream(JCR *jcr, BSOCK *fd)
+{
+   s_password password;
+
+   password.encoding = p_encoding_md5;
+   password.value = jcr->data_streams_key;
+
+   if (!fd->authenticate_inbound_connection(jcr, "File daemon",
+                                            "", password, me->tls)) {
+      Jmsg1(jcr, M_FATAL, 0,
+            _("Authorization problem: Two way security handshake failed with File daemon data stream at %s\n"),
+            fd->who());
+      return false;
+   }
+
+   return true;
+}
+
 /**
  * Authenticate with a remote file daemon.
  *
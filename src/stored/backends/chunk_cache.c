@@ -0,0 +1,455 @@
+/*
+   BAREOS® - Backup Archiving REcovery Open Sourced
+
+   Copyright (C) 2016-2016 Bareos GmbH & Co. KG
+
+   This program is Free Software; you can redistribute it and/or
+   modify it under the terms of version three of the GNU Affero General Public
+   License as published by the Free Software Foundation and included
+   in the file LICENSE.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU Affero General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+   02110-1301, USA.
+*/
+/*
+ * Local disk cache for chunks of chunked volumes.
+ *
+ * Chunks are stored as <directory>/<volumename>/<chunknumber> and are
+ * kept on a LRU list. When storing a new chunk would exceed the configured
+ * size of the cache the least recently used chunks are removed. The cache
+ * is best effort, any error accessing it is treated as a cache miss.
+ *
+ * All devices configured with the same cache directory share one cache
+ * so they use a single index and size budget.
+ */
+
+#include "bareos.h"
+
+#if defined(HAVE_OBJECTSTORE)
+#include "stored.h"
+#include "chunked_device.h"
+#include "chunk_cache.h"
+
+static dlist *caches = NULL;
+static pthread_mutex_t caches_lock = PTHREAD_MUTEX_INITIALIZER;
+
+chunk_cache::chunk_cache(const char *directory, uint64_t max_size)
+{
+   chunk_cache_entry *entry = NULL;
+   chunk_cache_volume *volume = NULL;
+
+   m_directory = bstrdup(directory);
+   m_max_size = (max_size) ? max_size : DEFAULT_CHUNK_CACHE_SIZE;
+   m_lru = New(dlist(entry, &entry->link));
+   m_volumes = New(dlist(volume, &volume->link));
+   memset(&m_stats, 0, sizeof(m_stats));
+   pthread_mutex_init(&m_lock, NULL);
+
+   scan_directory();
+}
+
+chunk_cache::~chunk_cache()
+{
+   chunk_cache_entry *entry;
+   chunk_cache_volume *volume;
+
+   while ((entry = (chunk_cache_entry *)m_lru->first())) {
+      remove_entry(entry, false);
+   }
+   delete m_lru;
+
+   while ((volume = (chunk_cache_volume *)m_volumes->first())) {
+      m_volumes->remove(volume);
+      free(volume->chunks);
+      free(volume->volname);
+      free(volume);
+   }
+   delete m_volumes;
+
+   free(m_directory);
+   pthread_mutex_destroy(&m_lock);
+}
+
+/*
+ * Get the cache of a directory, creating it for its first user. When the
+ * devices sharing a directory are configured with different sizes the
+ * smallest one is used.
+ */
+chunk_cache *chunk_cache::attach(const char *directory, uint64_t max_size)
+{
+   chunk_cache *cache = NULL;
+
+   if (!max_size) {
+      max_size = DEFAULT_CHUNK_CACHE_SIZE;
+   }
+
+   P(caches_lock);
+   if (!caches) {
+      caches = New(dlist(cache, &cache->m_link));
+   }
+
+   foreach_dlist(cache, caches) {
+      if (bstrcmp(cache->m_directory, directory)) {
+         break;
+      }
+   }
+
+   if (cache) {
+      P(cache->m_lock);
+      if (max_size < cache->m_max_size) {
+         cache->m_max_size = max_size;
+         cache->make_room(0);
+      }
+      V(cache->m_lock);
+   } else {
+      cache = New(chunk_cache(directory, max_size));
+      caches->append(cache);
+   }
+   cache->m_use_count++;
+   V(caches_lock);
+
+   return cache;
+}
+
+/*
+ * Release a cache, the last user frees it.
+ */
+void chunk_cache::detach(chunk_cache *cache)
+{
+   P(caches_lock);
+   if (--cache->m_use_count == 0) {
+      caches->remove(cache);
+      delete cache;
+      if (caches->empty()) {
+         delete caches;
+         caches = NULL;
+      }
+   }
+   V(caches_lock);
+}
+
+void chunk_cache::make_chunk_name(POOLMEM *&name, const char *volname, uint16_t chunk)
+{
+   Mmsg(name, "%s/%s/%04d", m_directory, volname, chunk);
+}
+
+/*
+ * Find the administration of a volume, optionally creating it.
+ * Should be called with m_lock held.
+ */
+chunk_cache_volume *chunk_cache::lookup_volume(const char *volname, bool create)
+{
+   chunk_cache_volume *volume;
+
+   foreach_dlist(volume, m_volumes) {
+      if (bstrcmp(volume->volname, volname)) {
+         return volume;
+      }
+   }
+
+   if (!create) {
+      return NULL;
+   }
+
+   volume = (chunk_cache_volume *)malloc(sizeof(chunk_cache_volume));
+   memset(volume, 0, sizeof(chunk_cache_volume));
+   volume->volname = bstrdup(volname);
+   volume->chunks = (chunk_cache_entry **)calloc(MAX_CHUNKS, sizeof(chunk_cache_entry *));
+   m_volumes->append(volume);
+
+   return volume;
+}
+
+/*
+ * Add a chunk as the most recently used entry.
+ * Should be called with m_lock held.
+ */
+void chunk_cache::add_entry(chunk_cache_volume *volume, uint16_t chunk, uint32_t size)
+{
+   chunk_cache_entry *entry;
+
+   entry = (chunk_cache_entry *)malloc(sizeof(chunk_cache_entry));
+   memset(entry, 0, sizeof(chunk_cache_entry));
+   entry->volume = volume;
+   entry->chunk = chunk;
+   entry->size = size;
+
+   volume->chunks[chunk] = entry;
+   m_lru->append(entry);
+
+   m_stats.cached_chunks++;
+   m_stats.cached_bytes += size;
+}
+
+/*
+ * Remove a chunk from the cache.
+ * Should be called with m_lock held.
+ */
+void chunk_cache::remove_entry(chunk_cache_entry *entry, bool unlink_file)
+{
+   if (unlink_file) {
+      POOL_MEM name(PM_FNAME);
+
+      make_chunk_name(name.addr(), entry->volume->volname, entry->chunk);
+      unlink(name.c_str());
+   }
+
+   entry->volume->chunks[entry->chunk] = NULL;
+   m_lru->remove(entry);
+
+   m_stats.cached_chunks--;
+   m_stats.cached_bytes -= entry->size;
+
+   free(entry);
+}
+
+/*
+ * Evict the least recently used chunks until size bytes fit in the cache.
+ * Should be called with m_lock held.
+ */
+void chunk_cache::make_room(uint32_t size)
+{
+   chunk_cache_entry *entry;
+
+   while (m_stats.cached_bytes + size > m_max_size) {
+      entry = (chunk_cache_entry *)m_lru->first();
+      if (!entry) {
+         break;
+      }
+
+      Dmsg2(100, "chunk_cache: evicting chunk %d of volume %s\n",
+            entry->chunk, entry->volume->volname);
+      remove_entry(entry, true);
+      m_stats.evictions++;
+   }
+}
+
+/*
+ * Pick up any chunks left in the cache directory by a previous run.
+ */
+void chunk_cache::scan_directory()
+{
+   DIR *dp, *vdp;
+   struct dirent *de, *vde;
+   struct stat st;
+   char *endp;
+   long chunk;
+   chunk_cache_volume *volume;
+   POOL_MEM name(PM_FNAME);
+
+   if (!(dp = opendir(m_directory))) {
+      berrno be;
+
+      if (mkdir(m_directory, 0700) < 0) {
+         Emsg2(M_WARNING, 0, _("Unable to create chunk cache directory %s: ERR=%s\n"),
+               m_directory, be.bstrerror());
+      }
+      return;
+   }
+
+   P(m_lock);
+   while ((de = readdir(dp))) {
+      if (de->d_name[0] == '.') {
+         continue;
+      }
+
+      Mmsg(name, "%s/%s", m_directory, de->d_name);
+      if (!(vdp = opendir(name.c_str()))) {
+         continue;
+      }
+
+      volume = NULL;
+      while ((vde = readdir(vdp))) {
+         chunk = strtol(vde->d_name, &endp, 10);
+         if (*endp != '\0' || endp == vde->d_name || chunk < 0 || chunk >= MAX_CHUNKS) {
+            continue;
+         }
+
+         Mmsg(name, "%s/%s/%s", m_directory, de->d_name, vde->d_name);
+         if (stat(name.c_str(), &st) < 0 || !S_ISREG(st.st_mode)) {
+            continue;
+         }
+
+         if (!volume) {
+            volume = lookup_volume(de->d_name, true);
+         }
+         add_entry(volume, (uint16_t)chunk, st.st_size);
+      }
+      closedir(vdp);
+   }
+   closedir(dp);
+
+   make_room(0);
+   V(m_lock);
+
+   Dmsg3(100, "chunk_cache: found %llu chunks (%llu bytes) in %s\n",
+         m_stats.cached_chunks, m_stats.cached_bytes, m_directory);
+}
+
+/*
+ * Try to satisfy a read of a chunk from the cache.
+ */
+bool chunk_cache::lookup(const char *volname, uint16_t chunk, char *buffer,
+                         uint32_t bufsize, uint32_t *buflen)
+{
+   int fd;
+   ssize_t nbytes = -1;
+   uint32_t size;
+   struct stat st;
+   chunk_cache_volume *volume;
+   chunk_cache_entry *entry = NULL;
+   POOL_MEM name(PM_FNAME);
+
+   P(m_lock);
+   volume = lookup_volume(volname, false);
+   if (volume) {
+      entry = volume->chunks[chunk];
+   }
+
+   if (!entry || entry->size > bufsize) {
+      m_stats.misses++;
+      V(m_lock);
+      return false;
+   }
+
+   /*
+    * Move the chunk to the end of the LRU list.
+    */
+   m_lru->remove(entry);
+   m_lru->append(entry);
+   size = entry->size;
+   V(m_lock);
+
+   make_chunk_name(name.addr(), volname, chunk);
+   fd = ::open(name.c_str(), O_RDONLY | O_BINARY);
+   if (fd >= 0) {
+      /*
+       * Only trust the file when it still has the size we know of,
+       * it may have been replaced by a newer version of the chunk.
+       */
+      if (fstat(fd, &st) == 0 && st.st_size == (off_t)size) {
+         nbytes = ::read(fd, buffer, size);
+      }
+      ::close(fd);
+   }
+
+   P(m_lock);
+   if (nbytes != (ssize_t)size) {
+      /*
+       * The chunk got evicted, replaced or is damaged, drop it from the cache.
+       */
+      if (volume->chunks[chunk] && volume->chunks[chunk]->size == size) {
+         remove_entry(volume->chunks[chunk], true);
+      }
+      m_stats.misses++;
+      V(m_lock);
+      return false;
+   }
+   m_stats.hits++;
+   V(m_lock);
+
+   Dmsg2(100, "chunk_cache: read chunk %d of volume %s from cache\n", chunk, volname);
+   *buflen = size;
+
+   return true;
+}
+
+/*
+ * Store a chunk in the cache, replacing any older version.
+ */
+void chunk_cache::store(const char *volname, uint16_t chunk, const char *buffer, uint32_t buflen)
+{
+   int fd;
+   ssize_t nbytes;
+   char ed1[50];
+   chunk_cache_volume *volume;
+   POOL_MEM name(PM_FNAME),
+            tmp_name(PM_FNAME);
+
+   if (buflen > m_max_size) {
+      return;
+   }
+
+   /*
+    * Write the data to a temporary file first so readers never see
+    * a partially written chunk.
+    */
+   Mmsg(tmp_name, "%s/%s", m_directory, volname);
+   if (mkdir(tmp_name.c_str(), 0700) < 0 && errno != EEXIST) {
+      berrno be;
+
+      Dmsg2(100, "chunk_cache: unable to create %s: ERR=%s\n", tmp_name.c_str(), be.bstrerror());
+      return;
+   }
+
+   make_chunk_name(name.addr(), volname, chunk);
+   Mmsg(tmp_name, "%s.%s.tmp", name.c_str(), edit_pthread(pthread_self(), ed1, sizeof(ed1)));
+   fd = ::open(tmp_name.c_str(), O_CREAT | O_TRUNC | O_WRONLY | O_BINARY, 0600);
+   if (fd < 0) {
+      berrno be;
+
+      Dmsg2(100, "chunk_cache: unable to create %s: ERR=%s\n", tmp_name.c_str(), be.bstrerror());
+      return;
+   }
+
+   nbytes = ::write(fd, buffer, buflen);
+   ::close(fd);
+   if (nbytes != (ssize_t)buflen) {
+      unlink(tmp_name.c_str());
+      return;
+   }
+
+   P(m_lock);
+   volume = lookup_volume(volname, true);
+   if (volume->chunks[chunk]) {
+      remove_entry(volume->chunks[chunk], false);
+   }
+
+   make_room(buflen);
+
+   if (rename(tmp_name.c_str(), name.c_str()) < 0) {
+      unlink(tmp_name.c_str());
+      V(m_lock);
+      return;
+   }
+
+   add_entry(volume, chunk, buflen);
+   m_stats.stores++;
+   V(m_lock);
+
+   Dmsg3(100, "chunk_cache: stored chunk %d of volume %s (%d bytes)\n", chunk, volname, buflen);
+}
+
+/*
+ * Remove all cached chunks of a volume e.g. when it gets truncated.
+ */
+void chunk_cache::invalidate_volume(const char *volname)
+{
+   chunk_cache_volume *volume;
+
+   P(m_lock);
+   volume = lookup_volume(volname, false);
+   if (volume) {
+      for (int i = 0; i < MAX_CHUNKS; i++) {
+         if (volume->chunks[i]) {
+            remove_entry(volume->chunks[i], true);
+         }
+      }
+   }
+   V(m_lock);
+}
+
+void chunk_cache::get_stats(chunk_cache_stats *stats)
+{
+   P(m_lock);
+   memcpy(stats, &m_stats, sizeof(chunk_cache_stats));
+   V(m_lock);
+}
+#endif /* HAVE_OBJECTSTORE */
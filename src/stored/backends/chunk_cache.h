@@ -0,0 +1,99 @@
+/*
+   BAREOS® - Backup Archiving REcovery Open Sourced
+
+   Copyright (C) 2016-2016 Bareos GmbH & Co. KG
+
+   This program is Free Software; you can redistribute it and/or
+   modify it under the terms of version three of the GNU Affero General Public
+   License as published by the Free Software Foundation, which is
+   listed in the file LICENSE.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+   Affero General Public License for more details.
+
+   You should have received a copy of the GNU Affero General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+   02110-1301, USA.
+*/
+/*
+ * Local disk cache for chunks of chunked volumes.
+ */
+
+#ifndef CHUNK_CACHE_H
+#define CHUNK_CACHE_H
+
+/*
+ * Default maximum size of the chunk cache when no size is configured.
+ */
+#define DEFAULT_CHUNK_CACHE_SIZE (1024 * 1024 * 1024)
+
+struct chunk_cache_volume;
+
+struct chunk_cache_entry {
+   dlink link;                     /* LRU list link */
+   chunk_cache_volume *volume;     /* Volume this chunk belongs to */
+   uint16_t chunk;                 /* Chunk number */
+   uint32_t size;                  /* Size of the cached chunk */
+};
+
+struct chunk_cache_volume {
+   dlink link;                     /* Volume list link */
+   char *volname;                  /* VolumeName */
+   chunk_cache_entry **chunks;     /* Cached chunks indexed by chunk number */
+};
+
+struct chunk_cache_stats {
+   uint64_t hits;                  /* Chunks served from the cache */
+   uint64_t misses;                /* Chunks not found in the cache */
+   uint64_t stores;                /* Chunks stored in the cache */
+   uint64_t evictions;             /* Chunks removed to make room */
+   uint64_t cached_chunks;         /* Chunks currently in the cache */
+   uint64_t cached_bytes;          /* Bytes currently in the cache */
+};
+
+class chunk_cache: public SMARTALLOC {
+private:
+   /*
+    * Private Members
+    */
+   dlink m_link;                   /* List of caches in use */
+   int m_use_count;                /* Devices using this cache */
+   char *m_directory;
+   uint64_t m_max_size;
+   dlist *m_lru;
+   dlist *m_volumes;
+   pthread_mutex_t m_lock;
+   chunk_cache_stats m_stats;
+
+   /*
+    * Private Methods
+    */
+   void make_chunk_name(POOLMEM *&name, const char *volname, uint16_t chunk);
+   chunk_cache_volume *lookup_volume(const char *volname, bool create);
+   void add_entry(chunk_cache_volume *volume, uint16_t chunk, uint32_t size);
+   void remove_entry(chunk_cache_entry *entry, bool unlink_file);
+   void make_room(uint32_t size);
+   void scan_directory();
+
+   chunk_cache(const char *directory, uint64_t max_size);
+   ~chunk_cache();
+
+public:
+   /*
+    * Public Methods
+    */
+   static chunk_cache *attach(const char *directory, uint64_t max_size);
+   static void detach(chunk_cache *cache);
+
+   bool lookup(const char *volname, uint16_t chunk, char *buffer,
+               uint32_t bufsize, uint32_t *buflen);
+   void store(const char *volname, uint16_t chunk, const char *buffer, uint32_t buflen);
+   void invalidate_volume(const char *volname);
+   void get_stats(chunk_cache_stats *stats);
+   uint64_t max_size() { return m_max_size; };
+   const char *directory() { return m_directory; };
+};
+#endif /* CHUNK_CACHE_H */
@@ -29,6 +29,7 @@
 #if defined(HAVE_OBJECTSTORE)
 #include "stored.h"
 #include "chunked_device.h"
+#include "chunk_cache.h"
 
 #ifdef HAVE_MMAP
 #ifdef HAVE_SYS_MMAN_H
@@ -60,6 +61,17 @@
  * chunked_volume_size() - Get the current size of a volume.
  * load_chunk() - Make sure we have the right chunk in memory.
  *
+ * When read-ahead is enabled the next chunks of a volume being read are
+ * fetched by read-ahead threads while the current chunk is being
+ * consumed so restores are not limited by the latency of reading
+ * one chunk at a time.
+ *
+ * When a cache directory is configured chunks are also kept in a size
+ * limited local disk cache. Reads are first tried from this cache and
+ * both flushed and read chunks are written through to it, so rereading
+ * recently used volumes doesn't need to fetch the data again from the
+ * backing store.
+ *
  * It also demands that the inheriting class implements the
  * following methods:
  *
@@ -93,6 +105,29 @@ static void *io_thread(void *data)
    return NULL;
 }
 
+/*
+ * Actual thread runner that processes read-ahead requests.
+ */
+static void *readahead_thread(void *data)
+{
+   char ed1[50];
+   chunked_device *dev = (chunked_device *)data;
+
+   /*
+    * Process read-ahead requests until we are done.
+    */
+   while (1) {
+      if (!dev->dequeue_readahead()) {
+         break;
+      }
+   }
+
+   Dmsg1(100, "Stopping read-ahead thread threadid=%s\n",
+         edit_pthread(pthread_self(), ed1, sizeof(ed1)));
+
+   return NULL;
+}
+
 /*
  * Allocate a new chunk buffer.
  */
@@ -204,6 +239,46 @@ bool chunked_device::start_io_threads()
    return true;
 }
 
+/*
+ * Start the read-ahead threads that are used for prefetching chunks.
+ */
+bool chunked_device::start_readahead_threads()
+{
+   char ed1[50];
+   uint8_t thread_nr;
+   pthread_t thread_id;
+   thread_handle *handle;
+
+   m_readahead_slots = (chunk_readahead *)malloc(m_readahead * sizeof(chunk_readahead));
+   memset(m_readahead_slots, 0, m_readahead * sizeof(chunk_readahead));
+
+   if (!m_thread_ids) {
+      m_thread_ids = New(alist(10, owned_by_alist));
+   }
+
+   /*
+    * Set this before starting the threads so we don't try again when we fail.
+    */
+   m_readahead_threads_started = true;
+
+   for (thread_nr = 1; thread_nr <= m_readahead; thread_nr++) {
+      if (pthread_create(&thread_id, NULL, readahead_thread, (void *)this)) {
+         return false;
+      }
+
+      handle = (thread_handle *)malloc(sizeof(thread_handle));
+      memset(handle, 0, sizeof(thread_handle));
+      handle->type = WAIT_JOIN_THREAD;
+      memcpy(&handle->thread_id, &thread_id, sizeof(pthread_t));
+      m_thread_ids->append(handle);
+
+      Dmsg1(100, "Started new read-ahead thread threadid=%s\n",
+            edit_pthread(thread_id, ed1, sizeof(ed1)));
+   }
+
+   return true;
+}
+
 /*
  * Stop the io-threads that are used for uploading.
  */
@@ -216,7 +291,19 @@ void chunked_device::stop_threads()
     * Tell all IO threads that we flush the circular buffer.
     * As such they will get a NULL chunk_io_request back and exit.
     */
-   m_cb->flush();
+   if (m_cb) {
+      m_cb->flush();
+   }
+
+   /*
+    * Tell all read-ahead threads to exit.
+    */
+   if (m_readahead_threads_started) {
+      P(m_readahead_lock);
+      m_readahead_shutdown = true;
+      pthread_cond_broadcast(&m_readahead_work);
+      V(m_readahead_lock);
+   }
 
    /*
     * Wait for all threads to exit.
@@ -346,6 +433,15 @@ bool chunked_device::enqueue_chunk(chunk_io_request *request)
       free_chunk_io_request(new_request);
    }
 
+   /*
+    * Keep track of the highest number of pending flush requests.
+    */
+   P(m_stats_lock);
+   if ((uint32_t)m_cb->size() > m_stats.max_queue_depth) {
+      m_stats.max_queue_depth = m_cb->size();
+   }
+   V(m_stats_lock);
+
    return (enqueued_request) ? true : false;
 }
 
@@ -397,7 +493,7 @@ bool chunked_device::dequeue_chunk()
             new_request->chunk, new_request->volname,
             edit_pthread(pthread_self(), ed1, sizeof(ed1)));
 
-      if (!flush_remote_chunk(new_request)) {
+      if (!timed_flush_remote_chunk(new_request)) {
           chunk_io_request *enqueued_request;
 
          /*
@@ -481,7 +577,7 @@ bool chunked_device::flush_chunk(bool release_chunk, bool move_to_next_chunk)
    if (m_io_threads) {
       retval = enqueue_chunk(&request);
    } else {
-      retval = flush_remote_chunk(&request);
+      retval = timed_flush_remote_chunk(&request);
    }
 
    /*
@@ -537,7 +633,22 @@ bool chunked_device::read_chunk()
 
    m_current_chunk->end_offset = m_current_chunk->start_offset + (m_current_chunk->chunk_size - 1);
 
-   if (!read_remote_chunk(&request)) {
+   /*
+    * When reading see if the chunk was already prefetched.
+    */
+   if (m_readahead && !m_current_chunk->writing) {
+      bool found, retval;
+
+      retval = claim_readahead_chunk(request.chunk, &found);
+      if (found) {
+         if (retval) {
+            schedule_readahead(request.chunk);
+         }
+         return retval;
+      }
+   }
+
+   if (!timed_read_remote_chunk(&request)) {
       /*
        * If the chunk doesn't exist on the backing store it has a size of 0 bytes.
        */
@@ -545,9 +656,321 @@ bool chunked_device::read_chunk()
       return false;
    }
 
+   if (m_readahead && !m_current_chunk->writing) {
+      schedule_readahead(request.chunk);
+   }
+
    return true;
 }
 
+/*
+ * Flush a chunk to the remote backing store and keep statistics.
+ */
+bool chunked_device::timed_flush_remote_chunk(chunk_io_request *request)
+{
+   bool retval;
+   btime_t start, elapsed;
+
+   P(m_stats_lock);
+   m_stats.flushes_inflight++;
+   V(m_stats_lock);
+
+   start = get_current_btime();
+   retval = flush_remote_chunk(request);
+   elapsed = get_current_btime() - start;
+
+   if (retval && m_cache) {
+      m_cache->store(request->volname, request->chunk, request->buffer, request->wbuflen);
+   }
+
+   P(m_stats_lock);
+   m_stats.flushes_inflight--;
+   if (retval) {
+      m_stats.chunks_flushed++;
+      m_stats.bytes_flushed += request->wbuflen;
+      m_stats.flush_time += elapsed;
+      if (elapsed > m_stats.max_flush_time) {
+         m_stats.max_flush_time = elapsed;
+      }
+   } else {
+      m_stats.flush_failures++;
+   }
+   V(m_stats_lock);
+
+   return retval;
+}
+
+/*
+ * Read a chunk from the remote backing store and keep statistics.
+ */
+bool chunked_device::timed_read_remote_chunk(chunk_io_request *request)
+{
+   bool retval;
+   btime_t start, elapsed;
+
+   if (m_cache && m_cache->lookup(request->volname, request->chunk, request->buffer,
+                                  request->wbuflen, request->rbuflen)) {
+      return true;
+   }
+
+   start = get_current_btime();
+   retval = read_remote_chunk(request);
+   elapsed = get_current_btime() - start;
+
+   if (retval && m_cache) {
+      m_cache->store(request->volname, request->chunk, request->buffer, *request->rbuflen);
+   }
+
+   if (retval) {
+      P(m_stats_lock);
+      m_stats.chunks_read++;
+      m_stats.bytes_read += *request->rbuflen;
+      m_stats.read_time += elapsed;
+      if (elapsed > m_stats.max_read_time) {
+         m_stats.max_read_time = elapsed;
+      }
+      V(m_stats_lock);
+   }
+
+   return retval;
+}
+
+/*
+ * Queue read-ahead requests for the chunks following the given chunk.
+ */
+void chunked_device::schedule_readahead(uint16_t chunk)
+{
+   int i, j;
+   uint16_t next_chunk;
+   chunk_readahead *slot;
+
+   if (!m_readahead_threads_started) {
+      if (!start_readahead_threads()) {
+         return;
+      }
+   }
+
+   P(m_readahead_lock);
+   for (i = 1; i <= m_readahead; i++) {
+      if (chunk + i >= MAX_CHUNKS) {
+         break;
+      }
+      next_chunk = chunk + i;
+
+      /*
+       * See if this chunk is already prefetched or being prefetched.
+       */
+      slot = NULL;
+      for (j = 0; j < m_readahead; j++) {
+         if (m_readahead_slots[j].state != RA_EMPTY &&
+             m_readahead_slots[j].chunk == next_chunk &&
+             bstrcmp(m_readahead_slots[j].volname, m_current_volname)) {
+            slot = &m_readahead_slots[j];
+            break;
+         }
+      }
+
+      if (slot) {
+         continue;
+      }
+
+      /*
+       * Find a free slot or a slot with data we no longer need.
+       */
+      for (j = 0; j < m_readahead; j++) {
+         chunk_readahead *candidate = &m_readahead_slots[j];
+
+         switch (candidate->state) {
+         case RA_EMPTY:
+            slot = candidate;
+            break;
+         case RA_READY:
+         case RA_FAILED:
+            if (!bstrcmp(candidate->volname, m_current_volname) ||
+                candidate->chunk <= chunk ||
+                candidate->chunk > chunk + m_readahead) {
+               slot = candidate;
+            }
+            break;
+         default:
+            break;
+         }
+
+         if (slot) {
+            break;
+         }
+      }
+
+      if (!slot) {
+         break;
+      }
+
+      if (!slot->buffer) {
+         slot->buffer = allocate_chunkbuffer();
+      }
+
+      if (slot->volname) {
+         free(slot->volname);
+      }
+      slot->volname = bstrdup(m_current_volname);
+      slot->chunk = next_chunk;
+      slot->buflen = 0;
+      slot->error = 0;
+      slot->state = RA_QUEUED;
+
+      Dmsg2(100, "Scheduled read-ahead of chunk %d of volume %s\n", next_chunk, m_current_volname);
+      pthread_cond_signal(&m_readahead_work);
+   }
+   V(m_readahead_lock);
+}
+
+/*
+ * See if the given chunk is prefetched and if so make it the current chunk.
+ * Sets found when the chunk was prefetched, returns false if the read failed.
+ */
+bool chunked_device::claim_readahead_chunk(uint16_t chunk, bool *found)
+{
+   bool retval = false;
+   char *buffer;
+   chunk_readahead *slot = NULL;
+
+   *found = false;
+   if (!m_readahead_slots) {
+      return false;
+   }
+
+   P(m_readahead_lock);
+   for (int i = 0; i < m_readahead; i++) {
+      if (m_readahead_slots[i].state != RA_EMPTY &&
+          m_readahead_slots[i].chunk == chunk &&
+          bstrcmp(m_readahead_slots[i].volname, m_current_volname)) {
+         slot = &m_readahead_slots[i];
+         break;
+      }
+   }
+
+   if (!slot) {
+      V(m_readahead_lock);
+
+      P(m_stats_lock);
+      m_stats.readahead_misses++;
+      V(m_stats_lock);
+
+      return false;
+   }
+
+   *found = true;
+   while (slot->state == RA_QUEUED || slot->state == RA_BUSY) {
+      pthread_cond_wait(&m_readahead_done, &m_readahead_lock);
+   }
+
+   if (slot->state == RA_READY) {
+      /*
+       * Swap the buffers so we don't need to copy the data.
+       */
+      buffer = m_current_chunk->buffer;
+      m_current_chunk->buffer = slot->buffer;
+      m_current_chunk->buflen = slot->buflen;
+      slot->buffer = buffer;
+      retval = true;
+   } else {
+      m_current_chunk->buflen = 0;
+      dev_errno = slot->error;
+   }
+   slot->state = RA_EMPTY;
+   V(m_readahead_lock);
+
+   Dmsg2(100, "Read chunk %d of volume %s from read-ahead\n", chunk, m_current_volname);
+
+   P(m_stats_lock);
+   m_stats.readahead_hits++;
+   V(m_stats_lock);
+
+   return retval;
+}
+
+/*
+ * Dequeue a read-ahead request and process it.
+ */
+bool chunked_device::dequeue_readahead()
+{
+   bool ok;
+   chunk_readahead *slot;
+   chunk_io_request request;
+
+   P(m_readahead_lock);
+   while (1) {
+      if (m_readahead_shutdown) {
+         V(m_readahead_lock);
+         return false;
+      }
+
+      /*
+       * Pick the lowest queued chunk first.
+       */
+      slot = NULL;
+      for (int i = 0; i < m_readahead; i++) {
+         if (m_readahead_slots[i].state == RA_QUEUED &&
+             (!slot || m_readahead_slots[i].chunk < slot->chunk)) {
+            slot = &m_readahead_slots[i];
+         }
+      }
+
+      if (slot) {
+         break;
+      }
+
+      pthread_cond_wait(&m_readahead_work, &m_readahead_lock);
+   }
+
+   slot->state = RA_BUSY;
+   request.volname = slot->volname;
+   request.chunk = slot->chunk;
+   request.buffer = slot->buffer;
+   request.wbuflen = m_current_chunk->chunk_size;
+   request.rbuflen = &slot->buflen;
+   request.release = false;
+   V(m_readahead_lock);
+
+   Dmsg2(100, "Prefetching chunk %d of volume %s\n", request.chunk, request.volname);
+
+   ok = timed_read_remote_chunk(&request);
+
+   P(m_readahead_lock);
+   if (ok) {
+      slot->state = RA_READY;
+   } else {
+      slot->buflen = 0;
+      slot->error = dev_errno;
+      slot->state = RA_FAILED;
+   }
+   pthread_cond_broadcast(&m_readahead_done);
+   V(m_readahead_lock);
+
+   return true;
+}
+
+/*
+ * Throw away all prefetched chunks e.g. when the volume changes.
+ */
+void chunked_device::invalidate_readahead()
+{
+   if (!m_readahead_slots) {
+      return;
+   }
+
+   P(m_readahead_lock);
+   for (int i = 0; i < m_readahead; i++) {
+      chunk_readahead *slot = &m_readahead_slots[i];
+
+      while (slot->state == RA_BUSY) {
+         pthread_cond_wait(&m_readahead_done, &m_readahead_lock);
+      }
+      slot->state = RA_EMPTY;
+   }
+   V(m_readahead_lock);
+}
+
 /*
  * Setup a chunked volume for reading or writing.
  */
@@ -565,6 +988,18 @@ void chunked_device::setup_chunk(int flags)
       m_current_chunk->end_offset = -1;
    }
 
+   /*
+    * Setup the local chunk cache when configured.
+    */
+   if (m_cache_dir && !m_cache) {
+      m_cache = chunk_cache::attach(m_cache_dir, m_cache_size);
+   }
+
+   /*
+    * Any prefetched data may belong to a different volume or be stale.
+    */
+   invalidate_readahead();
+
    /*
     * Reopen of a device.
     */
@@ -860,6 +1295,8 @@ int chunked_device::close_chunk()
          }
       }
 
+      invalidate_readahead();
+
       /*
        * Invalidate chunk.
        */
@@ -886,6 +1323,12 @@ bool chunked_device::truncate_chunked_volume(DCR *dcr)
          return false;
       }
 
+      invalidate_readahead();
+
+      if (m_cache) {
+         m_cache->invalidate_volume(m_current_volname);
+      }
+
       /*
        * Reinitialize the initial chunk.
        */
@@ -1019,6 +1462,10 @@ static int list_io_request(void *request, void *data)
  */
 bool chunked_device::device_status(bsdDevStatTrig *dst)
 {
+   chunk_io_stats stats;
+   POOL_MEM status(PM_MESSAGE);
+   char ed1[50], ed2[50], ed3[50], ed4[50], ed5[50], ed6[50];
+
    /*
     * See if we are using io-threads or not and the ordered circbuf is created and not empty.
     */
@@ -1036,6 +1483,53 @@ bool chunked_device::device_status(bsdDevStatTrig *dst)
       }
    }
 
+   P(m_stats_lock);
+   memcpy(&stats, &m_stats, sizeof(chunk_io_stats));
+   V(m_stats_lock);
+
+   if (m_io_threads > 0 && m_cb) {
+      status.bsprintf(_("IO queue depth: %d/%d (max %d), flushes in progress: %d\n"),
+                      m_cb->size(), m_cb->capacity(), stats.max_queue_depth, stats.flushes_inflight);
+      dst->status_length = pm_strcat(dst->status, status.c_str());
+   }
+
+   status.bsprintf(_("Chunks flushed: %s (%s bytes), failures: %s, flush latency avg %d ms max %d ms\n"),
+                   edit_uint64_with_commas(stats.chunks_flushed, ed1),
+                   edit_uint64_with_commas(stats.bytes_flushed, ed2),
+                   edit_uint64_with_commas(stats.flush_failures, ed3),
+                   (stats.chunks_flushed) ? (int)(stats.flush_time / stats.chunks_flushed / 1000) : 0,
+                   (int)(stats.max_flush_time / 1000));
+   dst->status_length = pm_strcat(dst->status, status.c_str());
+
+   status.bsprintf(_("Chunks read: %s (%s bytes), read latency avg %d ms max %d ms\n"),
+                   edit_uint64_with_commas(stats.chunks_read, ed1),
+                   edit_uint64_with_commas(stats.bytes_read, ed2),
+                   (stats.chunks_read) ? (int)(stats.read_time / stats.chunks_read / 1000) : 0,
+                   (int)(stats.max_read_time / 1000));
+   dst->status_length = pm_strcat(dst->status, status.c_str());
+
+   if (m_readahead > 0) {
+      status.bsprintf(_("Read-ahead: %d chunks, hits: %s, misses: %s\n"), m_readahead,
+                      edit_uint64_with_commas(stats.readahead_hits, ed1),
+                      edit_uint64_with_commas(stats.readahead_misses, ed2));
+      dst->status_length = pm_strcat(dst->status, status.c_str());
+   }
+
+   if (m_cache) {
+      chunk_cache_stats cache_stats;
+
+      m_cache->get_stats(&cache_stats);
+      status.bsprintf(_("Chunk cache %s: %s/%s bytes in %s chunks, hits: %s, misses: %s, evictions: %s\n"),
+                      m_cache->directory(),
+                      edit_uint64_with_commas(cache_stats.cached_bytes, ed1),
+                      edit_uint64_with_commas(m_cache->max_size(), ed2),
+                      edit_uint64_with_commas(cache_stats.cached_chunks, ed3),
+                      edit_uint64_with_commas(cache_stats.hits, ed4),
+                      edit_uint64_with_commas(cache_stats.misses, ed5),
+                      edit_uint64_with_commas(cache_stats.evictions, ed6));
+      dst->status_length = pm_strcat(dst->status, status.c_str());
+   }
+
    return (dst->status_length > 0);
 }
 
@@ -1064,6 +1558,24 @@ chunked_device::~chunked_device()
       m_cb = NULL;
    }
 
+   if (m_cache) {
+      chunk_cache::detach(m_cache);
+      m_cache = NULL;
+   }
+
+   if (m_readahead_slots) {
+      for (int i = 0; i < m_readahead; i++) {
+         if (m_readahead_slots[i].buffer) {
+            free_chunkbuffer(m_readahead_slots[i].buffer);
+         }
+         if (m_readahead_slots[i].volname) {
+            free(m_readahead_slots[i].volname);
+         }
+      }
+      free(m_readahead_slots);
+      m_readahead_slots = NULL;
+   }
+
    if (m_current_chunk) {
       if (m_current_chunk->buffer) {
          free_chunkbuffer(m_current_chunk->buffer);
@@ -1075,6 +1587,11 @@ chunked_device::~chunked_device()
    if (m_current_volname) {
       free(m_current_volname);
    }
+
+   pthread_cond_destroy(&m_readahead_work);
+   pthread_cond_destroy(&m_readahead_done);
+   pthread_mutex_destroy(&m_readahead_lock);
+   pthread_mutex_destroy(&m_stats_lock);
 }
 
 chunked_device::chunked_device()
@@ -1091,5 +1608,17 @@ chunked_device::chunked_device()
    m_chunk_size = 0;
    m_offset = 0;
    m_use_mmap = false;
+   m_readahead = 0;
+   m_readahead_slots = NULL;
+   m_cache = NULL;
+   m_cache_dir = NULL;
+   m_cache_size = 0;
+   m_readahead_threads_started = false;
+   m_readahead_shutdown = false;
+   memset(&m_stats, 0, sizeof(m_stats));
+   pthread_mutex_init(&m_readahead_lock, NULL);
+   pthread_cond_init(&m_readahead_work, NULL);
+   pthread_cond_init(&m_readahead_done, NULL);
+   pthread_mutex_init(&m_stats_lock, NULL);
 }
 #endif /* HAVE_OBJECTSTORE */
@@ -65,6 +65,42 @@ struct chunk_io_request {
    bool release;           /* Should we release the data to which the buffer points ? */
 };
 
+/*
+ * States of a read-ahead slot.
+ */
+enum readahead_state {
+   RA_EMPTY = 0,           /* Slot not in use */
+   RA_QUEUED,              /* Waiting for a read-ahead thread */
+   RA_BUSY,                /* Being read by a read-ahead thread */
+   RA_READY,               /* Data read and available */
+   RA_FAILED               /* Read failed, see error */
+};
+
+struct chunk_readahead {
+   readahead_state state;  /* See RA_* readahead_state enum */
+   char *volname;          /* VolumeName */
+   uint16_t chunk;         /* Chunk number */
+   char *buffer;           /* Data */
+   uint32_t buflen;        /* Size of the actual valid data in the chunk */
+   int error;              /* Value of dev_errno when the read failed */
+};
+
+struct chunk_io_stats {
+   uint64_t chunks_flushed;   /* Chunks flushed to the backing store */
+   uint64_t bytes_flushed;    /* Bytes flushed to the backing store */
+   uint64_t flush_failures;   /* Failed flushes to the backing store */
+   btime_t flush_time;        /* Total time spent flushing chunks */
+   btime_t max_flush_time;    /* Longest time spent flushing a chunk */
+   uint32_t flushes_inflight; /* Flushes currently being processed */
+   uint32_t max_queue_depth;  /* Highest number of pending flush requests */
+   uint64_t chunks_read;      /* Chunks read from the backing store */
+   uint64_t bytes_read;       /* Bytes read from the backing store */
+   btime_t read_time;         /* Total time spent reading chunks */
+   btime_t max_read_time;     /* Longest time spent reading a chunk */
+   uint64_t readahead_hits;   /* Chunks served from the read-ahead slots */
+   uint64_t readahead_misses; /* Chunks read synchronously */
+};
+
 struct chunk_descriptor {
    ssize_t chunk_size;     /* Total size of the memory chunk */
    char *buffer;           /* Data */
@@ -79,17 +115,28 @@ struct chunk_descriptor {
 
 #include "lib/ordered_cbuf.h"
 
+class chunk_cache;
+
 class chunked_device: public DEVICE {
 private:
    /*
     * Private Members
     */
    bool m_io_threads_started;
+   bool m_readahead_threads_started;
+   bool m_readahead_shutdown;
    bool m_end_of_media;
    char *m_current_volname;
    ordered_circbuf *m_cb;
    alist *m_thread_ids;
    chunk_descriptor *m_current_chunk;
+   chunk_readahead *m_readahead_slots;
+   pthread_mutex_t m_readahead_lock;
+   pthread_cond_t m_readahead_work;
+   pthread_cond_t m_readahead_done;
+   pthread_mutex_t m_stats_lock;
+   chunk_io_stats m_stats;
+   chunk_cache *m_cache;
 
    /*
     * Private Methods
@@ -98,10 +145,16 @@ private:
    void free_chunkbuffer(char *buffer);
    void free_chunk_io_request(chunk_io_request *request);
    bool start_io_threads();
+   bool start_readahead_threads();
    void stop_threads();
    bool enqueue_chunk(chunk_io_request *request);
    bool flush_chunk(bool release_chunk, bool move_to_next_chunk);
    bool read_chunk();
+   bool timed_flush_remote_chunk(chunk_io_request *request);
+   bool timed_read_remote_chunk(chunk_io_request *request);
+   void schedule_readahead(uint16_t chunk);
+   bool claim_readahead_chunk(uint16_t chunk, bool *found);
+   void invalidate_readahead();
 
 protected:
    /*
@@ -109,7 +162,10 @@ protected:
     */
    uint8_t m_io_threads;
    uint8_t m_io_slots;
+   uint8_t m_readahead;
    uint64_t m_chunk_size;
+   const char *m_cache_dir;
+   uint64_t m_cache_size;
    boffset_t m_offset;
    bool m_use_mmap;
 
@@ -140,6 +196,7 @@ public:
    virtual ~chunked_device();
 
    bool dequeue_chunk();
+   bool dequeue_readahead();
    bool device_status(bsdDevStatTrig *dst);
 
    /*
@@ -59,6 +59,9 @@ enum device_option_type {
    argument_chunksize,
    argument_iothreads,
    argument_ioslots,
+   argument_readahead,
+   argument_cachedir,
+   argument_cachesize,
    argument_mmap
 };
 
@@ -77,6 +80,9 @@ static device_option device_options[] = {
    { "chunksize=", argument_chunksize, 10 },
    { "iothreads=", argument_iothreads, 10 },
    { "ioslots=", argument_ioslots, 8 },
+   { "readahead=", argument_readahead, 10 },
+   { "cachedir=", argument_cachedir, 9 },
+   { "cachesize=", argument_cachesize, 10 },
    { "mmap", argument_mmap, 4 },
    { NULL, argument_none }
 };
@@ -604,6 +610,20 @@ bool droplet_device::initialize()
                   m_io_slots = value & 0xFF;
                   done = true;
                   break;
+               case argument_readahead:
+                  size_to_uint64(bp + device_options[i].compare_size, &value);
+                  m_readahead = value & 0xFF;
+                  done = true;
+                  break;
+               case argument_cachedir:
+                  m_cache_dir = bp + device_options[i].compare_size;
+                  done = true;
+                  break;
+               case argument_cachesize:
+                  size_to_uint64(bp + device_options[i].compare_size, &value);
+                  m_cache_size = value;
+                  done = true;
+                  break;
                case argument_mmap:
                   m_use_mmap = true;
                   done = true;
@@ -411,7 +411,7 @@ static void do_extract(char *devname)
    setup_decompression_buffers(jcr, &decompress_buf_size);
    if (decompress_buf_size > 0) {
       memset(&jcr->compress, 0, sizeof(CMPRS_CTX));
-      jcr->compress.inflate_buffer = get_memory(decompress_buf_size);
+      jcr->compress.inflate_buffer = get_large_memory(decompress_buf_size);
       jcr->compress.inflate_buffer_size = decompress_buf_size;
    }
 
@@ -133,7 +133,7 @@ DEV_BLOCK *new_block(DEVICE *dev)
    }
    block->dev = dev;
    block->block_len = block->buf_len;  /* default block size */
-   block->buf = get_memory(block->buf_len);
+   block->buf = get_large_memory(block->buf_len);
    empty_block(block);
    block->BlockVer = BLOCK_VER;       /* default write version */
    Dmsg1(650, "Returning new block=%x\n", block);
@@ -149,7 +149,7 @@ DEV_BLOCK *dup_block(DEV_BLOCK *eblock)
    int buf_len = sizeof_pool_memory(eblock->buf);
 
    memcpy(block, eblock, sizeof(DEV_BLOCK));
-   block->buf = get_memory(buf_len);
+   block->buf = get_large_memory(buf_len);
    memcpy(block->buf, eblock->buf, buf_len);
    return block;
 }
@@ -1101,7 +1101,7 @@ reread:
       dev->max_block_size = block->block_len;
       block->buf_len = block->block_len;
       free_memory(block->buf);
-      block->buf = get_memory(block->buf_len);
+      block->buf = get_large_memory(block->buf_len);
       empty_block(block);
       looping++;
       goto reread;                    /* re-read block with correct block size */
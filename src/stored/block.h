@@ -29,7 +29,6 @@
 #ifndef __BLOCK_H
 #define __BLOCK_H 1
 
-#define MAX_BLOCK_LENGTH  20000000      /**< this is a sort of sanity check */
 #define DEFAULT_BLOCK_SIZE (512 * 126)  /**< 64,512 N.B. do not use 65,536 here
                                            the POSIX standard defaults the size of a
                                            tape record to 126 blocks (63k). */
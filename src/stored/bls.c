@@ -447,6 +447,7 @@ static void get_session_record(DEVICE *dev, DEV_RECORD *rec, SESSION_LABEL *sess
       rtype = _("Begin Job Session");
       unser_session_label(sessrec, rec);
       jcr->JobId = sessrec->JobId;
+      register_jcr_jobid(jcr);
       break;
    case EOS_LABEL:
       rtype = _("End Job Session");
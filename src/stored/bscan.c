@@ -1307,6 +1307,7 @@ static JCR *create_job_record(B_DB *db, JOB_DBR *jr, SESSION_LABEL *label, DEV_R
 
    Pmsg2(000, _("Created new JobId=%u record for original JobId=%u\n"), jr->JobId, label->JobId);
    mjcr->JobId = jr->JobId;           /* set new JobId */
+   register_jcr_jobid(mjcr);
 
    return mjcr;
 }
@@ -1517,6 +1518,7 @@ static JCR *create_jcr(JOB_DBR *jr, DEV_RECORD *rec, uint32_t JobId)
    jobjcr->JobStatus = jr->JobStatus;
    bstrncpy(jobjcr->Job, jr->Job, sizeof(jobjcr->Job));
    jobjcr->JobId = JobId;      /* this is JobId on tape */
+   register_jcr_jobid(jobjcr);
    jobjcr->sched_time = jr->SchedTime;
    jobjcr->start_time = jr->StartTime;
    jobjcr->VolSessionId = rec->VolSessionId;
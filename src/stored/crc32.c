@@ -352,9 +352,10 @@ tole(0xccb0a91fL), tole(0x740cce7aL), tole(0x66b96194L), tole(0xde0506f1L)},
 };
 
 /**
- * Calculate the PNG 32 bit CRC on a buffer
+ * Calculate the PNG 32 bit CRC on a buffer using slicing-by-4.
+ * This is the portable implementation that works on any endianess.
  */
-uint32_t bcrc32(unsigned char*buf, int len)
+static uint32_t bcrc32_slice4(uint8_t *buf, int len)
 {
 # ifdef HAVE_LITTLE_ENDIAN
 #  define DO_CRC(x) crc = tab[0][(crc ^ (x)) & 255 ] ^ (crc >> 8)
@@ -398,6 +399,352 @@ uint32_t bcrc32(unsigned char*buf, int len)
         return tole(crc) ^ ~0;
 }
 
+/**
+ * Runtime dispatched implementations of the same CRC. All of them
+ * produce bit identical results, the fastest one available on the
+ * CPU we run on is selected the first time bcrc32() is called.
+ */
+#if defined(HAVE_LITTLE_ENDIAN) && defined(__GNUC__) && defined(__x86_64__)
+#define HAVE_CRC32_PCLMUL
+#include <cpuid.h>
+#include <wmmintrin.h>
+#include <smmintrin.h>
+#endif
+
+#if defined(HAVE_LITTLE_ENDIAN) && defined(__GNUC__) && defined(__aarch64__) && defined(__linux__)
+#define HAVE_CRC32_ARMV8
+#include <sys/auxv.h>
+#include <arm_acle.h>
+#ifndef HWCAP_CRC32
+#define HWCAP_CRC32 (1 << 7)
+#endif
+#endif
+
+typedef uint32_t (*crc32_function)(uint8_t *buf, int len);
+
+struct crc32_implementation {
+   const char *name;
+   crc32_function func;
+   bool (*available)();
+};
+
+static pthread_once_t crc32_init_once = PTHREAD_ONCE_INIT;
+static crc32_function crc32_func = bcrc32_slice4;
+static const char *crc32_name = "slice4";
+
+static bool crc32_always_available()
+{
+   return true;
+}
+
+#ifdef HAVE_LITTLE_ENDIAN
+/**
+ * Tables for slicing-by-8, generated from the first static table.
+ */
+static uint32_t tab8[8][256];
+
+static void crc32_init_slice8()
+{
+   for (int i = 0; i < 256; i++) {
+      tab8[0][i] = tab[0][i];
+   }
+
+   for (int k = 1; k < 8; k++) {
+      for (int i = 0; i < 256; i++) {
+         tab8[k][i] = (tab8[k - 1][i] >> 8) ^ tab8[0][tab8[k - 1][i] & 255];
+      }
+   }
+}
+
+/**
+ * Update a CRC (without pre and post inversion) using slicing-by-8.
+ */
+static inline uint32_t crc32_slice8_update(uint32_t crc, const uint8_t *buf, size_t len)
+{
+   uint32_t one, two;
+
+   while (len >= 8) {
+      memcpy(&one, buf, sizeof(one));
+      memcpy(&two, buf + 4, sizeof(two));
+      one ^= crc;
+      crc = tab8[7][one & 255] ^
+            tab8[6][(one >> 8) & 255] ^
+            tab8[5][(one >> 16) & 255] ^
+            tab8[4][one >> 24] ^
+            tab8[3][two & 255] ^
+            tab8[2][(two >> 8) & 255] ^
+            tab8[1][(two >> 16) & 255] ^
+            tab8[0][two >> 24];
+      buf += 8;
+      len -= 8;
+   }
+
+   while (len--) {
+      crc = tab8[0][(crc ^ *buf++) & 255] ^ (crc >> 8);
+   }
+
+   return crc;
+}
+
+static uint32_t bcrc32_slice8(uint8_t *buf, int len)
+{
+   return ~crc32_slice8_update(~0U, buf, len);
+}
+#endif /* HAVE_LITTLE_ENDIAN */
+
+#ifdef HAVE_CRC32_PCLMUL
+static bool crc32_pclmul_available()
+{
+   unsigned int eax, ebx, ecx, edx;
+
+   if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx)) {
+      return false;
+   }
+
+   return (ecx & bit_PCLMUL) && (ecx & bit_SSE4_1);
+}
+
+/**
+ * Fold 64 bytes at a time using carry-less multiplication as described
+ * in the Intel paper "Fast CRC Computation for Generic Polynomials Using
+ * PCLMULQDQ Instruction". Needs at least 64 bytes and a multiple of 16 bytes.
+ * Works on a CRC without pre and post inversion.
+ */
+__attribute__((target("pclmul,sse4.1")))
+static uint32_t crc32_pclmul_update(uint32_t crc, const uint8_t *buf, size_t len)
+{
+   static const uint64_t __attribute__((aligned(16))) k1k2[] = { 0x0154442bd4ULL, 0x01c6e41596ULL };
+   static const uint64_t __attribute__((aligned(16))) k3k4[] = { 0x01751997d0ULL, 0x00ccaa009eULL };
+   static const uint64_t __attribute__((aligned(16))) k5k0[] = { 0x0163cd6124ULL, 0x0000000000ULL };
+   static const uint64_t __attribute__((aligned(16))) poly[] = { 0x01db710641ULL, 0x01f7011641ULL };
+   __m128i x0, x1, x2, x3, x4, x5, x6, x7, x8;
+   __m128i y5, y6, y7, y8;
+
+   x1 = _mm_loadu_si128((__m128i *)(buf + 0x00));
+   x2 = _mm_loadu_si128((__m128i *)(buf + 0x10));
+   x3 = _mm_loadu_si128((__m128i *)(buf + 0x20));
+   x4 = _mm_loadu_si128((__m128i *)(buf + 0x30));
+
+   x1 = _mm_xor_si128(x1, _mm_cvtsi32_si128(crc));
+   x0 = _mm_load_si128((__m128i *)k1k2);
+
+   buf += 64;
+   len -= 64;
+
+   /*
+    * Parallel fold blocks of 64 bytes.
+    */
+   while (len >= 64) {
+      x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+      x6 = _mm_clmulepi64_si128(x2, x0, 0x00);
+      x7 = _mm_clmulepi64_si128(x3, x0, 0x00);
+      x8 = _mm_clmulepi64_si128(x4, x0, 0x00);
+
+      x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+      x2 = _mm_clmulepi64_si128(x2, x0, 0x11);
+      x3 = _mm_clmulepi64_si128(x3, x0, 0x11);
+      x4 = _mm_clmulepi64_si128(x4, x0, 0x11);
+
+      y5 = _mm_loadu_si128((__m128i *)(buf + 0x00));
+      y6 = _mm_loadu_si128((__m128i *)(buf + 0x10));
+      y7 = _mm_loadu_si128((__m128i *)(buf + 0x20));
+      y8 = _mm_loadu_si128((__m128i *)(buf + 0x30));
+
+      x1 = _mm_xor_si128(x1, x5);
+      x2 = _mm_xor_si128(x2, x6);
+      x3 = _mm_xor_si128(x3, x7);
+      x4 = _mm_xor_si128(x4, x8);
+
+      x1 = _mm_xor_si128(x1, y5);
+      x2 = _mm_xor_si128(x2, y6);
+      x3 = _mm_xor_si128(x3, y7);
+      x4 = _mm_xor_si128(x4, y8);
+
+      buf += 64;
+      len -= 64;
+   }
+
+   /*
+    * Fold into 128 bits.
+    */
+   x0 = _mm_load_si128((__m128i *)k3k4);
+
+   x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+   x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+   x1 = _mm_xor_si128(x1, x2);
+   x1 = _mm_xor_si128(x1, x5);
+
+   x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+   x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+   x1 = _mm_xor_si128(x1, x3);
+   x1 = _mm_xor_si128(x1, x5);
+
+   x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+   x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+   x1 = _mm_xor_si128(x1, x4);
+   x1 = _mm_xor_si128(x1, x5);
+
+   /*
+    * Single fold blocks of 16 bytes.
+    */
+   while (len >= 16) {
+      x2 = _mm_loadu_si128((__m128i *)buf);
+
+      x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+      x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+      x1 = _mm_xor_si128(x1, x2);
+      x1 = _mm_xor_si128(x1, x5);
+
+      buf += 16;
+      len -= 16;
+   }
+
+   /*
+    * Fold 128 bits to 64 bits.
+    */
+   x2 = _mm_clmulepi64_si128(x1, x0, 0x10);
+   x3 = _mm_setr_epi32(~0, 0, ~0, 0);
+   x1 = _mm_srli_si128(x1, 8);
+   x1 = _mm_xor_si128(x1, x2);
+
+   x0 = _mm_loadl_epi64((__m128i *)k5k0);
+
+   x2 = _mm_srli_si128(x1, 4);
+   x1 = _mm_and_si128(x1, x3);
+   x1 = _mm_clmulepi64_si128(x1, x0, 0x00);
+   x1 = _mm_xor_si128(x1, x2);
+
+   /*
+    * Barrett reduce to 32 bits.
+    */
+   x0 = _mm_load_si128((__m128i *)poly);
+
+   x2 = _mm_and_si128(x1, x3);
+   x2 = _mm_clmulepi64_si128(x2, x0, 0x10);
+   x2 = _mm_and_si128(x2, x3);
+   x2 = _mm_clmulepi64_si128(x2, x0, 0x00);
+   x1 = _mm_xor_si128(x1, x2);
+
+   return _mm_extract_epi32(x1, 1);
+}
+
+static uint32_t bcrc32_pclmul(uint8_t *buf, int len)
+{
+   uint32_t crc = ~0U;
+
+   if (len >= 64) {
+      size_t chunk = len & ~15;
+
+      crc = crc32_pclmul_update(crc, buf, chunk);
+      buf += chunk;
+      len -= chunk;
+   }
+
+   return ~crc32_slice8_update(crc, buf, len);
+}
+#endif /* HAVE_CRC32_PCLMUL */
+
+#ifdef HAVE_CRC32_ARMV8
+static bool crc32_armv8_available()
+{
+   return (getauxval(AT_HWCAP) & HWCAP_CRC32) != 0;
+}
+
+__attribute__((target("+crc")))
+static uint32_t bcrc32_armv8(uint8_t *buf, int len)
+{
+   uint64_t word;
+   uint32_t crc = ~0U;
+
+   while (len >= 8) {
+      memcpy(&word, buf, sizeof(word));
+      crc = __crc32d(crc, word);
+      buf += 8;
+      len -= 8;
+   }
+
+   while (len--) {
+      crc = __crc32b(crc, *buf++);
+   }
+
+   return ~crc;
+}
+#endif /* HAVE_CRC32_ARMV8 */
+
+/**
+ * All implementations, the preferred one last.
+ */
+static const crc32_implementation crc32_implementations[] = {
+   { "slice4", bcrc32_slice4, crc32_always_available },
+#ifdef HAVE_LITTLE_ENDIAN
+   { "slice8", bcrc32_slice8, crc32_always_available },
+#endif
+#ifdef HAVE_CRC32_PCLMUL
+   { "pclmul", bcrc32_pclmul, crc32_pclmul_available },
+#endif
+#ifdef HAVE_CRC32_ARMV8
+   { "armv8", bcrc32_armv8, crc32_armv8_available },
+#endif
+   { NULL, NULL, NULL }
+};
+
+static void crc32_select_implementation()
+{
+#ifdef HAVE_LITTLE_ENDIAN
+   crc32_init_slice8();
+#endif
+
+   for (int i = 0; crc32_implementations[i].name; i++) {
+      if (crc32_implementations[i].available()) {
+         crc32_func = crc32_implementations[i].func;
+         crc32_name = crc32_implementations[i].name;
+      }
+   }
+
+   Dmsg1(100, "Using %s CRC32 implementation\n", crc32_name);
+}
+
+/**
+ * Calculate the PNG 32 bit CRC on a buffer
+ */
+uint32_t bcrc32(uint8_t *buf, int len)
+{
+   pthread_once(&crc32_init_once, crc32_select_implementation);
+
+   return crc32_func(buf, len);
+}
+
+/**
+ * Return the name of the CRC implementation in use.
+ */
+const char *bcrc32_get_implementation()
+{
+   pthread_once(&crc32_init_once, crc32_select_implementation);
+
+   return crc32_name;
+}
+
+/**
+ * Force a specific CRC implementation e.g. for benchmarking.
+ * Returns false when the implementation is not available on this CPU.
+ */
+bool bcrc32_set_implementation(const char *name)
+{
+   pthread_once(&crc32_init_once, crc32_select_implementation);
+
+   for (int i = 0; crc32_implementations[i].name; i++) {
+      if (bstrcmp(crc32_implementations[i].name, name)) {
+         if (!crc32_implementations[i].available()) {
+            return false;
+         }
+         crc32_func = crc32_implementations[i].func;
+         crc32_name = crc32_implementations[i].name;
+         return true;
+      }
+   }
+
+   return false;
+}
 
 #ifdef CRC32_SUM
 
@@ -0,0 +1,152 @@
+/*
+   BAREOS® - Backup Archiving REcovery Open Sourced
+
+   Copyright (C) 2016-2016 Bareos GmbH & Co. KG
+
+   This program is Free Software; you can redistribute it and/or
+   modify it under the terms of version three of the GNU Affero General Public
+   License as published by the Free Software Foundation and included
+   in the file LICENSE.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+   Affero General Public License for more details.
+
+   You should have received a copy of the GNU Affero General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+   02110-1301, USA.
+*/
+/*
+ * Microbenchmark for the block checksum implementations. Each available
+ * implementation is first checked to produce the same results as the
+ * portable slicing-by-4 implementation and then timed on blocks of the
+ * given size.
+ *
+ * Usage: crc32_bench [-n iterations] [-s blocksize]
+ */
+#include "bareos.h"
+#include "stored.h"
+
+#define DEFAULT_ITERATIONS 20000
+#define MAX_VERIFY_LENGTH 1024
+
+static const char *implementations[] = {
+   "slice4",
+   "slice8",
+   "pclmul",
+   "armv8",
+   NULL
+};
+
+/*
+ * Compare the current implementation against the reference values
+ * for all lengths and alignments up to MAX_VERIFY_LENGTH.
+ */
+static bool verify(uint8_t *buf, uint32_t *reference)
+{
+   int i = 0;
+
+   for (int offset = 0; offset < 8; offset++) {
+      for (int len = 0; len <= MAX_VERIFY_LENGTH; len++) {
+         if (bcrc32(buf + offset, len) != reference[i++]) {
+            printf("%-8s mismatch at offset %d length %d\n",
+                   bcrc32_get_implementation(), offset, len);
+            return false;
+         }
+      }
+   }
+
+   return true;
+}
+
+static void usage()
+{
+   fprintf(stderr, "Usage: crc32_bench [-n iterations] [-s blocksize]\n"
+                   "       -n <iterations>  number of blocks to checksum (default %d)\n"
+                   "       -s <blocksize>   size of each block (default %d)\n",
+                   DEFAULT_ITERATIONS, DEFAULT_BLOCK_SIZE);
+   exit(1);
+}
+
+int main(int argc, char *argv[])
+{
+   int ch, i;
+   uint8_t *buf;
+   uint32_t *reference;
+   uint32_t crc = 0;
+   btime_t start;
+   double secs;
+   const char *preferred;
+   int iterations = DEFAULT_ITERATIONS;
+   int blocksize = DEFAULT_BLOCK_SIZE;
+
+   while ((ch = getopt(argc, argv, "n:s:?")) != -1) {
+      switch (ch) {
+      case 'n':
+         iterations = str_to_int64(optarg);
+         break;
+      case 's':
+         blocksize = str_to_int64(optarg);
+         break;
+      case '?':
+      default:
+         usage();
+      }
+   }
+
+   if (iterations <= 0 || blocksize <= 0) {
+      usage();
+   }
+
+   buf = (uint8_t *)malloc(MAX(blocksize, MAX_VERIFY_LENGTH) + 8);
+   srandom(1);
+   for (i = 0; i < MAX(blocksize, MAX_VERIFY_LENGTH) + 8; i++) {
+      buf[i] = random() & 0xFF;
+   }
+
+   preferred = bcrc32_get_implementation();
+   printf("Default implementation: %s\n", preferred);
+
+   /*
+    * Calculate the reference values using the portable implementation.
+    */
+   bcrc32_set_implementation("slice4");
+   reference = (uint32_t *)malloc(8 * (MAX_VERIFY_LENGTH + 1) * sizeof(uint32_t));
+   i = 0;
+   for (int offset = 0; offset < 8; offset++) {
+      for (int len = 0; len <= MAX_VERIFY_LENGTH; len++) {
+         reference[i++] = bcrc32(buf + offset, len);
+      }
+   }
+
+   for (i = 0; implementations[i]; i++) {
+      if (!bcrc32_set_implementation(implementations[i])) {
+         printf("%-8s not available\n", implementations[i]);
+         continue;
+      }
+
+      if (!verify(buf, reference)) {
+         continue;
+      }
+
+      start = get_current_btime();
+      for (int j = 0; j < iterations; j++) {
+         crc ^= bcrc32(buf, blocksize);
+      }
+      secs = (double)(get_current_btime() - start) / 1000000.0;
+
+      printf("%-8s %10d blocks of %d bytes %8.3f sec %10.1f MB/s\n", implementations[i],
+             iterations, blocksize, secs,
+             ((double)iterations * blocksize) / (secs * 1024.0 * 1024.0));
+   }
+
+   free(reference);
+   free(buf);
+
+   /*
+    * Use the result so the compiler cannot optimize the loops away.
+    */
+   return (crc == 0xFFFFFFFF) ? 1 : 0;
+}
@@ -642,6 +642,7 @@ public:
    uint32_t EndBlock;                 /**< Ending block written */
    int64_t  VolMediaId;               /**< MediaId */
    int64_t job_spool_size;            /**< Current job spool size */
+   int64_t job_prefetch_size;         /**< Bytes received while despooling */
    int64_t max_job_spool_size;        /**< Max job spool size */
    uint32_t VolMinBlocksize;          /**< Minimum Blocksize */
    uint32_t VolMaxBlocksize;          /**< Maximum Blocksize */
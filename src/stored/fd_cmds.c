@@ -43,6 +43,12 @@
 static char ferrmsg[] =
    "3900 Invalid command\n";
 
+/*
+ * Protects the registration of additional FD data connections.
+ */
+static pthread_mutex_t data_streams_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t data_streams_wait = PTHREAD_COND_INITIALIZER;
+
 /* Imported functions */
 
 /* Forward referenced FD commands */
@@ -78,6 +84,10 @@ static struct s_cmds fd_cmds[] = {
 /* Commands from the File daemon that require additional scanning */
 static char read_open[] =
    "read open session = %127s %ld %ld %ld %ld %ld %ld\n";
+static char append_open_streams[] =
+   "append open session streams=%d";
+static char append_data_streams[] =
+   "append data %ld streams=%d";
 
 /* Responses sent to the File daemon */
 static char NO_open[] =
@@ -90,6 +100,8 @@ static char OK_close[] =
    "3000 OK close Status = %d\n";
 static char OK_open[] =
    "3000 OK open ticket = %d\n";
+static char OK_open_streams[] =
+   "3000 OK open ticket = %d streams=%d key=%s\n";
 static char ERROR_append[] =
    "3903 Error append data\n";
 
@@ -160,6 +172,142 @@ void *handle_filed_connection(BSOCK *fd, char *job_name)
    return NULL;
 }
 
+/**
+ * After receiving a connection (in socket_server.c) for an additional
+ * data connection of a File daemon, this routine is called.
+ *
+ * The connection is authenticated with the key handed out when the
+ * data streams were granted and registered with the Job. It is taken
+ * over by the append data command.
+ */
+void *handle_filed_data_stream_connection(BSOCK *fd, char *job_name, int stream)
+{
+   JCR *jcr;
+
+   if (!(jcr = get_jcr_by_full_name(job_name))) {
+      Jmsg1(NULL, M_FATAL, 0, _("FD data stream connect failed: Job name not found: %s\n"), job_name);
+      fd->close();
+      delete fd;
+      return NULL;
+   }
+
+   Dmsg2(50, "Found Job %s for data stream %d\n", job_name, stream);
+
+   if (!jcr->authenticated || !jcr->data_streams_key ||
+       stream < 1 || stream >= jcr->data_streams) {
+      Jmsg2(jcr, M_FATAL, 0, _("Unexpected FD data stream %d for Job %s\n"), stream, jcr->Job);
+      goto bail_out;
+   }
+
+   fd->set_jcr(jcr);
+   if (!authenticate_filedaemon_data_stream(jcr, fd)) {
+      Dmsg2(50, "Authentication failed data stream %d Job %s\n", stream, jcr->Job);
+      goto bail_out;
+   }
+
+   P(data_streams_mutex);
+   if (jcr->data_bsocks && !jcr->data_bsocks[stream - 1]) {
+      jcr->data_bsocks[stream - 1] = fd;
+      fd = NULL;
+      pthread_cond_broadcast(&data_streams_wait);
+   }
+   V(data_streams_mutex);
+
+   if (fd) {
+      Jmsg2(jcr, M_FATAL, 0, _("Duplicate FD data stream %d for Job %s\n"), stream, jcr->Job);
+      goto bail_out;
+   }
+
+   free_jcr(jcr);
+   return NULL;
+
+bail_out:
+   fd->close();
+   delete fd;
+   free_jcr(jcr);
+   return NULL;
+}
+
+/**
+ * Release the data connections that were not taken over by the append data command.
+ */
+void free_data_streams(JCR *jcr)
+{
+   P(data_streams_mutex);
+   if (jcr->data_bsocks) {
+      for (int i = 0; i < jcr->data_streams - 1; i++) {
+         if (jcr->data_bsocks[i]) {
+            jcr->data_bsocks[i]->close();
+            delete jcr->data_bsocks[i];
+         }
+      }
+      free(jcr->data_bsocks);
+      jcr->data_bsocks = NULL;
+   }
+   if (jcr->data_streams_key) {
+      memset(jcr->data_streams_key, 0, strlen(jcr->data_streams_key));
+      free(jcr->data_streams_key);
+      jcr->data_streams_key = NULL;
+   }
+   V(data_streams_mutex);
+}
+
+/**
+ * Wait for the File daemon to connect the additional data connections
+ * it announced and hand them over to the main connection, which puts
+ * the striped packets of all of them back in order.
+ */
+static bool attach_data_streams(JCR *jcr, BSOCK *fd, int streams)
+{
+   int i;
+   int errstat = 0;
+   bool ok = true;
+   struct timeval tv;
+   struct timezone tz;
+   struct timespec timeout;
+
+   if (streams > jcr->data_streams) {
+      Jmsg2(jcr, M_FATAL, 0, _("FD wants %d data streams, but only %d were granted\n"),
+            streams, jcr->data_streams);
+      return false;
+   }
+
+   gettimeofday(&tv, &tz);
+   timeout.tv_nsec = tv.tv_usec * 1000;
+   timeout.tv_sec = tv.tv_sec + me->client_wait;
+
+   P(data_streams_mutex);
+   for (i = 0; i < streams - 1 && !job_canceled(jcr); ) {
+      if (jcr->data_bsocks[i]) {
+         i++;
+         continue;
+      }
+      errstat = pthread_cond_timedwait(&data_streams_wait, &data_streams_mutex, &timeout);
+      if (errstat == ETIMEDOUT || errstat == EINVAL || errstat == EPERM) {
+         break;
+      }
+   }
+
+   if (i < streams - 1) {
+      Jmsg2(jcr, M_FATAL, 0, _("FD data stream %d of %d did not connect\n"), i + 1, streams - 1);
+      ok = false;
+   } else {
+      for (i = 0; i < streams - 1; i++) {
+         fd->add_data_stream(jcr->data_bsocks[i]);
+         jcr->data_bsocks[i] = NULL;
+      }
+   }
+   V(data_streams_mutex);
+
+   free_data_streams(jcr);
+
+   if (ok) {
+      Dmsg2(110, "Job %s uses %d data streams\n", jcr->Job, streams);
+   }
+
+   return ok;
+}
+
 /**
  * Run a File daemon Job -- File daemon already authorized
  * Director sends us this command.
@@ -262,11 +410,22 @@ void do_fd_commands(JCR *jcr)
  */
 static bool append_data_cmd(JCR *jcr)
 {
+   long ticket;
+   int streams;
    BSOCK *fd = jcr->file_bsock;
 
    Dmsg1(120, "Append data: %s", fd->msg);
    if (jcr->session_opened) {
       Dmsg1(110, "<filed: %s", fd->msg);
+      if (sscanf(fd->msg, append_data_streams, &ticket, &streams) == 2 && streams > 1) {
+         if (!attach_data_streams(jcr, fd, streams)) {
+            pm_strcpy(jcr->errmsg, _("Attaching data streams failed.\n"));
+            fd->fsend(ERROR_append);
+            return false;
+         }
+      } else {
+         free_data_streams(jcr);
+      }
       jcr->setJobType(JT_BACKUP);
       if (do_append_data(jcr, fd, "FD")) {
          return true;
@@ -300,6 +459,7 @@ static bool append_end_session(JCR *jcr)
  */
 static bool append_open_session(JCR *jcr)
 {
+   int streams;
    BSOCK *fd = jcr->file_bsock;
 
    Dmsg1(120, "Append open session: %s", fd->msg);
@@ -311,6 +471,35 @@ static bool append_open_session(JCR *jcr)
 
    jcr->session_opened = true;
 
+   /*
+    * See if the File daemon wants to stripe the data over multiple connections.
+    */
+   if (sscanf(fd->msg, append_open_streams, &streams) == 1 && streams > 1 &&
+       me->max_data_streams_per_job > 1 && !jcr->passive_client) {
+      char seed[MAX_NAME_LENGTH];
+      char key[MAX_NAME_LENGTH];
+
+      if (streams > (int)me->max_data_streams_per_job) {
+         streams = me->max_data_streams_per_job;
+      }
+
+      bsnprintf(seed, sizeof(seed), "%p%d%d", jcr, jcr->JobId, streams);
+      make_session_key(key, seed, 1);
+
+      P(data_streams_mutex);
+      jcr->data_streams = streams;
+      jcr->data_streams_key = bstrdup(key);
+      jcr->data_bsocks = (BSOCK **)malloc((streams - 1) * sizeof(BSOCK *));
+      memset(jcr->data_bsocks, 0, (streams - 1) * sizeof(BSOCK *));
+      V(data_streams_mutex);
+
+      fd->fsend(OK_open_streams, jcr->VolSessionId, streams, key);
+      memset(key, 0, sizeof(key));
+      Dmsg2(110, ">filed: ticket=%d streams=%d\n", jcr->VolSessionId, streams);
+
+      return true;
+   }
+
    /* Send "Ticket" to File Daemon */
    fd->fsend(OK_open, jcr->VolSessionId);
    Dmsg1(110, ">filed: %s", fd->msg);
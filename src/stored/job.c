@@ -116,6 +116,7 @@ bool job_cmd(JCR *jcr)
       free_jcr(ojcr);
    }
    jcr->JobId = JobId;
+   register_jcr_jobid(jcr);
    Dmsg2(800, "Start JobId=%d %p\n", JobId, jcr);
    /*
     * If job rescheduled because previous was incomplete,
@@ -476,6 +477,8 @@ void stored_free_jcr(JCR *jcr)
       jcr->file_bsock = NULL;
    }
 
+   free_data_streams(jcr);
+
    if (jcr->job_name) {
       free_pool_memory(jcr->job_name);
    }
@@ -48,6 +48,7 @@ bool authenticate_director(JCR *jcr);
 bool authenticate_storagedaemon(JCR *jcr);
 bool authenticate_with_storagedaemon(JCR *jcr);
 bool authenticate_filedaemon(JCR *jcr);
+bool authenticate_filedaemon_data_stream(JCR *jcr, BSOCK *fd);
 bool authenticate_with_filedaemon(JCR *jcr);
 
 /* autochanger.c */
@@ -79,6 +80,8 @@ void display_tape_error_status(JCR *jcr, DEVICE *dev);
 
 /* crc32.c */
 uint32_t bcrc32(uint8_t *buf, int len);
+const char *bcrc32_get_implementation();
+bool bcrc32_set_implementation(const char *name);
 
 /* dev.c */
 DEVICE *init_dev(JCR *jcr, DEVRES *device);
@@ -107,6 +110,8 @@ void *handle_director_connection(BSOCK *dir);
 
 /* fd_cmds.c */
 void *handle_filed_connection(BSOCK *fd, char *job_name);
+void *handle_filed_data_stream_connection(BSOCK *fd, char *job_name, int stream);
+void free_data_streams(JCR *jcr);
 void run_job(JCR *jcr);
 void do_fd_commands(JCR *jcr);
 
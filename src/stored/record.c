@@ -147,6 +147,9 @@ static const char *record_compression_to_str(POOL_MEM &resultbuffer, const DEV_R
       case COMPRESS_FZ4H:
          compression_to_str(resultbuffer, "FZ4H", comp_len, comp_level, comp_version);
          break;
+      case COMPRESS_ZSTD:
+         compression_to_str(resultbuffer, "ZSTD", comp_len, comp_level, comp_version);
+         break;
       default:
          tmp.bsprintf(_("Compression algorithm 0x%x found, but not supported!\n"), comp_magic);
          resultbuffer.strcat(tmp);
@@ -555,16 +558,15 @@ void free_record(DEV_RECORD *rec)
    Dmsg0(950, "Leave free_record.\n");
 }
 
-static inline ssize_t write_header_to_block(DEV_BLOCK *block, const DEV_RECORD *rec, int32_t Stream)
+/*
+ * Serialize a record header at the current position of the block.
+ * The caller must have checked there is room for it.
+ */
+static inline void serialize_record_header(DEV_BLOCK *block, const DEV_RECORD *rec,
+                                           int32_t Stream, uint32_t remainder)
 {
    ser_declare;
 
-   /*
-    * Require enough room to write a full header
-    */
-   if (block_write_navail(block) < WRITE_RECHDR_LENGTH)
-      return -1;
-
    ser_begin(block->bufp, WRITE_RECHDR_LENGTH);
 
    if (BLOCK_VER == 1) {
@@ -578,7 +580,7 @@ static inline ssize_t write_header_to_block(DEV_BLOCK *block, const DEV_RECORD *
    ser_int32(rec->FileIndex);
    ser_int32(Stream);
 
-   ser_uint32(rec->remainder);   /* each header tracks remaining user bytes to write */
+   ser_uint32(remainder);        /* each header tracks remaining user bytes to write */
 
    block->bufp += WRITE_RECHDR_LENGTH;
    block->binbuf += WRITE_RECHDR_LENGTH;
@@ -592,10 +594,34 @@ static inline ssize_t write_header_to_block(DEV_BLOCK *block, const DEV_RECORD *
       }
       block->LastIndex = rec->FileIndex;
    }
+}
+
+static inline ssize_t write_header_to_block(DEV_BLOCK *block, const DEV_RECORD *rec, int32_t Stream)
+{
+   /*
+    * Require enough room to write a full header
+    */
+   if (block_write_navail(block) < WRITE_RECHDR_LENGTH)
+      return -1;
+
+   serialize_record_header(block, rec, Stream, rec->remainder);
 
    return WRITE_RECHDR_LENGTH;
 }
 
+/*
+ * Pack a complete record, header and data, into the block.
+ * The caller must have checked the whole record fits.
+ */
+static inline void pack_record_into_block(DEV_BLOCK *block, const DEV_RECORD *rec)
+{
+   serialize_record_header(block, rec, rec->Stream, rec->data_len);
+
+   memcpy(block->bufp, rec->data, rec->data_len);
+   block->bufp += rec->data_len;
+   block->binbuf += rec->data_len;
+}
+
 static inline ssize_t write_data_to_block(DEV_BLOCK *block, const DEV_RECORD *rec)
 {
    uint32_t len;
@@ -715,6 +741,26 @@ bool write_record_to_block(DCR *dcr, DEV_RECORD *rec)
    char buf1[100], buf2[100];
    DEV_BLOCK *block = dcr->block;
 
+   /*
+    * A new record that fits completely into the block, which is the common
+    * case for small files, is packed in one go without going through the
+    * state machine below. A record filling the block exactly is left to
+    * the state machine, as a record without data ending at the end of the
+    * block still gets a continuation header in the next one.
+    *
+    * Records are not batched any further: DCR::write_record() hands them in
+    * one at a time as they arrive from the File daemon, and each needs its
+    * own header as that carries its FileIndex, Stream and length. Only the
+    * part of a record spilling into the next block gets a continuation
+    * header, which is serialized by the same code as the record header.
+    */
+   if (rec->state == st_none &&
+       block_write_navail(block) > WRITE_RECHDR_LENGTH + rec->data_len) {
+      pack_record_into_block(block, rec);
+      rec->remainder = 0;
+      return true;
+   }
+
    /*
     * After this point the record is in nrec not rec e.g. its either converted
     * or is just a pointer to the same as the rec pointer being passed in.
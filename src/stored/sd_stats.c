@@ -38,210 +38,331 @@ static char TapeAlerts[] =
 static char JobStats[] =
    "Jobstats [%lld]: JobId=%ld, JobFiles=%lu, JobBytes=%llu, DevName=%s\n";
 
+/*
+ * Binary statistics records sent in reply to "stats binary", see also
+ * dird/stats.c. Each message holds the samples of one device or job and
+ * starts with the record type in network byte order, so its first byte
+ * is a NUL which no text line starts with.
+ */
+static char statsbinarycmd[] = "stats binary";
+
+#define STATS_RECORD_DEVICE 1
+#define STATS_RECORD_TAPEALERT 2
+#define STATS_RECORD_JOB 3
+
+/*
+ * Number of samples kept per device, tapealert list and job.
+ * When the director doesn't collect them in time the oldest are overwritten.
+ */
+#define DEVICE_STATS_RING_SIZE 1024
+#define TAPEALERT_RING_SIZE 64
+#define JOB_STATS_RING_SIZE 256
+
+/*
+ * Max number of samples sent in one message.
+ */
+#define STATS_BATCH_SIZE 256
+
+#define JOB_STATS_HASH_SIZE 256
+
 /* Static globals */
 static bool quit = false;
 static bool statistics_initialized = false;
 static pthread_t statistics_tid;
 static pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_mutex_t collect_mutex = PTHREAD_MUTEX_INITIALIZER;
 static pthread_cond_t wait_for_next_run = PTHREAD_COND_INITIALIZER;
 
-struct device_statistic {
-   dlink link;
-   bool collected;
-   utime_t timestamp;
-   btime_t DevReadTime;
-   btime_t DevWriteTime;
-   uint64_t DevWriteBytes;
-   uint64_t DevReadBytes;
-   uint64_t spool_size;
-   int num_waiting;
-   int num_writers;
-   DBId_t MediaId;
-   uint64_t VolCatBytes;
-   uint64_t VolCatFiles;
-   uint64_t VolCatBlocks;
-};
-
-struct device_tapealert {
-   dlink link;
-   utime_t timestamp;
-   uint64_t flags;
+/*
+ * Ring of samples. Sample number seq is kept in slot seq % size until it
+ * is overwritten by sample number seq + size.
+ */
+struct stats_ring {
+   uint32_t size;                     /* number of slots */
+   uint64_t stored;                   /* samples stored since creation */
+   uint64_t collected;                /* samples sent to the director */
+   uint64_t dropped;                  /* samples overwritten before being sent */
 };
 
+/*
+ * The samples are kept as a struct of arrays so a sample costs only
+ * the size of its values and comparing with the last one stays cheap.
+ */
 struct device_statistics {
-   dlink link;
+   hlink link;
    char DevName[MAX_NAME_LENGTH];
-   struct device_statistic *cached;
-   dlist *statistics;
-   dlist *tapealerts;
-};
-
-struct job_statistic {
-   dlink link;
-   bool collected;
-   utime_t timestamp;
-   uint32_t JobFiles;
-   uint64_t JobBytes;
-   char *DevName;
+   struct stats_ring ring;
+   utime_t *timestamp;
+   btime_t *DevReadTime;
+   btime_t *DevWriteTime;
+   uint64_t *DevWriteBytes;
+   uint64_t *DevReadBytes;
+   uint64_t *spool_size;
+   int32_t *num_waiting;
+   int32_t *num_writers;
+   DBId_t *MediaId;
+   uint64_t *VolCatBytes;
+   uint64_t *VolCatFiles;
+   uint64_t *VolCatBlocks;
+   struct stats_ring alerts;
+   utime_t *alert_timestamp;
+   uint64_t *alert_flags;
 };
 
 struct job_statistics {
-   dlink link;
+   struct job_statistics *next;       /* next in hash bucket */
    uint32_t JobId;
-   struct job_statistic *cached;
-   dlist *statistics;
+   struct stats_ring ring;
+   utime_t *timestamp;
+   uint32_t *JobFiles;
+   uint64_t *JobBytes;
+   const char **DevName;              /* name of the device resource */
 };
 
-static dlist *device_statistics = NULL;
-static dlist *job_statistics = NULL;
+static htable *device_statistics = NULL;
+static struct job_statistics **job_statistics = NULL;
 
 static inline void setup_statistics()
 {
    struct device_statistics *dev_stats = NULL;
-   struct job_statistics *job_stats = NULL;
 
-   device_statistics = New(dlist(dev_stats, &dev_stats->link));
-   job_statistics = New(dlist(job_stats, &job_stats->link));
+   P(mutex);
+   device_statistics = New(htable(dev_stats, &dev_stats->link, 64));
+   job_statistics = (struct job_statistics **)malloc(JOB_STATS_HASH_SIZE * sizeof(struct job_statistics *));
+   memset(job_statistics, 0, JOB_STATS_HASH_SIZE * sizeof(struct job_statistics *));
+   V(mutex);
 }
 
-void update_device_tapealert(const char *devname, uint64_t flags, utime_t now)
+/*
+ * Claim the slot for a new sample.
+ */
+static inline uint32_t ring_store(struct stats_ring *ring)
 {
-   bool found = false;
-   struct device_statistics *dev_stats = NULL;
-   struct device_tapealert *tape_alert = NULL;
+   return (uint32_t)(ring->stored++ % ring->size);
+}
 
-   if (!me || !me->collect_dev_stats || !device_statistics) {
-      return;
-   }
+/*
+ * Slot of the last sample stored.
+ */
+static inline uint32_t ring_last(struct stats_ring *ring)
+{
+   return (uint32_t)((ring->stored - 1) % ring->size);
+}
 
-   foreach_dlist(dev_stats, device_statistics) {
-      if (bstrcmp(dev_stats->DevName, devname)) {
-         found = true;
-         break;
-      }
+/*
+ * Number of the first sample not sent to the director yet that is still
+ * in the ring. Samples overwritten before being sent are accounted for.
+ */
+static inline uint64_t ring_first_pending(struct stats_ring *ring)
+{
+   uint64_t oldest;
+
+   oldest = (ring->stored > ring->size) ? ring->stored - ring->size : 0;
+   if (ring->collected < oldest) {
+      ring->dropped += oldest - ring->collected;
+      ring->collected = oldest;
    }
 
-   if (!found) {
+   return ring->collected;
+}
+
+/*
+ * Lookup the statistics of a device, creating them when needed.
+ * Called with the mutex held.
+ */
+static struct device_statistics *get_device_statistics(const char *devname)
+{
+   struct device_statistics *dev_stats;
+
+   dev_stats = (struct device_statistics *)device_statistics->lookup((char *)devname);
+   if (!dev_stats) {
       dev_stats = (struct device_statistics *)malloc(sizeof(struct device_statistics));
       memset(dev_stats, 0, sizeof(struct device_statistics));
-
       bstrncpy(dev_stats->DevName, devname, sizeof(dev_stats->DevName));
-      P(mutex);
-      device_statistics->append(dev_stats);
-      V(mutex);
+      device_statistics->insert(dev_stats->DevName, dev_stats);
    }
 
-   /*
-    * Add a new tapealert message.
-    */
-   tape_alert = (struct device_tapealert *)malloc(sizeof(struct device_tapealert));
-   memset(tape_alert, 0, sizeof(struct device_tapealert));
+   return dev_stats;
+}
 
-   tape_alert->timestamp = now;
-   tape_alert->flags = flags;
+static void free_device_statistics(struct device_statistics *dev_stats)
+{
+   if (dev_stats->ring.size) {
+      free(dev_stats->timestamp);
+      free(dev_stats->DevReadTime);
+      free(dev_stats->DevWriteTime);
+      free(dev_stats->DevWriteBytes);
+      free(dev_stats->DevReadBytes);
+      free(dev_stats->spool_size);
+      free(dev_stats->num_waiting);
+      free(dev_stats->num_writers);
+      free(dev_stats->MediaId);
+      free(dev_stats->VolCatBytes);
+      free(dev_stats->VolCatFiles);
+      free(dev_stats->VolCatBlocks);
+   }
+   if (dev_stats->alerts.size) {
+      free(dev_stats->alert_timestamp);
+      free(dev_stats->alert_flags);
+   }
+   free(dev_stats);
+}
 
-   if (!dev_stats->tapealerts) {
-      dev_stats->tapealerts = New(dlist(tape_alert, &tape_alert->link));
+/*
+ * Lookup the statistics of a job, optionally creating them.
+ * Called with the mutex held.
+ */
+static struct job_statistics *get_job_statistics(uint32_t JobId, bool create)
+{
+   struct job_statistics *job_stats;
+   int size = JOB_STATS_RING_SIZE;
+
+   for (job_stats = job_statistics[JobId % JOB_STATS_HASH_SIZE]; job_stats; job_stats = job_stats->next) {
+      if (job_stats->JobId == JobId) {
+         return job_stats;
+      }
+   }
+
+   if (create) {
+      job_stats = (struct job_statistics *)malloc(sizeof(struct job_statistics));
+      memset(job_stats, 0, sizeof(struct job_statistics));
+      job_stats->JobId = JobId;
+      job_stats->ring.size = size;
+      job_stats->timestamp = (utime_t *)malloc(size * sizeof(utime_t));
+      job_stats->JobFiles = (uint32_t *)malloc(size * sizeof(uint32_t));
+      job_stats->JobBytes = (uint64_t *)malloc(size * sizeof(uint64_t));
+      job_stats->DevName = (const char **)malloc(size * sizeof(const char *));
+      job_stats->next = job_statistics[JobId % JOB_STATS_HASH_SIZE];
+      job_statistics[JobId % JOB_STATS_HASH_SIZE] = job_stats;
+   }
+
+   return job_stats;
+}
+
+static void free_job_statistics(struct job_statistics *job_stats)
+{
+   free(job_stats->timestamp);
+   free(job_stats->JobFiles);
+   free(job_stats->JobBytes);
+   free(job_stats->DevName);
+   free(job_stats);
+}
+
+void update_device_tapealert(const char *devname, uint64_t flags, utime_t now)
+{
+   uint32_t slot;
+   int size = TAPEALERT_RING_SIZE;
+   struct device_statistics *dev_stats;
+
+   if (!me || !me->collect_dev_stats) {
+      return;
    }
 
    P(mutex);
-   dev_stats->tapealerts->append(tape_alert);
+   if (!device_statistics) {
+      V(mutex);
+      return;
+   }
+
+   dev_stats = get_device_statistics(devname);
+   if (!dev_stats->alerts.size) {
+      dev_stats->alerts.size = size;
+      dev_stats->alert_timestamp = (utime_t *)malloc(size * sizeof(utime_t));
+      dev_stats->alert_flags = (uint64_t *)malloc(size * sizeof(uint64_t));
+   }
+
+   /*
+    * Add a new tapealert message.
+    */
+   slot = ring_store(&dev_stats->alerts);
+   dev_stats->alert_timestamp[slot] = now;
+   dev_stats->alert_flags[slot] = flags;
    V(mutex);
 
-   Dmsg3(200, "New stats [%lld]: Device %s TapeAlert %llu\n",
-         tape_alert->timestamp, dev_stats->DevName, tape_alert->flags);
+   Dmsg3(200, "New stats [%lld]: Device %s TapeAlert %llu\n", now, devname, flags);
 }
 
 static inline void update_device_statistics(const char *devname, DEVICE *dev, utime_t now)
 {
-   bool found = false;
-   struct device_statistics *dev_stats = NULL;
-   struct device_statistic *dev_stat = NULL;
+   uint32_t slot;
+   int size = DEVICE_STATS_RING_SIZE;
+   struct device_statistics *dev_stats;
 
-   if (!me || !me->collect_dev_stats || !device_statistics) {
+   if (!me || !me->collect_dev_stats) {
       return;
    }
 
-   /*
-    * See if we already have statistics for this device.
-    */
-   foreach_dlist(dev_stats, device_statistics) {
-      if (bstrcmp(dev_stats->DevName, devname)) {
-         found = true;
-         break;
-      }
+   P(mutex);
+   if (!device_statistics) {
+      V(mutex);
+      return;
+   }
+
+   dev_stats = get_device_statistics(devname);
+   if (!dev_stats->ring.size) {
+      dev_stats->ring.size = size;
+      dev_stats->timestamp = (utime_t *)malloc(size * sizeof(utime_t));
+      dev_stats->DevReadTime = (btime_t *)malloc(size * sizeof(btime_t));
+      dev_stats->DevWriteTime = (btime_t *)malloc(size * sizeof(btime_t));
+      dev_stats->DevWriteBytes = (uint64_t *)malloc(size * sizeof(uint64_t));
+      dev_stats->DevReadBytes = (uint64_t *)malloc(size * sizeof(uint64_t));
+      dev_stats->spool_size = (uint64_t *)malloc(size * sizeof(uint64_t));
+      dev_stats->num_waiting = (int32_t *)malloc(size * sizeof(int32_t));
+      dev_stats->num_writers = (int32_t *)malloc(size * sizeof(int32_t));
+      dev_stats->MediaId = (DBId_t *)malloc(size * sizeof(DBId_t));
+      dev_stats->VolCatBytes = (uint64_t *)malloc(size * sizeof(uint64_t));
+      dev_stats->VolCatFiles = (uint64_t *)malloc(size * sizeof(uint64_t));
+      dev_stats->VolCatBlocks = (uint64_t *)malloc(size * sizeof(uint64_t));
    }
 
    /*
-    * If we have statistics and the cached entry is filled it points
-    * to the latest sampled statistics so we compare them with the current
+    * If we have statistics compare the latest sample with the current
     * statistics and if nothing changed we just return.
     */
-   if (found && dev_stats->cached) {
-      dev_stat = dev_stats->cached;
-
-      if (dev_stat->DevReadBytes == dev->DevReadBytes &&
-          dev_stat->DevWriteBytes == dev->DevWriteBytes &&
-          dev_stat->spool_size == dev->spool_size) {
+   if (dev_stats->ring.stored > 0) {
+      slot = ring_last(&dev_stats->ring);
+      if (dev_stats->DevReadBytes[slot] == dev->DevReadBytes &&
+          dev_stats->DevWriteBytes[slot] == dev->DevWriteBytes &&
+          dev_stats->spool_size[slot] == dev->spool_size) {
+         V(mutex);
          return;
       }
-   } else if (!found) {
-      dev_stats = (struct device_statistics *)malloc(sizeof(struct device_statistics));
-      memset(dev_stats, 0, sizeof(struct device_statistics));
-
-      bstrncpy(dev_stats->DevName, devname, sizeof(dev_stats->DevName));
-      P(mutex);
-      device_statistics->append(dev_stats);
-      V(mutex);
    }
 
    /*
     * Add a new set of statistics.
     */
-   dev_stat = (struct device_statistic *)malloc(sizeof(struct device_statistic));
-   memset(dev_stat, 0, sizeof(struct device_statistic));
-
-   dev_stat->timestamp = now;
-   dev_stat->DevReadTime = dev->DevReadTime;
-   dev_stat->DevWriteTime = dev->DevWriteTime;
-   dev_stat->DevWriteBytes = dev->DevWriteBytes;
-   dev_stat->DevReadBytes = dev->DevReadBytes;
-   dev_stat->spool_size = dev->spool_size;
-   dev_stat->num_waiting = dev->num_waiting;
-   dev_stat->num_writers = dev->num_writers;
-   dev_stat->MediaId = dev->VolCatInfo.VolMediaId;
-   dev_stat->VolCatBytes = dev->VolCatInfo.VolCatBytes;
-   dev_stat->VolCatFiles = dev->VolCatInfo.VolCatFiles;
-   dev_stat->VolCatBlocks = dev->VolCatInfo.VolCatBlocks;
-
-
-   if (!dev_stats->statistics) {
-      dev_stats->statistics = New(dlist(dev_stat, &dev_stat->link));
-   }
-
-   P(mutex);
-   dev_stats->cached = dev_stat;
-   dev_stats->statistics->append(dev_stat);
+   slot = ring_store(&dev_stats->ring);
+   dev_stats->timestamp[slot] = now;
+   dev_stats->DevReadTime[slot] = dev->DevReadTime;
+   dev_stats->DevWriteTime[slot] = dev->DevWriteTime;
+   dev_stats->DevWriteBytes[slot] = dev->DevWriteBytes;
+   dev_stats->DevReadBytes[slot] = dev->DevReadBytes;
+   dev_stats->spool_size[slot] = dev->spool_size;
+   dev_stats->num_waiting[slot] = dev->num_waiting;
+   dev_stats->num_writers[slot] = dev->num_writers;
+   dev_stats->MediaId[slot] = dev->VolCatInfo.VolMediaId;
+   dev_stats->VolCatBytes[slot] = dev->VolCatInfo.VolCatBytes;
+   dev_stats->VolCatFiles[slot] = dev->VolCatInfo.VolCatFiles;
+   dev_stats->VolCatBlocks[slot] = dev->VolCatInfo.VolCatBlocks;
    V(mutex);
 
    Dmsg5(200, "New stats [%lld]: Device %s Read %llu, Write %llu, Spoolsize %llu,\n",
-         dev_stat->timestamp, dev_stats->DevName, dev_stat->DevReadBytes,
-         dev_stat->DevWriteBytes, dev_stat->spool_size);
+         now, devname, dev->DevReadBytes, dev->DevWriteBytes, dev->spool_size);
    Dmsg4(200, "NumWaiting %ld, NumWriters %ld, ReadTime=%lld, WriteTime=%lld,\n",
-         dev_stat->num_waiting, dev_stat->num_writers, dev_stat->DevReadTime,
-         dev_stat->DevWriteTime);
+         dev->num_waiting, dev->num_writers, dev->DevReadTime, dev->DevWriteTime);
    Dmsg4(200, "MediaId=%ld VolBytes=%llu, VolFiles=%llu, VolBlocks=%llu\n",
-         dev_stat->MediaId, dev_stat->VolCatBytes, dev_stat->VolCatFiles,
-         dev_stat->VolCatBlocks);
+         dev->VolCatInfo.VolMediaId, dev->VolCatInfo.VolCatBytes,
+         dev->VolCatInfo.VolCatFiles, dev->VolCatInfo.VolCatBlocks);
 }
 
 void update_job_statistics(JCR *jcr, utime_t now)
 {
-   bool found = false;
-   struct job_statistics *job_stats = NULL;
-   struct job_statistic *job_stat = NULL;
+   uint32_t slot;
+   const char *DevName;
+   struct job_statistics *job_stats;
 
-   if (!me || !me->collect_job_stats || !job_statistics) {
+   if (!me || !me->collect_job_stats) {
       return;
    }
 
@@ -252,90 +373,73 @@ void update_job_statistics(JCR *jcr, utime_t now)
       return;
    }
 
-   /*
-    * See if we already have statistics for this job.
-    */
-   foreach_dlist(job_stats, job_statistics) {
-      if (job_stats->JobId == jcr->JobId) {
-         found = true;
-         break;
-      }
+   P(mutex);
+   if (!job_statistics) {
+      V(mutex);
+      return;
    }
 
    /*
-    * If we have statistics and the cached entry is filled it points
-    * to the latest sampled statistics so we compare them with the current
+    * If we have statistics compare the latest sample with the current
     * statistics and if nothing changed we just return.
     */
-   if (found && job_stats->cached) {
-      job_stat = job_stats->cached;
-
-      if (job_stat->JobFiles == jcr->JobFiles &&
-          job_stat->JobBytes == jcr->JobBytes) {
+   job_stats = get_job_statistics(jcr->JobId, true);
+   if (job_stats->ring.stored > 0) {
+      slot = ring_last(&job_stats->ring);
+      if (job_stats->JobFiles[slot] == jcr->JobFiles &&
+          job_stats->JobBytes[slot] == jcr->JobBytes) {
+         V(mutex);
          return;
       }
-   } else if (!found) {
-      job_stats = (struct job_statistics *)malloc(sizeof(struct job_statistics));
-      memset(job_stats, 0, sizeof(struct job_statistics));
-
-      job_stats->JobId = jcr->JobId;
-      P(mutex);
-      job_statistics->append(job_stats);
-      V(mutex);
    }
 
    /*
     * Add a new set of statistics.
     */
-   job_stat = (struct job_statistic *)malloc(sizeof(struct job_statistic));
-   memset(job_stat, 0, sizeof(struct job_statistic));
-
-   job_stat->timestamp = now;
-   job_stat->JobFiles = jcr->JobFiles;
-   job_stat->JobBytes = jcr->JobBytes;
    if (jcr->dcr) {
-      job_stat->DevName = bstrdup(jcr->dcr->device->name());
+      DevName = jcr->dcr->device->name();
    } else {
-      job_stat->DevName = bstrdup("unknown");
-   }
-
-   if (!job_stats->statistics) {
-      job_stats->statistics = New(dlist(job_stat, &job_stat->link));
+      DevName = "unknown";
    }
 
-   P(mutex);
-   job_stats->cached = job_stat;
-   job_stats->statistics->append(job_stat);
+   slot = ring_store(&job_stats->ring);
+   job_stats->timestamp[slot] = now;
+   job_stats->JobFiles[slot] = jcr->JobFiles;
+   job_stats->JobBytes[slot] = jcr->JobBytes;
+   job_stats->DevName[slot] = DevName;
    V(mutex);
 
    Dmsg5(200, "New stats [%lld]: JobId %ld, JobFiles %lu, JobBytes %llu, DevName %s\n",
-         job_stat->timestamp, job_stats->JobId, job_stat->JobFiles,
-         job_stat->JobBytes, job_stat->DevName);
+         now, jcr->JobId, jcr->JobFiles, jcr->JobBytes, DevName);
 }
 
 static inline void cleanup_cached_statistics()
 {
-   struct device_statistics *dev_stats;
+   struct device_statistics *dev_stats, *next_dev_stats;
    struct job_statistics *job_stats;
 
    P(mutex);
    if (device_statistics) {
-      foreach_dlist(dev_stats, device_statistics) {
-         dev_stats->statistics->destroy();
-         dev_stats->statistics = NULL;
+      dev_stats = (struct device_statistics *)device_statistics->first();
+      while (dev_stats) {
+         next_dev_stats = (struct device_statistics *)device_statistics->next();
+         free_device_statistics(dev_stats);
+         dev_stats = next_dev_stats;
       }
 
-      device_statistics->destroy();
+      delete device_statistics;
       device_statistics = NULL;
    }
 
    if (job_statistics) {
-      foreach_dlist(job_stats, job_statistics) {
-         job_stats->statistics->destroy();
-         job_stats->statistics = NULL;
+      for (int i = 0; i < JOB_STATS_HASH_SIZE; i++) {
+         while ((job_stats = job_statistics[i])) {
+            job_statistics[i] = job_stats->next;
+            free_job_statistics(job_stats);
+         }
       }
 
-      job_statistics->destroy();
+      free(job_statistics);
       job_statistics = NULL;
    }
    V(mutex);
@@ -461,147 +565,323 @@ void stop_statistics_thread()
    }
 }
 
-bool stats_cmd(JCR *jcr)
+/*
+ * Serialize the samples of a device not sent to the director yet,
+ * at most STATS_BATCH_SIZE of them.
+ * Called with the mutex held.
+ * Returns: number of samples serialized, the samples up to *upto are in buf.
+ */
+static int serialize_device_statistics(struct device_statistics *dev_stats, POOL_MEM &buf,
+                                       int32_t *len, uint64_t *upto)
 {
-   BSOCK *dir = jcr->dir_bsock;
+   int cnt;
+   uint32_t slot;
+   uint64_t seq;
+   ser_declare;
+
+   seq = ring_first_pending(&dev_stats->ring);
+   cnt = MIN(dev_stats->ring.stored - seq, STATS_BATCH_SIZE);
+   if (cnt == 0) {
+      return 0;
+   }
+
+   buf.check_size(8 + MAX_NAME_LENGTH + cnt * 84);
+   ser_begin(buf.c_str(), 0);
+   ser_uint32(STATS_RECORD_DEVICE);
+   ser_string(dev_stats->DevName);
+   ser_uint32(cnt);
+   for (int i = 0; i < cnt; i++, seq++) {
+      slot = seq % dev_stats->ring.size;
+      ser_uint64(dev_stats->timestamp[slot]);
+      ser_uint64(dev_stats->DevReadBytes[slot]);
+      ser_uint64(dev_stats->DevWriteBytes[slot]);
+      ser_uint64(dev_stats->spool_size[slot]);
+      ser_int32(dev_stats->num_waiting[slot]);
+      ser_int32(dev_stats->num_writers[slot]);
+      ser_uint64(dev_stats->DevReadTime[slot]);
+      ser_uint64(dev_stats->DevWriteTime[slot]);
+      ser_uint32(dev_stats->MediaId[slot]);
+      ser_uint64(dev_stats->VolCatBytes[slot]);
+      ser_uint64(dev_stats->VolCatFiles[slot]);
+      ser_uint64(dev_stats->VolCatBlocks[slot]);
+   }
+   *len = ser_length(buf.c_str());
+   *upto = seq;
+
+   return cnt;
+}
+
+/*
+ * Serialize the tapealerts of a device not sent to the director yet.
+ * Called with the mutex held.
+ */
+static int serialize_tapealerts(struct device_statistics *dev_stats, POOL_MEM &buf,
+                                int32_t *len, uint64_t *upto)
+{
+   int cnt;
+   uint32_t slot;
+   uint64_t seq;
+   ser_declare;
+
+   seq = ring_first_pending(&dev_stats->alerts);
+   cnt = MIN(dev_stats->alerts.stored - seq, STATS_BATCH_SIZE);
+   if (cnt == 0) {
+      return 0;
+   }
+
+   buf.check_size(8 + MAX_NAME_LENGTH + cnt * 16);
+   ser_begin(buf.c_str(), 0);
+   ser_uint32(STATS_RECORD_TAPEALERT);
+   ser_string(dev_stats->DevName);
+   ser_uint32(cnt);
+   for (int i = 0; i < cnt; i++, seq++) {
+      slot = seq % dev_stats->alerts.size;
+      ser_uint64(dev_stats->alert_timestamp[slot]);
+      ser_uint64(dev_stats->alert_flags[slot]);
+   }
+   *len = ser_length(buf.c_str());
+   *upto = seq;
+
+   return cnt;
+}
+
+/*
+ * Serialize the samples of a job not sent to the director yet.
+ * Called with the mutex held.
+ */
+static int serialize_job_statistics(struct job_statistics *job_stats, POOL_MEM &buf,
+                                    int32_t *len, uint64_t *upto)
+{
+   int cnt;
+   uint32_t slot;
+   uint64_t seq;
+   ser_declare;
+
+   seq = ring_first_pending(&job_stats->ring);
+   cnt = MIN(job_stats->ring.stored - seq, STATS_BATCH_SIZE);
+   if (cnt == 0) {
+      return 0;
+   }
+
+   buf.check_size(12 + cnt * (20 + MAX_NAME_LENGTH));
+   ser_begin(buf.c_str(), 0);
+   ser_uint32(STATS_RECORD_JOB);
+   ser_uint32(job_stats->JobId);
+   ser_uint32(cnt);
+   for (int i = 0; i < cnt; i++, seq++) {
+      slot = seq % job_stats->ring.size;
+      ser_uint64(job_stats->timestamp[slot]);
+      ser_uint32(job_stats->JobFiles[slot]);
+      ser_uint64(job_stats->JobBytes[slot]);
+      ser_string(job_stats->DevName[slot]);
+   }
+   *len = ser_length(buf.c_str());
+   *upto = seq;
+
+   return cnt;
+}
+
+/*
+ * Send serialized samples to the director, either as is or
+ * as text lines for directors that don't ask for binary records.
+ */
+static bool send_statistics(BSOCK *dir, POOL_MEM &buf, int32_t len, bool binary)
+{
+   int cnt;
+   uint32_t type, JobId;
+   char DevName[MAX_NAME_LENGTH];
    POOL_MEM msg(PM_MESSAGE);
-   POOL_MEM dev_tmp(PM_MESSAGE);
+   unser_declare;
 
-   if (device_statistics) {
-      struct device_statistics *dev_stats;
-
-      foreach_dlist(dev_stats, device_statistics) {
-         if (dev_stats->statistics) {
-            struct device_statistic *dev_stat, *next_dev_stat;
-
-            dev_stat = (struct device_statistic *)dev_stats->statistics->first();
-            while (dev_stat) {
-               next_dev_stat = (struct device_statistic *)dev_stats->statistics->next(dev_stat);
-
-               /*
-                * If the entry was already collected no need to do it again.
-                */
-               if (!dev_stat->collected) {
-                  pm_strcpy(dev_tmp, dev_stats->DevName);
-                  bash_spaces(dev_tmp);
-                  Mmsg(msg, DevStats, dev_stat->timestamp, dev_tmp.c_str(),
-                       dev_stat->DevReadBytes, dev_stat->DevWriteBytes,
-                       dev_stat->spool_size, dev_stat->num_waiting,
-                       dev_stat->num_writers, dev_stat->DevReadTime,
-                       dev_stat->DevWriteTime, dev_stat->MediaId,
-                       dev_stat->VolCatBytes, dev_stat->VolCatFiles,
-                       dev_stat->VolCatBlocks);
-                  Dmsg1(100, ">dird: %s", msg.c_str());
-                  dir->fsend(msg.c_str());
-               }
+   if (binary) {
+      dir->msg = check_pool_memory_size(dir->msg, len);
+      memcpy(dir->msg, buf.c_str(), len);
+      dir->msglen = len;
+      return dir->send();
+   }
 
-               P(mutex);
-               /*
-                * If this is the last one on the list leave it for comparison.
-                */
-               if (!next_dev_stat) {
-                  dev_stat->collected = true;
-               } else {
-                  dev_stats->statistics->remove(dev_stat);
-
-                  if (dev_stats->cached == dev_stat) {
-                     dev_stats->cached = NULL;
-                  }
-               }
-               V(mutex);
-               dev_stat = next_dev_stat;
-            }
+   unser_begin(buf.c_str(), len);
+   unser_uint32(type);
+   switch (type) {
+   case STATS_RECORD_DEVICE: {
+      uint64_t timestamp, DevReadTime, DevWriteTime;
+      uint64_t DevReadBytes, DevWriteBytes, spool_size;
+      uint64_t VolCatBytes, VolCatFiles, VolCatBlocks;
+      int32_t num_waiting, num_writers;
+      uint32_t MediaId;
+
+      unser_string(DevName);
+      bash_spaces(DevName);
+      unser_uint32(cnt);
+      for (int i = 0; i < cnt; i++) {
+         unser_uint64(timestamp);
+         unser_uint64(DevReadBytes);
+         unser_uint64(DevWriteBytes);
+         unser_uint64(spool_size);
+         unser_int32(num_waiting);
+         unser_int32(num_writers);
+         unser_uint64(DevReadTime);
+         unser_uint64(DevWriteTime);
+         unser_uint32(MediaId);
+         unser_uint64(VolCatBytes);
+         unser_uint64(VolCatFiles);
+         unser_uint64(VolCatBlocks);
+         Mmsg(msg, DevStats, (int64_t)timestamp, DevName, DevReadBytes, DevWriteBytes,
+              spool_size, (long)num_waiting, (long)num_writers, (int64_t)DevReadTime, (int64_t)DevWriteTime,
+              (long)MediaId, VolCatBytes, VolCatFiles, VolCatBlocks);
+         Dmsg1(100, ">dird: %s", msg.c_str());
+         if (!dir->fsend(msg.c_str())) {
+            return false;
          }
-
-         if (dev_stats->tapealerts) {
-            struct device_tapealert *tape_alert, *next_tape_alert;
-
-            tape_alert = (struct device_tapealert *)dev_stats->tapealerts->first();
-            while (tape_alert) {
-               pm_strcpy(dev_tmp, dev_stats->DevName);
-               bash_spaces(dev_tmp);
-               Mmsg(msg, TapeAlerts, tape_alert->timestamp, dev_tmp.c_str(), tape_alert->flags);
-               Dmsg1(100, ">dird: %s", msg.c_str());
-               dir->fsend(msg.c_str());
-
-               next_tape_alert = (struct device_tapealert *)dev_stats->tapealerts->next(tape_alert);
-               P(mutex);
-               dev_stats->tapealerts->remove(tape_alert);
-               V(mutex);
-               tape_alert = next_tape_alert;
-            }
+      }
+      break;
+   }
+   case STATS_RECORD_TAPEALERT: {
+      uint64_t timestamp, flags;
+
+      unser_string(DevName);
+      bash_spaces(DevName);
+      unser_uint32(cnt);
+      for (int i = 0; i < cnt; i++) {
+         unser_uint64(timestamp);
+         unser_uint64(flags);
+         Mmsg(msg, TapeAlerts, (int64_t)timestamp, DevName, flags);
+         Dmsg1(100, ">dird: %s", msg.c_str());
+         if (!dir->fsend(msg.c_str())) {
+            return false;
+         }
+      }
+      break;
+   }
+   case STATS_RECORD_JOB: {
+      uint64_t timestamp, JobBytes;
+      uint32_t JobFiles;
+
+      unser_uint32(JobId);
+      unser_uint32(cnt);
+      for (int i = 0; i < cnt; i++) {
+         unser_uint64(timestamp);
+         unser_uint32(JobFiles);
+         unser_uint64(JobBytes);
+         unser_string(DevName);
+         bash_spaces(DevName);
+         Mmsg(msg, JobStats, (int64_t)timestamp, (long)JobId, (unsigned long)JobFiles, JobBytes, DevName);
+         Dmsg1(100, ">dird: %s", msg.c_str());
+         if (!dir->fsend(msg.c_str())) {
+            return false;
          }
       }
+      break;
+   }
+   default:
+      break;
    }
 
-   if (job_statistics) {
-      bool found;
-      JCR *jcr;
-      struct job_statistics *job_stats, *next_job_stats;
-
-      job_stats = (struct job_statistics *)job_statistics->first();
-      while (job_stats) {
-         if (job_stats->statistics) {
-            struct job_statistic *job_stat, *next_job_stat;
-
-            job_stat = (struct job_statistic *)job_stats->statistics->first();
-            while (job_stat) {
-               next_job_stat = (struct job_statistic *)job_stats->statistics->next(job_stat);
-
-               /*
-                * If the entry was already collected no need to do it again.
-                */
-               if (!job_stat->collected) {
-                  pm_strcpy(dev_tmp, job_stat->DevName);
-                  bash_spaces(dev_tmp);
-                  Mmsg(msg, JobStats, job_stat->timestamp, job_stats->JobId,
-                       job_stat->JobFiles, job_stat->JobBytes, dev_tmp.c_str());
-                  Dmsg1(100, ">dird: %s", msg.c_str());
-                  dir->fsend(msg.c_str());
-               }
+   return true;
+}
 
-               P(mutex);
-               /*
-                * If this is the last one on the list leave it for comparison.
-                */
-               if (!next_job_stat) {
-                  job_stat->collected = true;
-               } else {
-                  job_stats->statistics->remove(job_stat);
-                  if (job_stats->cached == job_stat) {
-                     job_stats->cached = NULL;
-                  }
-               }
-               V(mutex);
-               job_stat = next_job_stat;
-            }
+bool stats_cmd(JCR *jcr)
+{
+   bool binary;
+   int32_t len;
+   uint64_t upto;
+   BSOCK *dir = jcr->dir_bsock;
+   POOL_MEM buf(PM_MESSAGE);
+   alist devices(10, not_owned_by_alist);
+   alist jobs(10, not_owned_by_alist);
+   struct device_statistics *dev_stats;
+   struct job_statistics *job_stats;
+
+   binary = bstrncmp(dir->msg, statsbinarycmd, strlen(statsbinarycmd));
+
+   /*
+    * Only one director at a time collects the samples. The samples are
+    * serialized with the mutex held and sent without it.
+    */
+   P(collect_mutex);
+   P(mutex);
+   if (device_statistics) {
+      foreach_htable(dev_stats, device_statistics) {
+         devices.append(dev_stats);
+      }
+   }
+   if (job_statistics) {
+      for (int i = 0; i < JOB_STATS_HASH_SIZE; i++) {
+         for (job_stats = job_statistics[i]; job_stats; job_stats = job_stats->next) {
+            jobs.append(job_stats);
          }
+      }
+   }
 
-         /*
-          * If the Job doesn't exist anymore remove it from the job_statistics.
-          */
-         next_job_stats = (struct job_statistics *)job_statistics->next(job_stats);
+   foreach_alist(dev_stats, &devices) {
+      while (serialize_device_statistics(dev_stats, buf, &len, &upto) > 0) {
+         V(mutex);
+         if (!send_statistics(dir, buf, len, binary)) {
+            goto bail_out;
+         }
+         P(mutex);
+         dev_stats->ring.collected = upto;
+      }
 
-         found = false;
-         foreach_jcr(jcr) {
-            if (jcr->JobId == job_stats->JobId) {
-               found = true;
-               break;
-            }
+      while (serialize_tapealerts(dev_stats, buf, &len, &upto) > 0) {
+         V(mutex);
+         if (!send_statistics(dir, buf, len, binary)) {
+            goto bail_out;
          }
-         endeach_jcr(jcr);
+         P(mutex);
+         dev_stats->alerts.collected = upto;
+      }
+
+      if (dev_stats->ring.dropped || dev_stats->alerts.dropped) {
+         Dmsg3(100, "Device %s: %llu samples and %llu tapealerts dropped before being collected\n",
+               dev_stats->DevName, dev_stats->ring.dropped, dev_stats->alerts.dropped);
+         dev_stats->ring.dropped = 0;
+         dev_stats->alerts.dropped = 0;
+      }
+   }
 
-         if (!found) {
-            P(mutex);
-            Dmsg1(200, "Removing jobid %d from job_statistics\n", job_stats->JobId);
-            job_statistics->remove(job_stats);
-            V(mutex);
+   foreach_alist(job_stats, &jobs) {
+      JCR *job_jcr;
+      struct job_statistics **pp;
+
+      while (serialize_job_statistics(job_stats, buf, &len, &upto) > 0) {
+         V(mutex);
+         if (!send_statistics(dir, buf, len, binary)) {
+            goto bail_out;
          }
+         P(mutex);
+         job_stats->ring.collected = upto;
+      }
 
-         job_stats = next_job_stats;
+      /*
+       * If the Job doesn't exist anymore remove it from the job_statistics.
+       */
+      V(mutex);
+      job_jcr = get_jcr_by_id(job_stats->JobId);
+      if (job_jcr) {
+         free_jcr(job_jcr);
+         P(mutex);
+         continue;
       }
+
+      P(mutex);
+      Dmsg1(200, "Removing jobid %d from job_statistics\n", job_stats->JobId);
+      for (pp = &job_statistics[job_stats->JobId % JOB_STATS_HASH_SIZE]; *pp; pp = &(*pp)->next) {
+         if (*pp == job_stats) {
+            *pp = job_stats->next;
+            break;
+         }
+      }
+      free_job_statistics(job_stats);
    }
+   V(mutex);
+   V(collect_mutex);
+
    dir->fsend(OKstats);
 
    return false;
+
+bail_out:
+   V(collect_mutex);
+   return false;
 }
@@ -56,6 +56,7 @@ static pthread_t tcp_server_tid;
 static void *handle_connection_request(void *arg)
 {
    BSOCK *bs = (BSOCK *)arg;
+   int stream;
    char name[MAX_NAME_LENGTH];
    char tbuf[MAX_TIME_LENGTH];
 
@@ -79,6 +80,14 @@ static void *handle_connection_request(void *arg)
 
    Dmsg1(110, "Conn: %s", bs->msg);
 
+   /*
+    * See if this is an additional File daemon data connection. If so call FD data stream handler.
+    */
+   if (sscanf(bs->msg, "Hello Data Stream %d Job %127s", &stream, name) == 2) {
+      Dmsg1(110, "Got a FD data stream connection at %s\n", bstrftimes(tbuf, sizeof(tbuf), (utime_t)time(NULL)));
+      return handle_filed_data_stream_connection(bs, name, stream);
+   }
+
    /*
     * See if this is a File daemon connection. If so call FD handler.
     */
@@ -35,11 +35,17 @@ static void make_unique_data_spool_filename(DCR *dcr, POOLMEM *&name);
 static bool open_data_spool_file(DCR *dcr);
 static bool close_data_spool_file(DCR *dcr, bool end_of_spool);
 static bool despool_data(DCR *dcr, bool commit);
-static int  read_block_from_spool_file(DCR *dcr);
+static struct despool_reader *start_despool_reader(DCR *dcr);
+static int read_block_from_despool_reader(struct despool_reader *rd, DCR *dcr);
+static void stop_despool_reader(struct despool_reader *rd);
+static struct spool_prefetch *start_spool_prefetch(DCR *dcr);
+static bool stop_spool_prefetch(struct spool_prefetch *pf);
 static bool open_attr_spool_file(JCR *jcr, BSOCK *bs);
 static bool close_attr_spool_file(JCR *jcr, BSOCK *bs);
 static bool write_spool_header(DCR *dcr);
 static bool write_spool_data(DCR *dcr);
+static void update_prefetch_spool_size(DCR *dcr, int64_t size);
+static bool spool_size_reached(DCR *dcr, int64_t max_job_spool_size, int64_t max_spool_size);
 
 struct spool_stats_t {
    uint32_t data_jobs;                /* current jobs spooling data */
@@ -50,6 +56,14 @@ struct spool_stats_t {
    int64_t max_attr_size;
    int64_t data_size;                 /* current data size (all jobs running) */
    int64_t attr_size;
+   uint32_t despool_jobs;             /* current jobs despooling data */
+   uint32_t total_despool_runs;       /* total despool runs */
+   uint64_t despool_bytes;            /* total bytes despooled */
+   uint64_t despool_time;             /* total seconds spent despooling */
+   uint64_t last_despool_rate;        /* bytes/second of last despool run */
+   uint64_t despool_stalls;           /* times the device waited for the spool file */
+   uint32_t prefetch_jobs;            /* current jobs receiving data while despooling */
+   int64_t prefetch_size;             /* bytes received while despooling */
 };
 
 static pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
@@ -63,6 +77,68 @@ struct spool_hdr {
    uint32_t len;                      /* length of next buffer */
 };
 
+/*
+ * Amount of spooled data read ahead while despooling.
+ */
+#define DESPOOL_READ_AHEAD_SIZE (16 * 1024 * 1024)
+#define DESPOOL_MIN_SLOTS 4
+#define DESPOOL_MAX_SLOTS 256
+
+/**
+ * Block read ahead from the spool file.
+ */
+struct despool_slot {
+   POOLMEM *buf;                      /* block buffer, same size as the DEV_BLOCK buffer */
+   spool_hdr hdr;                     /* header of this block */
+   int status;                        /* RB_OK, RB_EOT or RB_ERROR */
+};
+
+/**
+ * Spool file reader running in its own thread while despooling,
+ * so reading the spool file overlaps with writing to the device.
+ * Blocks are read straight into buffers that are swapped with the
+ * buffer of the DEV_BLOCK written to the device, so the data is not
+ * copied again once it has been read.
+ */
+struct despool_reader {
+   pthread_t tid;
+   pthread_mutex_t mutex;
+   pthread_cond_t cond;
+   JCR *jcr;
+   int fd;
+   uint32_t buf_len;                  /* max block length */
+   int num_slots;
+   int head;                          /* next slot to fill */
+   int tail;                          /* next slot to hand out */
+   int count;                         /* filled slots */
+   bool quit;
+   bool done;                         /* reader thread hit EOT or an error */
+   uint64_t stalls;                   /* times the consumer had to wait */
+   despool_slot *slots;
+};
+
+/**
+ * Second spool segment filled with the data the File daemon keeps sending
+ * while the first segment is written to the device (Spool Overlap).
+ * The messages are saved as received and replayed by the File daemon
+ * connection once despooling is done, which spools them again. So this
+ * data is written to the spool disk twice, the price for not having to
+ * build the blocks of the next spool file while despooling.
+ */
+struct spool_prefetch {
+   pthread_t tid;
+   pthread_mutex_t mutex;
+   pthread_cond_t cond;
+   JCR *jcr;
+   DCR *dcr;
+   int fd;                            /* prefetch file */
+   POOLMEM *msg;                      /* message buffer of the File daemon connection */
+   int32_t msglen;
+   uint64_t size;                     /* bytes saved */
+   bool stop;                         /* despooling is done */
+   bool ok;                           /* false on write error */
+};
+
 enum {
    RB_EOT = 1,
    RB_ERROR,
@@ -93,6 +169,27 @@ void list_spool_stats(void sendit(const char *msg, int len, void *sarg), void *a
 
       sendit(msg.c_str(), len, arg);
    }
+   if (spool_stats.despool_jobs || spool_stats.total_despool_runs) {
+      char ed3[30], ed4[30];
+      uint64_t rate;
+
+      rate = spool_stats.despool_bytes / MAX(spool_stats.despool_time, 1);
+      len = Mmsg(msg, _("Data despooling: %u active jobs; %u total runs, %s bytes, %s bytes/second; "
+                        "last run %s bytes/second; %s read stalls.\n"),
+         spool_stats.despool_jobs, spool_stats.total_despool_runs,
+         edit_uint64_with_commas(spool_stats.despool_bytes, ed1),
+         edit_uint64_with_suffix(rate, ed2),
+         edit_uint64_with_suffix(spool_stats.last_despool_rate, ed3),
+         edit_uint64_with_commas(spool_stats.despool_stalls, ed4));
+
+      sendit(msg.c_str(), len, arg);
+   }
+   if (spool_stats.prefetch_jobs || spool_stats.prefetch_size) {
+      len = Mmsg(msg, _("Spool overlap: %u active jobs, %s bytes received while despooling.\n"),
+         spool_stats.prefetch_jobs, edit_uint64_with_commas(spool_stats.prefetch_size, ed1));
+
+      sendit(msg.c_str(), len, arg);
+   }
 }
 
 bool begin_data_spool(DCR *dcr)
@@ -212,6 +309,43 @@ static bool close_data_spool_file(DCR *dcr, bool end_of_spool)
    return true;
 }
 
+/**
+ * Account for the data received while despooling. It is on disk in the
+ * prefetch file next to the spool file being despooled, so it counts
+ * against the same limits. A negative size releases it.
+ */
+static void update_prefetch_spool_size(DCR *dcr, int64_t size)
+{
+   P(dcr->dev->spool_mutex);
+   dcr->job_prefetch_size += size;
+   dcr->dev->spool_size += size;
+   V(dcr->dev->spool_mutex);
+
+   P(mutex);
+   spool_stats.prefetch_size += size;
+   spool_stats.data_size += size;
+   if (spool_stats.data_size > spool_stats.max_data_size) {
+      spool_stats.max_data_size = spool_stats.data_size;
+   }
+   V(mutex);
+}
+
+/**
+ * See if the job or the device reached its spool size limit.
+ * The data received while despooling is included.
+ */
+static bool spool_size_reached(DCR *dcr, int64_t max_job_spool_size, int64_t max_spool_size)
+{
+   bool reached;
+
+   P(dcr->dev->spool_mutex);
+   reached = (max_job_spool_size > 0 && dcr->job_spool_size + dcr->job_prefetch_size >= max_job_spool_size) ||
+             (max_spool_size > 0 && dcr->dev->spool_size >= (uint64_t)max_spool_size);
+   V(dcr->dev->spool_mutex);
+
+   return reached;
+}
+
 static const char *spool_name = "*spool*";
 
 /**
@@ -228,6 +362,9 @@ static bool despool_data(DCR *dcr, bool commit)
    int status;
    char ec1[50];
    BSOCK *dir = jcr->dir_bsock;
+   struct despool_reader *rd;
+   struct spool_prefetch *pf = NULL;
+   uint64_t stalls = 0;
 
    Dmsg0(100, "Despooling data\n");
    if (jcr->dcr->job_spool_size == 0) {
@@ -250,6 +387,14 @@ static bool despool_data(DCR *dcr, bool commit)
       jcr->setJobStatus(JS_DataDespooling);
    }
    jcr->sendJobStatus(JS_DataDespooling);
+
+   /*
+    * Unless the job is done, keep receiving data while we despool.
+    */
+   if (!commit && dcr->dev->device->spool_overlap) {
+      pf = start_spool_prefetch(dcr);
+   }
+
    dcr->despool_wait = true;
    dcr->spooling = false;
    /*
@@ -283,6 +428,9 @@ static bool despool_data(DCR *dcr, bool commit)
    Dmsg1(800, "read/write block size = %d\n", block->buf_len);
    lseek(rdcr->spool_fd, 0, SEEK_SET); /* rewind */
 
+#if defined(HAVE_POSIX_FADVISE) && defined(POSIX_FADV_SEQUENTIAL)
+   posix_fadvise(rdcr->spool_fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
 #if defined(HAVE_POSIX_FADVISE) && defined(POSIX_FADV_WILLNEED)
    posix_fadvise(rdcr->spool_fd, 0, 0, POSIX_FADV_WILLNEED);
 #endif
@@ -290,14 +438,23 @@ static bool despool_data(DCR *dcr, bool commit)
    /* Add run time, to get current wait time */
    int32_t despool_start = time(NULL) - jcr->run_time;
 
+   P(mutex);
+   spool_stats.despool_jobs++;
+   V(mutex);
+
    set_new_file_parameters(dcr);
 
+   rd = start_despool_reader(rdcr);
+   if (!rd) {
+      ok = false;
+   }
+
    while (ok) {
       if (job_canceled(jcr)) {
          ok = false;
          break;
       }
-      status = read_block_from_spool_file(rdcr);
+      status = read_block_from_despool_reader(rd, rdcr);
       if (status == RB_EOT) {
          break;
       } else if (status == RB_ERROR) {
@@ -316,6 +473,19 @@ static bool despool_data(DCR *dcr, bool commit)
       Dmsg3(800, "Write block ok=%d FI=%d LI=%d\n", ok, block->FirstIndex, block->LastIndex);
    }
 
+   if (rd) {
+      stalls = rd->stalls;
+      stop_despool_reader(rd);
+   }
+
+   /*
+    * Stop receiving before the despooled data is released from the
+    * spool size, the prefetched data is still limited by it.
+    */
+   if (pf && !stop_spool_prefetch(pf)) {
+      ok = false;
+   }
+
    /*
     * If this Job is incomplete, we need to backup the FileIndex
     *  to the last correctly saved file so that the JobMedia
@@ -349,6 +519,15 @@ static bool despool_data(DCR *dcr, bool commit)
         despool_elapsed / 3600, despool_elapsed % 3600 / 60, despool_elapsed % 60,
         edit_uint64_with_suffix(jcr->dcr->job_spool_size / despool_elapsed, ec1));
 
+   P(mutex);
+   spool_stats.despool_jobs--;
+   spool_stats.total_despool_runs++;
+   spool_stats.despool_bytes += jcr->dcr->job_spool_size;
+   spool_stats.despool_time += despool_elapsed;
+   spool_stats.last_despool_rate = jcr->dcr->job_spool_size / despool_elapsed;
+   spool_stats.despool_stalls += stalls;
+   V(mutex);
+
    dcr->block = block;                /* reset block */
 
    /*
@@ -406,22 +585,48 @@ static bool despool_data(DCR *dcr, bool commit)
 }
 
 /**
- * Read a block from the spool file
+ * Read exactly len bytes from the spool file.
+ *
+ *  Returns number of bytes read, less than len on end of file
+ *          -1 on error
+ */
+static ssize_t read_spool_fully(int fd, char *buf, size_t len)
+{
+   ssize_t status;
+   size_t nread = 0;
+
+   while (nread < len) {
+      status = read(fd, buf + nread, len - nread);
+      if (status < 0) {
+         if (errno == EINTR) {
+            continue;
+         }
+         return -1;
+      }
+      if (status == 0) {
+         break;
+      }
+      nread += status;
+   }
+
+   return nread;
+}
+
+/**
+ * Read the next block from the spool file into a read ahead slot.
  *
  *  Returns RB_OK on success
  *          RB_EOT when file done
  *          RB_ERROR on error
  */
-static int read_block_from_spool_file(DCR *dcr)
+static int read_spool_block(struct despool_reader *rd, despool_slot *slot)
 {
-   uint32_t rlen;
    ssize_t status;
-   spool_hdr hdr;
-   DEV_BLOCK *block = dcr->block;
-   JCR *jcr = dcr->jcr;
+   uint32_t rlen;
+   JCR *jcr = rd->jcr;
 
-   rlen = sizeof(hdr);
-   status = read(dcr->spool_fd, (char *)&hdr, (size_t)rlen);
+   rlen = sizeof(spool_hdr);
+   status = read_spool_fully(rd->fd, (char *)&slot->hdr, (size_t)rlen);
    if (status == 0) {
       Dmsg0(100, "EOT on spool read.\n");
       return RB_EOT;
@@ -429,39 +634,451 @@ static int read_block_from_spool_file(DCR *dcr)
       if (status == -1) {
          berrno be;
 
-         Jmsg(dcr->jcr, M_FATAL, 0, _("Spool header read error. ERR=%s\n"), be.bstrerror());
+         Jmsg(jcr, M_FATAL, 0, _("Spool header read error. ERR=%s\n"), be.bstrerror());
       } else {
          Pmsg2(000, _("Spool read error. Wanted %u bytes, got %d\n"), rlen, status);
          Jmsg2(jcr, M_FATAL, 0, _("Spool header read error. Wanted %u bytes, got %d\n"), rlen, status);
       }
-      jcr->forceJobStatus(JS_FatalError);  /* override any Incomplete */
       return RB_ERROR;
    }
-   rlen = hdr.len;
-   if (rlen > block->buf_len) {
-      Pmsg2(000, _("Spool block too big. Max %u bytes, got %u\n"), block->buf_len, rlen);
-      Jmsg2(jcr, M_FATAL, 0, _("Spool block too big. Max %u bytes, got %u\n"), block->buf_len, rlen);
-      jcr->forceJobStatus(JS_FatalError);  /* override any Incomplete */
+   rlen = slot->hdr.len;
+   if (rlen > rd->buf_len) {
+      Pmsg2(000, _("Spool block too big. Max %u bytes, got %u\n"), rd->buf_len, rlen);
+      Jmsg2(jcr, M_FATAL, 0, _("Spool block too big. Max %u bytes, got %u\n"), rd->buf_len, rlen);
       return RB_ERROR;
    }
-   status = read(dcr->spool_fd, (char *)block->buf, (size_t)rlen);
+   status = read_spool_fully(rd->fd, slot->buf, (size_t)rlen);
    if (status != (ssize_t)rlen) {
       Pmsg2(000, _("Spool data read error. Wanted %u bytes, got %d\n"), rlen, status);
-      Jmsg2(dcr->jcr, M_FATAL, 0, _("Spool data read error. Wanted %u bytes, got %d\n"), rlen, status);
-      jcr->forceJobStatus(JS_FatalError);  /* override any Incomplete */
+      Jmsg2(jcr, M_FATAL, 0, _("Spool data read error. Wanted %u bytes, got %d\n"), rlen, status);
       return RB_ERROR;
    }
+
+   return RB_OK;
+}
+
+extern "C" void *despool_reader_thread(void *arg)
+{
+   int status;
+   despool_slot *slot;
+   struct despool_reader *rd = (struct despool_reader *)arg;
+
+   set_jcr_in_tsd(rd->jcr);
+
+   while (1) {
+      P(rd->mutex);
+      while (!rd->quit && rd->count == rd->num_slots) {
+         pthread_cond_wait(&rd->cond, &rd->mutex);
+      }
+      if (rd->quit) {
+         V(rd->mutex);
+         break;
+      }
+      slot = &rd->slots[rd->head];
+      V(rd->mutex);
+
+      /*
+       * The slot is not handed out before count is incremented,
+       * so we can fill it without holding the lock.
+       */
+      status = read_spool_block(rd, slot);
+      slot->status = status;
+
+      P(rd->mutex);
+      rd->head = (rd->head + 1) % rd->num_slots;
+      rd->count++;
+      if (status != RB_OK) {
+         rd->done = true;
+      }
+      pthread_cond_broadcast(&rd->cond);
+      V(rd->mutex);
+
+      if (status != RB_OK) {
+         break;
+      }
+   }
+
+   return NULL;
+}
+
+/**
+ * Start reading the spool file ahead of the device.
+ */
+static struct despool_reader *start_despool_reader(DCR *dcr)
+{
+   int status, i;
+   struct despool_reader *rd;
+   DEV_BLOCK *block = dcr->block;
+
+   rd = (struct despool_reader *)malloc(sizeof(struct despool_reader));
+   memset(rd, 0, sizeof(struct despool_reader));
+   rd->jcr = dcr->jcr;
+   rd->fd = dcr->spool_fd;
+   rd->buf_len = block->buf_len;
+   rd->num_slots = DESPOOL_READ_AHEAD_SIZE / MAX(block->buf_len, 1);
+   if (rd->num_slots < DESPOOL_MIN_SLOTS) {
+      rd->num_slots = DESPOOL_MIN_SLOTS;
+   } else if (rd->num_slots > DESPOOL_MAX_SLOTS) {
+      rd->num_slots = DESPOOL_MAX_SLOTS;
+   }
+
+   /*
+    * Slot buffers must be exactly as big as the block buffer they are swapped with.
+    */
+   rd->slots = (despool_slot *)malloc(rd->num_slots * sizeof(despool_slot));
+   memset(rd->slots, 0, rd->num_slots * sizeof(despool_slot));
+   for (i = 0; i < rd->num_slots; i++) {
+      rd->slots[i].buf = get_large_memory(sizeof_pool_memory(block->buf));
+   }
+
+   pthread_mutex_init(&rd->mutex, NULL);
+   pthread_cond_init(&rd->cond, NULL);
+
+   if ((status = pthread_create(&rd->tid, NULL, despool_reader_thread, (void *)rd)) != 0) {
+      berrno be;
+
+      Jmsg1(dcr->jcr, M_FATAL, 0, _("Cannot create despool reader thread: %s\n"), be.bstrerror(status));
+      for (i = 0; i < rd->num_slots; i++) {
+         free_memory(rd->slots[i].buf);
+      }
+      pthread_mutex_destroy(&rd->mutex);
+      pthread_cond_destroy(&rd->cond);
+      free(rd->slots);
+      free(rd);
+      return NULL;
+   }
+
+   Dmsg2(100, "Despool reader started, %d slots of %u bytes\n", rd->num_slots, rd->buf_len);
+   return rd;
+}
+
+/**
+ * Get the next block read ahead from the spool file.
+ * The block buffer is swapped with the buffer of the read ahead slot.
+ *
+ *  Returns RB_OK on success
+ *          RB_EOT when file done
+ *          RB_ERROR on error
+ */
+static int read_block_from_despool_reader(struct despool_reader *rd, DCR *dcr)
+{
+   int status;
+   POOLMEM *buf;
+   despool_slot *slot;
+   DEV_BLOCK *block = dcr->block;
+   JCR *jcr = dcr->jcr;
+
+   P(rd->mutex);
+   if (rd->count == 0) {
+      rd->stalls++;
+      while (rd->count == 0) {
+         pthread_cond_wait(&rd->cond, &rd->mutex);
+      }
+   }
+   slot = &rd->slots[rd->tail];
+   V(rd->mutex);
+
+   status = slot->status;
+   if (status != RB_OK) {
+      if (status == RB_ERROR) {
+         jcr->forceJobStatus(JS_FatalError);  /* override any Incomplete */
+      }
+      return status;
+   }
+
+   buf = block->buf;
+   block->buf = slot->buf;
+   slot->buf = buf;
+
    /* Setup write pointers */
-   block->binbuf = rlen;
+   block->binbuf = slot->hdr.len;
    block->bufp = block->buf + block->binbuf;
-   block->FirstIndex = hdr.FirstIndex;
-   block->LastIndex = hdr.LastIndex;
+   block->FirstIndex = slot->hdr.FirstIndex;
+   block->LastIndex = slot->hdr.LastIndex;
    block->VolSessionId = dcr->jcr->VolSessionId;
    block->VolSessionTime = dcr->jcr->VolSessionTime;
    Dmsg2(800, "Read block FI=%d LI=%d\n", block->FirstIndex, block->LastIndex);
+
+   P(rd->mutex);
+   rd->tail = (rd->tail + 1) % rd->num_slots;
+   rd->count--;
+   pthread_cond_broadcast(&rd->cond);
+   V(rd->mutex);
+
    return RB_OK;
 }
 
+/**
+ * Stop the spool file reader and release its buffers.
+ */
+static void stop_despool_reader(struct despool_reader *rd)
+{
+   int i;
+
+   P(rd->mutex);
+   rd->quit = true;
+   pthread_cond_broadcast(&rd->cond);
+   V(rd->mutex);
+   pthread_join(rd->tid, NULL);
+
+   for (i = 0; i < rd->num_slots; i++) {
+      free_memory(rd->slots[i].buf);
+   }
+   pthread_mutex_destroy(&rd->mutex);
+   pthread_cond_destroy(&rd->cond);
+   free(rd->slots);
+   free(rd);
+}
+
+static void make_unique_prefetch_spool_filename(DCR *dcr, POOLMEM *&name)
+{
+   make_unique_data_spool_filename(dcr, name);
+   pm_strcat(name, ".prefetch");
+}
+
+/**
+ * Save a message received from the File daemon in the prefetch file,
+ * using the same format as the attribute spool of the BSOCK.
+ */
+static bool write_prefetch_msg(struct spool_prefetch *pf, BSOCK *bs)
+{
+   int32_t pktsiz;
+   ssize_t status;
+   size_t len, nwritten = 0;
+   char *ptr;
+
+   pktsiz = htonl((int32_t)bs->msglen);
+   if (write(pf->fd, (char *)&pktsiz, sizeof(int32_t)) != sizeof(int32_t)) {
+      return false;
+   }
+   pf->size += sizeof(int32_t);
+   update_prefetch_spool_size(pf->dcr, sizeof(int32_t));
+
+   if (bs->msglen <= 0) {
+      return true;
+   }
+
+   ptr = bs->msg;
+   len = bs->msglen;
+   while (nwritten < len) {
+      status = write(pf->fd, ptr + nwritten, len - nwritten);
+      if (status < 0) {
+         if (errno == EINTR) {
+            continue;
+         }
+         return false;
+      }
+      nwritten += status;
+   }
+   pf->size += len;
+   update_prefetch_spool_size(pf->dcr, len);
+
+   return true;
+}
+
+extern "C" void *spool_prefetch_thread(void *arg)
+{
+   int status;
+   int32_t n;
+   struct spool_prefetch *pf = (struct spool_prefetch *)arg;
+   JCR *jcr = pf->jcr;
+   BSOCK *fd = jcr->file_bsock;
+
+   set_jcr_in_tsd(jcr);
+
+   while (!job_canceled(jcr)) {
+      /*
+       * Messages still to be replayed from the previous segment
+       * must be taken over before the segment counts as full.
+       */
+      if (!fd->is_replaying() &&
+          spool_size_reached(pf->dcr, pf->dcr->max_job_spool_size, pf->dcr->dev->max_spool_size)) {
+         Dmsg1(100, "Spool prefetch full at %llu bytes\n", pf->size);
+         P(pf->mutex);
+         while (!pf->stop) {
+            pthread_cond_wait(&pf->cond, &pf->mutex);
+         }
+         V(pf->mutex);
+         break;
+      }
+
+      status = fd->wait_data_intr(0, 200000);
+      if (status < 0) {
+         break;
+      }
+      if (status == 0) {
+         if (pf->stop) {
+            break;
+         }
+         continue;
+      }
+
+      /*
+       * Errors stay recorded in the BSOCK, the job notices them
+       * with its next read.
+       */
+      n = fd->recv();
+      if (n < 0 && n != BNET_SIGNAL) {
+         break;
+      }
+
+      if (!write_prefetch_msg(pf, fd)) {
+         berrno be;
+
+         Qmsg1(jcr, M_FATAL, 0, _("Write error on spool prefetch file. ERR=%s\n"), be.bstrerror());
+         pf->ok = false;
+         break;
+      }
+
+      if (n == BNET_SIGNAL && fd->msglen == BNET_TERMINATE) {
+         break;
+      }
+   }
+
+   return NULL;
+}
+
+/**
+ * Start receiving the data of the File daemon into a second spool segment.
+ */
+static struct spool_prefetch *start_spool_prefetch(DCR *dcr)
+{
+   int status, spool_fd;
+   struct spool_prefetch *pf;
+   JCR *jcr = dcr->jcr;
+   POOLMEM *name;
+
+   /*
+    * Only prefetch when we despool because the spool is full and
+    * when the spool file need not be erased securely.
+    */
+   if ((dcr->max_job_spool_size == 0 && dcr->dev->max_spool_size == 0) ||
+       me->secure_erase_cmdline || !jcr->file_bsock) {
+      return NULL;
+   }
+
+   name = get_pool_memory(PM_MESSAGE);
+   make_unique_prefetch_spool_filename(dcr, name);
+#if defined(HAVE_WIN32) && defined(O_TEMPORARY)
+   spool_fd = open(name, O_CREAT | O_TRUNC | O_RDWR | O_BINARY | O_TEMPORARY, 0640);
+#else
+   spool_fd = open(name, O_CREAT | O_TRUNC | O_RDWR | O_BINARY, 0640);
+#endif
+   if (spool_fd < 0) {
+      berrno be;
+
+      Jmsg(jcr, M_WARNING, 0, _("Open spool prefetch file %s failed: ERR=%s\n"), name, be.bstrerror());
+      free_pool_memory(name);
+      return NULL;
+   }
+#if !defined(HAVE_WIN32)
+   /*
+    * The file is only used through the open descriptor.
+    */
+   unlink(name);
+#endif
+   free_pool_memory(name);
+
+   pf = (struct spool_prefetch *)malloc(sizeof(struct spool_prefetch));
+   memset(pf, 0, sizeof(struct spool_prefetch));
+   pf->jcr = jcr;
+   pf->dcr = dcr;
+   pf->fd = spool_fd;
+   pf->ok = true;
+
+   /*
+    * We despool in the middle of writing a record that still points
+    * into the message buffer of the connection, so receive into a
+    * buffer of our own.
+    */
+   pf->msg = jcr->file_bsock->msg;
+   pf->msglen = jcr->file_bsock->msglen;
+   jcr->file_bsock->msg = get_pool_memory(PM_BSOCK);
+   pthread_mutex_init(&pf->mutex, NULL);
+   pthread_cond_init(&pf->cond, NULL);
+
+   if ((status = pthread_create(&pf->tid, NULL, spool_prefetch_thread, (void *)pf)) != 0) {
+      berrno be;
+
+      Jmsg1(jcr, M_WARNING, 0, _("Cannot create spool prefetch thread: %s\n"), be.bstrerror(status));
+      free_pool_memory(jcr->file_bsock->msg);
+      jcr->file_bsock->msg = pf->msg;
+      close(spool_fd);
+      pthread_mutex_destroy(&pf->mutex);
+      pthread_cond_destroy(&pf->cond);
+      free(pf);
+      return NULL;
+   }
+
+   P(mutex);
+   spool_stats.prefetch_jobs++;
+   V(mutex);
+
+   Jmsg(jcr, M_INFO, 0, _("Spooling data into second segment while despooling ...\n"));
+
+   return pf;
+}
+
+/**
+ * Stop filling the second spool segment and hand it to the File daemon
+ * connection, which replays it before reading from the network again.
+ */
+static bool stop_spool_prefetch(struct spool_prefetch *pf)
+{
+   bool ok;
+   char ec1[50];
+   JCR *jcr = pf->jcr;
+
+   P(pf->mutex);
+   pf->stop = true;
+   pthread_cond_broadcast(&pf->cond);
+   V(pf->mutex);
+   pthread_join(pf->tid, NULL);
+
+   free_pool_memory(jcr->file_bsock->msg);
+   jcr->file_bsock->msg = pf->msg;
+   jcr->file_bsock->msglen = pf->msglen;
+
+   P(mutex);
+   spool_stats.prefetch_jobs--;
+   V(mutex);
+
+   ok = pf->ok;
+   if (ok && jcr->file_bsock->is_replaying()) {
+      Jmsg(jcr, M_FATAL, 0, _("Data received during the previous despool was not taken over.\n"));
+      ok = false;
+   }
+
+   if (ok && pf->size > 0 && lseek(pf->fd, 0, SEEK_SET) == 0) {
+      Jmsg(jcr, M_INFO, 0, _("Received %s bytes while despooling.\n"),
+           edit_uint64_with_commas(pf->size, ec1));
+      jcr->file_bsock->set_replay(pf->fd);
+   } else {
+      if (ok && pf->size > 0) {
+         berrno be;
+
+         Jmsg(jcr, M_FATAL, 0, _("Rewind of spool prefetch file failed: ERR=%s\n"), be.bstrerror());
+         ok = false;
+      }
+      close(pf->fd);
+   }
+
+   /*
+    * The data is counted again when it is spooled as it is replayed.
+    */
+   update_prefetch_spool_size(pf->dcr, -pf->dcr->job_prefetch_size);
+
+   if (!ok) {
+      jcr->forceJobStatus(JS_FatalError);
+   }
+
+   pthread_mutex_destroy(&pf->mutex);
+   pthread_cond_destroy(&pf->cond);
+   free(pf);
+
+   return ok;
+}
+
 /**
  * Write a block to the spool file
  *
@@ -471,6 +1088,7 @@ static int read_block_from_spool_file(DCR *dcr)
 bool write_block_to_spool_file(DCR *dcr)
 {
    uint32_t wlen, hlen;               /* length to write */
+   int64_t max_job_spool_size, max_spool_size;
    bool despool = false;
    DEV_BLOCK *block = dcr->block;
 
@@ -482,16 +1100,25 @@ bool write_block_to_spool_file(DCR *dcr)
       return true;
    }
 
+   /*
+    * With Spool Overlap the data received while despooling is on disk
+    * next to the spool file and counts against the same limits. So we
+    * despool at half of them to leave room for it.
+    */
+   max_job_spool_size = dcr->max_job_spool_size;
+   max_spool_size = dcr->dev->max_spool_size;
+   if (dcr->dev->device->spool_overlap) {
+      max_job_spool_size /= 2;
+      max_spool_size /= 2;
+   }
+
    hlen = sizeof(spool_hdr);
    wlen = block->binbuf;
    P(dcr->dev->spool_mutex);
    dcr->job_spool_size += hlen + wlen;
    dcr->dev->spool_size += hlen + wlen;
-   if ((dcr->max_job_spool_size > 0 && dcr->job_spool_size >= dcr->max_job_spool_size) ||
-       (dcr->dev->max_spool_size > 0 && dcr->dev->spool_size >= dcr->dev->max_spool_size)) {
-      despool = true;
-   }
    V(dcr->dev->spool_mutex);
+   despool = spool_size_reached(dcr, max_job_spool_size, max_spool_size);
    P(mutex);
    spool_stats.data_size += hlen + wlen;
    if (spool_stats.data_size > spool_stats.max_data_size) {
@@ -500,16 +1127,16 @@ bool write_block_to_spool_file(DCR *dcr)
    V(mutex);
    if (despool) {
       char ec1[30], ec2[30];
-      if (dcr->max_job_spool_size > 0) {
+      if (max_job_spool_size > 0) {
          Jmsg(dcr->jcr, M_INFO, 0, _("User specified Job spool size reached: "
             "JobSpoolSize=%s MaxJobSpoolSize=%s\n"),
-            edit_uint64_with_commas(dcr->job_spool_size, ec1),
-            edit_uint64_with_commas(dcr->max_job_spool_size, ec2));
+            edit_uint64_with_commas(dcr->job_spool_size + dcr->job_prefetch_size, ec1),
+            edit_uint64_with_commas(max_job_spool_size, ec2));
       } else {
          Jmsg(dcr->jcr, M_INFO, 0, _("User specified Device spool size reached: "
             "DevSpoolSize=%s MaxDevSpoolSize=%s\n"),
             edit_uint64_with_commas(dcr->dev->spool_size, ec1),
-            edit_uint64_with_commas(dcr->dev->max_spool_size, ec2));
+            edit_uint64_with_commas(max_spool_size, ec2));
       }
 
       if (!despool_data(dcr, false)) {
@@ -471,6 +471,7 @@ static void list_status_header(STATUS_PKT *sp)
    POOL_MEM msg(PM_MESSAGE);
    char dt[MAX_TIME_LENGTH];
    char b1[35], b2[35], b3[35], b4[35], b5[35];
+   LARGE_POOL_STATS large_stats;
 #if defined(HAVE_WIN32)
    char buf[300];
 #endif
@@ -538,6 +539,14 @@ static void list_status_header(STATUS_PKT *sp)
          edit_uint64_with_commas(sm_buffers, b4),
          edit_uint64_with_commas(sm_max_buffers, b5));
    sendit(msg, len, sp);
+   get_large_memory_stats(&large_stats);
+   len = Mmsg(msg, _(" Large buffers: inuse=%s bytes=%s cached=%s cached_bytes=%s max_bytes=%s\n"),
+         edit_uint64_with_commas(large_stats.in_use, b1),
+         edit_uint64_with_commas(large_stats.in_use_bytes, b2),
+         edit_uint64_with_commas(large_stats.cached, b3),
+         edit_uint64_with_commas(large_stats.cached_bytes, b4),
+         edit_uint64_with_commas(large_stats.max_bytes, b5));
+   sendit(msg, len, sp);
    len = Mmsg(msg, " Sizes: boffset_t=%d size_t=%d int32_t=%d int64_t=%d "
                    "mode=%d bwlimit=%skB/s\n",
               (int)sizeof(boffset_t), (int)sizeof(size_t), (int)sizeof(int32_t),
@@ -778,6 +787,14 @@ static void list_running_jobs(STATUS_PKT *sp)
             len= Mmsg(msg, _("    spooling=%d despooling=%d despool_wait=%d\n"),
                       dcr->spooling, dcr->despooling, dcr->despool_wait);
             sendit(msg, len, sp);
+            if (dcr->job_prefetch_size > 0) {
+               char ed1[50], ed2[50];
+
+               len = Mmsg(msg, _("    spool size=%s received while despooling=%s\n"),
+                          edit_uint64_with_commas(dcr->job_spool_size, ed1),
+                          edit_uint64_with_commas(dcr->job_prefetch_size, ed2));
+               sendit(msg, len, sp);
+            }
          }
          if (jcr->last_time == 0) {
             jcr->last_time = jcr->run_time;
@@ -86,6 +86,8 @@ static RES_ITEM store_items[] = {
    { "Compatible", CFG_TYPE_BOOL, ITEM(res_store.compatible), 0, CFG_ITEM_DEFAULT, "false", NULL, NULL },
    { "MaximumBandwidthPerJob", CFG_TYPE_SPEED, ITEM(res_store.max_bandwidth_per_job), 0, 0, NULL, NULL, NULL },
    { "AllowBandwidthBursting", CFG_TYPE_BOOL, ITEM(res_store.allow_bw_bursting), 0, CFG_ITEM_DEFAULT, "false", NULL, NULL },
+   { "MaximumDataStreamsPerJob", CFG_TYPE_PINT32, ITEM(res_store.max_data_streams_per_job), 0, CFG_ITEM_DEFAULT, "8", "17.4.2-",
+     "Maximum number of network connections a File daemon may stripe the data of a backup job over." },
    { "NdmpEnable", CFG_TYPE_BOOL, ITEM(res_store.ndmp_enable), 0, CFG_ITEM_DEFAULT, "false", NULL, NULL },
    { "NdmpSnooping", CFG_TYPE_BOOL, ITEM(res_store.ndmp_snooping), 0, CFG_ITEM_DEFAULT, "false", NULL, NULL },
    { "NdmpLogLevel", CFG_TYPE_PINT32, ITEM(res_store.ndmploglevel), 0, CFG_ITEM_DEFAULT, "4", NULL, NULL },
@@ -188,6 +190,11 @@ static RES_ITEM dev_items[] = {
    { "SpoolDirectory", CFG_TYPE_DIR, ITEM(res_dev.spool_directory), 0, 0, NULL, NULL, NULL },
    { "MaximumSpoolSize", CFG_TYPE_SIZE64, ITEM(res_dev.max_spool_size), 0, 0, NULL, NULL, NULL },
    { "MaximumJobSpoolSize", CFG_TYPE_SIZE64, ITEM(res_dev.max_job_spool_size), 0, 0, NULL, NULL, NULL },
+   { "SpoolOverlap", CFG_TYPE_BOOL, ITEM(res_dev.spool_overlap), 0, CFG_ITEM_DEFAULT, "false", "17.4.2-",
+     "Keep receiving data from the File daemon into a second spool segment while the spooled data is written to the device. "
+     "Both segments count against the spool size limits, so the spooled data is written to the device when half of "
+     "Maximum Spool Size or Maximum Job Spool Size is reached. The data received while despooling is written to "
+     "the second segment and copied into the next spool file afterwards, so it is written to the spool disk twice." },
    { "DriveIndex", CFG_TYPE_PINT16, ITEM(res_dev.drive_index), 0, 0, NULL, NULL, NULL },
    { "MaximumPartSize", CFG_TYPE_SIZE64, ITEM(res_dev.max_part_size), 0, CFG_ITEM_DEPRECATED, NULL, NULL, NULL },
    { "MountPoint", CFG_TYPE_STRNAME, ITEM(res_dev.mount_point), 0, 0, NULL, NULL, NULL },
@@ -289,6 +296,7 @@ static s_kw compression_algorithms[] = {
    { "lzfast", COMPRESS_FZFZ },
    { "lz4", COMPRESS_FZ4L },
    { "lz4hc", COMPRESS_FZ4H },
+   { "zstd", COMPRESS_ZSTD },
    { NULL, 0 }
 };
 
@@ -88,6 +88,7 @@ public:
    uint32_t ndmploglevel;             /**< Initial NDMP log level */
    uint32_t jcr_watchdog_time;        /**< Absolute time after which a Job gets terminated regardless of its progress */
    uint32_t stats_collect_interval;   /**< Statistics collect interval in seconds */
+   uint32_t max_data_streams_per_job; /**< Maximum number of FD data connections per job */
    MSGSRES *messages;                 /**< Daemon message handler */
    utime_t SDConnectTimeout;          /**< Timeout in seconds */
    utime_t FDConnectTimeout;          /**< Timeout in seconds */
@@ -138,6 +139,7 @@ public:
    bool drive_crypto_enabled;         /**< Enable hardware crypto */
    bool query_crypto_status;          /**< Query device for crypto status */
    bool collectstats;                 /**< Set if statistics should be collected */
+   bool spool_overlap;                /**< Keep receiving data while despooling */
    drive_number_t drive;              /**< Autochanger logical drive number */
    drive_number_t drive_index;        /**< Autochanger physical drive index */
    char cap_bits[CAP_BYTES];          /**< Capabilities of this device */
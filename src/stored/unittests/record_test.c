@@ -0,0 +1,358 @@
+/*
+   BAREOS® - Backup Archiving REcovery Open Sourced
+
+   Copyright (C) 2016-2016 Bareos GmbH & Co. KG
+
+   This program is Free Software; you can redistribute it and/or
+   modify it under the terms of version three of the GNU Affero General Public
+   License as published by the Free Software Foundation and included
+   in the file LICENSE.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+   Affero General Public License for more details.
+
+   You should have received a copy of the GNU Affero General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+   02110-1301, USA.
+*/
+/*
+ * Test that records written with write_record_to_block() read back
+ * unchanged with read_record_from_block(), both for records packed
+ * into the block in one go and for records spanning blocks.
+ */
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+
+extern "C" {
+#include <cmocka.h>
+}
+
+#include "bareos.h"
+#include "stored/stored.h"
+#include "stored/backends/unix_file_device.h"
+
+#define BLOCK_SIZE 1024
+#define MAX_BLOCKS 32
+#define SESSION_ID 17
+#define SESSION_TIME 1234567
+
+/*
+ * Space for records in an empty block.
+ */
+#define BLOCK_NAVAIL (BLOCK_SIZE - WRITE_BLKHDR_LENGTH)
+
+/*
+ * The data part of the blocks written, as it would end up on the volume.
+ */
+struct test_volume {
+   int num_blocks;
+   uint32_t len[MAX_BLOCKS];
+   char data[MAX_BLOCKS][BLOCK_SIZE];
+};
+
+static DCR *setup_test_dcr()
+{
+   DCR *dcr;
+   DEVICE *dev;
+
+   dev = New(unix_file_device);
+   dev->dev_type = B_FILE_DEV;
+   dev->max_block_size = BLOCK_SIZE;
+   dev->EndBlock = 0;
+   dev->EndFile = 0;
+
+   dcr = New(DCR);
+   dcr->jcr = NULL;
+   dcr->dev = dev;
+   dcr->block = new_block(dev);
+   dcr->block->VolSessionId = SESSION_ID;
+   dcr->block->VolSessionTime = SESSION_TIME;
+
+   return dcr;
+}
+
+static void free_test_dcr(DCR *dcr)
+{
+   DEVICE *dev = dcr->dev;
+
+   free_block(dcr->block);
+   delete dcr;
+   delete dev;
+}
+
+static void fill_record(DEV_RECORD *rec, int FileIndex, int32_t Stream, uint32_t len)
+{
+   rec->VolSessionId = SESSION_ID;
+   rec->VolSessionTime = SESSION_TIME;
+   rec->FileIndex = FileIndex;
+   rec->Stream = Stream;
+   rec->data = check_pool_memory_size(rec->data, len + 1);
+   for (uint32_t i = 0; i < len; i++) {
+      rec->data[i] = (char)(FileIndex * 31 + i);
+   }
+   rec->data_len = len;
+}
+
+/*
+ * Take the records from the block the way write_block_to_device() would
+ * and start a new one.
+ */
+static void flush_block(DCR *dcr, struct test_volume *vol)
+{
+   DEV_BLOCK *block = dcr->block;
+
+   assert_true(vol->num_blocks < MAX_BLOCKS);
+   vol->len[vol->num_blocks] = block->binbuf - WRITE_BLKHDR_LENGTH;
+   memcpy(vol->data[vol->num_blocks], block->buf + WRITE_BLKHDR_LENGTH,
+          vol->len[vol->num_blocks]);
+   vol->num_blocks++;
+   empty_block(block);
+}
+
+static void write_test_record(DCR *dcr, struct test_volume *vol, DEV_RECORD *rec)
+{
+   while (!write_record_to_block(dcr, rec)) {
+      flush_block(dcr, vol);
+   }
+   assert_int_equal(rec->state, st_none);
+   assert_int_equal(rec->remainder, 0);
+}
+
+/*
+ * Load a block the way read_block_from_device() leaves it.
+ */
+static void load_block(DCR *dcr, struct test_volume *vol, int i)
+{
+   DEV_BLOCK *block = dcr->block;
+
+   memcpy(block->buf + WRITE_BLKHDR_LENGTH, vol->data[i], vol->len[i]);
+   block->bufp = block->buf + WRITE_BLKHDR_LENGTH;
+   block->binbuf = vol->len[i];
+   block->BlockVer = BLOCK_VER;
+}
+
+/*
+ * Read back all records of the volume and compare them with the
+ * records generated from the sizes in lens.
+ */
+static void check_volume(DCR *dcr, struct test_volume *vol, const uint32_t *lens, int num_recs)
+{
+   int blk = 0;
+   int nrec = 0;
+   DEV_RECORD *rec, *expected;
+
+   rec = new_record(true);
+   expected = new_record(true);
+
+   load_block(dcr, vol, blk);
+   while (nrec < num_recs) {
+      if (!read_record_from_block(dcr, rec)) {
+         assert_false(bit_is_set(REC_NO_MATCH, rec->state_bits));
+         blk++;
+         assert_true(blk < vol->num_blocks);
+         load_block(dcr, vol, blk);
+         continue;
+      }
+      if (rec->remainder) {
+         continue;                    /* rest is in the next block */
+      }
+
+      fill_record(expected, nrec + 1, STREAM_FILE_DATA, lens[nrec]);
+      assert_int_equal(rec->VolSessionId, SESSION_ID);
+      assert_int_equal(rec->VolSessionTime, SESSION_TIME);
+      assert_int_equal(rec->FileIndex, expected->FileIndex);
+      assert_int_equal(rec->Stream, expected->Stream);
+      assert_int_equal(rec->data_len, expected->data_len);
+      assert_memory_equal(rec->data, expected->data, rec->data_len);
+      nrec++;
+   }
+
+   /*
+    * Nothing but the records written
+    */
+   assert_int_equal(blk, vol->num_blocks - 1);
+   assert_false(read_record_from_block(dcr, rec));
+
+   free_record(rec);
+   free_record(expected);
+}
+
+static void round_trip(const uint32_t *lens, int num_recs, int expected_blocks)
+{
+   DCR *dcr;
+   DEV_RECORD *rec;
+   struct test_volume *vol;
+
+   dcr = setup_test_dcr();
+   vol = (struct test_volume *)malloc(sizeof(struct test_volume));
+   vol->num_blocks = 0;
+
+   rec = new_record(true);
+   for (int i = 0; i < num_recs; i++) {
+      fill_record(rec, i + 1, STREAM_FILE_DATA, lens[i]);
+      write_test_record(dcr, vol, rec);
+   }
+   flush_block(dcr, vol);
+   free_record(rec);
+
+   assert_int_equal(vol->num_blocks, expected_blocks);
+   check_volume(dcr, vol, lens, num_recs);
+
+   free(vol);
+   free_test_dcr(dcr);
+}
+
+/*
+ * Small records, packed in one step while they fit, until one of
+ * them spills over into the next block.
+ */
+void test_record_small(void **state)
+{
+   uint32_t lens[60];
+
+   for (int i = 0; i < 60; i++) {
+      lens[i] = 10 + i % 20;
+   }
+
+   /*
+    * 720 bytes of headers and 1170 bytes of data.
+    */
+   round_trip(lens, 60, 2);
+}
+
+/*
+ * Records around the size that just fits into the space left.
+ */
+void test_record_fit(void **state)
+{
+   DCR *dcr;
+   DEV_RECORD *rec;
+   struct test_volume *vol;
+   uint32_t lens[4];
+
+   dcr = setup_test_dcr();
+   vol = (struct test_volume *)malloc(sizeof(struct test_volume));
+   vol->num_blocks = 0;
+   rec = new_record(true);
+
+   /*
+    * One byte more space than the record needs is the packed path.
+    */
+   lens[0] = BLOCK_NAVAIL - WRITE_RECHDR_LENGTH - 1;
+   fill_record(rec, 1, STREAM_FILE_DATA, lens[0]);
+   assert_true(write_record_to_block(dcr, rec));
+   assert_int_equal(block_write_navail(dcr->block), 1);
+   flush_block(dcr, vol);
+
+   /*
+    * A record filling the block exactly still ends in this block.
+    */
+   lens[1] = BLOCK_NAVAIL - WRITE_RECHDR_LENGTH;
+   fill_record(rec, 2, STREAM_FILE_DATA, lens[1]);
+   assert_true(write_record_to_block(dcr, rec));
+   assert_int_equal(block_write_navail(dcr->block), 0);
+   flush_block(dcr, vol);
+
+   /*
+    * Leave room for just the header of the next record, its data
+    * goes into the next block after a continuation header.
+    */
+   lens[2] = BLOCK_NAVAIL - 2 * WRITE_RECHDR_LENGTH;
+   fill_record(rec, 3, STREAM_FILE_DATA, lens[2]);
+   assert_true(write_record_to_block(dcr, rec));
+   assert_int_equal(block_write_navail(dcr->block), WRITE_RECHDR_LENGTH);
+
+   lens[3] = 100;
+   fill_record(rec, 4, STREAM_FILE_DATA, lens[3]);
+   assert_false(write_record_to_block(dcr, rec));
+   assert_int_equal(rec->state, st_header_cont);
+   assert_int_equal(rec->remainder, lens[3]);
+   flush_block(dcr, vol);
+   assert_true(write_record_to_block(dcr, rec));
+   assert_int_equal(block_write_navail(dcr->block),
+                    BLOCK_NAVAIL - WRITE_RECHDR_LENGTH - lens[3]);
+   flush_block(dcr, vol);
+
+   free_record(rec);
+   check_volume(dcr, vol, lens, 4);
+
+   free(vol);
+   free_test_dcr(dcr);
+}
+
+/*
+ * Records that exactly fill a block that already holds other records.
+ */
+void test_record_boundary(void **state)
+{
+   DCR *dcr;
+   DEV_RECORD *rec;
+   struct test_volume *vol;
+   uint32_t lens[5];
+
+   dcr = setup_test_dcr();
+   vol = (struct test_volume *)malloc(sizeof(struct test_volume));
+   vol->num_blocks = 0;
+   rec = new_record(true);
+
+   /*
+    * The space left is exactly the header plus the data of the second
+    * record, which is written without a continuation.
+    */
+   lens[0] = 200;
+   fill_record(rec, 1, STREAM_FILE_DATA, lens[0]);
+   assert_true(write_record_to_block(dcr, rec));
+
+   lens[1] = block_write_navail(dcr->block) - WRITE_RECHDR_LENGTH;
+   fill_record(rec, 2, STREAM_FILE_DATA, lens[1]);
+   assert_int_equal(block_write_navail(dcr->block), WRITE_RECHDR_LENGTH + rec->data_len);
+   assert_true(write_record_to_block(dcr, rec));
+   assert_int_equal(rec->state, st_none);
+   assert_int_equal(rec->remainder, 0);
+   assert_int_equal(block_write_navail(dcr->block), 0);
+   flush_block(dcr, vol);
+
+   /*
+    * Same with a single byte of data after a record filling most of
+    * the next block.
+    */
+   lens[2] = BLOCK_NAVAIL - 2 * WRITE_RECHDR_LENGTH - 1;
+   fill_record(rec, 3, STREAM_FILE_DATA, lens[2]);
+   assert_true(write_record_to_block(dcr, rec));
+
+   lens[3] = 1;
+   fill_record(rec, 4, STREAM_FILE_DATA, lens[3]);
+   assert_int_equal(block_write_navail(dcr->block), WRITE_RECHDR_LENGTH + rec->data_len);
+   assert_true(write_record_to_block(dcr, rec));
+   assert_int_equal(rec->state, st_none);
+   assert_int_equal(block_write_navail(dcr->block), 0);
+   flush_block(dcr, vol);
+
+   lens[4] = 10;
+   fill_record(rec, 5, STREAM_FILE_DATA, lens[4]);
+   write_test_record(dcr, vol, rec);
+   flush_block(dcr, vol);
+
+   free_record(rec);
+   assert_int_equal(vol->num_blocks, 3);
+   check_volume(dcr, vol, lens, 5);
+
+   free(vol);
+   free_test_dcr(dcr);
+}
+
+/*
+ * Small records mixed with records spanning one or more blocks.
+ */
+void test_record_span(void **state)
+{
+   uint32_t lens[] = {
+      100, 3000, 0, 50, BLOCK_NAVAIL, 1, 700, 700, 700, 5
+   };
+
+   round_trip(lens, sizeof(lens) / sizeof(lens[0]), 7);
+}
@@ -0,0 +1,44 @@
+/*
+   BAREOS® - Backup Archiving REcovery Open Sourced
+
+   Copyright (C) 2016-2016 Bareos GmbH & Co. KG
+
+   This program is Free Software; you can redistribute it and/or
+   modify it under the terms of version three of the GNU Affero General Public
+   License as published by the Free Software Foundation and included
+   in the file LICENSE.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+   Affero General Public License for more details.
+
+   You should have received a copy of the GNU Affero General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+   02110-1301, USA.
+*/
+/*
+ * Main program to run unittests for the storage daemon with the cmocka framework
+ */
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+
+extern "C" {
+#include <cmocka.h>
+}
+#include "protos.h"
+#include "bareos.h"
+
+
+int main(void) {
+   const struct CMUnitTest tests[] = {
+      cmocka_unit_test(test_record_small),
+      cmocka_unit_test(test_record_fit),
+      cmocka_unit_test(test_record_boundary),
+      cmocka_unit_test(test_record_span),
+   };
+
+   return cmocka_run_group_tests(tests, NULL, NULL);
+}